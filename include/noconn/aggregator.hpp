@@ -0,0 +1,54 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <optional>
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include "noconn/net/fleet_view.hpp"
+
+namespace noconn
+{
+    // "host:port" per line, '#' starts a comment. empty optional (after logging why) if unreadable
+    std::optional<std::vector<boost::asio::ip::tcp::endpoint>> load_agent_list(const std::string& path);
+
+    /*
+     * Aggregator mode: follows the routing tables of many noconn agents over their REST API and merges
+     * them into one fleet_view. Per agent there is one keep-alive connection and one request in flight:
+     *
+     *   1. the full table, paged through GET my_page/inet/route?limit=..&cursor=.., continuing from the
+     *      generation of the first page (pages read later are newer, replaying the deltas since the
+     *      first one over them converges on the agent's table),
+     *   2. then GET my_page/inet/route/deltas?since=<generation>&wait=.., which the agent holds until its
+     *      table changes. 410 Gone (the agent restarted or we fell too far behind) goes back to 1.
+     *
+     * An agent that does not answer is marked disconnected, keeps its last known table and is retried.
+     * Idle agents cost a parked socket and nothing else, so thousands of them fit one process; agents on
+     * the same machine only need their own ports.
+     */
+    class aggregator
+    {
+    public:
+        // the view lists the agents (disconnected) right away
+        explicit aggregator(std::vector<boost::asio::ip::tcp::endpoint> agents);
+
+        // agents are spread round robin over the executors
+        void start(const std::vector<boost::asio::any_io_executor>& executors);
+        // the followers wind down on their executors and are freed with the last handler holding them,
+        // call it while the executors still run
+        void stop();
+
+        const net::fleet_view& view() const;
+    private:
+        class follower;
+    private:
+        net::fleet_view m_view;
+        std::vector<boost::asio::ip::tcp::endpoint> m_agents;
+        std::vector<std::shared_ptr<follower>> m_followers;
+    };
+} // !namespace noconn
@@ -0,0 +1,71 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <optional>
+#include "noconn/util/metrics.hpp"
+
+namespace noconn
+{
+    struct health_component
+    {
+        std::string m_name;
+        bool m_ready = false;
+        // since the process started, once ready
+        std::optional<std::chrono::milliseconds> m_ready_after;
+    };
+
+    /*
+     * What GET health/ready and health/live report. Every inventory provider (routes, adapters) is a
+     * component and turns itself ready once its first scan was published, the process is ready when all
+     * of them are and it is not draining. Live only asks whether the tick loop still beats.
+     *
+     * Components are added before the providers start, everything else may be called from any thread.
+     * noconn_ready{component="<name>"} is 1 once a component is ready.
+     */
+    class health
+    {
+    public:
+        using component_id = std::size_t;
+
+        health();
+
+        component_id add_component(std::string name);
+        // the first call counts, later ones are cheap
+        void set_ready(component_id component);
+        bool is_ready(component_id component) const;
+        // every component ready and not draining
+        bool is_ready() const;
+
+        // a replaced instance stops being ready, so load balancers move on before it closes
+        void set_draining();
+        bool is_draining() const;
+
+        void beat();
+        std::chrono::steady_clock::duration since_beat() const;
+
+        std::vector<health_component> components() const;
+    private:
+        struct component_state
+        {
+            std::string m_name;
+            std::atomic<bool> m_ready = false;
+            std::atomic<int64_t> m_ready_after_ms = -1;
+            util::gauge* m_gauge = nullptr;
+        };
+    private:
+        std::chrono::steady_clock::time_point m_started;
+        // deque, components never move once added
+        std::deque<component_state> m_components;
+        std::atomic<bool> m_draining = false;
+        std::atomic<std::chrono::steady_clock::rep> m_last_beat;
+    };
+} // !namespace noconn
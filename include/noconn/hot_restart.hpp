@@ -0,0 +1,93 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <memory>
+#include <thread>
+#include <vector>
+#include <functional>
+#include "noconn/net/route_manager.hpp"
+#include "noconn/net/adapter_manager.hpp"
+#include "noconn/rest/server.hpp"
+
+namespace noconn
+{
+    // what a running instance hands to the one replacing it
+    struct handoff_state
+    {
+        std::vector<rest::inherited_acceptor> m_acceptors;
+        net::shared_route_snapshot m_routes;
+        // the delta history leading up to m_routes, oldest first
+        std::vector<net::shared_route_delta_set> m_route_deltas;
+        net::shared_adapter_snapshot m_adapters;
+    };
+
+    /*
+     * Zero-downtime upgrades. Every instance runs a handoff_listener on a local named pipe derived from
+     * its port. A new instance started with --hot-restart connects to it and receives:
+     *
+     *   1. duplicates of the listening sockets (WSADuplicateSocket, the windows counterpart of passing
+     *      descriptors with SCM_RIGHTS over a unix socket),
+     *   2. the current route and adapter snapshots, so its caches are warm from the first request, and
+     *      the route delta history, so clients following deltas continue across the restart.
+     *
+     * Both instances accept from the same listen queue until the new one confirms it is accepting. Only
+     * then does the old one close its acceptor and drain, so no connection is ever refused. If the new
+     * instance dies before confirming, the old one simply keeps serving. The old one acknowledges the
+     * confirmation once it let go of what only one instance may hold (the route history), the new one
+     * opens those only after the acknowledgement.
+     *
+     * wire format (little endian): -> u32 process id
+     *                              <- u32 socket count, WSAPROTOCOL_INFOW per socket, u32 size, state json
+     *                              -> u8 confirmation
+     *                              <- u8 acknowledgement
+     */
+    class handoff_listener
+    {
+    public:
+        // called on the listener thread for every takeover attempt
+        using state_provider = std::function<handoff_state()>;
+        // called on the listener thread once the new instance confirmed, before the confirmation is
+        // acknowledged. the listener stops after it
+        using handed_off_handler = std::function<void()>;
+
+        handoff_listener(unsigned short port, state_provider provider, handed_off_handler on_handed_off);
+        ~handoff_listener();
+
+        void start();
+        void stop();
+    private:
+        void run();
+        // one takeover attempt on a connected pipe, true once confirmed
+        bool serve(void* pipe);
+    private:
+        unsigned short m_port;
+        state_provider m_provider;
+        handed_off_handler m_on_handed_off;
+        // manual reset event, set by stop() to abort any wait on the pipe
+        void* m_stop_event;
+        std::thread m_thread;
+    };
+
+    class handoff_client
+    {
+    public:
+        ~handoff_client();
+
+        // connects to the instance serving port and receives its state, nullptr if none answers
+        static std::unique_ptr<handoff_client> take_over(unsigned short port);
+
+        // the acceptors are owned by the caller once received, snapshots are empty if the state was unreadable
+        const handoff_state& state() const;
+        // call once accepting on the inherited sockets, the old instance starts draining when it arrives.
+        // false unless the old instance acknowledged it (and with that let go of the route history)
+        bool confirm();
+    private:
+        explicit handoff_client(void* pipe);
+    private:
+        void* m_pipe;
+        handoff_state m_state;
+    };
+} // !namespace noconn
@@ -5,6 +5,19 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <limits>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <memory_resource>
+#include "noconn/net/wbem_consumer.hpp"
+#include "noconn/util/memory.hpp"
+#include "noconn/util/event_bus.hpp"
+#include "noconn/util/table_differ.hpp"
 
 namespace noconn
 {
@@ -24,11 +37,161 @@ namespace net
         bool m_enabled;
     };
 
+    bool operator==(const network_adapter& lhs, const network_adapter& rhs);
+
+    // an ipv4 unicast address assigned to an adapter
+    struct unicast_address
+    {
+        int m_interface_index = 0;
+        std::string m_address;
+        uint8_t m_prefix_length = 0;
+
+        bool operator==(const unicast_address&) const = default;
+    };
+
+    // views into the address it was taken from
+    struct unicast_address_key
+    {
+        int m_interface_index = 0;
+        std::string_view m_address;
+
+        auto operator<=>(const unicast_address_key&) const = default;
+    };
+
+    struct unicast_address_key_hash
+    {
+        std::size_t operator()(const unicast_address_key& key) const;
+    };
+} // !namespace net
+
+namespace util
+{
+    // adapters match by guid, any other field changes them
+    template <>
+    struct table_traits<net::network_adapter>
+    {
+        static std::string_view key(const net::network_adapter& adapter)
+        {
+            return adapter.m_guid;
+        }
+
+        static bool changed(const net::network_adapter& previous, const net::network_adapter& current)
+        {
+            return !(previous == current);
+        }
+    };
+
+    // addresses match by interface and address, a new prefix length changes them
+    template <>
+    struct table_traits<net::unicast_address>
+    {
+        static net::unicast_address_key key(const net::unicast_address& address)
+        {
+            return { address.m_interface_index, address.m_address };
+        }
+
+        static bool changed(const net::unicast_address& previous, const net::unicast_address& current)
+        {
+            return previous.m_prefix_length != current.m_prefix_length;
+        }
+    };
+} // !namespace util
+
+namespace net
+{
+    using adapter_differ = util::table_differ<std::string_view, network_adapter>;
+    using address_differ = util::table_differ<unicast_address_key, unicast_address, unicast_address_key_hash>;
+
+    // every set member must match
+    struct adapter_query
+    {
+        std::optional<int> m_interface_index;
+        std::optional<bool> m_enabled;
+        std::optional<std::string> m_name;
+        // resume after this adapter index
+        std::optional<int> m_after;
+        std::size_t m_limit = std::numeric_limits<std::size_t>::max();
+    };
+
+    struct adapter_page
+    {
+        // positions into the snapshot's adapters, by adapter index
+        std::vector<uint32_t> m_positions;
+        // set if more adapters match, pass it back as m_after
+        std::optional<int> m_next;
+    };
+
+    // immutable copy of the adapter inventory, shared with readers on other threads
+    struct adapter_snapshot
+    {
+        // bumped every time refresh() sees the inventory change, 0 until the first refresh
+        uint64_t m_generation = 0;
+        std::pmr::vector<network_adapter> m_adapters{ util::memory_resource(util::memory_subsystem::adapters) };
+        // positions sorted by adapter index, built with the snapshot
+        std::pmr::vector<uint32_t> m_by_index{ util::memory_resource(util::memory_subsystem::adapters) };
+        // of every adapter, sorted by interface index and address
+        std::pmr::vector<unicast_address> m_addresses{ util::memory_resource(util::memory_subsystem::adapters) };
+
+        adapter_page select(const adapter_query& query) const;
+    };
+
+    using shared_adapter_snapshot = std::shared_ptr<const adapter_snapshot>;
+
+    // in the order of util::table_change, differ results convert with a cast
+    enum class adapter_change
+    {
+        added,
+        changed,
+        removed
+    };
+
+    struct adapter_delta
+    {
+        adapter_change m_change;
+        // the new adapter, or the last one seen for removed adapters
+        network_adapter m_adapter;
+    };
+
+    struct address_delta
+    {
+        adapter_change m_change;
+        // the new address, or the last one seen for removed addresses
+        unicast_address m_address;
+    };
+
+    // changes that turned generation - 1 into generation, adapters are matched by guid
+    struct adapter_delta_set
+    {
+        uint64_t m_generation = 0;
+        std::chrono::system_clock::time_point m_time;
+        std::vector<adapter_delta> m_deltas;
+        std::vector<address_delta> m_address_deltas;
+    };
+
+    using adapter_event_bus = util::event_bus<adapter_delta_set>;
+
     class adapter_manager
     {
     public:
+        adapter_manager();
+
+        // re-enumerates adapters through WMI (and their addresses), must run on the thread that owns the consumer
+        void refresh(shared_wbem_consumer consumer);
+
+        // continues from a snapshot taken over from a previous process (hot restart)
+        void restore(const adapter_snapshot& snapshot);
+
+        // safe to call from any thread
+        shared_adapter_snapshot snapshot() const;
+        // every inventory change seen by refresh(), subscribe from any thread
+        adapter_event_bus& events();
+    private:
+        void publish(std::vector<network_adapter> adapters, std::vector<unicast_address> addresses, uint64_t generation);
     private:
-    
+        adapter_differ m_differ;
+        mutable std::mutex m_snapshot_mutex;
+        shared_adapter_snapshot m_snapshot;
+        adapter_event_bus m_events;
     };
 } // !namespace net
 } // !namespace noconn
\ No newline at end of file
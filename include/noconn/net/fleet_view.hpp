@@ -0,0 +1,100 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+#include "noconn/net/route_index.hpp"
+#include "noconn/net/route_manager.hpp"
+
+namespace noconn
+{
+namespace net
+{
+    using agent_id = uint32_t;
+
+    struct fleet_agent_status
+    {
+        std::string m_name;
+        bool m_connected = false;
+        // generation of the agent's table the view holds, 0 until the first full read
+        uint64_t m_generation = 0;
+        std::size_t m_routes = 0;
+        std::chrono::system_clock::time_point m_updated;
+    };
+
+    // one agent's route to the queried prefix
+    struct fleet_route_match
+    {
+        std::string m_agent;
+        // of the agent's table the route was read from
+        uint64_t m_generation = 0;
+        int m_interface_index = 0;
+        uint32_t m_gateway = 0;
+        int m_metric = 0;
+    };
+
+    /*
+     * Merged routing tables of many agents, each at its own generation. Routes are kept twice, in
+     * numeric form: per agent by route key (to apply deltas and drop a table on resync) and in a
+     * fleet-wide index by prefix, so "which hosts route 10.0.0.0/8 (via X)" reads one bucket whose size
+     * is the number of hosts with that route. The per-agent entry keeps the route's position in its
+     * bucket, so a delta costs a hash lookup in each however many hosts share the prefix.
+     *
+     * Writers (one per agent) and readers may be on any thread.
+     */
+    class fleet_view
+    {
+    public:
+        // agents are registered up front, ids are dense from 0
+        agent_id add_agent(std::string name);
+
+        // replaces the agent's table, with the generation it was read at
+        void replace(agent_id agent, uint64_t generation, const std::vector<route_entry>& routes);
+        // false (and nothing applied) if the set does not follow the generation the view holds
+        bool apply(agent_id agent, uint64_t generation, const std::vector<route_delta>& deltas);
+        void set_connected(agent_id agent, bool connected);
+
+        // every agent routing exactly this prefix, through gateway if set
+        std::vector<fleet_route_match> find(ipv4_prefix prefix, std::optional<uint32_t> gateway) const;
+        std::vector<fleet_agent_status> agents() const;
+    private:
+        struct fleet_route
+        {
+            agent_id m_agent = 0;
+            int m_interface_index = 0;
+            uint32_t m_gateway = 0;
+            int m_metric = 0;
+        };
+
+        struct route_value
+        {
+            uint32_t m_gateway = 0;
+            int m_metric = 0;
+            // position of the route in its m_by_prefix bucket
+            std::size_t m_slot = 0;
+        };
+
+        struct agent_state
+        {
+            fleet_agent_status m_status;
+            std::unordered_map<route_key, route_value, route_key_hash> m_routes;
+        };
+
+        static uint64_t prefix_key(uint32_t destination, uint8_t prefix_length);
+        void upsert(agent_id agent, const route_entry& entry);
+        void erase(agent_id agent, const route_key& key);
+    private:
+        mutable std::shared_mutex m_mutex;
+        std::vector<agent_state> m_agents;
+        std::unordered_map<uint64_t, std::vector<fleet_route>> m_by_prefix;
+    };
+} // !namespace net
+} // !namespace noconn
@@ -0,0 +1,126 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <filesystem>
+#include <shared_mutex>
+#include "noconn/net/route_manager.hpp"
+#include "noconn/util/mapped_file.hpp"
+
+namespace noconn
+{
+namespace net
+{
+    struct route_history_options
+    {
+        std::filesystem::path m_directory;
+        // the active segment is closed at either limit, the next one starts with a checkpoint
+        std::size_t m_segment_size = 16 * 1024 * 1024;
+        std::chrono::seconds m_segment_duration = std::chrono::hours(6);
+        // segments are deleted once every table state they hold is older than this
+        std::chrono::seconds m_retention = std::chrono::hours(24 * 7);
+    };
+
+    // the table as replayed from the history
+    struct route_history_state
+    {
+        route_snapshot m_snapshot;
+        // when the last replayed record was written, at or before the time asked for
+        std::chrono::system_clock::time_point m_time;
+    };
+
+    /*
+     * Append-only record of the routing table on disk, for "what did the table look like at <time>".
+     *
+     *   segment-<n>.log  records: a checkpoint (the full table) or a delta set, 32 byte header with a
+     *                    crc32 and 20 bytes per route. every segment starts with a checkpoint, so
+     *                    segments are independent and compaction just deletes whole files.
+     *   checkpoints.idx  memory mapped array of (time, generation, segment, offset), one per checkpoint,
+     *                    binary searched to find where replay starts.
+     *
+     * A new checkpoint is written once the deltas since the previous one are larger than it, which keeps
+     * the bytes written at most about twice the deltas on a high-churn host, and the replay for a query
+     * at about twice the size of the table. Each process start opens a new segment, a torn record at the
+     * end of the previous one is cut off.
+     *
+     * Only one process may have the directory open. On a hot restart the old instance close()s its
+     * history before it acknowledges the takeover, and the new one opens it only after that.
+     *
+     * record() and compact() run on the route engine thread, at() and close() on any thread.
+     */
+    class route_history
+    {
+    public:
+        explicit route_history(route_history_options options);
+
+        // creates the directory, repairs what a crash left behind, false if history cannot be written
+        bool open();
+
+        // appends everything published since the last call, with a checkpoint when one is due
+        void record(const route_manager& manager);
+        // the table as it was at time, empty if history does not reach back that far
+        std::optional<route_history_state> at(std::chrono::system_clock::time_point time) const;
+        // deletes the segments that fell out of the retention
+        void compact();
+        // stops recording and lets go of the directory, at() finds nothing afterwards
+        void close();
+    private:
+        struct index_header
+        {
+            uint64_t m_magic;
+            uint64_t m_count;
+        };
+
+        struct index_entry
+        {
+            int64_t m_time;
+            uint64_t m_generation;
+            uint64_t m_segment;
+            uint64_t m_offset;
+        };
+
+        std::filesystem::path segment_path(uint64_t segment) const;
+        // drops entries pointing at missing segments or past their end
+        void validate_index();
+        // reads the segment from offset to the last intact record, indexing checkpoints found past
+        // the last indexed one. returns where the intact records end.
+        uint64_t scan_segment(uint64_t segment, uint64_t offset);
+        bool start_segment(uint64_t segment);
+
+        void write_checkpoint(const route_snapshot& snapshot, std::chrono::system_clock::time_point time);
+        void write_record(uint32_t type, uint64_t generation, std::chrono::system_clock::time_point time, uint32_t count, const std::string& payload);
+        void append_index(const index_entry& entry);
+
+        index_header* header() const;
+        index_entry* entries() const;
+        std::size_t index_capacity() const;
+        uint64_t index_count() const;
+    private:
+        route_history_options m_options;
+
+        // shared by readers, exclusive while the index is remapped or segments are deleted
+        mutable std::shared_mutex m_mutex;
+        // held through record() and close(), the directory is only let go of between two records
+        std::mutex m_write_mutex;
+        util::mapped_file m_index;
+
+        std::ofstream m_segment;
+        uint64_t m_segment_number = 0;
+        uint64_t m_segment_offset = 0;
+        std::chrono::system_clock::time_point m_segment_started;
+
+        uint64_t m_generation = 0;
+        bool m_needs_checkpoint = true;
+        uint64_t m_checkpoint_bytes = 0;
+        uint64_t m_delta_bytes = 0;
+    };
+} // !namespace net
+} // !namespace noconn
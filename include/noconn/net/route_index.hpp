@@ -0,0 +1,120 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <span>
+#include <array>
+#include <string>
+#include <vector>
+#include <limits>
+#include <compare>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <memory_resource>
+#include "noconn/util/memory.hpp"
+
+namespace noconn
+{
+namespace net
+{
+    class route_entry;
+    class route_identifier;
+
+    struct ipv4_prefix
+    {
+        uint32_t m_address = 0;
+        uint8_t m_length = 0;
+    };
+
+    // dotted quad, host byte order
+    std::optional<uint32_t> parse_ipv4(std::string_view text);
+    std::string format_ipv4(uint32_t address);
+    // "10.0.0.0/8", the address is masked to the length
+    std::optional<ipv4_prefix> parse_ipv4_prefix(std::string_view text);
+    uint32_t prefix_mask(uint8_t length);
+
+    // route_identifier in numeric form (unique within a table), its order is the order of query results
+    // and what pagination cursors point at
+    struct route_key
+    {
+        uint32_t m_destination = 0;
+        uint8_t m_prefix_length = 0;
+        int m_interface_index = 0;
+
+        auto operator<=>(const route_key&) const = default;
+    };
+
+    struct route_key_hash
+    {
+        std::size_t operator()(const route_key& key) const;
+    };
+
+    // unparsable addresses map to 0.0.0.0
+    route_key make_route_key(const route_identifier& identifier);
+
+    // opaque to clients, stays meaningful across table generations
+    std::string to_cursor(const route_key& key);
+    std::optional<route_key> parse_cursor(std::string_view cursor);
+
+    // every set member must match
+    struct route_query
+    {
+        std::optional<int> m_interface_index;
+        std::optional<std::string> m_gateway;
+        std::optional<int> m_min_metric;
+        std::optional<int> m_max_metric;
+        // routes lying inside this prefix (more specific or equal)
+        std::optional<ipv4_prefix> m_within;
+        // routes whose prefix covers this address
+        std::optional<uint32_t> m_contains;
+        // resume after this key
+        std::optional<route_key> m_after;
+        std::size_t m_limit = std::numeric_limits<std::size_t>::max();
+    };
+
+    struct route_page
+    {
+        // positions into the snapshot's routes, in key order
+        std::vector<uint32_t> m_positions;
+        // set if more routes match, pass it back as m_after
+        std::optional<route_key> m_next;
+    };
+
+    /*
+     * Secondary indices over one immutable routing table, built once when the snapshot is published.
+     * Each index is a vector of positions sorted by (field, key), so a filter on an indexed field is a
+     * pair of binary searches. select() starts from whichever indexed filter yields the fewest
+     * candidates and checks the rest on those, so a query costs about the size of its most selective
+     * filter, and an unfiltered page about its own size.
+     */
+    class route_index
+    {
+    public:
+        route_index() = default;
+        explicit route_index(std::span<const route_entry> routes);
+
+        // routes must be the ones the index was built from
+        route_page select(std::span<const route_entry> routes, const route_query& query) const;
+        const route_key& key(uint32_t position) const;
+    private:
+        using position_range = std::pair<std::pmr::vector<uint32_t>::const_iterator, std::pmr::vector<uint32_t>::const_iterator>;
+
+        bool matches(std::span<const route_entry> routes, uint32_t position, const route_query& query) const;
+        position_range key_range(const route_key& first, const route_key& last) const;
+        // candidates for m_contains, one lookup per prefix length present in the table
+        std::pmr::vector<uint32_t> covering(uint32_t address) const;
+    private:
+        // accounted to the routes, like the snapshot they index
+        std::pmr::vector<route_key> m_keys{ util::memory_resource(util::memory_subsystem::routes) };
+        std::pmr::vector<uint32_t> m_by_key{ util::memory_resource(util::memory_subsystem::routes) };
+        std::pmr::vector<uint32_t> m_by_interface{ util::memory_resource(util::memory_subsystem::routes) };
+        std::pmr::vector<uint32_t> m_by_gateway{ util::memory_resource(util::memory_subsystem::routes) };
+        std::pmr::vector<uint32_t> m_by_metric{ util::memory_resource(util::memory_subsystem::routes) };
+        // bit n set if some route has prefix length n
+        uint64_t m_prefix_lengths = 0;
+    };
+} // !namespace net
+} // !namespace noconn
@@ -4,8 +4,24 @@
 
 #pragma once
 
+#include <deque>
 #include <string>
 #include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <semaphore>
+#include <memory_resource>
+#include <functional>
+#include "noconn/net/route_index.hpp"
+#include "noconn/util/event_bus.hpp"
+#include "noconn/util/memory.hpp"
+#include "noconn/util/mpsc_queue.hpp"
+#include "noconn/util/table_differ.hpp"
 
 namespace noconn
 {
@@ -31,17 +47,187 @@ namespace net
 		std::string m_gateway;
 		int m_metric;
 	};
+} // !namespace net
+
+namespace util
+{
+	// routes match by identifier, a new gateway or metric changes them
+	template <>
+	struct table_traits<net::route_entry>
+	{
+		static net::route_key key(const net::route_entry& entry)
+		{
+			return net::make_route_key(entry.m_identifier);
+		}
+
+		// tips: run "netsh interface ipv4 set interface 1 metric=10" to change metric for a given adapter
+		static bool changed(const net::route_entry& previous, const net::route_entry& current)
+		{
+			return previous.m_gateway != current.m_gateway || previous.m_metric != current.m_metric;
+		}
+	};
+} // !namespace util
+
+namespace net
+{
+	using route_differ = util::table_differ<route_key, route_entry, route_key_hash>;
+
+	// immutable copy of the routing table, shared with readers on other threads
+	struct route_snapshot
+	{
+		// bumped every time tick() sees the table change, 0 until the first tick
+		uint64_t m_generation = 0;
+		std::pmr::vector<route_entry> m_routes{ util::memory_resource(util::memory_subsystem::routes) };
+		// secondary indices over m_routes, built with the snapshot
+		route_index m_index;
+
+		route_page select(const route_query& query) const;
+	};
 
+	using shared_route_snapshot = std::shared_ptr<const route_snapshot>;
+
+	// in the order of util::table_change, differ results convert with a cast
+	enum class route_change
+	{
+		added,
+		changed,
+		removed
+	};
+
+	struct route_delta
+	{
+		route_change m_change;
+		// the new entry, or the last one seen for removed routes
+		route_entry m_entry;
+		// the entry it replaced, set for changed routes by tick() (not kept by the history, nor handed
+		// over on a hot restart)
+		std::optional<route_entry> m_previous;
+	};
+
+	// changes that turned generation - 1 into generation
+	struct route_delta_set
+	{
+		uint64_t m_generation = 0;
+		std::chrono::system_clock::time_point m_time;
+		// kept in the delta history, accounted to the journal
+		std::pmr::vector<route_delta> m_deltas{ util::memory_resource(util::memory_subsystem::journal) };
+	};
+
+	using shared_route_delta_set = std::shared_ptr<const route_delta_set>;
+	using route_event_bus = util::event_bus<route_delta_set>;
+
+	struct route_delta_history
+	{
+		// generation the sets lead up to
+		uint64_t m_generation = 0;
+		std::vector<shared_route_delta_set> m_sets;
+	};
+
+	enum class route_operation
+	{
+		add,
+		replace,
+		remove
+	};
+
+	struct route_command
+	{
+		route_operation m_operation;
+		// remove only looks at the identifier, replace swaps gateway and metric of the route with it
+		route_entry m_entry;
+	};
+
+	enum class route_batch_status
+	{
+		applied,
+		// refused before reaching the kernel: the route to add exists, or the one to change is missing
+		conflict,
+		// the kernel refused a command (or an address did not parse)
+		failed,
+		// never attempted, the engine is shutting down
+		cancelled
+	};
+
+	struct route_batch_result
+	{
+		route_batch_status m_status = route_batch_status::failed;
+		// the command that failed, the ones before it were rolled back
+		std::size_t m_failed_command = 0;
+		std::string m_error;
+		// generation of the first snapshot with the batch applied (the current one if it failed)
+		uint64_t m_generation = 0;
+	};
+
+	// called on the route engine thread, must hand the result off rather than do work
+	using route_batch_handler = std::function<void(route_batch_result)>;
+
+	/*
+	 * Owns the routing table on the route engine thread, the one calling tick(). Other threads read it
+	 * through snapshot() and change it through submit(): batches go onto a lock-free queue and each tick
+	 * group-commits everything queued since the previous one, so N concurrent requests cost one table
+	 * read, one diff and one published generation instead of N.
+	 */
 	class route_manager
 	{
 	public:
+		route_manager();
+
 		void tick();
 
-		bool add_route(const route_entry& entry);
-		bool remove_route(const route_identifier& entry);
 		std::vector<route_entry> get_routes() const;
+
+		// any thread, never blocks. the commands are applied in order and all or nothing on the next tick,
+		// completion is called once the snapshot containing them is published
+		void submit(std::vector<route_command> commands, route_batch_handler completion);
+		// engine thread: returns after timeout, or earlier once something was submitted
+		void wait_for_commands(std::chrono::milliseconds timeout);
+		// engine thread, before it stops ticking: fails whatever is still queued
+		void cancel_commands();
+
+		// continues from a snapshot taken over from a previous process (hot restart), before the first
+		// tick. the generation carries over, and so does the delta history leading up to it, so readers
+		// following deltas_since() continue where they were. sets that do not lead up to the snapshot
+		// without a gap are dropped (the readers then fetch the full table).
+		void restore(const route_snapshot& snapshot, std::vector<shared_route_delta_set> deltas);
+
+		// generations of deltas kept, readers further behind must fetch the full table. fewer while the
+		// journal is over its memory budget, the latest set always stays.
+		static constexpr std::size_t max_delta_history = 256;
+
+		// safe to call from any thread
+		shared_route_snapshot snapshot() const;
+		// the snapshot and the delta history leading up to it, read together (for a hot restart)
+		std::pair<shared_route_snapshot, std::vector<shared_route_delta_set>> journal() const;
+		// every delta set after generation, in order. empty optional if some were already dropped or
+		// generation is ahead of the table (e.g. the reader saw a previous run)
+		std::optional<route_delta_history> deltas_since(uint64_t generation) const;
+		// every published delta set, as it is published. subscribe from any thread
+		route_event_bus& events();
+	private:
+		struct pending_batch
+		{
+			std::vector<route_command> m_commands;
+			route_batch_handler m_completion;
+		};
+
+		void publish(std::vector<route_entry> routes, std::vector<route_delta> deltas);
+		std::vector<pending_batch> take_commands();
+		// applies to the kernel table, routes is the table as the engine believes it to be after the
+		// batches before this one
+		route_batch_result apply(const std::vector<route_command>& commands, std::vector<route_entry>& routes);
 	private:
 		std::vector<route_entry> m_routes;
+		route_differ m_differ;
+
+		util::mpsc_queue<pending_batch> m_commands;
+		// set by the first submit after the engine looked, so a burst posts the semaphore only once
+		std::atomic<bool> m_commands_signalled = false;
+		std::counting_semaphore<> m_commands_ready{ 0 };
+
+		mutable std::mutex m_snapshot_mutex;
+		shared_route_snapshot m_snapshot;
+		std::deque<shared_route_delta_set> m_deltas;
+		route_event_bus m_events;
 	};
 } // !namespace net
 } // !namespace noconn
\ No newline at end of file
@@ -0,0 +1,108 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <array>
+#include <deque>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <boost/json/value.hpp>
+#include "noconn/net/route_manager.hpp"
+#include "noconn/util/metrics.hpp"
+
+namespace noconn
+{
+namespace net
+{
+    // {"destination", "mask", "interface", "gateway", "metric"}, gateway and metric are not needed to remove
+    std::optional<route_command> parse_route_command(route_operation operation, const boost::json::value& value, std::string& error);
+
+    // every set member must match the delta
+    struct route_condition
+    {
+        // bit (1 << route_change) per change the rule reacts to
+        uint8_t m_changes = 0;
+        // exact destination and prefix length, rules with one are found by hash lookup
+        std::optional<ipv4_prefix> m_destination;
+        std::optional<int> m_interface_index;
+        std::optional<std::string> m_gateway;
+        // changed deltas whose gateway differs from the one they replaced
+        bool m_gateway_changed = false;
+    };
+
+    // the rule fires once more than m_count deltas matched within m_window, then counts from zero
+    struct route_threshold
+    {
+        std::size_t m_count = 0;
+        std::chrono::milliseconds m_window{ 0 };
+    };
+
+    struct route_rule
+    {
+        std::string m_name;
+        route_condition m_condition;
+        std::optional<route_threshold> m_threshold;
+        // logs a warning when fired
+        bool m_alert = false;
+        // submitted as one batch when fired
+        std::vector<route_command> m_commands;
+    };
+
+    /*
+     * {"rules": [{
+     *     "name": "backup-default",
+     *     "when": {"change": ["changed", "removed"], "destination": "0.0.0.0", "mask": "0.0.0.0",
+     *              "interface": 4, "gateway": "10.0.0.1", "gateway_changed": true},
+     *     "threshold": {"count": 50, "window_ms": 1000},
+     *     "then": [{"op": "alert"}, {"op": "add" | "replace" | "remove", <route fields as for the route api>}]
+     * }]}
+     *
+     * everything under "when" but "change" is optional, as is "threshold". empty optional (with error
+     * set) if the document is invalid. commands show up as deltas of a later tick, a rule matching what
+     * it does itself fires again.
+     */
+    std::optional<std::vector<route_rule>> parse_route_rules(const boost::json::value& document, std::string& error);
+
+    /*
+     * Reacts to route changes. Rules are compiled once into a dispatch table keyed by (change,
+     * destination, prefix length) plus a list per change for rules without a destination, so each delta
+     * costs one hash lookup and the conditions of the rules it can match: evaluation scales with churn,
+     * never with the size of the table. Threshold windows only hold the matches still inside them.
+     *
+     * evaluate() from one thread at a time, actions go to the route manager as command batches. Every
+     * firing counts in noconn_route_rule_fired_total{rule="<name>"}.
+     */
+    class route_rule_engine
+    {
+    public:
+        route_rule_engine(std::vector<route_rule> rules, route_manager& manager);
+
+        void evaluate(const route_delta_set& delta_set);
+        std::size_t size() const;
+    private:
+        struct compiled_rule
+        {
+            route_rule m_rule;
+            util::counter* m_fired;
+            std::deque<std::chrono::system_clock::time_point> m_matches;
+        };
+
+        static uint64_t dispatch_key(route_change change, uint32_t destination, uint8_t prefix_length);
+        static bool matches(const route_condition& condition, const route_delta& delta);
+        // true if the rule fires for this match
+        static bool count_match(compiled_rule& rule, std::chrono::system_clock::time_point time);
+        void fire(compiled_rule& rule, const route_delta& delta, uint64_t generation);
+    private:
+        std::vector<compiled_rule> m_rules;
+        std::unordered_map<uint64_t, std::vector<std::size_t>> m_by_destination;
+        std::array<std::vector<std::size_t>, 3> m_by_change;
+        route_manager& m_manager;
+    };
+} // !namespace net
+} // !namespace noconn
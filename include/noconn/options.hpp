@@ -0,0 +1,70 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <chrono>
+#include <optional>
+#include <cstddef>
+#include "noconn/util/memory.hpp"
+#include "noconn/util/thread.hpp"
+
+namespace noconn
+{
+    struct options
+    {
+        std::string m_address = "192.168.0.15";
+        unsigned short m_port = 3031;
+
+        // 0 keeps one io_context shared by the io lane's threads,
+        // otherwise one io_context (and acceptor) per shard
+        std::size_t m_shards = 0;
+
+        // network i/o: the http server (or its shards, one thread each) and the aggregator
+        util::lane_options m_io_lane{ 5 };
+        // the route and adapter providers hold one thread each for good, the others run the route
+        // monitor and the rule engine
+        util::lane_options m_poll_lane{ 3, {}, util::thread_priority::high };
+        // blocking calls out of request handlers (route history replays)
+        util::lane_options m_blocking_lane{ 2, {}, util::thread_priority::low };
+
+        // take the listening sockets and snapshots over from the instance running on m_port
+        bool m_hot_restart = false;
+        // how long a replaced instance waits for its connections to finish before it exits
+        std::chrono::seconds m_drain_timeout = std::chrono::seconds(30);
+
+        // route history is recorded here, empty disables it
+        std::string m_history_directory;
+        std::chrono::hours m_history_retention = std::chrono::hours(24 * 7);
+
+        // json route policy rules (see net::parse_route_rules), empty disables the rule engine
+        std::string m_rules_file;
+
+        // agents to aggregate ("host:port" per line), empty runs no aggregator
+        std::string m_agents_file;
+
+        // bytes per subsystem, see util::memory_account::set_budget
+        std::map<util::memory_subsystem, std::size_t> m_memory_budgets;
+
+        // record trace spans from startup instead of from POST debug/trace/start
+        bool m_trace = false;
+    };
+
+    /*
+     * noconn [--address <ip>] [--port <port>] [--shards <count|auto>] [--pin-threads]
+     *        [--lane <io|poll|blocking>:threads=<count>,cpus=<cpu>[-<cpu>],priority=<low|normal|high>]
+     *        [--hot-restart] [--drain-timeout <seconds>]
+     *        [--history-dir <path>] [--history-retention <hours>] [--rules <path>]
+     *        [--aggregate <agent list>] [--memory-budget <subsystem>=<MiB>]... [--trace]
+     *
+     * every --lane key is optional. --pin-threads pins io thread (or shard) i to cpu i, unless the io
+     * lane lists its own cpus. over their --memory-budget new connections are refused and the delta
+     * history gives up old sets, the other subsystems are only reported.
+     *
+     * returns an empty optional (after logging why) if the command line is invalid.
+     */
+    std::optional<options> parse_options(int argument_count, char** arguments);
+} // !namespace noconn
@@ -0,0 +1,147 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <boost/asio.hpp>
+#include "noconn/rest/router.hpp"
+
+namespace noconn
+{
+namespace rest
+{
+	struct admission_limits
+	{
+		// sustained requests per second and burst size of every client's token bucket
+		double m_client_rate = 50.0;
+		double m_client_burst = 100.0;
+		// admitted requests whose responses have not been written yet, across all connections
+		std::size_t m_max_in_flight = 256;
+		// shed new requests while the smoothed admission-to-write latency stays above this
+		std::chrono::milliseconds m_max_latency = std::chrono::milliseconds(250);
+		// buckets tracked at once, clients beyond this are admitted without a bucket
+		std::size_t m_max_clients = 4096;
+	};
+
+	enum class admission_decision
+	{
+		admitted,
+		// 429, this client is over its rate
+		rate_limited,
+		// 503, the server as a whole is over its in-flight or latency threshold
+		overloaded
+	};
+
+	class admission_controller;
+	using shared_admission_controller = std::shared_ptr<admission_controller>;
+
+	// held for every admitted request until its response is written, releases the in-flight slot when destroyed
+	class admission_ticket
+	{
+	public:
+		admission_ticket() = default;
+		admission_ticket(admission_controller* controller, std::chrono::steady_clock::time_point admitted_at);
+		admission_ticket(admission_ticket&& other) noexcept;
+		admission_ticket& operator=(admission_ticket&& other) noexcept;
+		admission_ticket(const admission_ticket&) = delete;
+		admission_ticket& operator=(const admission_ticket&) = delete;
+		~admission_ticket();
+
+		// response written, feeds the latency estimate. a ticket dropped without complete() only frees its slot.
+		void complete();
+		// frees the slot now without a latency sample, for requests that wait on purpose (long-polls).
+		// complete() does nothing afterwards
+		void exclude();
+	private:
+		void release(bool completed);
+	private:
+		admission_controller* m_controller = nullptr;
+		std::chrono::steady_clock::time_point m_admitted_at;
+	};
+
+	/*
+	 * Load shedding in front of the router. Each client address gets a token bucket, and the server
+	 * keeps one global count of admitted requests still waiting for their response to be written plus a
+	 * smoothed latency over them. Requests from a client out of tokens get a 429, requests arriving
+	 * while the server is past either threshold get a 503; both are answered from prebuilt responses
+	 * without touching the router, so a flood costs little more than parsing the request line.
+	 *
+	 * Buckets are spread over a few independently locked shards, one controller may be shared by all
+	 * servers of a shard_group.
+	 */
+	class admission_controller
+	{
+	public:
+		static shared_admission_controller create(admission_limits limits = {});
+
+		// at accept time, nothing is consumed: refuses the connection if the server is overloaded or the client has no tokens left
+		admission_decision check_connection(const boost::asio::ip::address& client);
+		// per request, consumes a token. ticket is only set for admitted requests.
+		admission_decision admit(const boost::asio::ip::address& client, admission_ticket& ticket);
+
+		bool is_overloaded() const;
+		std::size_t in_flight() const;
+		std::chrono::microseconds smoothed_latency() const;
+		const admission_limits& limits() const;
+
+		// prebuilt rejections, only version and keep-alive are adjusted per request
+		http_response make_rejection(const http_request& request, admission_decision decision) const;
+		// raw http/1.1 response written straight to a socket refused at accept
+		const std::string& connection_rejection(admission_decision decision) const;
+	protected:
+		explicit admission_controller(admission_limits limits);
+	private:
+		friend class admission_ticket;
+
+		static constexpr std::size_t bucket_shards = 16;
+		// latency samples older than this no longer keep the server in shedding mode
+		static constexpr std::chrono::seconds latency_window = std::chrono::seconds(1);
+
+		struct bucket
+		{
+			double m_tokens;
+			std::chrono::steady_clock::time_point m_updated;
+		};
+
+		// v4 addresses are stored v4-mapped, so both families share one key type
+		using address_key = boost::asio::ip::address_v6::bytes_type;
+
+		struct address_key_hash
+		{
+			std::size_t operator()(const address_key& key) const;
+		};
+
+		struct bucket_shard
+		{
+			std::mutex m_mutex;
+			std::unordered_map<address_key, bucket, address_key_hash> m_buckets;
+		};
+
+		static address_key to_key(const boost::asio::ip::address& client);
+
+		bool take_token(const boost::asio::ip::address& client, bool consume);
+		void refill(bucket& target, std::chrono::steady_clock::time_point now) const;
+		// drops buckets that have refilled completely, they hold nothing a new bucket would not
+		void evict_idle(bucket_shard& shard, std::chrono::steady_clock::time_point now) const;
+		void release(std::chrono::steady_clock::time_point admitted_at, bool completed);
+	private:
+		admission_limits m_limits;
+		std::array<bucket_shard, bucket_shards> m_shards;
+		std::atomic<std::size_t> m_in_flight = 0;
+		std::atomic<int64_t> m_latency_us = 0;
+		std::atomic<int64_t> m_last_sample = 0;
+		std::shared_ptr<const std::string> m_rate_limited_body;
+		std::shared_ptr<const std::string> m_overloaded_body;
+		std::string m_rate_limited_raw;
+		std::string m_overloaded_raw;
+	};
+} // !namespace rest
+} // !namespace noconn
@@ -0,0 +1,55 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <string_view>
+
+namespace noconn
+{
+namespace rest
+{
+	/*
+	 * Minimal CBOR (RFC 8949) encoder appending straight to a response body. There is no document
+	 * tree: callers write heads and values in order, so encoding a table is one pass over it with no
+	 * intermediate allocations besides the output growing.
+	 *
+	 * Containers are either definite (the count is written up front) or indefinite, closed with end().
+	 */
+	class cbor_writer
+	{
+	public:
+		explicit cbor_writer(std::string& output);
+
+		void write_uint(uint64_t value) { write_head(major_unsigned, value); }
+		void write_int(int64_t value);
+		void write_bool(bool value) { m_output.push_back(value ? '\xf5' : '\xf4'); }
+		void write_null() { m_output.push_back('\xf6'); }
+		void write_text(std::string_view value);
+		void write_bytes(const void* data, std::size_t size);
+		// 4 bytes, network order
+		void write_ipv4(uint32_t address);
+
+		void begin_array(std::size_t size) { write_head(major_array, size); }
+		void begin_map(std::size_t pairs) { write_head(major_map, pairs); }
+		void begin_array() { m_output.push_back('\x9f'); }
+		void begin_map() { m_output.push_back('\xbf'); }
+		// closes the innermost indefinite container
+		void end() { m_output.push_back('\xff'); }
+	private:
+		static constexpr uint8_t major_unsigned = 0;
+		static constexpr uint8_t major_negative = 1;
+		static constexpr uint8_t major_bytes = 2;
+		static constexpr uint8_t major_text = 3;
+		static constexpr uint8_t major_array = 4;
+		static constexpr uint8_t major_map = 5;
+
+		void write_head(uint8_t major, uint64_t value);
+	private:
+		std::string& m_output;
+	};
+} // !namespace rest
+} // !namespace noconn
@@ -1,26 +1,119 @@
-/* 
+/*
  *
  */
 
 #pragma once
 
-#include "noconn/rest/connection.hpp"
+#include <deque>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <optional>
+#include <functional>
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
 
 namespace noconn
 {
 namespace rest
 {
-	class client
+	class client;
+	using shared_client = std::shared_ptr<client>;
+
+	struct client_options
+	{
+		// requests written ahead of their responses on one connection, 1 disables pipelining
+		std::size_t m_pipeline_depth = 1;
+		std::chrono::seconds m_timeout = std::chrono::seconds(30);
+	};
+
+	/*
+	 * One keep-alive connection to a server. Requests are queued and written back to back on the
+	 * connection's strand, up to m_pipeline_depth of them waiting for a response at once; responses
+	 * come back in order and complete the requests' handlers on that strand.
+	 *
+	 * The connection is opened on the first send() and reopened on the next one after the server
+	 * closes it. A failed connection fails every queued and in-flight request with the error.
+	 */
+	class client : public std::enable_shared_from_this<client>
 	{
 	public:
-		void send_response();
+		using request_type = boost::beast::http::request<boost::beast::http::string_body>;
+		using response_type = boost::beast::http::response<boost::beast::http::string_body>;
+		using completion_handler = std::function<void(boost::beast::error_code error_code, response_type&& response)>;
+
+		static shared_client create(boost::asio::any_io_executor executor, boost::asio::ip::tcp::endpoint endpoint, client_options options = {});
+
+		// safe to call from any thread
+		void send(request_type&& request, completion_handler handler);
+		void close();
+
+		// queued and written requests still waiting for their response
+		std::size_t in_flight() const;
+	protected:
+		client(boost::asio::any_io_executor executor, boost::asio::ip::tcp::endpoint endpoint, client_options options);
+
+		void connect();
+		void on_connect(boost::beast::error_code error_code);
+		void write();
+		void on_write(boost::beast::error_code error_code, std::size_t bytes_transferred);
+		void read();
+		void on_read(boost::beast::error_code error_code, std::size_t bytes_transferred);
+		// drops the connection and completes the written requests with error_code, the queued ones too if
+		// include_queued (otherwise they go out on the next connection)
+		void fail(boost::beast::error_code error_code, bool include_queued);
+		// reopens the connection for queued requests once the old one has no operation pending
+		void reconnect_if_needed();
 	private:
-		void handle_request(const std::string& path, const std::string& method, const std::string& payload)
+		enum class connection_state
 		{
-			
-		}
+			disconnected,
+			connecting,
+			connected
+		};
+
+		struct pending_request
+		{
+			request_type m_request;
+			completion_handler m_handler;
+		};
+	private:
+		boost::asio::strand<boost::asio::any_io_executor> m_strand;
+		boost::asio::ip::tcp::endpoint m_endpoint;
+		client_options m_options;
+		std::optional<boost::beast::tcp_stream> m_stream;
+		connection_state m_state = connection_state::disconnected;
+		// not yet written
+		std::deque<pending_request> m_queued;
+		// written (or being written), waiting for their response in order
+		std::deque<completion_handler> m_awaiting;
+		// the request being written has to outlive async_write
+		std::optional<request_type> m_write_request;
+		// operations pending on m_stream
+		bool m_connecting = false;
+		bool m_writing = false;
+		bool m_reading = false;
+		boost::beast::flat_buffer m_buffer;
+		std::optional<boost::beast::http::response_parser<boost::beast::http::string_body>> m_parser;
+		std::atomic<std::size_t> m_in_flight = 0;
+	};
+
+	// fixed set of client connections to one endpoint, each request goes to the least busy one
+	class client_pool
+	{
+	public:
+		client_pool(boost::asio::any_io_executor executor, boost::asio::ip::tcp::endpoint endpoint, std::size_t size, client_options options = {});
+
+		void send(client::request_type&& request, client::completion_handler handler);
+		void close();
+
+		std::size_t size() const;
+		std::size_t in_flight() const;
 	private:
-		shared_connection m_request_handler;
+		std::vector<shared_client> m_clients;
+		std::atomic<std::size_t> m_next = 0;
 	};
 } // !namespace rest
-} // !namespace noconn
\ No newline at end of file
+} // !namespace noconn
@@ -0,0 +1,93 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <memory>
+#include <future>
+#include <string>
+#include <optional>
+#include <string_view>
+#include <functional>
+#include <cstdint>
+
+namespace noconn
+{
+namespace rest
+{
+	enum class content_encoding
+	{
+		identity,
+		deflate,
+		gzip,
+		zstd,
+		count
+	};
+
+	// value for the Content-Encoding header, empty for identity
+	std::string_view to_string(content_encoding encoding);
+
+	// best encoding we support from an Accept-Encoding header (honours q-values, q=0 excludes)
+	content_encoding negotiate_encoding(std::string_view accept_encoding);
+
+	// representations offered for negotiated resources
+	enum class media_type
+	{
+		json,
+		cbor,
+		count
+	};
+
+	// value for the Content-Type header
+	std::string_view to_string(media_type type);
+
+	// best representation from an Accept header, json unless the client weighs cbor higher. empty
+	// optional if the header rules out both (q=0, or neither named nor covered by a wildcard), answer 406
+	std::optional<media_type> negotiate_media_type(std::string_view accept);
+
+	// identity returns the input unchanged
+	std::string compress(std::string_view input, content_encoding encoding);
+
+	/*
+	 * One resource (e.g. the full route table) rendered and compressed once per snapshot generation.
+	 * Every representation is an immutable shared buffer, so all connections asking for the same
+	 * generation and encoding write the same bytes. Rendering and compression run outside the lock:
+	 * readers of a representation that is being produced wait for that one alone, readers of any other
+	 * (cached) representation are not held up.
+	 */
+	class cached_representation
+	{
+	public:
+		using shared_bytes = std::shared_ptr<const std::string>;
+		using render_function = std::function<std::string()>;
+
+		// bodies smaller than this are not worth compressing and are always sent as identity
+		static constexpr std::size_t min_compress_size = 512;
+
+		struct result
+		{
+			shared_bytes m_body;
+			content_encoding m_encoding;
+		};
+
+		result get(uint64_t generation, content_encoding encoding, const render_function& render);
+	private:
+		// the cached representation, made once per generation by the first reader asking for it.
+		// generations older than the cached one are made for the caller and not cached
+		shared_bytes produce(uint64_t generation, content_encoding encoding, const render_function& make);
+	private:
+		std::mutex m_mutex;
+		uint64_t m_generation = 0;
+		bool m_valid = false;
+		std::array<shared_bytes, static_cast<std::size_t>(content_encoding::count)> m_representations;
+		// representations of m_generation being produced right now
+		std::array<std::shared_future<shared_bytes>, static_cast<std::size_t>(content_encoding::count)> m_pending;
+	};
+
+	// one-off body (e.g. a filtered query result), compressed unless below min_compress_size
+	cached_representation::result encode_body(std::string&& body, content_encoding encoding);
+} // !namespace rest
+} // !namespace noconn
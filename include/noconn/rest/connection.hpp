@@ -5,10 +5,20 @@
 #pragma once
 
 #include <memory>
+#include <deque>
+#include <chrono>
+#include <optional>
 #include <boost/asio.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/bind_allocator.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
+#include "noconn/rest/router.hpp"
+#include "noconn/rest/admission.hpp"
+#include "noconn/rest/handler_memory.hpp"
 
 namespace noconn
 {
@@ -20,27 +30,110 @@ namespace rest
 	class server;
 	using shared_server = std::shared_ptr<server>;
 
+	// slot in the server's connection_registry
+	struct connection_handle
+	{
+		static constexpr uint32_t invalid_index = static_cast<uint32_t>(-1);
+
+		uint32_t m_index = invalid_index;
+		uint32_t m_generation = 0;
+
+		bool valid() const { return m_index != invalid_index; }
+	};
+
+	/*
+	 * One HTTP/1.1 connection, run by two coroutines on the connection's strand: read_loop parses requests
+	 * and queues their responses, write_loop writes them in order. A pipelining client can have up to
+	 * max_pipelined_responses answered ahead of the one being written, then the reader waits for the
+	 * writer. The loops wake each other through a pair of timers used as signals.
+	 *
+	 * Every operation takes its handler memory from m_handler_memory and the coroutine frames come from
+	 * asio's per-thread recycling allocator, so a request does not allocate for its async plumbing.
+	 */
 	class connection : public std::enable_shared_from_this <connection>
 	{
 	public:
+		// responses waiting to be written before we stop reading ahead on a pipelined connection
+		static constexpr std::size_t max_pipelined_responses = 16;
+		// a request (or the wait for the next one on a keep-alive connection) must arrive within this
+		static constexpr std::chrono::seconds read_timeout = std::chrono::seconds(30);
+
+
 		static shared_connection create(boost::asio::ip::tcp::socket&& socket, shared_server server);
 		~connection();
 
+		// a connection (with its handler memory and json arena) is accounted to util::memory_subsystem::connections
+		static void* operator new(std::size_t size);
+		static void operator delete(void* pointer, std::size_t size);
+
 		void open();
 		void close();
 
 		uint32_t id() const;
-		
-		void read();
-		void on_read(boost::beast::error_code error_code, std::size_t bytes_transferred);
-		void on_write(bool close_connection, boost::beast::error_code error_code, std::size_t bytes_transferred);
+		connection_handle handle() const;
+		void set_handle(connection_handle handle);
+
+		// called from the server's reaper, the check itself runs on the connection's strand
+		void close_if_idle(std::chrono::steady_clock::duration idle_timeout);
+		// graceful shutdown: close now if idle, otherwise after the request in progress is answered
+		void drain();
 	protected:
 		connection(boost::asio::ip::tcp::socket&& socket, uint32_t m_session_id, shared_server server);
+
+		// self keeps the connection alive for as long as the loop runs
+		boost::asio::awaitable<void> read_loop(shared_connection self);
+		boost::asio::awaitable<void> write_loop(shared_connection self);
+		// queues the response for one read, false once nothing more will be read. suspends while an async
+		// handler works, later pipelined requests wait in m_buffer until it answers.
+		boost::asio::awaitable<bool> on_read(boost::beast::error_code error_code, std::size_t bytes_transferred);
+		// suspends until signal() is called on the timer (or the connection closes)
+		boost::asio::awaitable<void> wait(boost::asio::steady_timer& signal);
+
+		// completion token for the loops: errors are returned in error_code instead of thrown, and the
+		// operation's state lives in m_handler_memory
+		auto use_handler_memory(boost::beast::error_code& error_code)
+		{
+			return boost::asio::bind_allocator(handler_allocator<void>(m_handler_memory), boost::asio::redirect_error(boost::asio::use_awaitable, error_code));
+		}
+
+		boost::asio::awaitable<http_response> handle_request(admission_ticket& ticket);
+		// between requests, with nothing owed to the client
+		bool is_idle() const;
+		void enqueue(http_response&& response, admission_ticket&& ticket, std::chrono::steady_clock::time_point received);
+	protected:
+		struct queued_response
+		{
+			http_response m_response;
+			// empty for rejected requests, released once the response is written
+			admission_ticket m_ticket;
+			// when the request was read
+			std::chrono::steady_clock::time_point m_received;
+		};
 	protected:
 		uint32_t m_id;
+		connection_handle m_handle;
 		boost::beast::tcp_stream m_stream;
-		boost::beast::http::request<boost::beast::http::string_body> m_request;
-		boost::beast::http::response<boost::beast::http::string_body> m_response;
+		boost::asio::ip::address m_remote_address;
+		// declared before m_responses, the tickets in there point into it
+		shared_admission_controller m_admission;
+		// recreated for every request, the body is parsed into m_json_arena as it arrives
+		std::optional<boost::beast::http::request_parser<json_body>> m_parser;
+		json_arena m_json_arena;
+		// responses in request order, front() is the one being written. deque keeps references
+		// stable for the in-flight async_write while new responses are pushed at the back.
+		std::deque<queued_response> m_responses;
+		// the reader waits on this while the pipeline is full, the writer while there is nothing to write
+		boost::asio::steady_timer m_read_signal;
+		boost::asio::steady_timer m_write_signal;
+		handler_memory m_handler_memory;
+		bool m_reading = false;
+		bool m_writing = false;
+		// a request is with its handler, possibly waiting on another thread
+		bool m_handling = false;
+		bool m_read_closed = false;
+		bool m_closed = false;
+		bool m_draining = false;
+		std::chrono::steady_clock::time_point m_last_activity;
         boost::beast::flat_buffer m_buffer;
 		shared_server m_server;
 	};
@@ -0,0 +1,56 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include <optional>
+#include <functional>
+#include "noconn/rest/connection.hpp"
+
+namespace noconn
+{
+namespace rest
+{
+	/*
+	 * Fixed capacity slot map of open connections. Slots are allocated once up front and recycled
+	 * through a free list, so insert and remove are O(1) and memory does not grow with the number of
+	 * clients seen over the lifetime of the process. Every slot carries a generation that is bumped on
+	 * removal, which makes a stale handle (a connection closing twice) harmless.
+	 */
+	class connection_registry
+	{
+	public:
+		using handle = connection_handle;
+		static constexpr uint32_t invalid_index = connection_handle::invalid_index;
+
+		explicit connection_registry(std::size_t capacity);
+
+		// empty if the registry is full
+		std::optional<handle> insert(shared_connection connection);
+		// false if the handle was already removed
+		bool remove(handle target_handle);
+
+		std::size_t size() const;
+		std::size_t capacity() const;
+
+		// callback runs under the registry lock, keep it short (post work elsewhere)
+		void for_each(const std::function<void(const shared_connection&)>& callback) const;
+		void clear();
+	private:
+		struct slot
+		{
+			shared_connection m_connection;
+			uint32_t m_generation = 0;
+			uint32_t m_next_free = invalid_index;
+		};
+
+		mutable std::mutex m_mutex;
+		std::vector<slot> m_slots;
+		uint32_t m_free_head;
+		std::size_t m_size = 0;
+	};
+} // !namespace rest
+} // !namespace noconn
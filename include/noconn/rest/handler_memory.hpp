@@ -0,0 +1,86 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace noconn
+{
+namespace rest
+{
+	/*
+	 * Per-connection memory for completion handler state. A connection only ever has a few operations in
+	 * flight (a read, a write, the stream's timeout timer, a signal wait), so a handful of fixed slots cover
+	 * them and every request reuses the same memory instead of going to the heap. Slots are claimed with a
+	 * compare-exchange because an operation's memory is released on whichever thread completed it.
+	 * Requests that do not fit fall back to the heap and are counted.
+	 */
+	class handler_memory
+	{
+	public:
+		static constexpr std::size_t slot_count = 6;
+		static constexpr std::size_t slot_size = 1024;
+
+		handler_memory() = default;
+		handler_memory(const handler_memory&) = delete;
+		handler_memory& operator=(const handler_memory&) = delete;
+
+		void* allocate(std::size_t size);
+		void deallocate(void* pointer);
+	private:
+		struct alignas(std::max_align_t) slot
+		{
+			unsigned char m_storage[slot_size];
+		};
+
+		std::array<slot, slot_count> m_slots;
+		std::array<std::atomic<bool>, slot_count> m_in_use{};
+	};
+
+	// associated allocator for handlers, the memory must outlive every operation using it
+	template <typename T>
+	class handler_allocator
+	{
+	public:
+		using value_type = T;
+
+		explicit handler_allocator(handler_memory& memory) noexcept
+			: m_memory(&memory)
+		{
+			// nothing for now
+		}
+
+		template <typename U>
+		handler_allocator(const handler_allocator<U>& other) noexcept
+			: m_memory(other.m_memory)
+		{
+			// nothing for now
+		}
+
+		T* allocate(std::size_t count)
+		{
+			return static_cast<T*>(m_memory->allocate(sizeof(T) * count));
+		}
+
+		void deallocate(T* pointer, std::size_t)
+		{
+			m_memory->deallocate(pointer);
+		}
+
+		template <typename U>
+		bool operator==(const handler_allocator<U>& other) const noexcept
+		{
+			return m_memory == other.m_memory;
+		}
+	private:
+		template <typename>
+		friend class handler_allocator;
+
+		handler_memory* m_memory;
+	};
+} // !namespace rest
+} // !namespace noconn
@@ -0,0 +1,163 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include <string>
+#include <optional>
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/json.hpp>
+
+namespace noconn
+{
+namespace rest
+{
+	struct json_limits
+	{
+		std::size_t m_max_body_size = 1024 * 1024;
+		std::size_t m_max_depth = 32;
+	};
+
+	/*
+	 * Per-connection memory for parsing request bodies. Parsed values live in a monotonic arena that
+	 * starts in a preallocated block, and the parser keeps its temporary stack in a fixed buffer, so a
+	 * typical request body is parsed without touching the heap (larger ones grow the arena through the
+	 * json memory account). reset() hands the arena back for the next request; every value parsed from
+	 * it must be gone by then.
+	 */
+	class json_arena
+	{
+	public:
+		static constexpr std::size_t initial_block_size = 16 * 1024;
+		static constexpr std::size_t parser_buffer_size = 4 * 1024;
+
+		explicit json_arena(json_limits limits = {});
+		json_arena(const json_arena&) = delete;
+		json_arena& operator=(const json_arena&) = delete;
+
+		boost::json::stream_parser& parser();
+		const json_limits& limits() const;
+
+		// starts a new value in the arena
+		void begin();
+		void reset();
+	private:
+		json_limits m_limits;
+		std::unique_ptr<unsigned char[]> m_initial_block;
+		boost::json::monotonic_resource m_resource;
+		std::array<unsigned char, parser_buffer_size> m_parser_buffer;
+		boost::json::stream_parser m_parser;
+	};
+
+	/*
+	 * Beast body that feeds bytes to the arena's stream_parser as they arrive instead of buffering the
+	 * whole body into a string first. A malformed body does not fail the read: the error is recorded in
+	 * the value and the request is still routed, so handlers can answer 400 on a healthy connection.
+	 */
+	struct json_body
+	{
+		struct value_type
+		{
+			// null for an empty body
+			boost::json::value m_value;
+			std::size_t m_size = 0;
+			boost::beast::error_code m_error;
+			// must be set before the body is read
+			json_arena* m_arena = nullptr;
+
+			bool empty() const { return m_size == 0; }
+			bool valid() const { return !m_error; }
+		};
+
+		class reader
+		{
+		public:
+			template <bool is_request, typename Fields>
+			reader(boost::beast::http::header<is_request, Fields>&, value_type& body)
+				: m_body(body)
+			{
+			}
+
+			void init(const boost::optional<std::uint64_t>& content_length, boost::beast::error_code& error_code)
+			{
+				error_code = {};
+				m_body.m_size = 0;
+				m_body.m_error = {};
+				m_body.m_value = nullptr;
+
+				if (m_body.m_arena == nullptr)
+				{
+					error_code = boost::beast::http::error::bad_transfer_encoding;
+					return;
+				}
+
+				if (content_length && *content_length > m_body.m_arena->limits().m_max_body_size)
+				{
+					error_code = boost::beast::http::error::body_limit;
+					return;
+				}
+
+				m_body.m_arena->begin();
+			}
+
+			template <typename ConstBufferSequence>
+			std::size_t put(const ConstBufferSequence& buffers, boost::beast::error_code& error_code)
+			{
+				error_code = {};
+				std::size_t bytes = boost::asio::buffer_size(buffers);
+				m_body.m_size += bytes;
+
+				if (m_body.m_size > m_body.m_arena->limits().m_max_body_size)
+				{
+					error_code = boost::beast::http::error::body_limit;
+					return 0;
+				}
+
+				if (m_body.m_error)
+				{
+					// already failed, drain the rest of the body
+					return bytes;
+				}
+
+				for (auto itr = boost::asio::buffer_sequence_begin(buffers); itr != boost::asio::buffer_sequence_end(buffers); ++itr)
+				{
+					boost::asio::const_buffer buffer = *itr;
+					m_body.m_arena->parser().write(static_cast<const char*>(buffer.data()), buffer.size(), m_body.m_error);
+					if (m_body.m_error)
+					{
+						break;
+					}
+				}
+
+				return bytes;
+			}
+
+			void finish(boost::beast::error_code& error_code)
+			{
+				error_code = {};
+				if (m_body.m_size == 0 || m_body.m_error)
+				{
+					return;
+				}
+
+				boost::json::stream_parser& parser = m_body.m_arena->parser();
+				parser.finish(m_body.m_error);
+				if (!m_body.m_error)
+				{
+					// move construct instead of assigning, assignment between different storages would deep copy
+					// the arena-backed tree onto the heap
+					std::destroy_at(&m_body.m_value);
+					std::construct_at(&m_body.m_value, parser.release());
+				}
+			}
+		private:
+			value_type& m_body;
+		};
+	};
+} // !namespace rest
+} // !namespace noconn
@@ -0,0 +1,32 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <optional>
+#include <string_view>
+
+namespace noconn
+{
+namespace rest
+{
+	// decoded "name=value&..." pairs of a request target's query string
+	class query_parameters
+	{
+	public:
+		// percent escapes and '+' are decoded, malformed escapes are kept as they are
+		explicit query_parameters(std::string_view query);
+
+		// first value for name, empty if absent
+		std::optional<std::string_view> get(std::string_view name) const;
+		bool empty() const;
+		const std::vector<std::pair<std::string, std::string>>& items() const;
+	private:
+		std::vector<std::pair<std::string, std::string>> m_parameters;
+	};
+} // !namespace rest
+} // !namespace noconn
@@ -0,0 +1,117 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <variant>
+#include <functional>
+#include <initializer_list>
+#include <boost/asio/awaitable.hpp>
+#include <boost/beast/http.hpp>
+#include "noconn/rest/json_body.hpp"
+#include "noconn/rest/shared_body.hpp"
+#include "noconn/rest/compression.hpp"
+
+namespace noconn
+{
+namespace rest
+{
+	class admission_ticket;
+
+	// request bodies are parsed into json while they are read, see json_body
+	using http_request = boost::beast::http::request<json_body>;
+	using http_response = boost::beast::http::response<shared_body>;
+
+	// path parameters captured while matching, views into the request target
+	class route_parameters
+	{
+	public:
+		static constexpr std::size_t max_parameters = 8;
+
+		// empty view if the route has no parameter with that name
+		std::string_view get(std::string_view name) const;
+		std::size_t size() const;
+
+		bool push(std::string_view name, std::string_view value);
+		void clear();
+	private:
+		std::array<std::pair<std::string_view, std::string_view>, max_parameters> m_parameters;
+		std::size_t m_size = 0;
+	};
+
+	struct request_context
+	{
+		const http_request& m_request;
+		// target without leading '/' and without the query string
+		std::string_view m_path;
+		// everything after '?', without the '?'
+		std::string_view m_query;
+		route_parameters m_parameters;
+		// the request's admission ticket, null if it was not admitted through one
+		admission_ticket* m_ticket = nullptr;
+	};
+
+	using route_handler = std::function<http_response(const request_context&)>;
+	// for handlers that wait on another thread (e.g. the route engine). the connection suspends until the
+	// response is ready, the request and context stay valid until then.
+	using async_route_handler = std::function<boost::asio::awaitable<http_response>(const request_context&)>;
+
+	extern http_response make_response(const http_request& request, boost::beast::http::status status, std::string&& body, std::string_view content_type);
+	// cached (possibly compressed) representation, sets Content-Encoding and Vary
+	extern http_response make_response(const http_request& request, boost::beast::http::status status, const cached_representation::result& body, std::string_view content_type);
+	extern http_response make_error_response(const http_request& request, boost::beast::http::status status, std::string_view message);
+
+	/*
+	 * Routes are compiled into a trie over path segments when they are registered, so matching a request
+	 * walks one node per segment and never copies or lowercases the target. Literal segments match case
+	 * insensitively, a "{name}" segment matches any single segment and is captured into route_parameters.
+	 *
+	 * All routes must be registered before the server starts accepting connections, dispatch() is const
+	 * and safe to call from every worker thread. Plain handlers complete without suspending, so routes
+	 * that answer from snapshots cost no more than a function call.
+	 */
+	class router
+	{
+	public:
+		router();
+
+		void add(std::string_view path, boost::beast::http::verb method, route_handler handler);
+		void add(std::string_view path, std::initializer_list<boost::beast::http::verb> methods, route_handler handler);
+		void add_async(std::string_view path, boost::beast::http::verb method, async_route_handler handler);
+		void add_async(std::string_view path, std::initializer_list<boost::beast::http::verb> methods, async_route_handler handler);
+
+		// 404 for unknown paths, 405 (with an Allow header) for known paths and unsupported methods.
+		// HEAD falls back to the GET handler with the body stripped. must be awaited on the connection's
+		// executor, async handlers resume there.
+		boost::asio::awaitable<http_response> dispatch(const http_request& request, admission_ticket* ticket = nullptr) const;
+	private:
+		static constexpr uint32_t no_node = static_cast<uint32_t>(-1);
+
+		using any_route_handler = std::variant<route_handler, async_route_handler>;
+
+		struct node
+		{
+			// literal children are kept sorted by segment length so most candidates are rejected on size alone
+			std::vector<uint32_t> m_children;
+			uint32_t m_parameter_child = no_node;
+			// lower case literal, or the parameter name for parameter nodes
+			std::string m_segment;
+			std::vector<std::pair<boost::beast::http::verb, any_route_handler>> m_handlers;
+		};
+
+		void add_handler(std::string_view path, boost::beast::http::verb method, any_route_handler handler);
+		uint32_t insert(std::string_view path);
+		uint32_t find(std::string_view path, route_parameters& parameters) const;
+		const any_route_handler* find_handler(const node& target, boost::beast::http::verb method) const;
+		std::string allowed_methods(const node& target) const;
+	private:
+		std::vector<node> m_nodes;
+	};
+} // !namespace rest
+} // !namespace noconn
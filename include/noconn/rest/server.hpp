@@ -6,11 +6,15 @@
 
 #include <memory>
 #include <vector>
+#include <optional>
 #include <boost/asio.hpp>
 #include <boost/asio/strand.hpp>
 #include <boost/beast/core.hpp>
 #include "noconn/rest/helper.hpp"
 #include "noconn/rest/connection.hpp"
+#include "noconn/rest/connection_registry.hpp"
+#include "noconn/rest/admission.hpp"
+#include "noconn/rest/router.hpp"
 
 
 namespace noconn
@@ -20,30 +24,125 @@ namespace rest
 	class server;
 	using shared_server = std::shared_ptr<server>;
 
+#if defined(SO_REUSEPORT)
+	// SO_REUSEPORT as a SettableSocketOption, asio has no public option for it
+	class reuse_port_option
+	{
+	public:
+		explicit reuse_port_option(bool enabled)
+			: m_value(enabled ? 1 : 0)
+		{
+			// nothing for now
+		}
+
+		template <typename Protocol>
+		int level(const Protocol&) const { return SOL_SOCKET; }
+
+		template <typename Protocol>
+		int name(const Protocol&) const { return SO_REUSEPORT; }
+
+		template <typename Protocol>
+		const void* data(const Protocol&) const { return &m_value; }
+
+		template <typename Protocol>
+		std::size_t size(const Protocol&) const { return sizeof(m_value); }
+	private:
+		int m_value;
+	};
+#endif
+
+	// a bound, listening socket taken over from another process (see hot_restart.hpp)
+	struct inherited_acceptor
+	{
+		boost::asio::ip::tcp m_protocol;
+		boost::asio::ip::tcp::acceptor::native_handle_type m_handle;
+	};
+
+	struct server_limits
+	{
+		// connections beyond this are closed right after accept
+		std::size_t m_max_connections = 1024;
+		// keep-alive connections that completed no request or response for this long are reaped. a
+		// connection waiting for its next request is already closed after connection::read_timeout, so
+		// only a shorter idle timeout frees idle keep-alive connections early
+		std::chrono::seconds m_idle_timeout = connection::read_timeout / 2;
+		std::chrono::seconds m_reap_interval = std::chrono::seconds(5);
+		json_limits m_json;
+		admission_limits m_admission;
+	};
+
 	class server : public std::enable_shared_from_this<server>
 	{
 	public:
-		static shared_server create(std::shared_ptr<boost::asio::io_context> io_context);
+		static shared_server create(std::shared_ptr<boost::asio::io_context> io_context, server_limits limits = {});
 
-		bool open(boost::asio::ip::address address, ip_port port);
+		// reuse_port lets several servers (one per shard) bind the same endpoint, see shard_group
+		bool open(boost::asio::ip::address address, ip_port port, bool reuse_port = false);
+		// accepts on a socket that is already listening, the server owns it from here on
+		bool open(const inherited_acceptor& acceptor);
+		// stops accepting and drains: idle connections close now, busy ones after their current
+		// response (sent with "Connection: close"). connection_count() reaches 0 once drained.
 		void close();
 		void close(shared_connection connection);
 
+		// the listening socket, to hand to another process. empty before open() and after close()
+		std::optional<inherited_acceptor> acceptor();
+
+		// register all routes before calling open()
+		router& get_router();
+		const router& get_router() const;
+
+		std::size_t connection_count() const;
+		const server_limits& limits() const;
+
+		const shared_admission_controller& admission() const;
+		// replaces the controller built from limits().m_admission, lets several servers share client buckets
+		void set_admission_controller(shared_admission_controller admission);
+
+		// accepted sockets are handed out round-robin to these executors instead of our own io_context
+		void set_accept_executors(std::vector<boost::asio::any_io_executor> executors);
+		static constexpr bool supports_reuse_port();
+
 	protected:
-		server(std::shared_ptr<boost::asio::io_context> io_context);
+		server(std::shared_ptr<boost::asio::io_context> io_context, server_limits limits);
 	
 	protected:
+		// starts accepting and reaping once m_acceptor is listening
+		void start();
 		void do_accept();
 		void handle_accept(boost::beast::error_code error_code, boost::asio::ip::tcp::socket socket);
+		// answers with the prebuilt 429/503 and closes, the socket never becomes a connection
+		void reject(boost::asio::ip::tcp::socket&& socket, admission_decision decision);
 
 		void handle_exit_signal(const boost::system::error_code& error, int signal);
+
+		void start_reaper();
+		void handle_reap(boost::beast::error_code error_code);
 		
 	private:
 		std::shared_ptr<boost::asio::io_context> m_io_context;
+		// serializes the acceptor and reaper against close(), which may come from any thread
+		boost::asio::strand<boost::asio::io_context::executor_type> m_strand;
 		boost::asio::signal_set m_signals;
 		std::unique_ptr<boost::asio::ip::tcp::acceptor> m_acceptor;
-		std::vector<shared_connection> m_connections;
+		router m_router;
+		server_limits m_limits;
+		shared_admission_controller m_admission;
+		connection_registry m_connections;
+		boost::asio::steady_timer m_reaper;
+		std::vector<boost::asio::any_io_executor> m_accept_executors;
+		std::size_t m_next_accept_executor = 0;
+		bool m_closing = false;
 		std::mutex m_mutex;
 	};
+
+	constexpr bool server::supports_reuse_port()
+	{
+#if defined(SO_REUSEPORT)
+		return true;
+#else
+		return false;
+#endif
+	}
 } // !namespace rest
 } // !namespace noconn
\ No newline at end of file
@@ -0,0 +1,56 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <functional>
+#include <boost/asio.hpp>
+#include "noconn/rest/helper.hpp"
+#include "noconn/rest/server.hpp"
+
+namespace noconn
+{
+namespace rest
+{
+	/*
+	 * One io_context and one server per shard, each meant to be run by a single (optionally pinned) thread.
+	 * Every shard binds its own acceptor to the same endpoint with SO_REUSEPORT so the kernel spreads
+	 * incoming connections, and a connection lives on the shard that accepted it until it closes.
+	 *
+	 * Without SO_REUSEPORT (windows) shard 0 owns the only acceptor and deals accepted sockets out
+	 * round-robin to the other shards' io_contexts, which keeps connections core-local after accept.
+	 */
+	class shard_group
+	{
+	public:
+		explicit shard_group(std::size_t shard_count);
+
+		// register_routes is called once per shard router
+		bool open(boost::asio::ip::address address, ip_port port, server_limits limits, const std::function<void(router&)>& register_routes);
+		// takes over the listening sockets of a previous process, one per server (so one in total
+		// without SO_REUSEPORT, one per shard with it)
+		bool open(const std::vector<inherited_acceptor>& acceptors, server_limits limits, const std::function<void(router&)>& register_routes);
+		// closes every server (draining their connections) and lets the io_contexts run out of work
+		void stop();
+
+		std::size_t size() const;
+		std::size_t connection_count() const;
+		std::vector<inherited_acceptor> acceptors();
+		std::shared_ptr<boost::asio::io_context> get_io_context(std::size_t shard) const;
+	private:
+		using open_function = std::function<bool(server&, std::size_t)>;
+
+		// opens one server per shard (or a single dealing one), open_server binds or adopts its acceptor
+		bool open(server_limits limits, const std::function<void(router&)>& register_routes, const open_function& open_server);
+	private:
+		using work_guard = boost::asio::executor_work_guard<boost::asio::io_context::executor_type>;
+
+		std::vector<std::shared_ptr<boost::asio::io_context>> m_io_contexts;
+		std::vector<work_guard> m_work_guards;
+		std::vector<shared_server> m_servers;
+	};
+} // !namespace rest
+} // !namespace noconn
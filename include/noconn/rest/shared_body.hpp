@@ -0,0 +1,104 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <boost/optional.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+
+namespace noconn
+{
+namespace rest
+{
+	/*
+	 * Response body that either owns its bytes or shares an immutable buffer with other responses.
+	 * Cached representations (e.g. a compressed route dump) are written to every connection that asks
+	 * for them without copying.
+	 */
+	struct shared_body
+	{
+		class value_type
+		{
+		public:
+			value_type() = default;
+			value_type(std::string&& body)
+				: m_owned(std::move(body))
+			{
+			}
+
+			value_type(std::shared_ptr<const std::string> body)
+				: m_shared(std::move(body))
+			{
+			}
+
+			value_type& operator=(std::string&& body)
+			{
+				m_shared.reset();
+				m_owned = std::move(body);
+				return *this;
+			}
+
+			std::string_view view() const
+			{
+				return m_shared ? std::string_view(*m_shared) : std::string_view(m_owned);
+			}
+
+			std::size_t size() const { return view().size(); }
+			bool empty() const { return view().empty(); }
+
+			void clear()
+			{
+				m_shared.reset();
+				m_owned.clear();
+			}
+		private:
+			std::shared_ptr<const std::string> m_shared;
+			std::string m_owned;
+		};
+
+		static std::uint64_t size(const value_type& body)
+		{
+			return body.size();
+		}
+
+		class writer
+		{
+		public:
+			using const_buffers_type = boost::asio::const_buffer;
+
+			template <bool is_request, typename Fields>
+			writer(const boost::beast::http::header<is_request, Fields>&, const value_type& body)
+				: m_body(body)
+			{
+			}
+
+			void init(boost::beast::error_code& error_code)
+			{
+				error_code = {};
+			}
+
+			boost::optional<std::pair<const_buffers_type, bool>> get(boost::beast::error_code& error_code)
+			{
+				error_code = {};
+				if (m_done)
+				{
+					return boost::none;
+				}
+
+				m_done = true;
+				std::string_view bytes = m_body.view();
+				return std::make_pair(const_buffers_type(bytes.data(), bytes.size()), false);
+			}
+		private:
+			const value_type& m_body;
+			bool m_done = false;
+		};
+	};
+} // !namespace rest
+} // !namespace noconn
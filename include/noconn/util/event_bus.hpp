@@ -0,0 +1,204 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <functional>
+#include <boost/asio/post.hpp>
+#include <boost/asio/any_io_executor.hpp>
+
+namespace noconn
+{
+namespace util
+{
+    /*
+     * Typed fan-out of event batches (e.g. one route_delta_set per tick) from a single publisher thread to
+     * subscribers running on their own executors.
+     *
+     * publish() never runs subscriber code and never waits: every subscriber has a bounded single
+     * producer ring, the publisher appends the shared batch to it and schedules a drain on the
+     * subscriber's executor only if none is pending. A subscriber that falls max_pending batches behind
+     * loses the newest ones and is told how many, it can resynchronise from the generation in the
+     * batches (or a snapshot). Batches are shared, not copied, between subscribers.
+     *
+     * A subscriber's handler never runs concurrently with itself, so any executor will do without a
+     * strand. Subscriber slots are never reused, unsubscribing only stops delivery and the slot keeps
+     * its executor until the bus is destroyed.
+     */
+    template <typename Batch>
+    class event_bus
+    {
+    public:
+        using shared_batch = std::shared_ptr<const Batch>;
+        // every batch received since the previous call, oldest first, and the batches dropped meanwhile
+        using handler = std::function<void(const std::vector<shared_batch>& batches, uint64_t dropped)>;
+
+        static constexpr std::size_t max_subscribers = 32;
+        static constexpr std::size_t max_pending = 64;
+    private:
+        struct subscriber
+        {
+            boost::asio::any_io_executor m_executor;
+            handler m_handler;
+            std::array<shared_batch, max_pending> m_ring;
+            // written by the publisher
+            std::atomic<uint64_t> m_head = 0;
+            // written by the drain on m_executor
+            std::atomic<uint64_t> m_tail = 0;
+            std::atomic<uint64_t> m_dropped = 0;
+            std::atomic<bool> m_scheduled = false;
+            std::atomic<bool> m_active = true;
+        };
+    public:
+        class subscription
+        {
+        public:
+            subscription() = default;
+            explicit subscription(subscriber* target)
+                : m_subscriber(target)
+            {
+                // nothing for now
+            }
+
+            subscription(subscription&& other) noexcept
+                : m_subscriber(std::exchange(other.m_subscriber, nullptr))
+            {
+                // nothing for now
+            }
+
+            subscription& operator=(subscription&& other) noexcept
+            {
+                unsubscribe();
+                m_subscriber = std::exchange(other.m_subscriber, nullptr);
+                return *this;
+            }
+
+            ~subscription()
+            {
+                unsubscribe();
+            }
+
+            bool valid() const
+            {
+                return m_subscriber != nullptr;
+            }
+
+            // batches already queued are not delivered, a handler running right now finishes
+            void unsubscribe()
+            {
+                if (m_subscriber != nullptr)
+                {
+                    m_subscriber->m_active.store(false, std::memory_order_release);
+                    m_subscriber = nullptr;
+                }
+            }
+        private:
+            subscriber* m_subscriber = nullptr;
+        };
+
+        event_bus() = default;
+        event_bus(const event_bus&) = delete;
+        event_bus& operator=(const event_bus&) = delete;
+
+        // any thread. an invalid subscription once max_subscribers were handed out
+        subscription subscribe(boost::asio::any_io_executor executor, handler target)
+        {
+            // only subscribers contend here, the publisher reads m_count
+            std::lock_guard<std::mutex> lock(m_subscribe_mutex);
+            std::size_t count = m_count.load(std::memory_order_relaxed);
+            if (count == max_subscribers)
+            {
+                return subscription();
+            }
+
+            m_subscribers[count] = std::make_unique<subscriber>();
+            m_subscribers[count]->m_executor = std::move(executor);
+            m_subscribers[count]->m_handler = std::move(target);
+            m_count.store(count + 1, std::memory_order_release);
+            return subscription(m_subscribers[count].get());
+        }
+
+        // from one thread at a time
+        void publish(shared_batch batch)
+        {
+            std::size_t count = m_count.load(std::memory_order_acquire);
+            for (std::size_t index = 0; index < count; ++index)
+            {
+                subscriber& target = *m_subscribers[index];
+                if (!target.m_active.load(std::memory_order_acquire))
+                {
+                    continue;
+                }
+
+                uint64_t head = target.m_head.load(std::memory_order_relaxed);
+                if (head - target.m_tail.load(std::memory_order_acquire) == max_pending)
+                {
+                    target.m_dropped.fetch_add(1, std::memory_order_seq_cst);
+                }
+                else
+                {
+                    target.m_ring[head % max_pending] = batch;
+                    target.m_head.store(head + 1, std::memory_order_seq_cst);
+                }
+
+                // a drain in progress picks this up before it returns
+                if (!target.m_scheduled.exchange(true, std::memory_order_seq_cst))
+                {
+                    boost::asio::post(target.m_executor, [&target]() { drain(target); });
+                }
+            }
+        }
+    private:
+        static void drain(subscriber& target)
+        {
+            // m_scheduled stays set while we run, so drains of one subscriber never overlap whatever the
+            // executor, and publishes meanwhile are picked up by the loop instead of another post
+            uint64_t tail = target.m_tail.load(std::memory_order_relaxed);
+            while (true)
+            {
+                std::vector<shared_batch> batches;
+                uint64_t head = target.m_head.load(std::memory_order_acquire);
+                batches.reserve(static_cast<std::size_t>(head - tail));
+                for (; tail != head; ++tail)
+                {
+                    batches.push_back(std::move(target.m_ring[tail % max_pending]));
+                }
+
+                target.m_tail.store(tail, std::memory_order_release);
+                uint64_t dropped = target.m_dropped.exchange(0, std::memory_order_acq_rel);
+
+                if (target.m_active.load(std::memory_order_acquire) && (!batches.empty() || dropped > 0))
+                {
+                    target.m_handler(batches, dropped);
+                }
+
+                // seq_cst pairs with the publisher's head store and exchange: either it sees the flag
+                // cleared and posts, or we see its batch here
+                target.m_scheduled.store(false, std::memory_order_seq_cst);
+                if (target.m_head.load(std::memory_order_seq_cst) == tail && target.m_dropped.load(std::memory_order_seq_cst) == 0)
+                {
+                    return;
+                }
+
+                if (target.m_scheduled.exchange(true, std::memory_order_seq_cst))
+                {
+                    // the publisher posted another drain already
+                    return;
+                }
+            }
+        }
+    private:
+        std::mutex m_subscribe_mutex;
+        std::array<std::unique_ptr<subscriber>, max_subscribers> m_subscribers;
+        std::atomic<std::size_t> m_count = 0;
+    };
+} // !namespace util
+} // !namespace noconn
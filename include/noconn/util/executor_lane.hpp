@@ -0,0 +1,60 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include "noconn/util/thread.hpp"
+
+namespace noconn
+{
+namespace util
+{
+    /*
+     * A named set of threads running io_contexts, with its own cpus and priority, so one kind of work
+     * (network i/o, polling, blocking calls) cannot starve another of threads. Threads are called
+     * <name>_<index> and keep running their io_context through exceptions thrown by handlers.
+     */
+    class executor_lane
+    {
+    public:
+        // one io_context shared by options.m_threads threads
+        executor_lane(std::string name, lane_options options);
+        // one thread per io_context (shards), options.m_threads is ignored
+        executor_lane(std::string name, lane_options options, std::vector<std::shared_ptr<boost::asio::io_context>> io_contexts);
+        ~executor_lane();
+
+        executor_lane(const executor_lane&) = delete;
+        executor_lane& operator=(const executor_lane&) = delete;
+
+        void start();
+        // drops the lane's work, stops its io_contexts and joins the threads. does nothing twice
+        void stop();
+
+        const std::string& name() const;
+        std::size_t thread_count() const;
+        // the first io_context is the only one unless the lane runs shards
+        std::shared_ptr<boost::asio::io_context> get_io_context() const;
+        boost::asio::any_io_executor get_executor() const;
+        // one per io_context
+        std::vector<boost::asio::any_io_executor> executors() const;
+    private:
+        using work_guard = boost::asio::executor_work_guard<boost::asio::io_context::executor_type>;
+
+        void run(std::size_t index);
+    private:
+        std::string m_name;
+        lane_options m_options;
+        std::vector<std::shared_ptr<boost::asio::io_context>> m_io_contexts;
+        std::vector<work_guard> m_work_guards;
+        std::vector<std::thread> m_threads;
+    };
+} // !namespace util
+} // !namespace noconn
@@ -0,0 +1,154 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <tuple>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <fmt/format.h>
+
+/*
+ * Logging facade for hot paths. The level is checked before any argument is touched, first at compile
+ * time (NOCONN_LOG_COMPILE_LEVEL) and then against the runtime level. Enabled records capture their
+ * arguments by value into a per-thread lock-free ring; a background thread does the formatting and
+ * hands the text to whatlog. A full ring drops the record (and counts it) rather than blocking.
+ *
+ *   NOCONN_LOG_INFO("connection::on_read", "{} [REQUEST] target: {}.", id, target);
+ *
+ * The scope must be a string literal, the format string is checked at compile time.
+ */
+
+// 0 trace, 1 debug, 2 info, 3 warning, 4 error
+#ifndef NOCONN_LOG_COMPILE_LEVEL
+#ifdef NDEBUG
+#define NOCONN_LOG_COMPILE_LEVEL 2
+#else
+#define NOCONN_LOG_COMPILE_LEVEL 0
+#endif
+#endif
+
+#define NOCONN_LOG(level, scope, format, ...)                                                           \
+    do                                                                                                  \
+    {                                                                                                   \
+        if constexpr (static_cast<int>(level) >= NOCONN_LOG_COMPILE_LEVEL)                              \
+        {                                                                                               \
+            if (::noconn::util::log::is_enabled(level))                                                 \
+            {                                                                                           \
+                ::noconn::util::log::write(level, scope, format, ##__VA_ARGS__);                        \
+            }                                                                                           \
+        }                                                                                               \
+    } while (false)
+
+#define NOCONN_LOG_TRACE(scope, format, ...) NOCONN_LOG(::noconn::util::log_level::trace, scope, format, ##__VA_ARGS__)
+#define NOCONN_LOG_DEBUG(scope, format, ...) NOCONN_LOG(::noconn::util::log_level::debug, scope, format, ##__VA_ARGS__)
+#define NOCONN_LOG_INFO(scope, format, ...) NOCONN_LOG(::noconn::util::log_level::info, scope, format, ##__VA_ARGS__)
+#define NOCONN_LOG_WARNING(scope, format, ...) NOCONN_LOG(::noconn::util::log_level::warning, scope, format, ##__VA_ARGS__)
+#define NOCONN_LOG_ERROR(scope, format, ...) NOCONN_LOG(::noconn::util::log_level::error, scope, format, ##__VA_ARGS__)
+
+namespace noconn
+{
+namespace util
+{
+    enum class log_level : int
+    {
+        trace = 0,
+        debug = 1,
+        info = 2,
+        warning = 3,
+        error = 4
+    };
+
+    struct log_record
+    {
+        static constexpr std::size_t argument_capacity = 200;
+
+        using format_function = void (*)(const log_record& record, fmt::memory_buffer& output);
+        using destroy_function = void (*)(log_record& record);
+
+        log_level m_level;
+        const char* m_scope;
+        fmt::string_view m_format;
+        format_function m_format_function;
+        destroy_function m_destroy_function;
+        alignas(std::max_align_t) unsigned char m_arguments[argument_capacity];
+    };
+
+    class log
+    {
+    public:
+        static bool is_enabled(log_level level);
+        static void set_level(log_level level);
+
+        // starts the formatting thread, records written before start() are formatted synchronously
+        static void start();
+        // drains every ring and joins the formatting thread
+        static void stop();
+        static bool is_running();
+
+        // records lost because a thread's ring was full, also exported as noconn_log_dropped_total
+        static uint64_t dropped();
+
+        template <typename... Args>
+        static void write(log_level level, const char* scope, fmt::format_string<Args...> format, Args&&... arguments);
+    private:
+        // views and c strings may not outlive the call, capture them as owning strings
+        template <typename T>
+        using capture_t = std::conditional_t<
+            std::is_convertible_v<const std::decay_t<T>&, std::string_view> && !std::is_same_v<std::decay_t<T>, std::string>,
+            std::string, std::decay_t<T>>;
+
+        // nullptr if the calling thread's ring is full (or logging is not started)
+        static log_record* acquire();
+        static void commit();
+        static void write_now(log_level level, const char* scope, std::string_view message);
+    };
+
+    template <typename... Args>
+    void log::write(log_level level, const char* scope, fmt::format_string<Args...> format, Args&&... arguments)
+    {
+        using arguments_t = std::tuple<capture_t<Args>...>;
+
+        if constexpr (sizeof(arguments_t) > log_record::argument_capacity || alignof(arguments_t) > alignof(std::max_align_t))
+        {
+            // too large to capture, pay for formatting on this thread
+            write_now(level, scope, fmt::format(format, std::forward<Args>(arguments)...));
+        }
+        else
+        {
+            if (!is_running())
+            {
+                write_now(level, scope, fmt::format(format, std::forward<Args>(arguments)...));
+                return;
+            }
+
+            log_record* record = acquire();
+            if (record == nullptr)
+            {
+                return;
+            }
+
+            record->m_level = level;
+            record->m_scope = scope;
+            record->m_format = static_cast<fmt::string_view>(format);
+            ::new (static_cast<void*>(record->m_arguments)) arguments_t(std::forward<Args>(arguments)...);
+            record->m_format_function = [](const log_record& target, fmt::memory_buffer& output)
+            {
+                const arguments_t& captured = *std::launder(reinterpret_cast<const arguments_t*>(target.m_arguments));
+                std::apply([&](const auto&... values) { fmt::vformat_to(fmt::appender(output), target.m_format, fmt::make_format_args(values...)); }, captured);
+            };
+            record->m_destroy_function = [](log_record& target)
+            {
+                std::launder(reinterpret_cast<arguments_t*>(target.m_arguments))->~arguments_t();
+            };
+
+            commit();
+        }
+    }
+} // !namespace util
+} // !namespace noconn
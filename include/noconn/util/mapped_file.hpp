@@ -0,0 +1,45 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+
+namespace noconn
+{
+namespace util
+{
+    // shared read/write mapping of a whole file
+    class mapped_file
+    {
+    public:
+        mapped_file() = default;
+        ~mapped_file();
+
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+
+        // creates the file if needed and grows it (zero filled) to at least size
+        bool open(const std::filesystem::path& path, std::size_t size);
+        void close();
+        // maps the file again at the new size, pointers into the old mapping are invalid afterwards
+        bool resize(std::size_t size);
+
+        bool is_open() const;
+        void* data() const;
+        std::size_t size() const;
+    private:
+        std::filesystem::path m_path;
+        void* m_data = nullptr;
+        std::size_t m_size = 0;
+#if defined(_WIN32)
+        void* m_file = nullptr;
+        void* m_mapping = nullptr;
+#else
+        int m_file = -1;
+#endif
+    };
+} // !namespace util
+} // !namespace noconn
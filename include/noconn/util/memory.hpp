@@ -0,0 +1,157 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <string_view>
+#include <memory_resource>
+#include "noconn/util/metrics.hpp"
+
+/*
+ * Memory accounting per subsystem. Containers that make up a subsystem's state allocate through its
+ * tracking resource (a std::pmr::memory_resource, or any resource with the same interface through
+ * basic_tracking_resource), which forwards to the heap and counts in the metrics' per-thread shards:
+ *
+ *   std::pmr::vector<route_entry> m_routes{ util::memory_resource(util::memory_subsystem::routes) };
+ *
+ * Everything is exported as noconn_memory_*{subsystem="<name>"}.
+ */
+
+namespace noconn
+{
+namespace util
+{
+    enum class memory_subsystem
+    {
+        routes,
+        adapters,
+        connections,
+        json,
+        journal,
+        count
+    };
+
+    std::string_view to_string(memory_subsystem subsystem);
+    std::optional<memory_subsystem> parse_memory_subsystem(std::string_view name);
+
+    struct memory_usage
+    {
+        int64_t m_live_bytes = 0;
+        int64_t m_peak_bytes = 0;
+        uint64_t m_allocated_bytes = 0;
+        uint64_t m_allocations = 0;
+        // 0 without a budget
+        std::size_t m_budget_bytes = 0;
+    };
+
+    /*
+     * Live bytes are what was allocated minus what was freed, summed over the shards when asked. The peak
+     * is sampled (every 64th allocation of a thread, every large one and every usage() call), so it can
+     * miss a spike that comes and goes between samples.
+     */
+    class memory_account
+    {
+    public:
+        explicit memory_account(memory_subsystem subsystem);
+
+        void on_allocate(std::size_t bytes)
+        {
+            m_allocated.add(bytes);
+            m_allocations.add();
+
+            thread_local uint32_t allocations = 0;
+            if (bytes >= large_allocation || (++allocations & (sample_interval - 1)) == 0)
+            {
+                sample();
+            }
+        }
+
+        void on_deallocate(std::size_t bytes)
+        {
+            m_freed.add(bytes);
+        }
+
+        int64_t live_bytes() const;
+        memory_usage usage() const;
+
+        // 0 removes it. a subsystem over its budget is logged once per crossing, what it costs the
+        // subsystem is up to its owner (see over_budget())
+        void set_budget(std::size_t bytes);
+        bool over_budget() const;
+    private:
+        static constexpr uint32_t sample_interval = 64;
+        static constexpr std::size_t large_allocation = 64 * 1024;
+
+        void sample() const;
+    private:
+        memory_subsystem m_subsystem;
+        counter& m_allocated;
+        counter& m_freed;
+        counter& m_allocations;
+        gauge& m_peak;
+        gauge& m_budget;
+        mutable std::atomic<int64_t> m_peak_bytes = 0;
+        std::atomic<std::size_t> m_budget_bytes = 0;
+        mutable std::atomic<bool> m_over_budget = false;
+    };
+
+    template <typename Base>
+    class basic_tracking_resource : public Base
+    {
+    public:
+        basic_tracking_resource(memory_account& account, Base* upstream)
+            : m_account(account), m_upstream(upstream)
+        {
+            // nothing for now
+        }
+
+        memory_account& account() const
+        {
+            return m_account;
+        }
+    private:
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override
+        {
+            void* pointer = m_upstream->allocate(bytes, alignment);
+            m_account.on_allocate(bytes);
+            return pointer;
+        }
+
+        void do_deallocate(void* pointer, std::size_t bytes, std::size_t alignment) override
+        {
+            m_upstream->deallocate(pointer, bytes, alignment);
+            m_account.on_deallocate(bytes);
+        }
+
+        bool do_is_equal(const Base& other) const noexcept override
+        {
+            return this == &other;
+        }
+    private:
+        memory_account& m_account;
+        Base* m_upstream;
+    };
+
+    using tracking_resource = basic_tracking_resource<std::pmr::memory_resource>;
+
+    // process wide, never destroyed: memory may be handed back during static destruction
+    memory_account& get_memory_account(memory_subsystem subsystem);
+    // forwards to std::pmr::new_delete_resource()
+    std::pmr::memory_resource* memory_resource(memory_subsystem subsystem);
+
+    // the object and its control block are accounted to the subsystem
+    template <typename T, typename... Args>
+    std::shared_ptr<T> make_tracked_shared(memory_subsystem subsystem, Args&&... arguments)
+    {
+        return std::allocate_shared<T>(std::pmr::polymorphic_allocator<T>(memory_resource(subsystem)), std::forward<Args>(arguments)...);
+    }
+} // !namespace util
+} // !namespace noconn
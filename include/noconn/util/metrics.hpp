@@ -0,0 +1,198 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <map>
+#include <bit>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <string_view>
+
+/*
+ * Process wide metrics, exported in the prometheus text format. Recording is meant for hot paths: every
+ * metric is split into a few cache-line sized shards and a thread always writes to its own shard with a
+ * relaxed atomic add, so threads never contend on a line. Shards are only summed when the registry is
+ * rendered (a scrape).
+ *
+ * Look metrics up once and keep the reference, lookups take the registry lock:
+ *
+ *   static util::counter& requests = util::metrics_registry::instance().get_counter("noconn_http_requests_total", "...");
+ *   requests.add();
+ */
+
+namespace noconn
+{
+namespace util
+{
+    constexpr std::size_t metric_shards = 16;
+
+    std::size_t next_metric_shard();
+
+    // shard of the calling thread, assigned round-robin on first use
+    inline std::size_t metric_shard()
+    {
+        thread_local std::size_t shard = next_metric_shard();
+        return shard;
+    }
+
+    class counter
+    {
+    public:
+        void add(uint64_t value = 1)
+        {
+            m_cells[metric_shard()].m_value.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        uint64_t value() const;
+    private:
+        struct alignas(64) cell
+        {
+            std::atomic<uint64_t> m_value = 0;
+        };
+
+        std::array<cell, metric_shards> m_cells;
+    };
+
+    // gauges move rarely (connections opening, a table being republished), one atomic is enough
+    class gauge
+    {
+    public:
+        void add(int64_t value) { m_value.fetch_add(value, std::memory_order_relaxed); }
+        void set(int64_t value) { m_value.store(value, std::memory_order_relaxed); }
+        int64_t value() const { return m_value.load(std::memory_order_relaxed); }
+    private:
+        std::atomic<int64_t> m_value = 0;
+    };
+
+    enum class histogram_unit
+    {
+        // recorded in nanoseconds, exported in seconds
+        nanoseconds,
+        // plain counts (sizes, lengths)
+        count
+    };
+
+    struct histogram_snapshot;
+
+    /*
+     * Log-linear (HDR style) histogram over unsigned 64 bit values: every power of two is split into
+     * 8 linear sub-buckets, so any value lands in a bucket at most 12.5% wide, from 0 up to 2^64 with a
+     * fixed 496 buckets and no configuration.
+     */
+    class histogram
+    {
+    public:
+        static constexpr std::size_t sub_bucket_bits = 3;
+        static constexpr std::size_t sub_buckets = std::size_t(1) << sub_bucket_bits;
+        static constexpr std::size_t bucket_count = (64 - sub_bucket_bits + 1) * sub_buckets;
+
+        explicit histogram(histogram_unit unit);
+
+        void record(uint64_t value)
+        {
+            shard& target = m_shards[metric_shard()];
+            target.m_buckets[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+            target.m_sum.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        void record(std::chrono::steady_clock::duration duration)
+        {
+            auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+            record(static_cast<uint64_t>(nanoseconds < 0 ? 0 : nanoseconds));
+        }
+
+        histogram_unit unit() const;
+        histogram_snapshot snapshot() const;
+
+        static constexpr std::size_t bucket_index(uint64_t value)
+        {
+            if (value < sub_buckets)
+            {
+                return static_cast<std::size_t>(value);
+            }
+
+            std::size_t exponent = 63 - static_cast<std::size_t>(std::countl_zero(value));
+            std::size_t sub_bucket = static_cast<std::size_t>(value >> (exponent - sub_bucket_bits)) & (sub_buckets - 1);
+            return (exponent - sub_bucket_bits + 1) * sub_buckets + sub_bucket;
+        }
+
+        // smallest value that lands in the bucket
+        static constexpr uint64_t bucket_lower_bound(std::size_t index)
+        {
+            if (index < sub_buckets)
+            {
+                return index;
+            }
+
+            std::size_t exponent = index / sub_buckets + sub_bucket_bits - 1;
+            return uint64_t(sub_buckets + index % sub_buckets) << (exponent - sub_bucket_bits);
+        }
+    private:
+        struct alignas(64) shard
+        {
+            std::array<std::atomic<uint64_t>, bucket_count> m_buckets{};
+            std::atomic<uint64_t> m_sum = 0;
+        };
+
+        histogram_unit m_unit;
+        std::unique_ptr<shard[]> m_shards;
+    };
+
+    struct histogram_snapshot
+    {
+        std::array<uint64_t, histogram::bucket_count> m_buckets{};
+        uint64_t m_count = 0;
+        uint64_t m_sum = 0;
+
+        // lower bound of the bucket holding the q-th value, q in [0, 1]
+        uint64_t quantile(double q) const;
+        // values strictly below bound, bound must be a bucket boundary to be exact
+        uint64_t count_below(uint64_t bound) const;
+    };
+
+    class metrics_registry
+    {
+    public:
+        static metrics_registry& instance();
+
+        // labels are written verbatim between the braces, e.g. R"(code="2xx")". the same name and labels
+        // return the same metric, the same name with a different type throws std::logic_error.
+        counter& get_counter(std::string_view name, std::string_view help, std::string_view labels = {});
+        gauge& get_gauge(std::string_view name, std::string_view help, std::string_view labels = {});
+        histogram& get_histogram(std::string_view name, std::string_view help, histogram_unit unit, std::string_view labels = {});
+
+        // prometheus text exposition format 0.0.4
+        void render(std::string& output) const;
+    private:
+        enum class metric_type
+        {
+            counter,
+            gauge,
+            histogram
+        };
+
+        struct family
+        {
+            metric_type m_type;
+            std::string m_help;
+            // labels => metric, only one of the three is set
+            std::map<std::string, std::unique_ptr<counter>, std::less<>> m_counters;
+            std::map<std::string, std::unique_ptr<gauge>, std::less<>> m_gauges;
+            std::map<std::string, std::unique_ptr<histogram>, std::less<>> m_histograms;
+        };
+
+        family& get_family(std::string_view name, std::string_view help, metric_type type);
+    private:
+        mutable std::mutex m_mutex;
+        std::map<std::string, family, std::less<>> m_families;
+    };
+} // !namespace util
+} // !namespace noconn
@@ -0,0 +1,84 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <utility>
+#include <optional>
+
+namespace noconn
+{
+namespace util
+{
+    /*
+     * Unbounded multi-producer single-consumer queue (Vyukov). push() is one exchange and one store, no
+     * thread ever waits on another. Nodes are linked from the oldest (m_tail, consumer side) to the newest
+     * (m_head, producer side), m_tail always points at a node whose value was already taken.
+     *
+     * A producer that was preempted between its exchange and its store hides the items pushed after it
+     * until it resumes, pop() reports empty meanwhile. The consumer just picks them up on its next pass.
+     */
+    template <typename T>
+    class mpsc_queue
+    {
+    public:
+        mpsc_queue()
+            : m_head(new node()), m_tail(m_head.load(std::memory_order_relaxed))
+        {
+            // nothing for now
+        }
+
+        ~mpsc_queue()
+        {
+            while (m_tail != nullptr)
+            {
+                node* next = m_tail->m_next.load(std::memory_order_relaxed);
+                delete m_tail;
+                m_tail = next;
+            }
+        }
+
+        mpsc_queue(const mpsc_queue&) = delete;
+        mpsc_queue& operator=(const mpsc_queue&) = delete;
+
+        // any thread
+        void push(T value)
+        {
+            node* item = new node();
+            item->m_value.emplace(std::move(value));
+
+            node* previous = m_head.exchange(item, std::memory_order_acq_rel);
+            previous->m_next.store(item, std::memory_order_release);
+        }
+
+        // consumer thread only
+        std::optional<T> pop()
+        {
+            node* next = m_tail->m_next.load(std::memory_order_acquire);
+            if (next == nullptr)
+            {
+                return std::nullopt;
+            }
+
+            std::optional<T> result(std::move(next->m_value));
+            next->m_value.reset();
+
+            delete m_tail;
+            m_tail = next;
+            return result;
+        }
+    private:
+        struct node
+        {
+            std::atomic<node*> m_next = nullptr;
+            std::optional<T> m_value;
+        };
+    private:
+        // written by every producer, kept off the consumer's cache line
+        alignas(64) std::atomic<node*> m_head;
+        alignas(64) node* m_tail;
+    };
+} // !namespace util
+} // !namespace noconn
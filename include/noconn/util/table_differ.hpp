@@ -0,0 +1,153 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <span>
+#include <vector>
+#include <cstddef>
+#include <utility>
+#include <functional>
+#include <type_traits>
+#include <unordered_map>
+
+namespace noconn
+{
+namespace util
+{
+    enum class table_change
+    {
+        added,
+        changed,
+        removed
+    };
+
+    /*
+     * How rows of an inventory are matched and compared, specialized next to the row type:
+     *
+     *   template <> struct table_traits<route_entry>
+     *   {
+     *       static route_key key(const route_entry& entry);
+     *       // same key, is it still the same row
+     *       static bool changed(const route_entry& previous, const route_entry& current);
+     *   };
+     *
+     * key() may return a view into the row, it is only used while both tables are alive.
+     */
+    template <typename Value>
+    struct table_traits;
+
+    /*
+     * Diffs two versions of a table (the previous and current snapshot of an inventory) and hands every
+     * difference to a visitor, which turns it into the inventory's own delta type:
+     *
+     *   visitor(table_change change, const Value& value, const Value* previous)
+     *
+     * value is the current row, or the last one seen for removed rows. previous is the row a changed
+     * one replaced, null otherwise. diff() returns the number of differences.
+     *
+     * diff() matches rows through a hash index of the previous table, O(previous + current) instead of
+     * comparing every pair, and keeps the index's buckets between calls. Added and changed rows come in
+     * current order, then removed rows in previous order. Rows sharing a key all match the first
+     * previous row with it, and previous rows are only removed once their key is gone.
+     *
+     * diff_sorted() walks two tables already sorted by key (unique keys) in one merge pass, with no
+     * index at all, and reports in key order.
+     */
+    template <typename Key, typename Value, typename Hash = std::hash<Key>, typename Traits = table_traits<Value>>
+    class table_differ
+    {
+    public:
+        static_assert(std::is_convertible_v<decltype(Traits::key(std::declval<const Value&>())), Key>, "table_traits::key() must yield the differ's key");
+        static_assert(std::is_same_v<decltype(Traits::changed(std::declval<const Value&>(), std::declval<const Value&>())), bool>, "table_traits::changed() must return bool");
+
+        template <typename Visitor>
+        std::size_t diff(std::span<const Value> previous, std::span<const Value> current, Visitor&& visitor)
+        {
+            m_positions.clear();
+            m_positions.reserve(previous.size());
+            m_first.resize(previous.size());
+            for (std::size_t index = 0; index < previous.size(); ++index)
+            {
+                m_first[index] = m_positions.emplace(Key(Traits::key(previous[index])), index).first->second;
+            }
+
+            m_seen.assign(previous.size(), false);
+            std::size_t count = 0;
+            for (const Value& row : current)
+            {
+                auto match = m_positions.find(Key(Traits::key(row)));
+                if (match == m_positions.end())
+                {
+                    visitor(table_change::added, row, static_cast<const Value*>(nullptr));
+                    ++count;
+                    continue;
+                }
+
+                m_seen[match->second] = true;
+                const Value& before = previous[match->second];
+                if (Traits::changed(before, row))
+                {
+                    visitor(table_change::changed, row, &before);
+                    ++count;
+                }
+            }
+
+            for (std::size_t index = 0; index < previous.size(); ++index)
+            {
+                if (!m_seen[m_first[index]])
+                {
+                    visitor(table_change::removed, previous[index], static_cast<const Value*>(nullptr));
+                    ++count;
+                }
+            }
+
+            return count;
+        }
+
+        template <typename Visitor>
+        static std::size_t diff_sorted(std::span<const Value> previous, std::span<const Value> current, Visitor&& visitor)
+        {
+            std::size_t count = 0;
+            auto before = previous.begin();
+            auto after = current.begin();
+            while (before != previous.end() || after != current.end())
+            {
+                if (after == current.end() || (before != previous.end() && Key(Traits::key(*before)) < Key(Traits::key(*after))))
+                {
+                    visitor(table_change::removed, *before, static_cast<const Value*>(nullptr));
+                    ++before;
+                }
+                else if (before == previous.end() || Key(Traits::key(*after)) < Key(Traits::key(*before)))
+                {
+                    visitor(table_change::added, *after, static_cast<const Value*>(nullptr));
+                    ++after;
+                }
+                else
+                {
+                    if (Traits::changed(*before, *after))
+                    {
+                        visitor(table_change::changed, *after, &*before);
+                        ++count;
+                    }
+
+                    ++before;
+                    ++after;
+                    continue;
+                }
+
+                ++count;
+            }
+
+            return count;
+        }
+    private:
+        // first previous position per key, and per previous row the first position with its key
+        std::unordered_map<Key, std::size_t, Hash> m_positions;
+        std::vector<std::size_t> m_first;
+        // indexed by first positions, set once the key turns up in the current table
+        std::vector<bool> m_seen;
+    };
+} // !namespace util
+} // !namespace noconn
@@ -0,0 +1,39 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+namespace noconn
+{
+namespace util
+{
+    // number of logical cpus, never less than 1
+    std::size_t cpu_count();
+
+    // pins the calling thread to a single logical cpu (modulo cpu_count())
+    bool pin_current_thread(std::size_t cpu);
+
+    enum class thread_priority
+    {
+        low,
+        normal,
+        high
+    };
+
+    // relative to the process, raising it may need privileges the process does not have
+    bool set_current_thread_priority(thread_priority priority);
+
+    // threads, cpus and priority of an executor_lane
+    struct lane_options
+    {
+        std::size_t m_threads = 1;
+        // thread i is pinned to m_cpus[i % size], empty leaves them to the scheduler
+        std::vector<std::size_t> m_cpus;
+        thread_priority m_priority = thread_priority::normal;
+    };
+} // !namespace util
+} // !namespace noconn
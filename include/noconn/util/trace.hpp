@@ -0,0 +1,132 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstdint>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define NOCONN_TRACE_HAS_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define NOCONN_TRACE_HAS_TSC 1
+#else
+#define NOCONN_TRACE_HAS_TSC 0
+#endif
+
+/*
+ * Span tracing, to see where a slow request or tick spent its time. Every thread records finished spans
+ * into its own fixed ring (the oldest are overwritten), timestamps are raw TSC reads that are only
+ * converted to microseconds when the rings are dumped as Chrome trace-event json (chrome://tracing,
+ * ui.perfetto.dev). While tracing is off a span costs one relaxed load and a branch.
+ *
+ *   NOCONN_TRACE_SPAN("route_manager::diff");
+ *   NOCONN_TRACE_ASYNC_SPAN("connection::async_write", m_id);
+ *
+ * Names must be string literals, only the pointer is kept. Plain spans must not cross a co_await (they
+ * are drawn nested on the thread's track), async spans may: they are drawn on their own track per name
+ * and id, and are recorded by the thread that ends them.
+ */
+
+#ifndef NOCONN_TRACE_COMPILE
+#define NOCONN_TRACE_COMPILE 1
+#endif
+
+#define NOCONN_TRACE_CONCAT_IMPL(a, b) a##b
+#define NOCONN_TRACE_CONCAT(a, b) NOCONN_TRACE_CONCAT_IMPL(a, b)
+
+#if NOCONN_TRACE_COMPILE
+#define NOCONN_TRACE_SPAN(name, ...) ::noconn::util::trace_span NOCONN_TRACE_CONCAT(noconn_trace_span_, __LINE__)(name, ##__VA_ARGS__)
+#define NOCONN_TRACE_ASYNC_SPAN(name, id) ::noconn::util::trace_span NOCONN_TRACE_CONCAT(noconn_trace_span_, __LINE__)(name, id, ::noconn::util::trace_kind::async)
+#else
+#define NOCONN_TRACE_SPAN(name, ...) do {} while (false)
+#define NOCONN_TRACE_ASYNC_SPAN(name, id) do {} while (false)
+#endif
+
+namespace noconn
+{
+namespace util
+{
+    enum class trace_kind : uint8_t
+    {
+        // begins and ends on one thread without suspending
+        complete,
+        // may suspend, identified by its argument
+        async
+    };
+
+    class trace
+    {
+    public:
+        static bool is_enabled()
+        {
+            return m_enabled.load(std::memory_order_relaxed);
+        }
+
+        // forgets what was recorded before and starts recording
+        static void start();
+        static void stop();
+
+        static uint64_t now()
+        {
+#if NOCONN_TRACE_HAS_TSC
+            return __rdtsc();
+#else
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+        }
+
+        // trace id of the calling thread, the thread's ring is made on first use
+        static uint32_t current_thread();
+        // shown for the calling thread's track
+        static void set_thread_name(std::string name);
+
+        // into the calling thread's ring
+        static void record(const char* name, trace_kind kind, uint32_t thread, uint64_t start, uint64_t end, uint64_t argument);
+
+        // {"traceEvents": [...]} of every ring, since the last start()
+        static std::string dump();
+    private:
+        static inline std::atomic<bool> m_enabled = false;
+    };
+
+    class trace_span
+    {
+    public:
+        explicit trace_span(const char* name, uint64_t argument = 0, trace_kind kind = trace_kind::complete)
+        {
+            if (trace::is_enabled())
+            {
+                m_name = name;
+                m_kind = kind;
+                m_argument = argument;
+                m_thread = trace::current_thread();
+                m_start = trace::now();
+            }
+        }
+
+        ~trace_span()
+        {
+            if (m_name != nullptr)
+            {
+                trace::record(m_name, m_kind, m_thread, m_start, trace::now(), m_argument);
+            }
+        }
+
+        trace_span(const trace_span&) = delete;
+        trace_span& operator=(const trace_span&) = delete;
+    private:
+        // null while tracing was off at the start
+        const char* m_name = nullptr;
+        trace_kind m_kind = trace_kind::complete;
+        uint32_t m_thread = 0;
+        uint64_t m_start = 0;
+        uint64_t m_argument = 0;
+    };
+} // !namespace util
+} // !namespace noconn
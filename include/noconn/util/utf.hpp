@@ -0,0 +1,43 @@
+/*
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+namespace noconn
+{
+namespace util
+{
+    // returned by utf16_to_utf8 when the output buffer is too small
+    constexpr std::size_t utf_error = static_cast<std::size_t>(-1);
+
+    // worst case: every utf-16 code unit becomes 3 utf-8 bytes (surrogate pairs become 4 bytes for 2 units)
+    constexpr std::size_t utf8_max_length(std::size_t utf16_length)
+    {
+        return utf16_length * 3;
+    }
+
+    // exact number of utf-8 bytes needed to encode the input. unpaired surrogates count as U+FFFD.
+    std::size_t utf8_length(const char16_t* input, std::size_t length);
+
+    // transcodes utf-16 into the caller-provided buffer and returns the number of bytes written,
+    // or utf_error if the buffer is too small. unpaired surrogates are replaced with U+FFFD.
+    // uses SSE2/NEON to move runs of ascii 8 code units at a time when available.
+    std::size_t utf16_to_utf8(const char16_t* input, std::size_t length, char* output, std::size_t capacity);
+
+    // plain one-code-point-at-a-time reference implementation. utf16_to_utf8 must always
+    // produce byte-identical output (checked in debug builds).
+    std::size_t utf16_to_utf8_scalar(const char16_t* input, std::size_t length, char* output, std::size_t capacity);
+
+    // appends to an existing string so callers can reuse its capacity between conversions
+    void append_utf8(std::wstring_view input, std::string& output);
+    void append_utf8(std::u16string_view input, std::string& output);
+
+    std::string to_utf8(std::wstring_view input);
+    std::string to_utf8(std::u16string_view input);
+} // !namespace util
+} // !namespace noconn
@@ -0,0 +1,366 @@
+/*
+ *
+ */
+
+#include <cctype>
+#include <fstream>
+#include <charconv>
+#include <boost/asio.hpp>
+#include <boost/json.hpp>
+#include <fmt/format.h>
+#include <whatlog/logger.hpp>
+#include "noconn/net/route_rules.hpp"
+#include "noconn/rest/client.hpp"
+#include "noconn/util/log.hpp"
+#include "noconn/aggregator.hpp"
+
+namespace noconn
+{
+    namespace
+    {
+        constexpr std::size_t table_page_size = 1000;
+        // below the agent's cap and the client's request timeout
+        constexpr std::chrono::milliseconds delta_wait(15000);
+        constexpr std::chrono::seconds retry_interval(5);
+
+        std::optional<uint64_t> json_uint(const boost::json::object& object, std::string_view name)
+        {
+            const boost::json::value* value = object.if_contains(name);
+            if (value == nullptr)
+            {
+                return std::nullopt;
+            }
+
+            boost::system::error_code error_code;
+            uint64_t result = value->to_number<uint64_t>(error_code);
+            return error_code ? std::nullopt : std::optional<uint64_t>(result);
+        }
+
+        // the agent's json route, the same fields a route command has
+        std::optional<net::route_entry> parse_route(const boost::json::value& value)
+        {
+            std::string ignored;
+            std::optional<net::route_command> command = net::parse_route_command(net::route_operation::add, value, ignored);
+            return command.has_value() ? std::optional<net::route_entry>(std::move(command->m_entry)) : std::nullopt;
+        }
+    } // !anonymous namespace
+
+    std::optional<std::vector<boost::asio::ip::tcp::endpoint>> load_agent_list(const std::string& path)
+    {
+        whatlog::logger log("load_agent_list");
+        std::ifstream file(path);
+        if (!file)
+        {
+            log.error(fmt::format("failed to open agent list \"{}\".", path));
+            return std::nullopt;
+        }
+
+        std::vector<boost::asio::ip::tcp::endpoint> result;
+        std::string line;
+        for (std::size_t line_number = 1; std::getline(file, line); ++line_number)
+        {
+            std::string_view text = line;
+            text = text.substr(0, text.find('#'));
+            while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back())))
+            {
+                text.remove_suffix(1);
+            }
+
+            while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front())))
+            {
+                text.remove_prefix(1);
+            }
+
+            if (text.empty())
+            {
+                continue;
+            }
+
+            std::size_t colon = text.rfind(':');
+            unsigned short port = 0;
+            boost::system::error_code error_code;
+            boost::asio::ip::address address;
+            if (colon != std::string_view::npos)
+            {
+                address = boost::asio::ip::make_address(std::string(text.substr(0, colon)), error_code);
+                auto [end, error] = std::from_chars(text.data() + colon + 1, text.data() + text.size(), port);
+                if (error != std::errc() || end != text.data() + text.size())
+                {
+                    port = 0;
+                }
+            }
+
+            if (colon == std::string_view::npos || error_code || port == 0)
+            {
+                log.error(fmt::format("agent list \"{}\", line {}: expected <address>:<port>.", path, line_number));
+                return std::nullopt;
+            }
+
+            result.emplace_back(address, port);
+        }
+
+        return result;
+    }
+
+    /*
+     * Follows one agent. Every step runs on m_strand (the client's strand is layered on it, so its
+     * completions do too), a step issues at most one request.
+     */
+    class aggregator::follower : public std::enable_shared_from_this<follower>
+    {
+    public:
+        follower(boost::asio::any_io_executor executor, boost::asio::ip::tcp::endpoint endpoint, net::fleet_view& view, net::agent_id agent)
+            : m_strand(boost::asio::make_strand(executor)), m_endpoint(endpoint), m_view(view), m_agent(agent), m_timer(m_strand)
+        {
+            m_client = rest::client::create(m_strand, endpoint);
+        }
+
+        void start()
+        {
+            boost::asio::post(m_strand, [self = shared_from_this()]() { self->read_table({}); });
+        }
+
+        void stop()
+        {
+            boost::asio::post(m_strand, [self = shared_from_this()]()
+                {
+                    self->m_stopped = true;
+                    self->m_timer.cancel();
+                    self->m_client->close();
+                });
+        }
+    private:
+        void read_table(std::string cursor)
+        {
+            if (cursor.empty())
+            {
+                m_following = false;
+                m_table.clear();
+                m_table_generation.reset();
+            }
+
+            std::string target = fmt::format("/my_page/inet/route?limit={}", table_page_size);
+            if (!cursor.empty())
+            {
+                target += fmt::format("&cursor={}", cursor);
+            }
+
+            send(std::move(target), [this](rest::client::response_type&& response) { on_table(std::move(response)); });
+        }
+
+        void on_table(rest::client::response_type&& response)
+        {
+            boost::system::error_code error_code;
+            boost::json::value document = boost::json::parse(response.body(), error_code);
+            const boost::json::object* object = !error_code ? document.if_object() : nullptr;
+            std::optional<uint64_t> generation = object != nullptr ? json_uint(*object, "generation") : std::nullopt;
+            const boost::json::value* routes_value = object != nullptr ? object->if_contains("routes") : nullptr;
+            const boost::json::array* routes = routes_value != nullptr ? routes_value->if_array() : nullptr;
+            if (response.result() != boost::beast::http::status::ok || !generation.has_value() || routes == nullptr)
+            {
+                retry_later(fmt::format("unexpected table response ({}).", response.result_int()));
+                return;
+            }
+
+            if (!m_table_generation.has_value())
+            {
+                m_table_generation = *generation;
+            }
+
+            for (const boost::json::value& route : *routes)
+            {
+                if (std::optional<net::route_entry> entry = parse_route(route))
+                {
+                    m_table.push_back(std::move(*entry));
+                }
+            }
+
+            const boost::json::value* next = object->if_contains("next");
+            if (next != nullptr && next->is_string())
+            {
+                const boost::json::string& cursor = next->get_string();
+                read_table(std::string(cursor.data(), cursor.size()));
+                return;
+            }
+
+            m_view.replace(m_agent, *m_table_generation, m_table);
+            m_generation = *m_table_generation;
+            m_following = true;
+            m_table.clear();
+            m_table.shrink_to_fit();
+            m_view.set_connected(m_agent, true);
+            NOCONN_LOG_INFO("aggregator::follower", "following {}:{} from generation {}.", m_endpoint.address().to_string(), m_endpoint.port(), m_generation);
+            follow();
+        }
+
+        void follow()
+        {
+            std::string target = fmt::format("/my_page/inet/route/deltas?since={}&wait={}", m_generation, delta_wait.count());
+            send(std::move(target), [this](rest::client::response_type&& response) { on_deltas(std::move(response)); });
+        }
+
+        void on_deltas(rest::client::response_type&& response)
+        {
+            if (response.result() == boost::beast::http::status::gone)
+            {
+                read_table({});
+                return;
+            }
+
+            boost::system::error_code error_code;
+            boost::json::value document = boost::json::parse(response.body(), error_code);
+            const boost::json::object* object = !error_code ? document.if_object() : nullptr;
+            const boost::json::value* sets_value = object != nullptr ? object->if_contains("deltas") : nullptr;
+            const boost::json::array* sets = sets_value != nullptr ? sets_value->if_array() : nullptr;
+            if (response.result() != boost::beast::http::status::ok || sets == nullptr)
+            {
+                retry_later(fmt::format("unexpected deltas response ({}).", response.result_int()));
+                return;
+            }
+
+            m_view.set_connected(m_agent, true);
+            std::vector<net::route_delta> deltas;
+            for (const boost::json::value& set_value : *sets)
+            {
+                const boost::json::object* set = set_value.if_object();
+                std::optional<uint64_t> generation = set != nullptr ? json_uint(*set, "generation") : std::nullopt;
+                const boost::json::value* changes_value = set != nullptr ? set->if_contains("changes") : nullptr;
+                const boost::json::array* changes = changes_value != nullptr ? changes_value->if_array() : nullptr;
+                if (!generation.has_value() || changes == nullptr)
+                {
+                    read_table({});
+                    return;
+                }
+
+                deltas.clear();
+                for (const boost::json::value& change_value : *changes)
+                {
+                    const boost::json::object* change = change_value.if_object();
+                    const boost::json::value* kind = change != nullptr ? change->if_contains("change") : nullptr;
+                    std::optional<net::route_entry> entry = parse_route(change_value);
+                    if (kind == nullptr || !kind->is_string() || !entry.has_value())
+                    {
+                        continue;
+                    }
+
+                    // the view upserts added and changed routes alike
+                    net::route_change type = kind->get_string() == "removed" ? net::route_change::removed : net::route_change::changed;
+                    deltas.push_back({ type, std::move(*entry) });
+                }
+
+                if (!m_view.apply(m_agent, *generation, deltas))
+                {
+                    // a gap, the view cannot be trusted to converge from here
+                    read_table({});
+                    return;
+                }
+
+                m_generation = *generation;
+            }
+
+            follow();
+        }
+
+        template <typename Handler>
+        void send(std::string target, Handler handler)
+        {
+            rest::client::request_type request{ boost::beast::http::verb::get, target, 11 };
+            request.set(boost::beast::http::field::host, fmt::format("{}:{}", m_endpoint.address().to_string(), m_endpoint.port()));
+            request.set(boost::beast::http::field::accept, "application/json");
+            request.keep_alive(true);
+
+            // completions run on the client's strand, which runs on ours
+            m_client->send(std::move(request), [self = shared_from_this(), handler = std::move(handler)](boost::beast::error_code error_code, rest::client::response_type&& response) mutable
+                {
+                    if (self->m_stopped)
+                    {
+                        return;
+                    }
+
+                    if (error_code)
+                    {
+                        self->retry_later(error_code.message());
+                        return;
+                    }
+
+                    handler(std::move(response));
+                });
+        }
+
+        void retry_later(const std::string& reason)
+        {
+            m_view.set_connected(m_agent, false);
+            NOCONN_LOG_WARNING("aggregator::follower", "agent {}:{} failed: {}, retrying in {}s.", m_endpoint.address().to_string(), m_endpoint.port(), reason, retry_interval.count());
+
+            m_timer.expires_after(retry_interval);
+            m_timer.async_wait([self = shared_from_this()](boost::system::error_code error_code)
+                {
+                    if (error_code || self->m_stopped)
+                    {
+                        return;
+                    }
+
+                    // the view keeps the last table, continue from it if the agent still has the deltas
+                    if (self->m_following)
+                    {
+                        self->follow();
+                    }
+                    else
+                    {
+                        self->read_table({});
+                    }
+                });
+        }
+    private:
+        boost::asio::strand<boost::asio::any_io_executor> m_strand;
+        boost::asio::ip::tcp::endpoint m_endpoint;
+        net::fleet_view& m_view;
+        net::agent_id m_agent;
+        rest::shared_client m_client;
+        boost::asio::steady_timer m_timer;
+        bool m_stopped = false;
+
+        // generation the view holds for this agent, once the table was read
+        bool m_following = false;
+        uint64_t m_generation = 0;
+        // the table being paged in, and the generation of its first page
+        std::vector<net::route_entry> m_table;
+        std::optional<uint64_t> m_table_generation;
+    };
+
+    aggregator::aggregator(std::vector<boost::asio::ip::tcp::endpoint> agents)
+        : m_agents(std::move(agents))
+    {
+        for (const boost::asio::ip::tcp::endpoint& endpoint : m_agents)
+        {
+            m_view.add_agent(fmt::format("{}:{}", endpoint.address().to_string(), endpoint.port()));
+        }
+    }
+
+    void aggregator::start(const std::vector<boost::asio::any_io_executor>& executors)
+    {
+        m_followers.reserve(m_agents.size());
+        for (std::size_t index = 0; index < m_agents.size(); ++index)
+        {
+            // ids were handed out in the same order
+            auto target = std::make_shared<follower>(executors[index % executors.size()], m_agents[index], m_view, static_cast<net::agent_id>(index));
+            target->start();
+            m_followers.push_back(std::move(target));
+        }
+    }
+
+    void aggregator::stop()
+    {
+        for (const std::shared_ptr<follower>& target : m_followers)
+        {
+            target->stop();
+        }
+
+        m_followers.clear();
+    }
+
+    const net::fleet_view& aggregator::view() const
+    {
+        return m_view;
+    }
+} // !namespace noconn
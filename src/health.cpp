@@ -0,0 +1,99 @@
+/*
+ *
+ */
+
+#include <fmt/format.h>
+#include "noconn/health.hpp"
+
+namespace noconn
+{
+    health::health()
+        : m_started(std::chrono::steady_clock::now()), m_last_beat(m_started.time_since_epoch().count())
+    {
+        // nothing for now
+    }
+
+    health::component_id health::add_component(std::string name)
+    {
+        component_state& component = m_components.emplace_back();
+        component.m_gauge = &util::metrics_registry::instance().get_gauge("noconn_ready", "1 once the inventory provider published its first scan.", fmt::format("component=\"{}\"", name));
+        component.m_name = std::move(name);
+        return m_components.size() - 1;
+    }
+
+    void health::set_ready(component_id component)
+    {
+        component_state& state = m_components[component];
+        if (state.m_ready.load(std::memory_order_acquire) || state.m_ready.exchange(true, std::memory_order_acq_rel))
+        {
+            return;
+        }
+
+        std::chrono::milliseconds ready_after = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_started);
+        state.m_ready_after_ms.store(ready_after.count(), std::memory_order_relaxed);
+        state.m_gauge->set(1);
+    }
+
+    bool health::is_ready(component_id component) const
+    {
+        return m_components[component].m_ready.load(std::memory_order_acquire);
+    }
+
+    bool health::is_ready() const
+    {
+        if (is_draining())
+        {
+            return false;
+        }
+
+        for (const component_state& component : m_components)
+        {
+            if (!component.m_ready.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void health::set_draining()
+    {
+        m_draining.store(true, std::memory_order_release);
+    }
+
+    bool health::is_draining() const
+    {
+        return m_draining.load(std::memory_order_acquire);
+    }
+
+    void health::beat()
+    {
+        m_last_beat.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    }
+
+    std::chrono::steady_clock::duration health::since_beat() const
+    {
+        std::chrono::steady_clock::time_point last_beat{ std::chrono::steady_clock::duration(m_last_beat.load(std::memory_order_relaxed)) };
+        return std::chrono::steady_clock::now() - last_beat;
+    }
+
+    std::vector<health_component> health::components() const
+    {
+        std::vector<health_component> result;
+        result.reserve(m_components.size());
+        for (const component_state& component : m_components)
+        {
+            health_component& status = result.emplace_back();
+            status.m_name = component.m_name;
+            status.m_ready = component.m_ready.load(std::memory_order_acquire);
+            int64_t ready_after = component.m_ready_after_ms.load(std::memory_order_relaxed);
+            if (ready_after >= 0)
+            {
+                status.m_ready_after = std::chrono::milliseconds(ready_after);
+            }
+        }
+
+        return result;
+    }
+} // !namespace noconn
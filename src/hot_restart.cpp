@@ -0,0 +1,485 @@
+/*
+ *
+ */
+
+#include <winsock2.h>
+#include <windows.h>
+#include <chrono>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/json.hpp>
+#include <fmt/format.h>
+#include <whatlog/logger.hpp>
+#include "noconn/hot_restart.hpp"
+
+namespace noconn
+{
+    namespace
+    {
+        // a takeover that stalls this long is abandoned, the running instance keeps serving
+        constexpr DWORD io_timeout_ms = 10000;
+        // the new instance opens its servers between receiving the sockets and confirming
+        constexpr DWORD confirm_timeout_ms = 60000;
+        // sanity limits on what the other side claims to send
+        constexpr uint32_t max_sockets = 256;
+        constexpr uint32_t max_state_size = 256 * 1024 * 1024;
+
+        class scoped_handle
+        {
+        public:
+            explicit scoped_handle(HANDLE handle)
+                : m_handle(handle)
+            {
+                // nothing for now
+            }
+
+            ~scoped_handle()
+            {
+                if (valid())
+                {
+                    CloseHandle(m_handle);
+                }
+            }
+
+            scoped_handle(const scoped_handle&) = delete;
+            scoped_handle& operator=(const scoped_handle&) = delete;
+
+            bool valid() const { return m_handle != nullptr && m_handle != INVALID_HANDLE_VALUE; }
+            HANDLE get() const { return m_handle; }
+        private:
+            HANDLE m_handle;
+        };
+
+        std::wstring pipe_name(unsigned short port)
+        {
+            return L"\\\\.\\pipe\\noconn-hot-restart-" + std::to_wstring(port);
+        }
+
+        // waits for an overlapped operation, cancels it (and waits for the cancellation, it points into
+        // our stack) if stop_event fires or the timeout expires first
+        bool wait_for(HANDLE pipe, OVERLAPPED& overlapped, HANDLE stop_event, DWORD timeout_ms)
+        {
+            HANDLE events[2] = { overlapped.hEvent, stop_event };
+            DWORD result = WaitForMultipleObjects(stop_event != nullptr ? 2 : 1, events, FALSE, timeout_ms);
+            if (result == WAIT_OBJECT_0)
+            {
+                return true;
+            }
+
+            CancelIoEx(pipe, &overlapped);
+            DWORD ignored = 0;
+            GetOverlappedResult(pipe, &overlapped, &ignored, TRUE);
+            return false;
+        }
+
+        // reads or writes exactly size bytes
+        bool transfer(HANDLE pipe, HANDLE stop_event, bool is_write, void* data, std::size_t size, DWORD timeout_ms = io_timeout_ms)
+        {
+            scoped_handle event(CreateEventW(nullptr, TRUE, FALSE, nullptr));
+            if (!event.valid())
+            {
+                return false;
+            }
+
+            char* cursor = static_cast<char*>(data);
+            while (size > 0)
+            {
+                OVERLAPPED overlapped{};
+                overlapped.hEvent = event.get();
+                DWORD chunk = static_cast<DWORD>(std::min<std::size_t>(size, 64 * 1024));
+
+                BOOL is_done = is_write ? WriteFile(pipe, cursor, chunk, nullptr, &overlapped) : ReadFile(pipe, cursor, chunk, nullptr, &overlapped);
+                if (!is_done && GetLastError() != ERROR_IO_PENDING)
+                {
+                    return false;
+                }
+
+                DWORD transferred = 0;
+                if (!wait_for(pipe, overlapped, stop_event, timeout_ms) || !GetOverlappedResult(pipe, &overlapped, &transferred, FALSE) || transferred == 0)
+                {
+                    return false;
+                }
+
+                cursor += transferred;
+                size -= transferred;
+            }
+
+            return true;
+        }
+
+        // routes and adapters as arrays of fields, the table is the bulk of the message
+        std::string serialize_state(const handoff_state& state)
+        {
+            boost::json::object json;
+            if (state.m_routes)
+            {
+                boost::json::array entries;
+                entries.reserve(state.m_routes->m_routes.size());
+                for (const net::route_entry& entry : state.m_routes->m_routes)
+                {
+                    const net::route_identifier& identifier = entry.m_identifier;
+                    entries.emplace_back(boost::json::array{ identifier.m_destination, identifier.m_mask, identifier.m_interface_index, entry.m_gateway, entry.m_metric });
+                }
+
+                json["routes"] = boost::json::object{ { "generation", state.m_routes->m_generation }, { "entries", std::move(entries) } };
+            }
+
+            if (!state.m_route_deltas.empty())
+            {
+                // the changes as [change, destination, mask, interface, gateway, metric], the time in ms
+                boost::json::array sets;
+                sets.reserve(state.m_route_deltas.size());
+                for (const net::shared_route_delta_set& set : state.m_route_deltas)
+                {
+                    boost::json::array changes;
+                    changes.reserve(set->m_deltas.size());
+                    for (const net::route_delta& delta : set->m_deltas)
+                    {
+                        const net::route_identifier& identifier = delta.m_entry.m_identifier;
+                        changes.emplace_back(boost::json::array{ static_cast<int>(delta.m_change), identifier.m_destination, identifier.m_mask, identifier.m_interface_index,
+                            delta.m_entry.m_gateway, delta.m_entry.m_metric });
+                    }
+
+                    int64_t time = std::chrono::duration_cast<std::chrono::milliseconds>(set->m_time.time_since_epoch()).count();
+                    sets.emplace_back(boost::json::object{ { "generation", set->m_generation }, { "time", time }, { "changes", std::move(changes) } });
+                }
+
+                json["route_deltas"] = std::move(sets);
+            }
+
+            if (state.m_adapters)
+            {
+                boost::json::array entries;
+                entries.reserve(state.m_adapters->m_adapters.size());
+                for (const net::network_adapter& adapter : state.m_adapters->m_adapters)
+                {
+                    entries.emplace_back(boost::json::array{ adapter.m_name, adapter.m_guid, adapter.m_description, adapter.m_type, adapter.m_adapter_index, adapter.m_enabled });
+                }
+
+                boost::json::array addresses;
+                addresses.reserve(state.m_adapters->m_addresses.size());
+                for (const net::unicast_address& address : state.m_adapters->m_addresses)
+                {
+                    addresses.emplace_back(boost::json::array{ address.m_interface_index, address.m_address, address.m_prefix_length });
+                }
+
+                json["adapters"] = boost::json::object{ { "generation", state.m_adapters->m_generation }, { "entries", std::move(entries) }, { "addresses", std::move(addresses) } };
+            }
+
+            return boost::json::serialize(json);
+        }
+
+        // leaves the snapshots empty (start cold) if anything is malformed
+        void parse_state(std::string_view text, handoff_state& state)
+        {
+            whatlog::logger log("parse_state");
+            auto to_string = [](const boost::json::value& value) { return std::string(value.as_string()); };
+
+            try
+            {
+                boost::json::value json = boost::json::parse(text);
+                const boost::json::object& root = json.as_object();
+
+                if (const boost::json::value* routes = root.if_contains("routes"))
+                {
+                    const boost::json::object& routes_object = routes->as_object();
+                    auto snapshot = std::make_shared<net::route_snapshot>();
+                    snapshot->m_generation = boost::json::value_to<uint64_t>(routes_object.at("generation"));
+                    for (const boost::json::value& entry : routes_object.at("entries").as_array())
+                    {
+                        const boost::json::array& fields = entry.as_array();
+                        snapshot->m_routes.emplace_back(to_string(fields.at(0)), to_string(fields.at(1)), boost::json::value_to<int>(fields.at(2)),
+                            to_string(fields.at(3)), boost::json::value_to<int>(fields.at(4)));
+                    }
+
+                    state.m_routes = std::move(snapshot);
+                }
+
+                // absent when handed over by a version without it, delta readers then fetch the full table
+                if (const boost::json::value* route_deltas = root.if_contains("route_deltas"))
+                {
+                    for (const boost::json::value& set : route_deltas->as_array())
+                    {
+                        const boost::json::object& set_object = set.as_object();
+                        auto deltas = std::make_shared<net::route_delta_set>();
+                        deltas->m_generation = boost::json::value_to<uint64_t>(set_object.at("generation"));
+                        deltas->m_time = std::chrono::system_clock::time_point(std::chrono::milliseconds(boost::json::value_to<int64_t>(set_object.at("time"))));
+                        for (const boost::json::value& change : set_object.at("changes").as_array())
+                        {
+                            const boost::json::array& fields = change.as_array();
+                            int kind = boost::json::value_to<int>(fields.at(0));
+                            if (kind < static_cast<int>(net::route_change::added) || kind > static_cast<int>(net::route_change::removed))
+                            {
+                                throw std::invalid_argument(fmt::format("unknown route change {}", kind));
+                            }
+
+                            deltas->m_deltas.push_back({ static_cast<net::route_change>(kind), net::route_entry(to_string(fields.at(1)), to_string(fields.at(2)),
+                                boost::json::value_to<int>(fields.at(3)), to_string(fields.at(4)), boost::json::value_to<int>(fields.at(5))), std::nullopt });
+                        }
+
+                        state.m_route_deltas.emplace_back(std::move(deltas));
+                    }
+                }
+
+                if (const boost::json::value* adapters = root.if_contains("adapters"))
+                {
+                    const boost::json::object& adapters_object = adapters->as_object();
+                    auto snapshot = std::make_shared<net::adapter_snapshot>();
+                    snapshot->m_generation = boost::json::value_to<uint64_t>(adapters_object.at("generation"));
+                    for (const boost::json::value& entry : adapters_object.at("entries").as_array())
+                    {
+                        const boost::json::array& fields = entry.as_array();
+                        snapshot->m_adapters.emplace_back(to_string(fields.at(0)), to_string(fields.at(1)), to_string(fields.at(2)), to_string(fields.at(3)),
+                            boost::json::value_to<int>(fields.at(4)), fields.at(5).as_bool());
+                    }
+
+                    // absent when handed over by a version without addresses, the first refresh adds them
+                    if (const boost::json::value* addresses = adapters_object.if_contains("addresses"))
+                    {
+                        for (const boost::json::value& entry : addresses->as_array())
+                        {
+                            const boost::json::array& fields = entry.as_array();
+                            snapshot->m_addresses.push_back({ boost::json::value_to<int>(fields.at(0)), to_string(fields.at(1)), boost::json::value_to<uint8_t>(fields.at(2)) });
+                        }
+                    }
+
+                    state.m_adapters = std::move(snapshot);
+                }
+            }
+            catch (const std::exception& ex)
+            {
+                log.warning(fmt::format("failed to read the handed over state, starting with empty snapshots. exception: {}.", ex.what()));
+                state.m_routes.reset();
+                state.m_route_deltas.clear();
+                state.m_adapters.reset();
+            }
+        }
+    } // !anonymous namespace
+
+    handoff_listener::handoff_listener(unsigned short port, state_provider provider, handed_off_handler on_handed_off)
+        :   m_port(port), m_provider(std::move(provider)), m_on_handed_off(std::move(on_handed_off)),
+            m_stop_event(CreateEventW(nullptr, TRUE, FALSE, nullptr))
+    {
+        // nothing for now
+    }
+
+    handoff_listener::~handoff_listener()
+    {
+        stop();
+        CloseHandle(m_stop_event);
+    }
+
+    void handoff_listener::start()
+    {
+        m_thread = std::thread([this]() { run(); });
+    }
+
+    void handoff_listener::stop()
+    {
+        SetEvent(m_stop_event);
+        if (m_thread.joinable() && m_thread.get_id() != std::this_thread::get_id())
+        {
+            m_thread.join();
+        }
+    }
+
+    void handoff_listener::run()
+    {
+        whatlog::rename_thread(GetCurrentThread(), "handoff");
+        whatlog::logger log("handoff_listener::run");
+        std::wstring name = pipe_name(m_port);
+        bool is_listening = false;
+
+        while (WaitForSingleObject(m_stop_event, 0) != WAIT_OBJECT_0)
+        {
+            // fails while the instance we replaced still holds the name, retry until it lets go
+            scoped_handle pipe(CreateNamedPipeW(name.c_str(), PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+                PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, 1, 64 * 1024, 64 * 1024, 0, nullptr));
+            if (!pipe.valid())
+            {
+                WaitForSingleObject(m_stop_event, 1000);
+                continue;
+            }
+
+            if (!is_listening)
+            {
+                log.info(fmt::format("accepting hot restarts for port {}.", m_port));
+                is_listening = true;
+            }
+
+            scoped_handle event(CreateEventW(nullptr, TRUE, FALSE, nullptr));
+            OVERLAPPED overlapped{};
+            overlapped.hEvent = event.get();
+            if (!ConnectNamedPipe(pipe.get(), &overlapped))
+            {
+                DWORD error = GetLastError();
+                if (error == ERROR_IO_PENDING && !wait_for(pipe.get(), overlapped, m_stop_event, INFINITE))
+                {
+                    continue;
+                }
+
+                if (error != ERROR_IO_PENDING && error != ERROR_PIPE_CONNECTED)
+                {
+                    log.error(fmt::format("failed to wait for a hot restart. error: {}.", error));
+                    continue;
+                }
+            }
+
+            log.info("a new instance is taking over.");
+            if (serve(pipe.get()))
+            {
+                log.info("the new instance is accepting, handing off.");
+                m_on_handed_off();
+
+                // the new instance waits for this before it opens the route history
+                uint8_t acknowledgement = 1;
+                if (!transfer(pipe.get(), m_stop_event, true, &acknowledgement, sizeof(acknowledgement)))
+                {
+                    log.warning("failed to acknowledge the hot restart.");
+                }
+
+                return;
+            }
+
+            log.warning("hot restart aborted, this instance keeps serving.");
+            DisconnectNamedPipe(pipe.get());
+        }
+    }
+
+    bool handoff_listener::serve(void* pipe)
+    {
+        whatlog::logger log("handoff_listener::serve");
+
+        DWORD process_id = 0;
+        if (!transfer(pipe, m_stop_event, false, &process_id, sizeof(process_id)))
+        {
+            return false;
+        }
+
+        handoff_state state = m_provider();
+        std::vector<WSAPROTOCOL_INFOW> protocol_infos(state.m_acceptors.size());
+        for (std::size_t index = 0; index < state.m_acceptors.size(); ++index)
+        {
+            // the duplicate belongs to the target process, it goes away with it if the takeover fails
+            if (WSADuplicateSocketW(static_cast<SOCKET>(state.m_acceptors[index].m_handle), process_id, &protocol_infos[index]) != 0)
+            {
+                log.error(fmt::format("failed to duplicate listening socket for process {}. error: {}.", process_id, WSAGetLastError()));
+                return false;
+            }
+        }
+
+        std::string body = serialize_state(state);
+        uint32_t socket_count = static_cast<uint32_t>(protocol_infos.size());
+        uint32_t body_size = static_cast<uint32_t>(body.size());
+        uint8_t confirmation = 0;
+
+        return transfer(pipe, m_stop_event, true, &socket_count, sizeof(socket_count)) &&
+            transfer(pipe, m_stop_event, true, protocol_infos.data(), protocol_infos.size() * sizeof(WSAPROTOCOL_INFOW)) &&
+            transfer(pipe, m_stop_event, true, &body_size, sizeof(body_size)) &&
+            transfer(pipe, m_stop_event, true, body.data(), body.size()) &&
+            transfer(pipe, m_stop_event, false, &confirmation, sizeof(confirmation), confirm_timeout_ms) &&
+            confirmation == 1;
+    }
+
+    handoff_client::handoff_client(void* pipe)
+        : m_pipe(pipe)
+    {
+        // nothing for now
+    }
+
+    handoff_client::~handoff_client()
+    {
+        CloseHandle(m_pipe);
+    }
+
+    std::unique_ptr<handoff_client> handoff_client::take_over(unsigned short port)
+    {
+        whatlog::logger log("handoff_client::take_over");
+        std::wstring name = pipe_name(port);
+
+        // asio has not necessarily initialized winsock yet, the reference is held for the process lifetime
+        WSADATA wsa_data;
+        WSAStartup(MAKEWORD(2, 2), &wsa_data);
+
+        // fails right away if no instance is listening
+        if (!WaitNamedPipeW(name.c_str(), io_timeout_ms))
+        {
+            log.info(fmt::format("no instance is serving port {}.", port));
+            return nullptr;
+        }
+
+        HANDLE pipe = CreateFileW(name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, nullptr);
+        if (pipe == INVALID_HANDLE_VALUE)
+        {
+            log.error(fmt::format("failed to connect to the running instance. error: {}.", GetLastError()));
+            return nullptr;
+        }
+
+        std::unique_ptr<handoff_client> client(new handoff_client(pipe));
+
+        DWORD process_id = GetCurrentProcessId();
+        uint32_t socket_count = 0;
+        if (!transfer(pipe, nullptr, true, &process_id, sizeof(process_id)) ||
+            !transfer(pipe, nullptr, false, &socket_count, sizeof(socket_count)) ||
+            socket_count == 0 || socket_count > max_sockets)
+        {
+            log.error("the running instance did not hand over its listening sockets.");
+            return nullptr;
+        }
+
+        std::vector<WSAPROTOCOL_INFOW> protocol_infos(socket_count);
+        uint32_t body_size = 0;
+        if (!transfer(pipe, nullptr, false, protocol_infos.data(), protocol_infos.size() * sizeof(WSAPROTOCOL_INFOW)) ||
+            !transfer(pipe, nullptr, false, &body_size, sizeof(body_size)) || body_size > max_state_size)
+        {
+            log.error("failed to receive the listening sockets.");
+            return nullptr;
+        }
+
+        std::string body(body_size, '\0');
+        if (!transfer(pipe, nullptr, false, body.data(), body.size()))
+        {
+            log.error("failed to receive the snapshots.");
+            return nullptr;
+        }
+
+        for (WSAPROTOCOL_INFOW& protocol_info : protocol_infos)
+        {
+            SOCKET socket = WSASocketW(FROM_PROTOCOL_INFO, FROM_PROTOCOL_INFO, FROM_PROTOCOL_INFO, &protocol_info, 0, WSA_FLAG_OVERLAPPED);
+            if (socket == INVALID_SOCKET)
+            {
+                log.error(fmt::format("failed to open a handed over socket. error: {}.", WSAGetLastError()));
+                for (const rest::inherited_acceptor& acceptor : client->m_state.m_acceptors)
+                {
+                    closesocket(static_cast<SOCKET>(acceptor.m_handle));
+                }
+
+                return nullptr;
+            }
+
+            boost::asio::ip::tcp protocol = protocol_info.iAddressFamily == AF_INET6 ? boost::asio::ip::tcp::v6() : boost::asio::ip::tcp::v4();
+            client->m_state.m_acceptors.push_back({ protocol, socket });
+        }
+
+        parse_state(body, client->m_state);
+        log.info(fmt::format("received {} listening sockets, routes: {}, adapters: {}.", socket_count,
+            client->m_state.m_routes ? client->m_state.m_routes->m_routes.size() : 0, client->m_state.m_adapters ? client->m_state.m_adapters->m_adapters.size() : 0));
+
+        return client;
+    }
+
+    const handoff_state& handoff_client::state() const
+    {
+        return m_state;
+    }
+
+    bool handoff_client::confirm()
+    {
+        uint8_t confirmation = 1;
+        uint8_t acknowledgement = 0;
+        return transfer(m_pipe, nullptr, true, &confirmation, sizeof(confirmation)) &&
+            transfer(m_pipe, nullptr, false, &acknowledgement, sizeof(acknowledgement)) &&
+            acknowledgement == 1;
+    }
+} // !namespace noconn
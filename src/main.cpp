@@ -4,260 +4,1409 @@
 
 #include <iostream>
 #include <string>
+#include <array>
+#include <bit>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <charconv>
+#include <fstream>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 #include <optional>
+#include <tuple>
+#include <unordered_set>
 #include <boost/version.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/asio.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/dll.hpp>
-#include <boost/signals2.hpp>
 #include <boost/json.hpp>
 #include <fmt/core.h>
 #include <whatlog/logger.hpp>
 #include "noconn/net/adapter_manager.hpp"
 #include "noconn/net/wbem_consumer.hpp"
 #include "noconn/net/route_manager.hpp"
+#include "noconn/net/route_history.hpp"
+#include "noconn/net/route_rules.hpp"
+#include "noconn/rest/cbor.hpp"
+#include "noconn/rest/query.hpp"
 #include "noconn/rest/server.hpp"
+#include "noconn/rest/shard_group.hpp"
+#include "noconn/util/log.hpp"
+#include "noconn/util/memory.hpp"
+#include "noconn/util/trace.hpp"
+#include "noconn/util/executor_lane.hpp"
+#include "noconn/aggregator.hpp"
+#include "noconn/health.hpp"
+#include "noconn/hot_restart.hpp"
+#include "noconn/options.hpp"
 
 
 namespace noconn
 {
-    struct add_route_arg
+    struct json_validator
     {
-        std::string m_address;
-        std::string m_mask;
+        enum json_response
+        {
+            invalid,
+            valid,
+            empty
+        };
+
+        // the body was already parsed (into the connection's arena) while it was read
+        json_response validate(const rest::json_body::value_type& body)
+        {
+            if (body.empty())
+            {
+                return json_response::empty;
+            }
+
+            if (!body.valid())
+            {
+                whatlog::logger log("json_validator::validate");
+                log.error(fmt::format("failed to parse message. error: {}.", body.m_error.message()));
+                return json_response::invalid;
+            }
+
+            return json_response::valid;
+        }
     };
 
-    struct rest_method
+    // pages of filtered results are capped, clients follow "next" for the rest
+    constexpr std::size_t max_page_size = 1000;
+    // operations in one route batch, all of them are applied by the engine in a single tick
+    constexpr std::size_t max_batch_operations = 256;
+    // longest a deltas request waits for the table to change, below the clients' request timeout
+    constexpr std::size_t max_delta_wait = 20000;
+
+    // bit per serializable field, in output order
+    using field_mask = uint32_t;
+    constexpr field_mask all_fields = ~field_mask(0);
+
+    constexpr std::array<std::string_view, 5> route_fields = { "destination", "mask", "gateway", "interface", "metric" };
+    constexpr std::array<std::string_view, 6> adapter_fields = { "name", "guid", "description", "type", "index", "enabled" };
+
+    // "fields=destination,gateway", empty optional on an unknown field
+    template <std::size_t count>
+    std::optional<field_mask> parse_fields(std::optional<std::string_view> text, const std::array<std::string_view, count>& fields)
     {
-        enum class type
+        if (!text.has_value())
         {
-            get,
-            post,
-            put,
-            del
-        };
+            return all_fields;
+        }
+
+        field_mask result = 0;
+        std::string_view remaining = *text;
+        while (!remaining.empty())
+        {
+            std::size_t end = remaining.find(',');
+            std::string_view name = remaining.substr(0, end);
+            remaining.remove_prefix(end == std::string_view::npos ? remaining.size() : end + 1);
+
+            auto itr_field = std::find(fields.begin(), fields.end(), name);
+            if (itr_field == fields.end())
+            {
+                return std::nullopt;
+            }
+
+            result |= field_mask(1) << (itr_field - fields.begin());
+        }
+
+        return result;
+    }
+
+    template <typename T>
+    bool parse_number(std::optional<std::string_view> text, std::optional<T>& value)
+    {
+        if (!text.has_value())
+        {
+            return true;
+        }
+
+        T result{};
+        auto [end, error] = std::from_chars(text->data(), text->data() + text->size(), result);
+        if (error != std::errc() || end != text->data() + text->size())
+        {
+            return false;
+        }
+
+        value = result;
+        return true;
+    }
+
+    // false (with the reason in error) if the query has a parameter the endpoint does not know
+    bool check_parameters(const rest::query_parameters& parameters, std::initializer_list<std::string_view> known, std::string& error)
+    {
+        for (const auto& parameter : parameters.items())
+        {
+            if (std::find(known.begin(), known.end(), parameter.first) == known.end())
+            {
+                error = fmt::format("unknown query parameter \"{}\".", parameter.first);
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    template <std::size_t count>
+    unsigned field_count(field_mask fields, const std::array<std::string_view, count>&)
+    {
+        return static_cast<unsigned>(std::popcount(fields & ((field_mask(1) << count) - 1)));
+    }
+
+    std::optional<rest::media_type> negotiate_media_type(const rest::request_context& context)
+    {
+        return rest::negotiate_media_type(context.m_request[boost::beast::http::field::accept]);
+    }
+
+    rest::http_response make_not_acceptable_response(const rest::request_context& context)
+    {
+        return rest::make_error_response(context.m_request, boost::beast::http::status::not_acceptable, "only application/json and application/cbor are available.");
+    }
+
+    // the representation depends on both Accept and Accept-Encoding
+    rest::http_response make_negotiated_response(const rest::request_context& context, rest::media_type media, const rest::cached_representation::result& body)
+    {
+        rest::http_response response = rest::make_response(context.m_request, boost::beast::http::status::ok, body, rest::to_string(media));
+        response.set(boost::beast::http::field::vary, "Accept, Accept-Encoding");
+        return response;
+    }
+
+    rest::http_response make_negotiated_response(const rest::request_context& context, rest::media_type media, std::string&& body)
+    {
+        rest::content_encoding encoding = rest::negotiate_encoding(context.m_request[boost::beast::http::field::accept_encoding]);
+        return make_negotiated_response(context, media, rest::encode_body(std::move(body), encoding));
+    }
+
+    // json-only endpoints, compressed as the client accepts but never varying on Accept
+    rest::http_response make_json_response(const rest::request_context& context, std::string&& body)
+    {
+        rest::content_encoding encoding = rest::negotiate_encoding(context.m_request[boost::beast::http::field::accept_encoding]);
+        return rest::make_response(context.m_request, boost::beast::http::status::ok, rest::encode_body(std::move(body), encoding), rest::to_string(rest::media_type::json));
+    }
+
+    boost::json::object route_entry_json(const net::route_entry& entry, field_mask fields = all_fields)
+    {
+        const net::route_identifier& identifier = entry.m_identifier;
+        boost::json::object json_value;
+        if (fields & (1u << 0)) json_value["destination"] = identifier.m_destination;
+        if (fields & (1u << 1)) json_value["mask"] = identifier.m_mask;
+        if (fields & (1u << 2)) json_value["gateway"] = entry.m_gateway;
+        if (fields & (1u << 3)) json_value["interface"] = identifier.m_interface_index;
+        if (fields & (1u << 4)) json_value["metric"] = entry.m_metric;
+        return json_value;
+    }
+
+    /*
+     * Same fields as route_entry_json, but addresses are 4-byte strings (network order) and "mask" is
+     * written as "prefix_length". The key is the one the snapshot's index already parsed.
+     */
+    void write_route_cbor(rest::cbor_writer& writer, const net::route_entry& entry, const net::route_key& key, field_mask fields = all_fields)
+    {
+        writer.begin_map(field_count(fields, route_fields));
+        if (fields & (1u << 0)) { writer.write_text("destination"); writer.write_ipv4(key.m_destination); }
+        if (fields & (1u << 1)) { writer.write_text("prefix_length"); writer.write_uint(key.m_prefix_length); }
+        if (fields & (1u << 2))
+        {
+            writer.write_text("gateway");
+            if (std::optional<uint32_t> gateway = net::parse_ipv4(entry.m_gateway))
+            {
+                writer.write_ipv4(*gateway);
+            }
+            else
+            {
+                writer.write_text(entry.m_gateway);
+            }
+        }
+        if (fields & (1u << 3)) { writer.write_text("interface"); writer.write_int(key.m_interface_index); }
+        if (fields & (1u << 4)) { writer.write_text("metric"); writer.write_int(entry.m_metric); }
+    }
+
+    boost::json::object adapter_json(const net::network_adapter& adapter, field_mask fields = all_fields)
+    {
+        boost::json::object json_value;
+        if (fields & (1u << 0)) json_value["name"] = adapter.m_name;
+        if (fields & (1u << 1)) json_value["guid"] = adapter.m_guid;
+        if (fields & (1u << 2)) json_value["description"] = adapter.m_description;
+        if (fields & (1u << 3)) json_value["type"] = adapter.m_type;
+        if (fields & (1u << 4)) json_value["index"] = adapter.m_adapter_index;
+        if (fields & (1u << 5)) json_value["enabled"] = adapter.m_enabled;
+        return json_value;
+    }
+
+    void write_adapter_cbor(rest::cbor_writer& writer, const net::network_adapter& adapter, field_mask fields = all_fields)
+    {
+        writer.begin_map(field_count(fields, adapter_fields));
+        if (fields & (1u << 0)) { writer.write_text("name"); writer.write_text(adapter.m_name); }
+        if (fields & (1u << 1)) { writer.write_text("guid"); writer.write_text(adapter.m_guid); }
+        if (fields & (1u << 2)) { writer.write_text("description"); writer.write_text(adapter.m_description); }
+        if (fields & (1u << 3)) { writer.write_text("type"); writer.write_text(adapter.m_type); }
+        if (fields & (1u << 4)) { writer.write_text("index"); writer.write_int(adapter.m_adapter_index); }
+        if (fields & (1u << 5)) { writer.write_text("enabled"); writer.write_bool(adapter.m_enabled); }
+    }
+
+    /*
+     * Hands the batch to the route engine and suspends the calling coroutine until it was committed (or
+     * refused). The engine thread only posts the result back, the coroutine resumes on its own executor.
+     */
+    boost::asio::awaitable<net::route_batch_result> submit_route_commands(net::route_manager& manager, std::vector<net::route_command> commands)
+    {
+        return boost::asio::async_initiate<const boost::asio::use_awaitable_t<>, void(net::route_batch_result)>(
+            [&manager](auto handler, std::vector<net::route_command> commands)
+            {
+                // route_batch_handler has to be copyable, the coroutine's handler is move only
+                auto shared_handler = std::make_shared<decltype(handler)>(std::move(handler));
+                manager.submit(std::move(commands), [shared_handler](net::route_batch_result result)
+                    {
+                        auto executor = boost::asio::get_associated_executor(*shared_handler);
+                        boost::asio::post(executor, [shared_handler, result = std::move(result)]() mutable { (*shared_handler)(std::move(result)); });
+                    });
+            }, boost::asio::use_awaitable, std::move(commands));
+    }
+
+    /*
+     * Runs function on the blocking lane and suspends the calling coroutine meanwhile, it resumes on its
+     * own executor with the result. Keeps disk reads and slow system calls off the network threads.
+     * What function throws is rethrown in the coroutine, never on the lane's thread.
+     */
+    template <typename Function>
+    boost::asio::awaitable<std::invoke_result_t<Function>> run_blocking(boost::asio::any_io_executor executor, Function function)
+    {
+        using result_type = std::invoke_result_t<Function>;
+        return boost::asio::async_initiate<const boost::asio::use_awaitable_t<>, void(std::exception_ptr, result_type)>(
+            [executor](auto handler, Function function)
+            {
+                boost::asio::post(executor, [handler = std::move(handler), function = std::move(function)]() mutable
+                    {
+                        std::exception_ptr exception;
+                        result_type result{};
+                        try
+                        {
+                            result = function();
+                        }
+                        catch (...)
+                        {
+                            exception = std::current_exception();
+                        }
+
+                        auto resume = boost::asio::get_associated_executor(handler);
+                        boost::asio::post(resume, [handler = std::move(handler), exception, result = std::move(result)]() mutable { handler(exception, std::move(result)); });
+                    });
+            }, boost::asio::use_awaitable, std::move(function));
+    }
+
+    std::string_view to_string(net::route_change change)
+    {
+        switch (change)
+        {
+        case net::route_change::added:
+            return "added";
+        case net::route_change::changed:
+            return "changed";
+        default:
+            return "removed";
+        }
+    }
+
+    // 503 with Retry-After while a provider's first scan is still running, rather than an empty inventory
+    rest::http_response make_not_ready_response(const rest::request_context& context, std::string_view inventory)
+    {
+        rest::http_response response = rest::make_error_response(context.m_request, boost::beast::http::status::service_unavailable, fmt::format("the {} inventory is still being read.", inventory));
+        response.set(boost::beast::http::field::retry_after, "1");
+        return response;
+    }
+
+    /*
+     * Deltas requests waiting for the table to change. Every waiter's timer runs on its connection's
+     * strand, wake_all() cancels each pending wait there and the waiter checks the generation again.
+     */
+    class delta_waiters
+    {
+    public:
+        using waiter = std::shared_ptr<boost::asio::steady_timer>;
+
+        void add(const waiter& timer)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_waiters.insert(timer);
+        }
+
+        void remove(const waiter& timer)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_waiters.erase(timer);
+        }
+
+        // any thread
+        void wake_all()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (const waiter& timer : m_waiters)
+            {
+                boost::asio::post(timer->get_executor(), [timer]() { timer->cancel(); });
+            }
+        }
+    private:
+        std::mutex m_mutex;
+        std::unordered_set<waiter> m_waiters;
+    };
+
+    struct req_handler_route
+    {
+        req_handler_route(std::shared_ptr<net::route_manager> route_manager, std::shared_ptr<net::route_history> route_history, boost::asio::any_io_executor blocking_executor,
+            boost::asio::any_io_executor events_executor, std::shared_ptr<const health> health_state, health::component_id component)
+            : m_route_manager(route_manager), m_route_history(route_history), m_blocking_executor(blocking_executor), m_health(health_state), m_component(component),
+              m_delta_waiters(std::make_shared<delta_waiters>())
+        {
+            // the snapshot is published before its delta set, woken waiters see the new generation. not on
+            // the blocking lane, wake-ups would queue behind history replays
+            m_delta_subscription = m_route_manager->events().subscribe(events_executor,
+                [waiters = m_delta_waiters](const std::vector<net::shared_route_delta_set>&, uint64_t) { waiters->wake_all(); });
+        }
+
+        rest::http_response list(const rest::request_context& context)
+        {
+            if (!m_health->is_ready(m_component))
+            {
+                return make_not_ready_response(context, "route");
+            }
+
+            rest::query_parameters parameters(context.m_query);
+            if (!parameters.empty())
+            {
+                return query(context, parameters);
+            }
+
+            net::shared_route_snapshot snapshot = m_route_manager->snapshot();
+            std::optional<rest::media_type> negotiated = negotiate_media_type(context);
+            if (!negotiated.has_value())
+            {
+                return make_not_acceptable_response(context);
+            }
+
+            rest::media_type media = *negotiated;
+            rest::content_encoding encoding = rest::negotiate_encoding(context.m_request[boost::beast::http::field::accept_encoding]);
+
+            // rendered and compressed once per routing table generation and media type, shared by every request
+            rest::cached_representation::result body = m_list_cache[static_cast<std::size_t>(media)].get(snapshot->m_generation, encoding, [&snapshot, media]()
+                {
+                    if (media == rest::media_type::cbor)
+                    {
+                        // {"generation", "routes": [...]}
+                        std::string output;
+                        output.reserve(snapshot->m_routes.size() * 64 + 32);
+                        rest::cbor_writer writer(output);
+                        writer.begin_map(2);
+                        writer.write_text("generation");
+                        writer.write_uint(snapshot->m_generation);
+                        writer.write_text("routes");
+                        writer.begin_array(snapshot->m_routes.size());
+                        for (std::size_t index = 0; index < snapshot->m_routes.size(); ++index)
+                        {
+                            write_route_cbor(writer, snapshot->m_routes[index], snapshot->m_index.key(static_cast<uint32_t>(index)));
+                        }
+
+                        return output;
+                    }
+
+                    boost::json::object json;
+                    for (std::size_t index = 0; index < snapshot->m_routes.size(); ++index)
+                    {
+                        json[fmt::format("entry_{}", index)] = route_entry_json(snapshot->m_routes[index]);
+                    }
+
+                    return boost::json::serialize(json);
+                });
+
+            return make_negotiated_response(context, media, body);
+        }
+
+        /*
+         * GET my_page/inet/route?interface=12&gateway=10.0.0.1&metric_min=0&metric_max=50&within=10.0.0.0/8
+         *     &contains=10.1.2.3&fields=destination,gateway&limit=100&cursor=<next>
+         *
+         * answered from the snapshot's indices, returns {"generation", "routes": [...], "next"}
+         */
+        rest::http_response query(const rest::request_context& context, const rest::query_parameters& parameters)
+        {
+            std::string error;
+            if (!check_parameters(parameters, { "interface", "gateway", "metric_min", "metric_max", "within", "contains", "fields", "limit", "cursor" }, error))
+            {
+                return rest::make_error_response(context.m_request, boost::beast::http::status::bad_request, error);
+            }
+
+            net::route_query route_query;
+            std::optional<std::size_t> limit;
+            if (!parse_number(parameters.get("interface"), route_query.m_interface_index) ||
+                !parse_number(parameters.get("metric_min"), route_query.m_min_metric) ||
+                !parse_number(parameters.get("metric_max"), route_query.m_max_metric) ||
+                !parse_number(parameters.get("limit"), limit))
+            {
+                return rest::make_error_response(context.m_request, boost::beast::http::status::bad_request, "invalid number in query.");
+            }
+
+            if (std::optional<std::string_view> gateway = parameters.get("gateway"))
+            {
+                route_query.m_gateway = std::string(*gateway);
+            }
+
+            if (std::optional<std::string_view> within = parameters.get("within"))
+            {
+                route_query.m_within = net::parse_ipv4_prefix(*within);
+                if (!route_query.m_within.has_value())
+                {
+                    return rest::make_error_response(context.m_request, boost::beast::http::status::bad_request, "invalid prefix in \"within\".");
+                }
+            }
+
+            if (std::optional<std::string_view> contains = parameters.get("contains"))
+            {
+                route_query.m_contains = net::parse_ipv4(*contains);
+                if (!route_query.m_contains.has_value())
+                {
+                    return rest::make_error_response(context.m_request, boost::beast::http::status::bad_request, "invalid address in \"contains\".");
+                }
+            }
+
+            if (std::optional<std::string_view> cursor = parameters.get("cursor"))
+            {
+                route_query.m_after = net::parse_cursor(*cursor);
+                if (!route_query.m_after.has_value())
+                {
+                    return rest::make_error_response(context.m_request, boost::beast::http::status::bad_request, "invalid cursor.");
+                }
+            }
+
+            std::optional<field_mask> fields = parse_fields(parameters.get("fields"), route_fields);
+            if (!fields.has_value())
+            {
+                return rest::make_error_response(context.m_request, boost::beast::http::status::bad_request, "unknown field in \"fields\".");
+            }
+
+            route_query.m_limit = std::min(limit.value_or(max_page_size), max_page_size);
+
+            net::shared_route_snapshot snapshot = m_route_manager->snapshot();
+            net::route_page page = snapshot->select(route_query);
+
+            std::optional<rest::media_type> negotiated = negotiate_media_type(context);
+            if (!negotiated.has_value())
+            {
+                return make_not_acceptable_response(context);
+            }
+
+            rest::media_type media = *negotiated;
+            if (media == rest::media_type::cbor)
+            {
+                std::string output;
+                output.reserve(page.m_positions.size() * 64 + 64);
+                rest::cbor_writer writer(output);
+                writer.begin_map(3);
+                writer.write_text("generation");
+                writer.write_uint(snapshot->m_generation);
+                writer.write_text("routes");
+                writer.begin_array(page.m_positions.size());
+                for (uint32_t position : page.m_positions)
+                {
+                    write_route_cbor(writer, snapshot->m_routes[position], snapshot->m_index.key(position), *fields);
+                }
+
+                writer.write_text("next");
+                if (page.m_next.has_value())
+                {
+                    writer.write_text(net::to_cursor(*page.m_next));
+                }
+                else
+                {
+                    writer.write_null();
+                }
+
+                return make_negotiated_response(context, media, std::move(output));
+            }
+
+            boost::json::array routes;
+            routes.reserve(page.m_positions.size());
+            for (uint32_t position : page.m_positions)
+            {
+                routes.emplace_back(route_entry_json(snapshot->m_routes[position], *fields));
+            }
+
+            boost::json::object json;
+            json["generation"] = snapshot->m_generation;
+            json["routes"] = std::move(routes);
+            json["next"] = page.m_next.has_value() ? boost::json::value(net::to_cursor(*page.m_next)) : boost::json::value(nullptr);
+            return make_negotiated_response(context, media, boost::json::serialize(json));
+        }
+
+        /*
+         * GET my_page/inet/route/deltas?since=<generation>&wait=<milliseconds>
+         *
+         * returns {"generation", "deltas": [{"generation", "time", "changes": [{"change", <route fields>}]}]},
+         * the changes that lead from since to the current table. 410 Gone if they are no longer kept, the
+         * client must fetch the full table and continue from its generation. with wait, a client that is
+         * up to date is answered once the table changes or wait ran out (empty "deltas"), which is how
+         * aggregators follow an agent.
+         */
+        boost::asio::awaitable<rest::http_response> deltas(const rest::request_context& context)
+        {
+            rest::query_parameters parameters(context.m_query);
+            std::string error;
+            if (!check_parameters(parameters, { "since", "wait" }, error))
+            {
+                co_return rest::make_error_response(context.m_request, boost::beast::http::status::bad_request, error);
+            }
+
+            std::optional<uint64_t> since;
+            if (!parse_number(parameters.get("since"), since) || !since.has_value())
+            {
+                co_return rest::make_error_response(context.m_request, boost::beast::http::status::bad_request, "\"since\" must be a generation.");
+            }
+
+            std::optional<std::size_t> wait;
+            if (!parse_number(parameters.get("wait"), wait))
+            {
+                co_return rest::make_error_response(context.m_request, boost::beast::http::status::bad_request, "\"wait\" must be milliseconds.");
+            }
+
+            if (wait.has_value() && m_route_manager->snapshot()->m_generation == *since)
+            {
+                // excluded from admission on purpose: a parked request would hold an in-flight slot for
+                // the whole wait, and its wait would count as latency and shed every other request
+                if (context.m_ticket != nullptr)
+                {
+                    context.m_ticket->exclude();
+                }
+
+                // woken by the next delta set, a waiting request costs a timer and no thread. registered
+                // before the generation is checked again, so a set published in between still wakes it
+                std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::min(*wait, max_delta_wait));
+                auto timer = std::make_shared<boost::asio::steady_timer>(co_await boost::asio::this_coro::executor, deadline);
+                m_delta_waiters->add(timer);
+                boost::system::error_code error_code;
+                while (m_route_manager->snapshot()->m_generation == *since && std::chrono::steady_clock::now() < deadline)
+                {
+                    co_await timer->async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, error_code));
+                }
+
+                m_delta_waiters->remove(timer);
+            }
 
-        using method_result_t = std::optional<type>;
+            std::optional<net::route_delta_history> history = m_route_manager->deltas_since(*since);
+            if (!history.has_value())
+            {
+                co_return rest::make_error_response(context.m_request, boost::beast::http::status::gone, "deltas since this generation are no longer available.");
+            }
+
+            auto milliseconds = [](std::chrono::system_clock::time_point time)
+            {
+                return static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count());
+            };
+
+            std::optional<rest::media_type> negotiated = negotiate_media_type(context);
+            if (!negotiated.has_value())
+            {
+                co_return make_not_acceptable_response(context);
+            }
+
+            rest::media_type media = *negotiated;
+            if (media == rest::media_type::cbor)
+            {
+                std::string output;
+                rest::cbor_writer writer(output);
+                writer.begin_map(2);
+                writer.write_text("generation");
+                writer.write_uint(history->m_generation);
+                writer.write_text("deltas");
+                writer.begin_array(history->m_sets.size());
+                for (const net::shared_route_delta_set& set : history->m_sets)
+                {
+                    writer.begin_map(3);
+                    writer.write_text("generation");
+                    writer.write_uint(set->m_generation);
+                    writer.write_text("time");
+                    writer.write_int(milliseconds(set->m_time));
+                    writer.write_text("changes");
+                    writer.begin_array(set->m_deltas.size());
+                    for (const net::route_delta& delta : set->m_deltas)
+                    {
+                        // [change, route]
+                        writer.begin_array(2);
+                        writer.write_text(to_string(delta.m_change));
+                        write_route_cbor(writer, delta.m_entry, net::make_route_key(delta.m_entry.m_identifier));
+                    }
+                }
+
+                co_return make_negotiated_response(context, media, std::move(output));
+            }
+
+            boost::json::array sets;
+            sets.reserve(history->m_sets.size());
+            for (const net::shared_route_delta_set& set : history->m_sets)
+            {
+                boost::json::array changes;
+                changes.reserve(set->m_deltas.size());
+                for (const net::route_delta& delta : set->m_deltas)
+                {
+                    boost::json::object change = route_entry_json(delta.m_entry);
+                    change["change"] = to_string(delta.m_change);
+                    changes.emplace_back(std::move(change));
+                }
+
+                boost::json::object json_set;
+                json_set["generation"] = set->m_generation;
+                json_set["time"] = milliseconds(set->m_time);
+                json_set["changes"] = std::move(changes);
+                sets.emplace_back(std::move(json_set));
+            }
+
+            boost::json::object json;
+            json["generation"] = history->m_generation;
+            json["deltas"] = std::move(sets);
+            co_return make_negotiated_response(context, media, boost::json::serialize(json));
+        }
+
+        /*
+         * GET my_page/inet/route/history?at=<milliseconds since the unix epoch>
+         *
+         * the table as it was at that time, replayed from the on-disk history:
+         * {"generation", "time" (of the last change replayed), "routes": [...]}. 404 if history is disabled or does not reach back that far.
+         */
+        boost::asio::awaitable<rest::http_response> history(const rest::request_context& context)
+        {
+            if (!m_route_history)
+            {
+                co_return rest::make_error_response(context.m_request, boost::beast::http::status::not_found, "route history is not enabled.");
+            }
+
+            rest::query_parameters parameters(context.m_query);
+            std::string error;
+            if (!check_parameters(parameters, { "at" }, error))
+            {
+                co_return rest::make_error_response(context.m_request, boost::beast::http::status::bad_request, error);
+            }
+
+            std::optional<int64_t> at;
+            if (!parse_number(parameters.get("at"), at) || !at.has_value())
+            {
+                co_return rest::make_error_response(context.m_request, boost::beast::http::status::bad_request, "\"at\" must be milliseconds since the unix epoch.");
+            }
+
+            // replaying segments reads the disk, done on the blocking lane
+            std::chrono::system_clock::time_point time{ std::chrono::milliseconds(*at) };
+            std::optional<net::route_history_state> state;
+            try
+            {
+                state = co_await run_blocking(m_blocking_executor, [route_history = m_route_history, time]() { return route_history->at(time); });
+            }
+            catch (const std::exception& ex)
+            {
+                NOCONN_LOG_ERROR("req_handler_route::history", "failed to replay the route history. exception: {}.", ex.what());
+                co_return rest::make_error_response(context.m_request, boost::beast::http::status::internal_server_error, "failed to replay the route history.");
+            }
+
+            if (!state.has_value())
+            {
+                co_return rest::make_error_response(context.m_request, boost::beast::http::status::not_found, "route history does not reach back to this time.");
+            }
+
+            std::optional<rest::media_type> negotiated = negotiate_media_type(context);
+            if (!negotiated.has_value())
+            {
+                co_return make_not_acceptable_response(context);
+            }
+
+            rest::media_type media = *negotiated;
+            const net::route_snapshot& snapshot = state->m_snapshot;
+            // the time of the last record replayed, not the one asked for
+            int64_t replayed_time = std::chrono::duration_cast<std::chrono::milliseconds>(state->m_time.time_since_epoch()).count();
+            if (media == rest::media_type::cbor)
+            {
+                std::string output;
+                output.reserve(snapshot.m_routes.size() * 64 + 64);
+                rest::cbor_writer writer(output);
+                writer.begin_map(3);
+                writer.write_text("generation");
+                writer.write_uint(snapshot.m_generation);
+                writer.write_text("time");
+                writer.write_int(replayed_time);
+                writer.write_text("routes");
+                writer.begin_array(snapshot.m_routes.size());
+                for (std::size_t index = 0; index < snapshot.m_routes.size(); ++index)
+                {
+                    write_route_cbor(writer, snapshot.m_routes[index], snapshot.m_index.key(static_cast<uint32_t>(index)));
+                }
+
+                co_return make_negotiated_response(context, media, std::move(output));
+            }
+
+            boost::json::array routes;
+            routes.reserve(snapshot.m_routes.size());
+            for (const net::route_entry& entry : snapshot.m_routes)
+            {
+                routes.emplace_back(route_entry_json(entry));
+            }
+
+            boost::json::object json;
+            json["generation"] = snapshot.m_generation;
+            json["time"] = replayed_time;
+            json["routes"] = std::move(routes);
+            co_return make_negotiated_response(context, media, boost::json::serialize(json));
+        }
+
+        /*
+         * POST my_page/inet/route adds, PUT replaces gateway and metric, DELETE removes
+         *   {"destination": "10.1.0.0", "mask": "255.255.0.0", "interface": 12, "gateway": "10.0.0.1", "metric": 25}
+         *
+         * answered once the route engine committed the change, with the first generation that has it:
+         * {"generation"}. 409 if the route exists (add) or is missing (replace, remove).
+         */
+        boost::asio::awaitable<rest::http_response> modify(const rest::request_context& context)
+        {
+            json_validator::json_response json_result = m_json_validator.validate(context.m_request.body());
+            if (json_result != json_validator::json_response::valid)
+            {
+                co_return rest::make_error_response(context.m_request, boost::beast::http::status::bad_request, "a route is required as json.");
+            }
+
+            net::route_operation operation = net::route_operation::add;
+            if (context.m_request.method() == boost::beast::http::verb::put)
+            {
+                operation = net::route_operation::replace;
+            }
+            else if (context.m_request.method() == boost::beast::http::verb::delete_)
+            {
+                operation = net::route_operation::remove;
+            }
+
+            std::string error;
+            std::optional<net::route_command> command = net::parse_route_command(operation, context.m_request.body().m_value, error);
+            if (!command.has_value())
+            {
+                co_return rest::make_error_response(context.m_request, boost::beast::http::status::bad_request, error);
+            }
+
+            std::vector<net::route_command> commands;
+            commands.push_back(std::move(*command));
+            net::route_batch_result result = co_await submit_route_commands(*m_route_manager, std::move(commands));
+            co_return make_batch_response(context, result, operation == net::route_operation::add ? boost::beast::http::status::created : boost::beast::http::status::ok);
+        }
+
+        /*
+         * POST my_page/inet/route/batch
+         *   {"operations": [{"op": "add" | "replace" | "remove", <route fields as for modify>}, ...]}
+         *
+         * applied in order and all or nothing. on failure {"generation", "error", "failed_operation"}, the
+         * index of the operation that failed.
+         */
+        boost::asio::awaitable<rest::http_response> batch(const rest::request_context& context)
+        {
+            json_validator::json_response json_result = m_json_validator.validate(context.m_request.body());
+            const boost::json::object* body = json_result == json_validator::json_response::valid ? context.m_request.body().m_value.if_object() : nullptr;
+            const boost::json::value* operations_value = body != nullptr ? body->if_contains("operations") : nullptr;
+            const boost::json::array* operations = operations_value != nullptr ? operations_value->if_array() : nullptr;
+            if (operations == nullptr || operations->empty())
+            {
+                co_return rest::make_error_response(context.m_request, boost::beast::http::status::bad_request, "\"operations\" must be a non-empty array.");
+            }
+
+            if (operations->size() > max_batch_operations)
+            {
+                co_return rest::make_error_response(context.m_request, boost::beast::http::status::bad_request, fmt::format("at most {} operations per batch.", max_batch_operations));
+            }
+
+            std::vector<net::route_command> commands;
+            commands.reserve(operations->size());
+            for (std::size_t index = 0; index < operations->size(); ++index)
+            {
+                const boost::json::object* operation_object = (*operations)[index].if_object();
+                const boost::json::value* op = operation_object != nullptr ? operation_object->if_contains("op") : nullptr;
+                const boost::json::string* op_name = op != nullptr ? op->if_string() : nullptr;
+
+                std::optional<net::route_operation> operation;
+                if (op_name != nullptr && *op_name == "add") operation = net::route_operation::add;
+                if (op_name != nullptr && *op_name == "replace") operation = net::route_operation::replace;
+                if (op_name != nullptr && *op_name == "remove") operation = net::route_operation::remove;
+
+                std::string error = "\"op\" must be add, replace or remove.";
+                std::optional<net::route_command> command = operation.has_value() ? net::parse_route_command(*operation, (*operations)[index], error) : std::nullopt;
+                if (!command.has_value())
+                {
+                    co_return rest::make_error_response(context.m_request, boost::beast::http::status::bad_request, fmt::format("operation {}: {}", index, error));
+                }
+
+                commands.push_back(std::move(*command));
+            }
+
+            net::route_batch_result result = co_await submit_route_commands(*m_route_manager, std::move(commands));
+            co_return make_batch_response(context, result, boost::beast::http::status::ok);
+        }
+
+        rest::http_response make_batch_response(const rest::request_context& context, const net::route_batch_result& result, boost::beast::http::status success)
+        {
+            boost::beast::http::status status = success;
+            boost::json::object json;
+            json["generation"] = result.m_generation;
+            switch (result.m_status)
+            {
+            case net::route_batch_status::applied:
+                break;
+            case net::route_batch_status::conflict:
+                status = boost::beast::http::status::conflict;
+                break;
+            case net::route_batch_status::failed:
+                status = boost::beast::http::status::unprocessable_entity;
+                break;
+            default:
+                status = boost::beast::http::status::service_unavailable;
+                break;
+            }
+
+            if (result.m_status != net::route_batch_status::applied)
+            {
+                json["error"] = result.m_error;
+                json["failed_operation"] = result.m_failed_command;
+            }
+
+            return rest::make_response(context.m_request, status, boost::json::serialize(json), "application/json");
+        }
+
+        std::shared_ptr<net::route_manager> m_route_manager;
+        // null when history is disabled
+        std::shared_ptr<net::route_history> m_route_history;
+        boost::asio::any_io_executor m_blocking_executor;
+        std::shared_ptr<const health> m_health;
+        health::component_id m_component;
+        // deltas requests waiting for the next generation, woken by the route event bus
+        std::shared_ptr<delta_waiters> m_delta_waiters;
+        net::route_event_bus::subscription m_delta_subscription;
+        std::array<rest::cached_representation, static_cast<std::size_t>(rest::media_type::count)> m_list_cache;
+        json_validator m_json_validator;
+    };
+
+    struct req_handler_adapter
+    {
+        req_handler_adapter(std::shared_ptr<net::adapter_manager> adapter_manager, std::shared_ptr<const health> health_state, health::component_id component)
+            : m_adapter_manager(adapter_manager), m_health(health_state), m_component(component)
+        {
+            // nothing for now
+        }
 
-        static method_result_t validate(const std::string& method)
+        rest::http_response list(const rest::request_context& context)
         {
-            method_result_t result;
+            if (!m_health->is_ready(m_component))
+            {
+                return make_not_ready_response(context, "adapter");
+            }
+
+            rest::query_parameters parameters(context.m_query);
+            if (!parameters.empty())
+            {
+                return query(context, parameters);
+            }
+
+            net::shared_adapter_snapshot snapshot = m_adapter_manager->snapshot();
+            std::optional<rest::media_type> negotiated = negotiate_media_type(context);
+            if (!negotiated.has_value())
+            {
+                return make_not_acceptable_response(context);
+            }
+
+            rest::media_type media = *negotiated;
+            rest::content_encoding encoding = rest::negotiate_encoding(context.m_request[boost::beast::http::field::accept_encoding]);
+
+            rest::cached_representation::result body = m_list_cache[static_cast<std::size_t>(media)].get(snapshot->m_generation, encoding, [&snapshot, media]()
+                {
+                    if (media == rest::media_type::cbor)
+                    {
+                        // {"generation", "adapters": [...]}
+                        std::string output;
+                        rest::cbor_writer writer(output);
+                        writer.begin_map(2);
+                        writer.write_text("generation");
+                        writer.write_uint(snapshot->m_generation);
+                        writer.write_text("adapters");
+                        writer.begin_array(snapshot->m_adapters.size());
+                        for (const net::network_adapter& adapter : snapshot->m_adapters)
+                        {
+                            write_adapter_cbor(writer, adapter);
+                        }
+
+                        return output;
+                    }
+
+                    boost::json::object json;
+                    for (std::size_t index = 0; index < snapshot->m_adapters.size(); ++index)
+                    {
+                        json[fmt::format("entry_{}", index)] = adapter_json(snapshot->m_adapters[index]);
+                    }
+
+                    return boost::json::serialize(json);
+                });
+
+            return make_negotiated_response(context, media, body);
+        }
+
+        // GET my_page/inet/adapter?interface=12&enabled=true&name=Ethernet&fields=name,index&limit=10&cursor=<next>
+        rest::http_response query(const rest::request_context& context, const rest::query_parameters& parameters)
+        {
+            std::string error;
+            if (!check_parameters(parameters, { "interface", "enabled", "name", "fields", "limit", "cursor" }, error))
+            {
+                return rest::make_error_response(context.m_request, boost::beast::http::status::bad_request, error);
+            }
+
+            net::adapter_query adapter_query;
+            std::optional<std::size_t> limit;
+            if (!parse_number(parameters.get("interface"), adapter_query.m_interface_index) ||
+                !parse_number(parameters.get("cursor"), adapter_query.m_after) ||
+                !parse_number(parameters.get("limit"), limit))
+            {
+                return rest::make_error_response(context.m_request, boost::beast::http::status::bad_request, "invalid number in query.");
+            }
 
-            std::string method_lower_case = method; 
-            boost::algorithm::to_lower(method_lower_case);
+            if (std::optional<std::string_view> enabled = parameters.get("enabled"))
+            {
+                if (*enabled != "true" && *enabled != "false")
+                {
+                    return rest::make_error_response(context.m_request, boost::beast::http::status::bad_request, "\"enabled\" must be true or false.");
+                }
 
-            if (method_lower_case == "get")
+                adapter_query.m_enabled = *enabled == "true";
+            }
+
+            if (std::optional<std::string_view> name = parameters.get("name"))
             {
-                result = type::get;
+                adapter_query.m_name = std::string(*name);
             }
-            else if (method_lower_case == "post")
+
+            std::optional<field_mask> fields = parse_fields(parameters.get("fields"), adapter_fields);
+            if (!fields.has_value())
             {
-                result = type::post;
+                return rest::make_error_response(context.m_request, boost::beast::http::status::bad_request, "unknown field in \"fields\".");
             }
-            else if (method_lower_case == "put")
+
+            adapter_query.m_limit = std::min(limit.value_or(max_page_size), max_page_size);
+
+            net::shared_adapter_snapshot snapshot = m_adapter_manager->snapshot();
+            net::adapter_page page = snapshot->select(adapter_query);
+
+            std::optional<rest::media_type> negotiated = negotiate_media_type(context);
+            if (!negotiated.has_value())
             {
-                result = type::put;
+                return make_not_acceptable_response(context);
             }
-            else if (method_lower_case == "delete")
+
+            rest::media_type media = *negotiated;
+            if (media == rest::media_type::cbor)
+            {
+                std::string output;
+                rest::cbor_writer writer(output);
+                writer.begin_map(3);
+                writer.write_text("generation");
+                writer.write_uint(snapshot->m_generation);
+                writer.write_text("adapters");
+                writer.begin_array(page.m_positions.size());
+                for (uint32_t position : page.m_positions)
+                {
+                    write_adapter_cbor(writer, snapshot->m_adapters[position], *fields);
+                }
+
+                writer.write_text("next");
+                if (page.m_next.has_value())
+                {
+                    writer.write_text(fmt::format("{}", *page.m_next));
+                }
+                else
+                {
+                    writer.write_null();
+                }
+
+                return make_negotiated_response(context, media, std::move(output));
+            }
+
+            boost::json::array adapters;
+            adapters.reserve(page.m_positions.size());
+            for (uint32_t position : page.m_positions)
+            {
+                adapters.emplace_back(adapter_json(snapshot->m_adapters[position], *fields));
+            }
+
+            boost::json::object json;
+            json["generation"] = snapshot->m_generation;
+            json["adapters"] = std::move(adapters);
+            json["next"] = page.m_next.has_value() ? boost::json::value(fmt::format("{}", *page.m_next)) : boost::json::value(nullptr);
+            return make_negotiated_response(context, media, boost::json::serialize(json));
+        }
+
+        std::shared_ptr<net::adapter_manager> m_adapter_manager;
+        std::shared_ptr<const health> m_health;
+        health::component_id m_component;
+        std::array<rest::cached_representation, static_cast<std::size_t>(rest::media_type::count)> m_list_cache;
+    };
+
+    struct req_handler_fleet
+    {
+        explicit req_handler_fleet(std::shared_ptr<aggregator> aggregator)
+            : m_aggregator(aggregator)
+        {
+            // nothing for now
+        }
+
+        /*
+         * GET my_page/fleet/route?prefix=10.0.0.0/8&gateway=10.0.0.1
+         *
+         * every aggregated agent routing exactly prefix (through gateway if given), returns
+         * {"routes": [{"agent", "generation", "interface", "gateway", "metric"}]}
+         */
+        rest::http_response routes(const rest::request_context& context)
+        {
+            if (!m_aggregator)
+            {
+                return rest::make_error_response(context.m_request, boost::beast::http::status::not_found, "not running as an aggregator.");
+            }
+
+            rest::query_parameters parameters(context.m_query);
+            std::string error;
+            if (!check_parameters(parameters, { "prefix", "gateway" }, error))
+            {
+                return rest::make_error_response(context.m_request, boost::beast::http::status::bad_request, error);
+            }
+
+            std::optional<std::string_view> prefix_text = parameters.get("prefix");
+            std::optional<net::ipv4_prefix> prefix = prefix_text.has_value() ? net::parse_ipv4_prefix(*prefix_text) : std::nullopt;
+            if (!prefix.has_value())
+            {
+                return rest::make_error_response(context.m_request, boost::beast::http::status::bad_request, "\"prefix\" must be a prefix like 10.0.0.0/8.");
+            }
+
+            std::optional<uint32_t> gateway;
+            if (std::optional<std::string_view> gateway_text = parameters.get("gateway"))
+            {
+                gateway = net::parse_ipv4(*gateway_text);
+                if (!gateway.has_value())
+                {
+                    return rest::make_error_response(context.m_request, boost::beast::http::status::bad_request, "invalid address in \"gateway\".");
+                }
+            }
+
+            std::vector<net::fleet_route_match> matches = m_aggregator->view().find(*prefix, gateway);
+            boost::json::array routes;
+            routes.reserve(matches.size());
+            for (const net::fleet_route_match& match : matches)
+            {
+                boost::json::object route;
+                route["agent"] = match.m_agent;
+                route["generation"] = match.m_generation;
+                route["interface"] = match.m_interface_index;
+                route["gateway"] = net::format_ipv4(match.m_gateway);
+                route["metric"] = match.m_metric;
+                routes.emplace_back(std::move(route));
+            }
+
+            boost::json::object json;
+            json["routes"] = std::move(routes);
+            return make_json_response(context, boost::json::serialize(json));
+        }
+
+        // GET my_page/fleet/agents, {"agents": [{"agent", "connected", "generation", "routes", "updated"}]}
+        rest::http_response agents(const rest::request_context& context)
+        {
+            if (!m_aggregator)
+            {
+                return rest::make_error_response(context.m_request, boost::beast::http::status::not_found, "not running as an aggregator.");
+            }
+
+            std::vector<net::fleet_agent_status> statuses = m_aggregator->view().agents();
+            boost::json::array agents;
+            agents.reserve(statuses.size());
+            for (const net::fleet_agent_status& status : statuses)
+            {
+                boost::json::object agent;
+                agent["agent"] = status.m_name;
+                agent["connected"] = status.m_connected;
+                agent["generation"] = status.m_generation;
+                agent["routes"] = status.m_routes;
+                agent["updated"] = static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(status.m_updated.time_since_epoch()).count());
+                agents.emplace_back(std::move(agent));
+            }
+
+            boost::json::object json;
+            json["agents"] = std::move(agents);
+            return make_json_response(context, boost::json::serialize(json));
+        }
+
+        std::shared_ptr<aggregator> m_aggregator;
+    };
+
+    struct req_handler_health
+    {
+        // the tick loop polls every 70ms, this long without a tick means it hangs
+        static constexpr std::chrono::seconds max_tick_silence{ 10 };
+
+        explicit req_handler_health(std::shared_ptr<const health> health_state)
+            : m_health(health_state)
+        {
+            // nothing for now
+        }
+
+        /*
+         * GET health/ready, 200 once every inventory provider published its first scan, 503 (with
+         * Retry-After) before that and while a replaced instance drains:
+         * {"ready", "draining", "components": [{"name", "ready", "ready_after_ms"}]}
+         */
+        rest::http_response ready(const rest::request_context& context)
+        {
+            boost::json::array components;
+            for (const health_component& component : m_health->components())
+            {
+                boost::json::object json;
+                json["name"] = component.m_name;
+                json["ready"] = component.m_ready;
+                if (component.m_ready_after.has_value())
+                {
+                    json["ready_after_ms"] = static_cast<int64_t>(component.m_ready_after->count());
+                }
+
+                components.emplace_back(std::move(json));
+            }
+
+            bool is_ready = m_health->is_ready();
+            boost::json::object json;
+            json["ready"] = is_ready;
+            json["draining"] = m_health->is_draining();
+            json["components"] = std::move(components);
+
+            rest::http_response response = rest::make_response(context.m_request, is_ready ? boost::beast::http::status::ok : boost::beast::http::status::service_unavailable, boost::json::serialize(json), "application/json");
+            if (!is_ready)
             {
-                result = type::del;
+                response.set(boost::beast::http::field::retry_after, "1");
             }
 
-            return result;
+            return response;
         }
-    };
-    
-
-    struct response
-    {
-        const static response server_error; 
-        const static response invalid_path;
-        const static response bad_request;
-        const static response invalid_rest_method;
 
-        response(int code, const std::string& message)
-            : m_code(code), m_message(message) 
+        // GET health/live, 200 while the tick loop runs, 503 once it stopped ticking: {"alive", "since_tick_ms"}
+        rest::http_response live(const rest::request_context& context)
         {
-            // nothing for now
+            std::chrono::steady_clock::duration since_beat = m_health->since_beat();
+            bool is_alive = since_beat < max_tick_silence;
+
+            boost::json::object json;
+            json["alive"] = is_alive;
+            json["since_tick_ms"] = static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(since_beat).count());
+            return rest::make_response(context.m_request, is_alive ? boost::beast::http::status::ok : boost::beast::http::status::service_unavailable, boost::json::serialize(json), "application/json");
         }
 
-        int m_code;
-        std::string m_message;
+        std::shared_ptr<const health> m_health;
     };
 
-    const response response::server_error = { 500, "server failed to handle request." };
-    const response response::invalid_path = { 404, "service requested not found." };
-    const response response::bad_request = { 400, "invalid json." };
-    const response response::invalid_rest_method = { 500, "invalid rest method." };
-
-    struct json_validator
+    struct req_handler_memory
     {
-        enum json_response
-        {
-            invalid,
-            valid,
-            empty
-        };
-
-        using optional_json_t = std::optional<boost::json::value>;
-        using json_validator_response_t = std::pair<json_response, optional_json_t>;
-
-        json_validator_response_t validate(const std::string& message)
+        /*
+         * GET debug/memory, what each subsystem's tracking resource counted:
+         * {"subsystems": [{"name", "live_bytes", "peak_bytes", "allocated_bytes", "allocations",
+         *   "budget_bytes", "over_budget", "bytes_per_second", "allocations_per_second"}]}
+         * rates are since the previous request (or the start).
+         */
+        rest::http_response memory(const rest::request_context& context)
         {
-            whatlog::logger log("json_validator::validate");
-            auto result = std::make_pair<json_response, optional_json_t>(json_response::invalid, {});
-
-            if (!message.empty())
+            constexpr std::size_t subsystem_count = static_cast<std::size_t>(util::memory_subsystem::count);
+            std::array<util::memory_usage, subsystem_count> usages;
+            for (std::size_t index = 0; index < subsystem_count; ++index)
             {
-                try
-                {
-                    auto json = boost::json::parse(message);
-                    result.first = json_response::valid;
-                    result.second = json;
+                usages[index] = util::get_memory_account(static_cast<util::memory_subsystem>(index)).usage();
+            }
 
-                }
-                catch (const std::exception& ex)
-                {
-                    // todo: log error message
-                    log.error(fmt::format("failed to parse message. error: {}.", ex.what()));
-                }
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            std::array<util::memory_usage, subsystem_count> previous;
+            std::chrono::steady_clock::time_point previous_time;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                previous = std::exchange(m_previous, usages);
+                previous_time = std::exchange(m_previous_time, now);
             }
-            else
+
+            double seconds = std::max(std::chrono::duration<double>(now - previous_time).count(), 0.001);
+            boost::json::array subsystems;
+            for (std::size_t index = 0; index < subsystem_count; ++index)
             {
-                result.first = json_response::empty;
-                result.second = boost::json::parse("{}");
+                const util::memory_usage& usage = usages[index];
+                boost::json::object json;
+                json["name"] = util::to_string(static_cast<util::memory_subsystem>(index));
+                json["live_bytes"] = usage.m_live_bytes;
+                json["peak_bytes"] = usage.m_peak_bytes;
+                json["allocated_bytes"] = usage.m_allocated_bytes;
+                json["allocations"] = usage.m_allocations;
+                json["budget_bytes"] = usage.m_budget_bytes;
+                json["over_budget"] = usage.m_budget_bytes != 0 && usage.m_live_bytes > static_cast<int64_t>(usage.m_budget_bytes);
+                json["bytes_per_second"] = static_cast<double>(usage.m_allocated_bytes - previous[index].m_allocated_bytes) / seconds;
+                json["allocations_per_second"] = static_cast<double>(usage.m_allocations - previous[index].m_allocations) / seconds;
+                subsystems.emplace_back(std::move(json));
             }
-            
 
-            return result;
+            boost::json::object json;
+            json["subsystems"] = std::move(subsystems);
+            return make_json_response(context, boost::json::serialize(json));
         }
+
+        std::mutex m_mutex;
+        std::array<util::memory_usage, static_cast<std::size_t>(util::memory_subsystem::count)> m_previous{};
+        std::chrono::steady_clock::time_point m_previous_time = std::chrono::steady_clock::now();
     };
 
-    struct path_validator
+    // routes are compiled once, before the server starts accepting connections
+    void register_routes(rest::router& router, std::shared_ptr<req_handler_route> route_handler, std::shared_ptr<req_handler_adapter> adapter_handler, std::shared_ptr<req_handler_fleet> fleet_handler,
+        std::shared_ptr<req_handler_health> health_handler, std::shared_ptr<req_handler_memory> memory_handler)
     {
-        enum path_response
-        {
-            invalid_path,
-            route_path
-        };
+        using boost::beast::http::verb;
 
-        std::array<std::string, 2> valid_paths_str{"my_page/invalid", "my_page/inet/route"};
-        std::array<path_response, 2> valid_paths_enum{path_response::invalid_path, path_response::route_path};
+        router.add("my_page/inet/adapter", verb::get,
+            [adapter_handler](const rest::request_context& context) { return adapter_handler->list(context); });
 
-        path_response validate(const std::string& path)
-        {
-            std::string path_lower_key = path;
-            std::transform(path_lower_key.begin(), path_lower_key.end(), path_lower_key.begin(),
-                [](unsigned char c) { return std::tolower(c); });
+        router.add("my_page/inet/route", verb::get,
+            [route_handler](const rest::request_context& context) { return route_handler->list(context); });
+        router.add_async("my_page/inet/route", { verb::post, verb::put, verb::delete_ },
+            [route_handler](const rest::request_context& context) { return route_handler->modify(context); });
+        router.add_async("my_page/inet/route/batch", verb::post,
+            [route_handler](const rest::request_context& context) { return route_handler->batch(context); });
+        router.add_async("my_page/inet/route/deltas", verb::get,
+            [route_handler](const rest::request_context& context) { return route_handler->deltas(context); });
+        router.add_async("my_page/inet/route/history", verb::get,
+            [route_handler](const rest::request_context& context) { return route_handler->history(context); });
 
-            if (path_lower_key == valid_paths_str[path_response::route_path])
-            {
-                return path_response::route_path;
-            }
+        router.add("my_page/fleet/route", verb::get,
+            [fleet_handler](const rest::request_context& context) { return fleet_handler->routes(context); });
+        router.add("my_page/fleet/agents", verb::get,
+            [fleet_handler](const rest::request_context& context) { return fleet_handler->agents(context); });
 
-            return path_response::invalid_path;
-        }
-    };
+        router.add("health/ready", verb::get,
+            [health_handler](const rest::request_context& context) { return health_handler->ready(context); });
+        router.add("health/live", verb::get,
+            [health_handler](const rest::request_context& context) { return health_handler->live(context); });
 
-    struct req_handler_route
+        router.add("debug/memory", verb::get,
+            [memory_handler](const rest::request_context& context) { return memory_handler->memory(context); });
+
+        // chrome trace-event json of the spans recorded since the last start, open in ui.perfetto.dev
+        router.add("debug/trace", verb::get,
+            [](const rest::request_context& context) { return make_json_response(context, util::trace::dump()); });
+        router.add("debug/trace/start", verb::post, [](const rest::request_context& context)
+            {
+                util::trace::start();
+                return rest::make_response(context.m_request, boost::beast::http::status::ok, std::string(R"({"tracing":true})"), "application/json");
+            });
+        router.add("debug/trace/stop", verb::post, [](const rest::request_context& context)
+            {
+                util::trace::stop();
+                return rest::make_response(context.m_request, boost::beast::http::status::ok, std::string(R"({"tracing":false})"), "application/json");
+            });
+    }
+
+    std::string_view to_string(net::adapter_change change)
     {
-        response handle(const boost::json::value& message)
+        switch (change)
         {
-            response result(100, "temp");
-            return result;
+        case net::adapter_change::added:
+            return "added";
+        case net::adapter_change::changed:
+            return "changed";
+        default:
+            return "removed";
         }
-    };
+    }
 
-    struct request_handler
+    // logs route and adapter changes on a worker thread, the tick thread only queues the batches
+    class route_monitor
     {
-        response handle(const std::string& path, const std::string& method, const std::string& message)
+    public:
+        route_monitor(boost::asio::any_io_executor executor, net::route_manager& route_manager, net::adapter_manager& adapter_manager)
         {
-            whatlog::logger log("test_connection::handle_data");
-
-            // validate method
-            rest_method::method_result_t method_t = rest_method::validate(method);
-            if (!method_t.has_value())
+            m_routes = route_manager.events().subscribe(executor,
+                [](const std::vector<net::shared_route_delta_set>& batches, uint64_t dropped) { on_routes(batches, dropped); });
+            m_adapters = adapter_manager.events().subscribe(executor,
+                [](const std::vector<net::adapter_event_bus::shared_batch>& batches, uint64_t dropped) { on_adapters(batches, dropped); });
+        }
+    private:
+        static void on_routes(const std::vector<net::shared_route_delta_set>& batches, uint64_t dropped)
+        {
+            whatlog::logger log("route_monitor::on_routes");
+            if (dropped > 0)
             {
-                return response::invalid_rest_method;
+                log.warning(fmt::format("fell behind, {} route delta sets were not logged.", dropped));
             }
 
-            // validate service path
-            response result = response::server_error;
-            path_validator::path_response path_result = m_path_validator.validate(path);
-            if (path_result != path_validator::path_response::invalid_path)
+            for (const net::shared_route_delta_set& batch : batches)
             {
-                // validate json
-                json_validator::json_validator_response_t json_result = m_json_validator.validate(message);
-                if (json_result.first != json_validator::json_response::invalid)
-                {
-                    // validate request
-                    switch (path_result)
-                    {
-                    case path_validator::path_response::route_path:
-                        result = m_req_handler_route.handle(json_result.second.value());
-                        break;
-                    }
-                }
-                else
+                for (const net::route_delta& delta : batch->m_deltas)
                 {
-                    // invalid json
-                    result = response::bad_request;
+                    const net::route_entry& route = delta.m_entry;
+                    log.info(fmt::format("route_{}: generation: {}, dst: {}, mask: {}, gateway: {}, if: {}, metric: {}.", to_string(delta.m_change), batch->m_generation,
+                        route.m_identifier.m_destination, route.m_identifier.m_mask, route.m_gateway, route.m_identifier.m_interface_index, route.m_metric));
                 }
             }
-            else
-            {
-                // invalid service path
-                result = response::invalid_path;
-            }
-
-            return result;
-
-            // todo? should the request handler communicate directly with the route handler?
-            // or should the action be passed to the main thread which then does the work?
-            // but then how will we respond to the request?
         }
 
-        path_validator m_path_validator;
-        json_validator m_json_validator;
-        req_handler_route m_req_handler_route;
-    };
-
-
-    struct route_monitor
-    {
-        boost::signals2::signal<void(const add_route_arg&)> m_sig_added;
-        boost::signals2::signal<void(const add_route_arg&)> m_sig_removed;
-        boost::signals2::signal<void(const add_route_arg&)> m_sig_changed;
-
-        void update()
+        static void on_adapters(const std::vector<net::adapter_event_bus::shared_batch>& batches, uint64_t dropped)
         {
-            if (true)
+            whatlog::logger log("route_monitor::on_adapters");
+            if (dropped > 0)
+            {
+                log.warning(fmt::format("fell behind, {} adapter delta sets were not logged.", dropped));
+            }
+
+            for (const net::adapter_event_bus::shared_batch& batch : batches)
             {
-                add_route_arg arg;
-                m_sig_added(arg);
+                for (const net::adapter_delta& delta : batch->m_deltas)
+                {
+                    const net::network_adapter& adapter = delta.m_adapter;
+                    log.info(fmt::format("adapter_{}: generation: {}, name: {}, index: {}, enabled: {}, guid: {}.", to_string(delta.m_change), batch->m_generation,
+                        adapter.m_name, adapter.m_adapter_index, adapter.m_enabled, adapter.m_guid));
+                }
+
+                for (const net::address_delta& delta : batch->m_address_deltas)
+                {
+                    const net::unicast_address& address = delta.m_address;
+                    log.info(fmt::format("address_{}: generation: {}, interface: {}, address: {}/{}.", to_string(delta.m_change), batch->m_generation,
+                        address.m_interface_index, address.m_address, address.m_prefix_length));
+                }
             }
         }
+    private:
+        net::route_event_bus::subscription m_routes;
+        net::adapter_event_bus::subscription m_adapters;
     };
 
-    struct test_route_handler
+    // empty optional (after logging why) if the file cannot be read or is not a valid rule set
+    std::optional<std::vector<net::route_rule>> load_route_rules(const std::string& path)
     {
-        void add_route(const add_route_arg& arg)
+        whatlog::logger log("*::load_route_rules");
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
         {
-            whatlog::logger log("test_route_handler::add_route");
-            log.info(fmt::format("adding new route {{ address: {}, mask: {} }}.", arg.m_address, arg.m_mask));
+            log.error(fmt::format("failed to open route rules \"{}\".", path));
+            return std::nullopt;
         }
-        
-        void remove_route()
-        {
 
+        std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        boost::system::error_code error_code;
+        boost::json::value document = boost::json::parse(text, error_code);
+        if (error_code)
+        {
+            log.error(fmt::format("route rules \"{}\" are not valid json: {}.", path, error_code.message()));
+            return std::nullopt;
         }
 
-        void change_route()
+        std::string error;
+        std::optional<std::vector<net::route_rule>> rules = net::parse_route_rules(document, error);
+        if (!rules.has_value())
         {
-
+            log.error(fmt::format("invalid route rules \"{}\": {}", path, error));
         }
-    };
+
+        return rules;
+    }
 
     bool initialize_console_logger()
 	{
@@ -289,13 +1438,6 @@ namespace noconn
             return;
         }
 
-        route_monitor route_monitor;
-        test_route_handler route_handler;
-        
-        route_monitor.m_sig_added.connect(std::bind(&test_route_handler::add_route, &route_handler, std::placeholders::_1));
-
-        route_monitor.update();
-
         // std::vector<noconn::network_adapter> adapters = noconn::get_network_adapters(consumer);
         // for (const noconn::network_adapter& adapter : adapters)
         // {
@@ -315,37 +1457,6 @@ namespace noconn
 
         // CreateIpForwardEntry (MIB_IPFORWARDROW)
     }
-
-    void work_handler(const std::string& thread_name, std::shared_ptr<boost::asio::io_context> io_context)
-    {
-        whatlog::rename_thread(GetCurrentThread(), thread_name);
-        whatlog::logger log("work_handler");
-        log.info(fmt::format("starting thread {}.", thread_name));
-
-        for (;;)
-        {
-            try
-            {
-                boost::system::error_code error_code;
-                io_context->run(error_code);
-
-                if (error_code)
-                {
-                    log.error(fmt::format("worker thread encountered an error. message: ", error_code.message()));
-                }
-
-                break;
-            }
-            catch (std::exception& ex)
-            {
-                log.warning(fmt::format("worker thread encountered an error. exception: {}.", std::string(ex.what())));
-            }
-            catch (...)
-            {
-                log.warning("worker thread encountered an unknown exception.");
-            }
-        }
-    }
 } // !namespace noconn
 
 int main(int argument_count, char** arguments)
@@ -360,41 +1471,406 @@ int main(int argument_count, char** arguments)
     std::cout << "current path is set to " << executable_directory << std::endl;
     whatlog::logger::initialize_file_logger(executable_directory, "noconn");
     whatlog::logger log("main");
+    // hot paths log through the facade from here on, formatted off the worker threads
+    noconn::util::log::start();
 
     log.info(fmt::format("built with [boost: {}, fmt: {}].", BOOST_LIB_VERSION, FMT_VERSION));
     
-    noconn::request_handler req_handler;
-    req_handler.handle("my_page/inet/route", "get", "");
+    std::optional<noconn::options> options = noconn::parse_options(argument_count, arguments);
+    if (!options.has_value())
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (options->m_trace)
+    {
+        noconn::util::trace::start();
+    }
+
+    for (const auto& [subsystem, budget] : options->m_memory_budgets)
+    {
+        noconn::util::get_memory_account(subsystem).set_budget(budget);
+        log.info(fmt::format("{} memory budget: {} bytes.", noconn::util::to_string(subsystem), budget));
+    }
+
+    // compiled before anything is opened, a rule set that does not load is a startup error
+    std::optional<std::vector<noconn::net::route_rule>> route_rules;
+    if (!options->m_rules_file.empty())
+    {
+        route_rules = noconn::load_route_rules(options->m_rules_file);
+        if (!route_rules.has_value())
+        {
+            return EXIT_FAILURE;
+        }
+    }
 
     // Invoke-RestMethod -Uri 'http://192.168.0.15:3031/test' -Method GET
-    const auto address = boost::asio::ip::make_address("192.168.0.15");
-    const unsigned short port = 3031;
-    const auto document_root = std::make_shared<std::string>(".");
-    
-    std::vector<std::string> thread_names = { "mercury", "venus", "earth", "mars", "jupiter" };
-    const int worker_threads_count = thread_names.size();
+    const auto address = boost::asio::ip::make_address(options->m_address);
+    const unsigned short port = options->m_port;
+    auto route_mgr = std::make_shared<noconn::net::route_manager>();
+    auto adapter_mgr = std::make_shared<noconn::net::adapter_manager>();
 
-    auto io_context = std::make_shared<boost::asio::io_context>(worker_threads_count);
-    auto work = std::make_shared<boost::asio::io_context::work>(*io_context);
-    
-    boost::thread_group worker_threads;
-    for (size_t i = 0; i < worker_threads_count; ++i)
+    // opened only once the instance we replace (if any) acknowledged the takeover, it closes its
+    // history before that
+    std::shared_ptr<noconn::net::route_history> route_history;
+    if (!options->m_history_directory.empty())
+    {
+        noconn::net::route_history_options history_options;
+        history_options.m_directory = options->m_history_directory;
+        history_options.m_retention = options->m_history_retention;
+        route_history = std::make_shared<noconn::net::route_history>(history_options);
+    }
+
+    // followed once the worker threads run, the fleet endpoints answer (with every agent disconnected) from the start
+    std::shared_ptr<noconn::aggregator> aggregator;
+    if (!options->m_agents_file.empty())
+    {
+        std::optional<std::vector<boost::asio::ip::tcp::endpoint>> agents = noconn::load_agent_list(options->m_agents_file);
+        if (!agents.has_value())
+        {
+            return EXIT_FAILURE;
+        }
+
+        aggregator = std::make_shared<noconn::aggregator>(std::move(*agents));
+    }
+
+    // network i/o, polling and blocking calls each run on their own threads (see options), so a slow
+    // enumeration or a burst of requests cannot hold the others up
+    noconn::util::executor_lane blocking_lane("blocking", options->m_blocking_lane);
+    noconn::util::executor_lane poll_lane("poll", options->m_poll_lane);
+    std::unique_ptr<noconn::util::executor_lane> io_lane;
+    blocking_lane.start();
+    poll_lane.start();
+
+    // every inventory provider turns ready with its first scan, their endpoints answer 503 until then
+    auto health = std::make_shared<noconn::health>();
+    const noconn::health::component_id routes_component = health->add_component("routes");
+    const noconn::health::component_id adapters_component = health->add_component("adapters");
+
+    auto route_handler = std::make_shared<noconn::req_handler_route>(route_mgr, route_history, blocking_lane.get_executor(), poll_lane.get_executor(), health, routes_component);
+    auto adapter_handler = std::make_shared<noconn::req_handler_adapter>(adapter_mgr, health, adapters_component);
+    auto fleet_handler = std::make_shared<noconn::req_handler_fleet>(aggregator);
+    auto health_handler = std::make_shared<noconn::req_handler_health>(health);
+    auto memory_handler = std::make_shared<noconn::req_handler_memory>();
+    auto register_routes = [route_handler, adapter_handler, fleet_handler, health_handler, memory_handler](noconn::rest::router& router)
+    {
+        noconn::register_routes(router, route_handler, adapter_handler, fleet_handler, health_handler, memory_handler);
+    };
+
+    // a replacement takes the listening sockets and the snapshots over before it opens anything
+    std::unique_ptr<noconn::handoff_client> handoff;
+    if (options->m_hot_restart)
+    {
+        handoff = noconn::handoff_client::take_over(port);
+        if (!handoff)
+        {
+            log.warning("hot restart requested but no running instance handed over, starting cold.");
+        }
+    }
+
+    if (handoff)
+    {
+        // warm from the first request, the first tick only publishes what changed since
+        if (handoff->state().m_routes)
+        {
+            route_mgr->restore(*handoff->state().m_routes, handoff->state().m_route_deltas);
+            health->set_ready(routes_component);
+        }
+
+        if (handoff->state().m_adapters)
+        {
+            adapter_mgr->restore(*handoff->state().m_adapters);
+            health->set_ready(adapters_component);
+        }
+    }
+
+    std::unique_ptr<noconn::rest::shard_group> shards;
+    noconn::rest::shared_server server;
+    bool is_open = false;
+
+    if (options->m_shards > 0)
+    {
+        // one io_context, acceptor and thread per shard
+        shards = std::make_unique<noconn::rest::shard_group>(options->m_shards);
+        std::vector<std::shared_ptr<boost::asio::io_context>> io_contexts;
+        for (size_t i = 0; i < shards->size(); ++i)
+        {
+            io_contexts.push_back(shards->get_io_context(i));
+        }
+
+        io_lane = std::make_unique<noconn::util::executor_lane>("shard", options->m_io_lane, std::move(io_contexts));
+        io_lane->start();
+
+        is_open = handoff ? shards->open(handoff->state().m_acceptors, {}, register_routes) : shards->open(address, noconn::rest::ip_port(port), {}, register_routes);
+    }
+    else
+    {
+        io_lane = std::make_unique<noconn::util::executor_lane>("io", options->m_io_lane);
+        io_lane->start();
+
+        server = noconn::rest::server::create(io_lane->get_io_context());
+        register_routes(server->get_router());
+        if (handoff)
+        {
+            const std::vector<noconn::rest::inherited_acceptor>& acceptors = handoff->state().m_acceptors;
+            is_open = acceptors.size() == 1 && server->open(acceptors.front());
+        }
+        else
+        {
+            is_open = server->open(address, noconn::rest::ip_port(port));
+        }
+    }
+
+    // stops accepting, gives open connections the drain timeout to finish, then stops the lanes
+    auto shutdown = [&]()
+    {
+        auto connection_count = [&]() { return shards ? shards->connection_count() : server->connection_count(); };
+        if (shards)
+        {
+            shards->stop();
+        }
+        else
+        {
+            server->close();
+        }
+
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + options->m_drain_timeout;
+        while (connection_count() > 0 && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+
+        if (connection_count() > 0)
+        {
+            log.warning(fmt::format("drain timed out, dropping {} connections.", connection_count()));
+        }
+
+        io_lane->stop();
+        blocking_lane.stop();
+        poll_lane.stop();
+        noconn::util::log::stop();
+    };
+
+    if (!is_open)
+    {
+        if (handoff)
+        {
+            // never confirmed, the running instance keeps serving
+            log.error("failed to accept on the handed over sockets, leaving the running instance in place.");
+        }
+        else
+        {
+            // nothing would ever be served, do not look healthy
+            log.error(fmt::format("failed to listen on {}:{}{}.", options->m_address, port, shards ? " (sharded)" : ""));
+        }
+
+        shutdown();
+        return EXIT_FAILURE;
+    }
+
+    if (handoff)
+    {
+        if (!handoff->confirm())
+        {
+            log.warning("the previous instance did not acknowledge the hot restart confirmation, it may keep accepting and recording its route history.");
+        }
+
+        handoff.reset();
+    }
+
+    if (route_history && !route_history->open())
+    {
+        // answers 404 for every time, records nothing
+        log.error("failed to open the route history, it stays disabled.");
+    }
+
+    // the next upgrade takes over from us
+    // set under stop_mutex once a new instance took over or an inventory provider failed, the adapter
+    // provider sleeps on stop_condition between refreshes
+    std::atomic<bool> is_stopping = false;
+    std::mutex stop_mutex;
+    std::condition_variable stop_condition;
+    noconn::handoff_listener handoff_listener(port,
+        [&]()
+        {
+            noconn::handoff_state state;
+            if (shards)
+            {
+                state.m_acceptors = shards->acceptors();
+            }
+            else if (std::optional<noconn::rest::inherited_acceptor> acceptor = server->acceptor())
+            {
+                state.m_acceptors.push_back(*acceptor);
+            }
+
+            // inventories still being read are read again by the successor
+            if (health->is_ready(routes_component))
+            {
+                std::tie(state.m_routes, state.m_route_deltas) = route_mgr->journal();
+            }
+
+            if (health->is_ready(adapters_component))
+            {
+                state.m_adapters = adapter_mgr->snapshot();
+            }
+
+            return state;
+        },
+        [&]()
+        {
+            health->set_draining();
+            // before the takeover is acknowledged, the new instance opens the history right after
+            if (route_history)
+            {
+                route_history->close();
+            }
+
+            std::lock_guard<std::mutex> lock(stop_mutex);
+            is_stopping = true;
+            stop_condition.notify_all();
+        }
+    );
+    handoff_listener.start();
+
+    // subscribed before the first tick, so it sees the table as it was found at start
+    boost::asio::any_io_executor monitor_executor = poll_lane.get_executor();
+    noconn::route_monitor route_monitor(monitor_executor, *route_mgr, *adapter_mgr);
+
+    if (aggregator)
+    {
+        aggregator->start(io_lane->executors());
+        log.info(fmt::format("aggregating {} agents.", aggregator->view().agents().size()));
+    }
+
+    // evaluated next to the monitor, off the tick thread. its commands are committed by a later tick
+    std::unique_ptr<noconn::net::route_rule_engine> rule_engine;
+    noconn::net::route_event_bus::subscription rule_subscription;
+    if (route_rules.has_value())
     {
-        log.info("spawning worker_thread {" + thread_names[i] + "} for boost asio.");
-        worker_threads.create_thread(boost::bind(&noconn::work_handler, thread_names[i], io_context));
+        rule_engine = std::make_unique<noconn::net::route_rule_engine>(std::move(*route_rules), *route_mgr);
+        log.info(fmt::format("loaded {} route rules.", rule_engine->size()));
+        rule_subscription = route_mgr->events().subscribe(monitor_executor,
+            [engine = rule_engine.get()](const std::vector<noconn::net::shared_route_delta_set>& batches, uint64_t dropped)
+            {
+                if (dropped > 0)
+                {
+                    NOCONN_LOG_WARNING("route_rule_engine", "rules missed {} route delta sets.", dropped);
+                }
+
+                for (const noconn::net::shared_route_delta_set& batch : batches)
+                {
+                    engine->evaluate(*batch);
+                }
+            });
     }
 
-    auto server = noconn::rest::server::create(io_context);
-    server->open(address, noconn::rest::ip_port(port));
+    // the inventory providers start together, each keeping a poll thread until a new instance takes
+    // over, and publish (and turn ready) as soon as their first scan is done. the first one to fail
+    // stops the others, main waits until all of them returned (both under stop_mutex)
+    std::size_t running_providers = 0;
+    bool has_provider_failed = false;
+    auto run_provider = [&](std::string_view name, std::function<void()> provider)
+    {
+        {
+            std::lock_guard<std::mutex> lock(stop_mutex);
+            ++running_providers;
+        }
+
+        boost::asio::post(poll_lane.get_executor(), [&, name, provider = std::move(provider)]()
+            {
+                bool is_failed = true;
+                try
+                {
+                    provider();
+                    is_failed = false;
+                }
+                catch (const std::exception& ex)
+                {
+                    log.error(fmt::format("the {} provider failed. exception: {}.", name, ex.what()));
+                }
+                catch (...)
+                {
+                    log.error(fmt::format("the {} provider failed with an unknown exception.", name));
+                }
+
+                std::lock_guard<std::mutex> lock(stop_mutex);
+                if (is_failed)
+                {
+                    has_provider_failed = true;
+                    is_stopping = true;
+                }
+
+                --running_providers;
+                stop_condition.notify_all();
+            });
+    };
+
+    run_provider("route", [&]()
+        {
+            while (!is_stopping)
+            {
+                route_mgr->tick();
+                health->beat();
+                health->set_ready(routes_component);
+                if (route_history)
+                {
+                    route_history->record(*route_mgr);
+                }
+
+                // polls the table every 70ms, commands queued meanwhile are committed together on the next
+                // tick. by time, route commands make ticks come early.
+                route_mgr->wait_for_commands(std::chrono::milliseconds(70));
+            }
+        });
+
+    run_provider("adapter", [&]()
+        {
+            // COM is initialized for the thread that creates the consumer, adapters are refreshed from this thread only
+            noconn::net::shared_wbem_consumer consumer = noconn::net::wbem_consumer::get_consumer();
+            if (!consumer)
+            {
+                // an empty inventory is all there will be
+                log.error("failed to create wbem consumer, adapter inventory disabled.");
+                health->set_ready(adapters_component);
+                return;
+            }
+
+            // WMI queries are slow, refresh the adapter inventory far less often than the routing table
+            const std::chrono::steady_clock::duration adapter_refresh_interval = std::chrono::seconds(5);
+            std::unique_lock<std::mutex> lock(stop_mutex);
+            while (!is_stopping)
+            {
+                lock.unlock();
+                adapter_mgr->refresh(consumer);
+                health->set_ready(adapters_component);
+                lock.lock();
+
+                stop_condition.wait_for(lock, adapter_refresh_interval, [&is_stopping]() { return is_stopping.load(); });
+            }
+        });
+
+    {
+        std::unique_lock<std::mutex> lock(stop_mutex);
+        stop_condition.wait(lock, [&running_providers]() { return running_providers == 0; });
+    }
 
-    noconn::net::route_manager route_mgr;
+    if (has_provider_failed)
+    {
+        log.error("an inventory provider failed, draining connections.");
+    }
+    else
+    {
+        log.info("a new instance took over, draining connections.");
+    }
 
-    while (true)
+    route_mgr->cancel_commands();
+    if (aggregator)
     {
-        route_mgr.tick();
-        // never ending loop
-        std::this_thread::sleep_for(std::chrono::milliseconds(70));
+        aggregator->stop();
     }
 
-    return EXIT_SUCCESS;
+    handoff_listener.stop();
+    shutdown();
+
+    return has_provider_failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -8,10 +8,12 @@
 #include <Wbemidl.h>
 #include <iphlpapi.h>
 #include <vector>
-#include <locale>
-#include <codecvt>
+#include <numeric>
+#include <algorithm>
 #include <fmt/format.h>
 #include <whatlog/logger.hpp>
+#include "noconn/util/utf.hpp"
+#include "noconn/util/trace.hpp"
 #include "noconn/net/wbem_consumer.hpp"
 #include "noconn/net/adapter_manager.hpp"
 
@@ -21,6 +23,66 @@ namespace net
 {
     namespace
     {
+        // reads a BSTR property straight into output without an intermediate std::wstring
+        HRESULT get_string_property(IWbemClassObject* object, const wchar_t* name, std::string& output)
+        {
+            VARIANT property;
+            VariantInit(&property);
+            HRESULT result = object->Get(name, 0, &property, 0, 0);
+            if (FAILED(result))
+            {
+                // nothing was written to the variant, there is nothing to clear
+                return result;
+            }
+
+            if (property.vt == VT_BSTR && property.bstrVal != nullptr)
+            {
+                util::append_utf8(std::wstring_view(property.bstrVal, SysStringLen(property.bstrVal)), output);
+            }
+
+            VariantClear(&property);
+            return result;
+        }
+
+        // output is left alone if the property is null or of another type
+        HRESULT get_int_property(IWbemClassObject* object, const wchar_t* name, int& output)
+        {
+            VARIANT property;
+            VariantInit(&property);
+            HRESULT result = object->Get(name, 0, &property, 0, 0);
+            if (FAILED(result))
+            {
+                return result;
+            }
+
+            if (property.vt == VT_I4)
+            {
+                output = property.intVal;
+            }
+
+            VariantClear(&property);
+            return result;
+        }
+
+        HRESULT get_bool_property(IWbemClassObject* object, const wchar_t* name, bool& output)
+        {
+            VARIANT property;
+            VariantInit(&property);
+            HRESULT result = object->Get(name, 0, &property, 0, 0);
+            if (FAILED(result))
+            {
+                return result;
+            }
+
+            if (property.vt == VT_BOOL)
+            {
+                output = property.boolVal != VARIANT_FALSE;
+            }
+
+            VariantClear(&property);
+            return result;
+        }
+
         void list_adapter_ip_addresses()
         {
             whatlog::logger log("list_adapter_ip_addresses");
@@ -135,7 +197,6 @@ namespace net
 
             std::vector<network_adapter> result;
             std::wstring query = L"SELECT * FROM Win32_NetworkAdapter";
-            std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> converter;
             IEnumWbemClassObject* pEnumerator = consumer->exec_query(query);
             if (pEnumerator != nullptr)
             {
@@ -151,31 +212,29 @@ namespace net
                         break;
                     }
 
-                    VARIANT vtProp;
-                    HRESULT hr_guid = pclsObj->Get(L"GUID", 0, &vtProp, 0, 0);
+                    std::string guid;
+                    HRESULT hr_guid = get_string_property(pclsObj, L"GUID", guid);
                     // only list adapters with a valid GUID
-                    if (vtProp.pbstrVal != nullptr)
+                    if (!guid.empty())
                     {
-                        std::wstring guid = vtProp.bstrVal;
-
-                        HRESULT hr_name = pclsObj->Get(L"Name", 0, &vtProp, 0, 0);
-                        std::wstring name = vtProp.bstrVal;
+                        std::string name;
+                        HRESULT hr_name = get_string_property(pclsObj, L"Name", name);
 
-                        HRESULT hr_desc = pclsObj->Get(L"Description", 0, &vtProp, 0, 0);
-                        std::wstring desc = vtProp.bstrVal;
+                        std::string desc;
+                        HRESULT hr_desc = get_string_property(pclsObj, L"Description", desc);
 
-                        HRESULT hr_adapter_type = pclsObj->Get(L"AdapterType", 0, &vtProp, 0, 0);
-                        std::wstring adapter_type = L"[UNAVAILABLE]";
-                        if (vtProp.pbstrVal != nullptr)
+                        std::string adapter_type;
+                        HRESULT hr_adapter_type = get_string_property(pclsObj, L"AdapterType", adapter_type);
+                        if (adapter_type.empty())
                         {
-                            adapter_type = vtProp.bstrVal;
+                            adapter_type = "[UNAVAILABLE]";
                         }
 
-                        HRESULT hr_interface_index = pclsObj->Get(L"InterfaceIndex", 0, &vtProp, 0, 0);
-                        int index = vtProp.intVal;
+                        int index = 0;
+                        HRESULT hr_interface_index = get_int_property(pclsObj, L"InterfaceIndex", index);
 
-                        HRESULT hr_enabled = pclsObj->Get(L"NetEnabled", 0, &vtProp, 0, 0);
-                        bool enabled = vtProp.boolVal;
+                        bool enabled = false;
+                        HRESULT hr_enabled = get_bool_property(pclsObj, L"NetEnabled", enabled);
 
                         if (SUCCEEDED(hr_guid) &&
                             SUCCEEDED(hr_name) &&
@@ -184,15 +243,11 @@ namespace net
                             SUCCEEDED(hr_interface_index) &&
                             SUCCEEDED(hr_enabled))
                         {
-
-                            noconn::net::network_adapter adapter(converter.to_bytes(name), converter.to_bytes(guid),
-                                converter.to_bytes(desc), converter.to_bytes(adapter_type), index, enabled);
-
+                            noconn::net::network_adapter adapter(name, guid, desc, adapter_type, index, enabled);
                             result.emplace_back(std::move(adapter));
                         }
                     }
 
-                    VariantClear(&vtProp);
                     pclsObj->Release();
                 }
 
@@ -200,12 +255,63 @@ namespace net
             }
             else
             {
-                std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> converter;
-                log.error(fmt::format("failed to execute query \"{}\".", converter.to_bytes(query)));
+                log.error(fmt::format("failed to execute query \"{}\".", util::to_utf8(query)));
             }
 
             return result;
         }
+
+        // ipv4 unicast addresses of every adapter, sorted by interface index and address. empty optional
+        // (after logging why) if they could not be read
+        std::optional<std::vector<unicast_address>> get_unicast_addresses()
+        {
+            whatlog::logger log("get_unicast_addresses");
+            ULONG flags = GAA_FLAG_SKIP_ANYCAST | GAA_FLAG_SKIP_MULTICAST | GAA_FLAG_SKIP_DNS_SERVER | GAA_FLAG_SKIP_FRIENDLY_NAME;
+
+            // the buffer size microsoft recommends, retried if adapters were added between the calls
+            std::vector<unsigned char> buffer(15 * 1024);
+            ULONG size = static_cast<ULONG>(buffer.size());
+            ULONG status = ERROR_BUFFER_OVERFLOW;
+            for (int attempt = 0; attempt < 3 && status == ERROR_BUFFER_OVERFLOW; ++attempt)
+            {
+                buffer.resize(size);
+                status = GetAdaptersAddresses(AF_INET, flags, nullptr, reinterpret_cast<PIP_ADAPTER_ADDRESSES>(buffer.data()), &size);
+            }
+
+            std::vector<unicast_address> result;
+            if (status == ERROR_NO_DATA)
+            {
+                return result;
+            }
+
+            if (status != NO_ERROR)
+            {
+                log.error(fmt::format("call to GetAdaptersAddresses failed with error: {}.", status));
+                return std::nullopt;
+            }
+
+            for (PIP_ADAPTER_ADDRESSES adapter = reinterpret_cast<PIP_ADAPTER_ADDRESSES>(buffer.data()); adapter != nullptr; adapter = adapter->Next)
+            {
+                for (PIP_ADAPTER_UNICAST_ADDRESS address = adapter->FirstUnicastAddress; address != nullptr; address = address->Next)
+                {
+                    if (address->Address.lpSockaddr->sa_family != AF_INET)
+                    {
+                        continue;
+                    }
+
+                    const sockaddr_in* ipv4 = reinterpret_cast<const sockaddr_in*>(address->Address.lpSockaddr);
+                    result.push_back({ static_cast<int>(adapter->IfIndex), inet_ntoa(ipv4->sin_addr), address->OnLinkPrefixLength });
+                }
+            }
+
+            std::sort(result.begin(), result.end(), [](const unicast_address& lhs, const unicast_address& rhs)
+                {
+                    using traits = util::table_traits<unicast_address>;
+                    return traits::key(lhs) < traits::key(rhs);
+                });
+
+            return result;
+        }
     } // !anonymous namespace 
     network_adapter::network_adapter(const std::string& name, const std::string& guid,
         const std::string& description, const std::string& adapter_type, int adapter_index, bool enabled)
@@ -213,5 +319,138 @@ namespace net
     {
         // nothing for now
     }
+
+    bool operator==(const network_adapter& lhs, const network_adapter& rhs)
+    {
+        return lhs.m_guid == rhs.m_guid &&
+            lhs.m_name == rhs.m_name &&
+            lhs.m_description == rhs.m_description &&
+            lhs.m_type == rhs.m_type &&
+            lhs.m_adapter_index == rhs.m_adapter_index &&
+            lhs.m_enabled == rhs.m_enabled;
+    }
+
+    std::size_t unicast_address_key_hash::operator()(const unicast_address_key& key) const
+    {
+        return std::hash<std::string_view>()(key.m_address) ^ (static_cast<std::size_t>(static_cast<uint32_t>(key.m_interface_index)) * 0x9e3779b97f4a7c15ull);
+    }
+
+    adapter_page adapter_snapshot::select(const adapter_query& query) const
+    {
+        auto index_of = [this](uint32_t position) { return m_adapters[position].m_adapter_index; };
+        auto begin = m_by_index.begin();
+        auto end = m_by_index.end();
+
+        if (query.m_interface_index.has_value())
+        {
+            begin = std::lower_bound(begin, end, *query.m_interface_index, [&](uint32_t position, int value) { return index_of(position) < value; });
+            end = std::upper_bound(begin, end, *query.m_interface_index, [&](int value, uint32_t position) { return value < index_of(position); });
+        }
+
+        if (query.m_after.has_value())
+        {
+            begin = std::upper_bound(begin, end, *query.m_after, [&](int value, uint32_t position) { return value < index_of(position); });
+        }
+
+        adapter_page result;
+        for (auto itr = begin; itr != end && query.m_limit != 0; ++itr)
+        {
+            const network_adapter& adapter = m_adapters[*itr];
+            if ((query.m_enabled.has_value() && adapter.m_enabled != *query.m_enabled) || (query.m_name.has_value() && adapter.m_name != *query.m_name))
+            {
+                continue;
+            }
+
+            if (result.m_positions.size() == query.m_limit)
+            {
+                result.m_next = index_of(result.m_positions.back());
+                break;
+            }
+
+            result.m_positions.push_back(*itr);
+        }
+
+        return result;
+    }
+
+    adapter_manager::adapter_manager()
+        : m_snapshot(util::make_tracked_shared<adapter_snapshot>(util::memory_subsystem::adapters))
+    {
+        // nothing for now
+    }
+
+    void adapter_manager::refresh(shared_wbem_consumer consumer)
+    {
+        NOCONN_TRACE_SPAN("adapter_manager::refresh");
+        std::vector<network_adapter> adapters = get_network_adapters(consumer);
+
+        shared_adapter_snapshot current = snapshot();
+        std::optional<std::vector<unicast_address>> addresses = get_unicast_addresses();
+        if (!addresses.has_value())
+        {
+            // keep the last known addresses rather than report them all removed
+            addresses.emplace(current->m_addresses.begin(), current->m_addresses.end());
+        }
+
+        auto delta_set = std::make_shared<adapter_delta_set>();
+        m_differ.diff(current->m_adapters, adapters, [&delta_set](util::table_change change, const network_adapter& adapter, const network_adapter*)
+            {
+                delta_set->m_deltas.push_back({ static_cast<adapter_change>(change), adapter });
+            });
+        address_differ::diff_sorted(current->m_addresses, *addresses, [&delta_set](util::table_change change, const unicast_address& address, const unicast_address*)
+            {
+                delta_set->m_address_deltas.push_back({ static_cast<adapter_change>(change), address });
+            });
+
+        bool is_changed = !delta_set->m_deltas.empty() || !delta_set->m_address_deltas.empty();
+        if (current->m_generation != 0 && !is_changed)
+        {
+            return;
+        }
+
+        delta_set->m_generation = current->m_generation + 1;
+        delta_set->m_time = std::chrono::system_clock::now();
+        publish(std::move(adapters), std::move(*addresses), delta_set->m_generation);
+        // a first refresh that finds no adapters publishes generation 1 with nothing to tell
+        if (is_changed)
+        {
+            m_events.publish(std::move(delta_set));
+        }
+    }
+
+    void adapter_manager::restore(const adapter_snapshot& snapshot)
+    {
+        publish(std::vector<network_adapter>(snapshot.m_adapters.begin(), snapshot.m_adapters.end()),
+            std::vector<unicast_address>(snapshot.m_addresses.begin(), snapshot.m_addresses.end()), snapshot.m_generation);
+    }
+
+    void adapter_manager::publish(std::vector<network_adapter> adapters, std::vector<unicast_address> addresses, uint64_t generation)
+    {
+        auto next = util::make_tracked_shared<adapter_snapshot>(util::memory_subsystem::adapters);
+        next->m_adapters.assign(std::make_move_iterator(adapters.begin()), std::make_move_iterator(adapters.end()));
+        next->m_addresses.assign(std::make_move_iterator(addresses.begin()), std::make_move_iterator(addresses.end()));
+        next->m_generation = generation;
+
+        next->m_by_index.resize(next->m_adapters.size());
+        std::iota(next->m_by_index.begin(), next->m_by_index.end(), 0u);
+        std::sort(next->m_by_index.begin(), next->m_by_index.end(), [&next](uint32_t lhs, uint32_t rhs)
+            {
+                return next->m_adapters[lhs].m_adapter_index < next->m_adapters[rhs].m_adapter_index;
+            });
+
+        std::lock_guard<std::mutex> lock(m_snapshot_mutex);
+        m_snapshot = std::move(next);
+    }
+
+    shared_adapter_snapshot adapter_manager::snapshot() const
+    {
+        std::lock_guard<std::mutex> lock(m_snapshot_mutex);
+        return m_snapshot;
+    }
+
+    adapter_event_bus& adapter_manager::events()
+    {
+        return m_events;
+    }
 } // !namespace net
 } // !namespace noconn
\ No newline at end of file
@@ -0,0 +1,182 @@
+/*
+ *
+ */
+
+#include <iterator>
+#include <algorithm>
+#include "noconn/net/fleet_view.hpp"
+
+namespace noconn
+{
+namespace net
+{
+    agent_id fleet_view::add_agent(std::string name)
+    {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        m_agents.emplace_back();
+        m_agents.back().m_status.m_name = std::move(name);
+        return static_cast<agent_id>(m_agents.size() - 1);
+    }
+
+    void fleet_view::replace(agent_id agent, uint64_t generation, const std::vector<route_entry>& routes)
+    {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        agent_state& state = m_agents[agent];
+        std::vector<route_key> previous;
+        previous.reserve(state.m_routes.size());
+        for (const auto& [key, value] : state.m_routes)
+        {
+            previous.push_back(key);
+        }
+
+        for (const route_key& key : previous)
+        {
+            erase(agent, key);
+        }
+
+        for (const route_entry& entry : routes)
+        {
+            upsert(agent, entry);
+        }
+
+        state.m_status.m_generation = generation;
+        state.m_status.m_routes = state.m_routes.size();
+        state.m_status.m_updated = std::chrono::system_clock::now();
+    }
+
+    bool fleet_view::apply(agent_id agent, uint64_t generation, const std::vector<route_delta>& deltas)
+    {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        agent_state& state = m_agents[agent];
+        if (generation != state.m_status.m_generation + 1)
+        {
+            return false;
+        }
+
+        for (const route_delta& delta : deltas)
+        {
+            if (delta.m_change == route_change::removed)
+            {
+                erase(agent, make_route_key(delta.m_entry.m_identifier));
+            }
+            else
+            {
+                upsert(agent, delta.m_entry);
+            }
+        }
+
+        state.m_status.m_generation = generation;
+        state.m_status.m_routes = state.m_routes.size();
+        state.m_status.m_updated = std::chrono::system_clock::now();
+        return true;
+    }
+
+    void fleet_view::set_connected(agent_id agent, bool connected)
+    {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        m_agents[agent].m_status.m_connected = connected;
+    }
+
+    std::vector<fleet_route_match> fleet_view::find(ipv4_prefix prefix, std::optional<uint32_t> gateway) const
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        std::vector<fleet_route_match> result;
+        auto bucket = m_by_prefix.find(prefix_key(prefix.m_address, prefix.m_length));
+        if (bucket == m_by_prefix.end())
+        {
+            return result;
+        }
+
+        std::vector<fleet_route> routes;
+        std::copy_if(bucket->second.begin(), bucket->second.end(), std::back_inserter(routes),
+            [&gateway](const fleet_route& route) { return !gateway.has_value() || route.m_gateway == *gateway; });
+        std::sort(routes.begin(), routes.end(), [](const fleet_route& lhs, const fleet_route& rhs)
+            {
+                return lhs.m_agent != rhs.m_agent ? lhs.m_agent < rhs.m_agent : lhs.m_interface_index < rhs.m_interface_index;
+            });
+
+        result.reserve(routes.size());
+        for (const fleet_route& route : routes)
+        {
+            const fleet_agent_status& status = m_agents[route.m_agent].m_status;
+            result.push_back({ status.m_name, status.m_generation, route.m_interface_index, route.m_gateway, route.m_metric });
+        }
+
+        return result;
+    }
+
+    std::vector<fleet_agent_status> fleet_view::agents() const
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        std::vector<fleet_agent_status> result;
+        result.reserve(m_agents.size());
+        for (const agent_state& state : m_agents)
+        {
+            result.push_back(state.m_status);
+        }
+
+        return result;
+    }
+
+    uint64_t fleet_view::prefix_key(uint32_t destination, uint8_t prefix_length)
+    {
+        return (uint64_t(destination) << 8) | prefix_length;
+    }
+
+    void fleet_view::upsert(agent_id agent, const route_entry& entry)
+    {
+        route_key key = make_route_key(entry.m_identifier);
+        uint32_t gateway = parse_ipv4(entry.m_gateway).value_or(0);
+        std::vector<fleet_route>& holders = m_by_prefix[prefix_key(key.m_destination, key.m_prefix_length)];
+
+        auto [itr_route, is_added] = m_agents[agent].m_routes.try_emplace(key);
+        route_value& value = itr_route->second;
+        value.m_gateway = gateway;
+        value.m_metric = entry.m_metric;
+        if (is_added)
+        {
+            value.m_slot = holders.size();
+            holders.push_back({ agent, key.m_interface_index, gateway, entry.m_metric });
+        }
+        else
+        {
+            holders[value.m_slot].m_gateway = gateway;
+            holders[value.m_slot].m_metric = entry.m_metric;
+        }
+    }
+
+    void fleet_view::erase(agent_id agent, const route_key& key)
+    {
+        std::unordered_map<route_key, route_value, route_key_hash>& routes = m_agents[agent].m_routes;
+        auto itr_route = routes.find(key);
+        if (itr_route == routes.end())
+        {
+            return;
+        }
+
+        std::size_t slot = itr_route->second.m_slot;
+        routes.erase(itr_route);
+
+        auto bucket = m_by_prefix.find(prefix_key(key.m_destination, key.m_prefix_length));
+        if (bucket == m_by_prefix.end())
+        {
+            return;
+        }
+
+        // order within a bucket does not matter (find() sorts what it returns), the last route moves
+        // into the gap and its owner learns the new position
+        std::vector<fleet_route>& holders = bucket->second;
+        if (slot + 1 != holders.size())
+        {
+            const fleet_route& moved = holders[slot] = holders.back();
+            m_agents[moved.m_agent].m_routes.at(route_key{ key.m_destination, key.m_prefix_length, moved.m_interface_index }).m_slot = slot;
+        }
+
+        holders.pop_back();
+        if (holders.empty())
+        {
+            m_by_prefix.erase(bucket);
+        }
+    }
+} // !namespace net
+} // !namespace noconn
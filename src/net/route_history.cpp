@@ -0,0 +1,569 @@
+/*
+ *
+ */
+
+#include <map>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <charconv>
+#include <algorithm>
+#include <system_error>
+#include <zlib.h>
+#include <fmt/format.h>
+#include <whatlog/logger.hpp>
+#include "noconn/net/route_history.hpp"
+
+namespace noconn
+{
+namespace net
+{
+    namespace
+    {
+        // "ncnridx1"
+        constexpr uint64_t index_magic = 0x3178646972636e6e;
+        constexpr std::size_t initial_index_capacity = 4096;
+
+        constexpr uint32_t record_checkpoint = 1;
+        constexpr uint32_t record_deltas = 2;
+
+        // destination, mask, gateway, interface, metric
+        constexpr std::size_t route_size = 20;
+        // change, route
+        constexpr std::size_t delta_size = 1 + route_size;
+        // larger than any table we expect, keeps a corrupt size from allocating gigabytes
+        constexpr uint32_t max_record_size = 256 * 1024 * 1024;
+
+        // written as is, little endian like every host the service runs on
+        struct record_header
+        {
+            // payload bytes
+            uint32_t m_size;
+            // crc32 of the fields after this one and the payload
+            uint32_t m_checksum;
+            // milliseconds since the unix epoch
+            int64_t m_time;
+            uint64_t m_generation;
+            uint32_t m_type;
+            // routes in a checkpoint, deltas in a delta set
+            uint32_t m_count;
+        };
+
+        static_assert(sizeof(record_header) == 32);
+
+        int64_t to_milliseconds(std::chrono::system_clock::time_point time)
+        {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+        }
+
+        template <typename T>
+        void put(std::string& output, T value)
+        {
+            char bytes[sizeof(T)];
+            std::memcpy(bytes, &value, sizeof(T));
+            output.append(bytes, sizeof(T));
+        }
+
+        template <typename T>
+        T get(const char*& input)
+        {
+            T value;
+            std::memcpy(&value, input, sizeof(T));
+            input += sizeof(T);
+            return value;
+        }
+
+        void put_route(std::string& output, const route_entry& entry)
+        {
+            put<uint32_t>(output, parse_ipv4(entry.m_identifier.m_destination).value_or(0));
+            put<uint32_t>(output, parse_ipv4(entry.m_identifier.m_mask).value_or(0));
+            put<uint32_t>(output, parse_ipv4(entry.m_gateway).value_or(0));
+            put<int32_t>(output, entry.m_identifier.m_interface_index);
+            put<int32_t>(output, entry.m_metric);
+        }
+
+        route_entry get_route(const char*& input)
+        {
+            uint32_t destination = get<uint32_t>(input);
+            uint32_t mask = get<uint32_t>(input);
+            uint32_t gateway = get<uint32_t>(input);
+            int32_t interface_index = get<int32_t>(input);
+            int32_t metric = get<int32_t>(input);
+            return route_entry(format_ipv4(destination), format_ipv4(mask), interface_index, format_ipv4(gateway), metric);
+        }
+
+        uint32_t checksum(const record_header& header, const std::string& payload)
+        {
+            constexpr std::size_t fields_offset = offsetof(record_header, m_time);
+            uLong result = crc32(0L, Z_NULL, 0);
+            result = crc32(result, reinterpret_cast<const Bytef*>(&header) + fields_offset, static_cast<uInt>(sizeof(record_header) - fields_offset));
+            result = crc32(result, reinterpret_cast<const Bytef*>(payload.data()), static_cast<uInt>(payload.size()));
+            return static_cast<uint32_t>(result);
+        }
+
+        // false at the end of the segment and on a torn or corrupt record
+        bool read_record(std::istream& input, record_header& header, std::string& payload)
+        {
+            if (!input.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.m_size > max_record_size)
+            {
+                return false;
+            }
+
+            std::size_t unit = header.m_type == record_checkpoint ? route_size : header.m_type == record_deltas ? delta_size : 0;
+            if (unit == 0 || header.m_size != static_cast<uint64_t>(header.m_count) * unit)
+            {
+                return false;
+            }
+
+            payload.resize(header.m_size);
+            if (!input.read(payload.data(), static_cast<std::streamsize>(payload.size())))
+            {
+                return false;
+            }
+
+            return checksum(header, payload) == header.m_checksum;
+        }
+
+        // segment numbers in the directory, ascending
+        std::vector<uint64_t> list_segments(const std::filesystem::path& directory)
+        {
+            std::vector<uint64_t> result;
+            std::error_code error_code;
+            for (const auto& item : std::filesystem::directory_iterator(directory, error_code))
+            {
+                std::string name = item.path().filename().string();
+                uint64_t segment = 0;
+                if (name.size() > 12 && name.starts_with("segment-") && name.ends_with(".log") &&
+                    std::from_chars(name.data() + 8, name.data() + name.size() - 4, segment).ptr == name.data() + name.size() - 4)
+                {
+                    result.push_back(segment);
+                }
+            }
+
+            std::sort(result.begin(), result.end());
+            return result;
+        }
+    } // !anonymous namespace
+
+    route_history::route_history(route_history_options options)
+        : m_options(std::move(options))
+    {
+        // nothing for now
+    }
+
+    std::filesystem::path route_history::segment_path(uint64_t segment) const
+    {
+        return m_options.m_directory / fmt::format("segment-{:010}.log", segment);
+    }
+
+    route_history::index_header* route_history::header() const
+    {
+        return static_cast<index_header*>(m_index.data());
+    }
+
+    route_history::index_entry* route_history::entries() const
+    {
+        return reinterpret_cast<index_entry*>(static_cast<char*>(m_index.data()) + sizeof(index_header));
+    }
+
+    std::size_t route_history::index_capacity() const
+    {
+        return (m_index.size() - sizeof(index_header)) / sizeof(index_entry);
+    }
+
+    uint64_t route_history::index_count() const
+    {
+        return m_index.is_open() ? std::atomic_ref<uint64_t>(header()->m_count).load(std::memory_order_acquire) : 0;
+    }
+
+    bool route_history::open()
+    {
+        whatlog::logger log("route_history::open");
+
+        std::error_code error_code;
+        std::filesystem::create_directories(m_options.m_directory, error_code);
+        if (error_code)
+        {
+            log.error(fmt::format("failed to create {}. message: {}.", m_options.m_directory.string(), error_code.message()));
+            return false;
+        }
+
+        if (!m_index.open(m_options.m_directory / "checkpoints.idx", sizeof(index_header) + initial_index_capacity * sizeof(index_entry)))
+        {
+            log.error(fmt::format("failed to map the checkpoint index in {}.", m_options.m_directory.string()));
+            return false;
+        }
+
+        bool is_rebuilt = header()->m_magic != index_magic;
+        if (is_rebuilt)
+        {
+            header()->m_magic = index_magic;
+            std::atomic_ref<uint64_t>(header()->m_count).store(0, std::memory_order_release);
+        }
+        else
+        {
+            validate_index();
+        }
+
+        std::vector<uint64_t> segments = list_segments(m_options.m_directory);
+        for (std::size_t index = 0; index < segments.size(); ++index)
+        {
+            // a lost index is rebuilt from every segment, otherwise only the last one can be behind it
+            uint64_t segment = segments[index];
+            bool is_last = index + 1 == segments.size();
+            if (!is_rebuilt && !is_last)
+            {
+                continue;
+            }
+
+            uint64_t count = index_count();
+            uint64_t offset = count > 0 && entries()[count - 1].m_segment == segment ? entries()[count - 1].m_offset : 0;
+            uint64_t end = scan_segment(segment, offset);
+            if (!is_last)
+            {
+                continue;
+            }
+
+            // cut off the record a crash tore, and forget checkpoints that were in it
+            for (count = index_count(); count > 0 && entries()[count - 1].m_segment == segment && entries()[count - 1].m_offset >= end; --count)
+            {
+                std::atomic_ref<uint64_t>(header()->m_count).store(count - 1, std::memory_order_release);
+            }
+
+            if (end == 0)
+            {
+                // a previous run that never got to write
+                std::filesystem::remove(segment_path(segment), error_code);
+            }
+            else
+            {
+                std::filesystem::resize_file(segment_path(segment), end, error_code);
+            }
+        }
+
+        if (!start_segment(segments.empty() ? 1 : segments.back() + 1))
+        {
+            return false;
+        }
+
+        compact();
+        return true;
+    }
+
+    void route_history::validate_index()
+    {
+        uint64_t count = std::min<uint64_t>(index_count(), index_capacity());
+        uint64_t kept = 0;
+        for (uint64_t index = 0; index < count; ++index)
+        {
+            const index_entry& entry = entries()[index];
+            std::error_code error_code;
+            uint64_t size = std::filesystem::file_size(segment_path(entry.m_segment), error_code);
+            if (!error_code && entry.m_offset + sizeof(record_header) <= size)
+            {
+                entries()[kept++] = entry;
+            }
+        }
+
+        std::atomic_ref<uint64_t>(header()->m_count).store(kept, std::memory_order_release);
+    }
+
+    uint64_t route_history::scan_segment(uint64_t segment, uint64_t offset)
+    {
+        std::ifstream input(segment_path(segment), std::ios::binary);
+        input.seekg(static_cast<std::streamoff>(offset));
+
+        record_header header{};
+        std::string payload;
+        uint64_t end = offset;
+        while (read_record(input, header, payload))
+        {
+            uint64_t count = index_count();
+            bool is_indexed = count > 0 && entries()[count - 1].m_segment == segment && entries()[count - 1].m_offset >= end;
+            if (header.m_type == record_checkpoint && !is_indexed)
+            {
+                append_index({ header.m_time, header.m_generation, segment, end });
+            }
+
+            end += sizeof(header) + header.m_size;
+        }
+
+        return end;
+    }
+
+    bool route_history::start_segment(uint64_t segment)
+    {
+        m_segment.close();
+        m_segment.clear();
+        m_segment.open(segment_path(segment), std::ios::binary | std::ios::out | std::ios::trunc);
+        if (!m_segment)
+        {
+            whatlog::logger log("route_history::start_segment");
+            log.error(fmt::format("failed to create {}, route history stops.", segment_path(segment).string()));
+            return false;
+        }
+
+        m_segment_number = segment;
+        m_segment_offset = 0;
+        m_segment_started = std::chrono::system_clock::now();
+        // segments stand on their own
+        m_needs_checkpoint = true;
+        return true;
+    }
+
+    void route_history::record(const route_manager& manager)
+    {
+        std::lock_guard<std::mutex> write_lock(m_write_mutex);
+        if (!m_segment.is_open())
+        {
+            return;
+        }
+
+        std::chrono::system_clock::time_point now = std::chrono::system_clock::now();
+        if (m_segment_offset >= m_options.m_segment_size || now - m_segment_started >= m_options.m_segment_duration)
+        {
+            if (!start_segment(m_segment_number + 1))
+            {
+                return;
+            }
+
+            compact();
+        }
+
+        if (!m_needs_checkpoint)
+        {
+            std::optional<route_delta_history> history = manager.deltas_since(m_generation);
+            if (!history.has_value())
+            {
+                // further behind than the manager keeps, or its generation went backwards (restart)
+                m_needs_checkpoint = true;
+            }
+            else
+            {
+                for (const shared_route_delta_set& set : history->m_sets)
+                {
+                    std::string payload;
+                    payload.reserve(set->m_deltas.size() * delta_size);
+                    for (const route_delta& delta : set->m_deltas)
+                    {
+                        put<uint8_t>(payload, static_cast<uint8_t>(delta.m_change));
+                        put_route(payload, delta.m_entry);
+                    }
+
+                    write_record(record_deltas, set->m_generation, set->m_time, static_cast<uint32_t>(set->m_deltas.size()), payload);
+                    m_delta_bytes += sizeof(record_header) + payload.size();
+                }
+
+                m_generation = history->m_generation;
+            }
+        }
+
+        // a checkpoint costs as much as the deltas it saves replaying
+        if (m_segment.is_open() && (m_needs_checkpoint || m_delta_bytes > m_checkpoint_bytes))
+        {
+            write_checkpoint(*manager.snapshot(), now);
+        }
+    }
+
+    void route_history::write_checkpoint(const route_snapshot& snapshot, std::chrono::system_clock::time_point time)
+    {
+        std::string payload;
+        payload.reserve(snapshot.m_routes.size() * route_size);
+        for (const route_entry& entry : snapshot.m_routes)
+        {
+            put_route(payload, entry);
+        }
+
+        write_record(record_checkpoint, snapshot.m_generation, time, static_cast<uint32_t>(snapshot.m_routes.size()), payload);
+
+        m_generation = snapshot.m_generation;
+        m_needs_checkpoint = false;
+        m_checkpoint_bytes = sizeof(record_header) + payload.size();
+        m_delta_bytes = 0;
+    }
+
+    void route_history::write_record(uint32_t type, uint64_t generation, std::chrono::system_clock::time_point time, uint32_t count, const std::string& payload)
+    {
+        record_header header{ static_cast<uint32_t>(payload.size()), 0, to_milliseconds(time), generation, type, count };
+        header.m_checksum = checksum(header, payload);
+
+        uint64_t offset = m_segment_offset;
+        m_segment.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        m_segment.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+        // readers open the segment on their own, they see the record once it left our buffer
+        m_segment.flush();
+        if (!m_segment)
+        {
+            whatlog::logger log("route_history::write_record");
+            log.error(fmt::format("failed to write {}, route history stops.", segment_path(m_segment_number).string()));
+            m_segment.close();
+            return;
+        }
+
+        m_segment_offset += sizeof(header) + payload.size();
+        if (type == record_checkpoint)
+        {
+            // only after the record is written, the index never points at missing data
+            append_index({ header.m_time, generation, m_segment_number, offset });
+        }
+    }
+
+    void route_history::append_index(const index_entry& entry)
+    {
+        uint64_t count = index_count();
+        if (count == index_capacity())
+        {
+            std::unique_lock<std::shared_mutex> lock(m_mutex);
+            if (!m_index.resize(sizeof(index_header) + 2 * index_capacity() * sizeof(index_entry)))
+            {
+                whatlog::logger log("route_history::append_index");
+                log.error("failed to grow the checkpoint index, time travel stops at the last indexed checkpoint.");
+                return;
+            }
+        }
+
+        if (!m_index.is_open())
+        {
+            return;
+        }
+
+        entries()[count] = entry;
+        std::atomic_ref<uint64_t>(header()->m_count).store(count + 1, std::memory_order_release);
+    }
+
+    std::optional<route_history_state> route_history::at(std::chrono::system_clock::time_point time) const
+    {
+        int64_t target = to_milliseconds(time);
+
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        uint64_t count = index_count();
+        if (count == 0)
+        {
+            return std::nullopt;
+        }
+
+        // replay starts at the last checkpoint at or before the target
+        const index_entry* first = entries();
+        const index_entry* itr_after = std::upper_bound(first, first + count, target, [](int64_t value, const index_entry& entry) { return value < entry.m_time; });
+        if (itr_after == first)
+        {
+            return std::nullopt;
+        }
+
+        const index_entry start = *(itr_after - 1);
+        std::ifstream input(segment_path(start.m_segment), std::ios::binary);
+        input.seekg(static_cast<std::streamoff>(start.m_offset));
+
+        std::map<route_key, route_entry> routes;
+        uint64_t generation = 0;
+        int64_t replayed_time = 0;
+        bool has_checkpoint = false;
+
+        record_header header{};
+        std::string payload;
+        while (read_record(input, header, payload) && header.m_time <= target)
+        {
+            const char* cursor = payload.data();
+            if (header.m_type == record_checkpoint)
+            {
+                // normally only the first record, later ones may not be indexed yet
+                routes.clear();
+                for (uint32_t index = 0; index < header.m_count; ++index)
+                {
+                    route_entry entry = get_route(cursor);
+                    routes.insert_or_assign(make_route_key(entry.m_identifier), std::move(entry));
+                }
+
+                has_checkpoint = true;
+            }
+            else if (has_checkpoint)
+            {
+                for (uint32_t index = 0; index < header.m_count; ++index)
+                {
+                    uint8_t change = get<uint8_t>(cursor);
+                    route_entry entry = get_route(cursor);
+                    route_key key = make_route_key(entry.m_identifier);
+                    if (change == static_cast<uint8_t>(route_change::removed))
+                    {
+                        routes.erase(key);
+                    }
+                    else
+                    {
+                        routes.insert_or_assign(key, std::move(entry));
+                    }
+                }
+            }
+
+            generation = header.m_generation;
+            replayed_time = header.m_time;
+        }
+
+        if (!has_checkpoint)
+        {
+            return std::nullopt;
+        }
+
+        route_history_state result;
+        result.m_time = std::chrono::system_clock::time_point(std::chrono::milliseconds(replayed_time));
+        result.m_snapshot.m_generation = generation;
+        result.m_snapshot.m_routes.reserve(routes.size());
+        for (auto& route : routes)
+        {
+            result.m_snapshot.m_routes.push_back(std::move(route.second));
+        }
+
+        result.m_snapshot.m_index = route_index(result.m_snapshot.m_routes);
+        return result;
+    }
+
+    void route_history::compact()
+    {
+        whatlog::logger log("route_history::compact");
+        int64_t horizon = to_milliseconds(std::chrono::system_clock::now() - m_options.m_retention);
+
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        uint64_t count = index_count();
+        index_entry* first = entries();
+        index_entry* itr_after = count > 0 ? std::upper_bound(first, first + count, horizon, [](int64_t value, const index_entry& entry) { return value < entry.m_time; }) : first;
+        if (itr_after == first)
+        {
+            return;
+        }
+
+        // the newest checkpoint before the horizon still answers queries at the horizon, its segment
+        // stays, everything older goes
+        uint64_t keep_segment = (itr_after - 1)->m_segment;
+        for (uint64_t segment : list_segments(m_options.m_directory))
+        {
+            if (segment >= keep_segment)
+            {
+                break;
+            }
+
+            std::error_code error_code;
+            if (!std::filesystem::remove(segment_path(segment), error_code) && error_code)
+            {
+                // picked up again by the next compaction
+                log.warning(fmt::format("failed to delete {}. message: {}.", segment_path(segment).string(), error_code.message()));
+            }
+        }
+
+        uint64_t dropped = static_cast<uint64_t>(std::find_if(first, first + count, [keep_segment](const index_entry& entry) { return entry.m_segment >= keep_segment; }) - first);
+        if (dropped > 0)
+        {
+            std::memmove(first, first + dropped, (count - dropped) * sizeof(index_entry));
+            std::atomic_ref<uint64_t>(header()->m_count).store(count - dropped, std::memory_order_release);
+        }
+    }
+
+    void route_history::close()
+    {
+        std::lock_guard<std::mutex> write_lock(m_write_mutex);
+        m_segment.close();
+
+        // waits for the replays still reading through the index
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        m_index.close();
+    }
+} // !namespace net
+} // !namespace noconn
@@ -0,0 +1,346 @@
+/*
+ *
+ */
+
+#include <bit>
+#include <numeric>
+#include <algorithm>
+#include <charconv>
+#include <fmt/format.h>
+#include "noconn/net/route_manager.hpp"
+#include "noconn/net/route_index.hpp"
+
+namespace noconn
+{
+namespace net
+{
+    namespace
+    {
+        template <typename Field>
+        void sort_by(std::pmr::vector<uint32_t>& positions, const std::pmr::vector<route_key>& keys, Field field)
+        {
+            positions.resize(keys.size());
+            std::iota(positions.begin(), positions.end(), 0u);
+            std::sort(positions.begin(), positions.end(), [&](uint32_t lhs, uint32_t rhs)
+                {
+                    auto lhs_field = field(lhs);
+                    auto rhs_field = field(rhs);
+                    if (lhs_field != rhs_field)
+                    {
+                        return lhs_field < rhs_field;
+                    }
+
+                    return keys[lhs] < keys[rhs];
+                });
+        }
+    } // !anonymous namespace
+
+    std::optional<uint32_t> parse_ipv4(std::string_view text)
+    {
+        uint32_t result = 0;
+        for (int octet = 0; octet < 4; ++octet)
+        {
+            if (octet > 0)
+            {
+                if (text.empty() || text.front() != '.')
+                {
+                    return std::nullopt;
+                }
+
+                text.remove_prefix(1);
+            }
+
+            unsigned value = 0;
+            auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+            if (error != std::errc() || end == text.data() || value > 255)
+            {
+                return std::nullopt;
+            }
+
+            result = (result << 8) | value;
+            text.remove_prefix(static_cast<std::size_t>(end - text.data()));
+        }
+
+        if (!text.empty())
+        {
+            return std::nullopt;
+        }
+
+        return result;
+    }
+
+    uint32_t prefix_mask(uint8_t length)
+    {
+        return length == 0 ? 0 : ~uint32_t(0) << (32 - std::min<uint8_t>(length, 32));
+    }
+
+    std::string format_ipv4(uint32_t address)
+    {
+        return fmt::format("{}.{}.{}.{}", address >> 24, (address >> 16) & 0xff, (address >> 8) & 0xff, address & 0xff);
+    }
+
+    std::optional<ipv4_prefix> parse_ipv4_prefix(std::string_view text)
+    {
+        std::size_t slash = text.find('/');
+        std::optional<uint32_t> address = parse_ipv4(text.substr(0, slash));
+        if (!address.has_value())
+        {
+            return std::nullopt;
+        }
+
+        unsigned length = 32;
+        if (slash != std::string_view::npos)
+        {
+            std::string_view length_text = text.substr(slash + 1);
+            auto [end, error] = std::from_chars(length_text.data(), length_text.data() + length_text.size(), length);
+            if (error != std::errc() || end != length_text.data() + length_text.size() || length > 32)
+            {
+                return std::nullopt;
+            }
+        }
+
+        ipv4_prefix result;
+        result.m_length = static_cast<uint8_t>(length);
+        result.m_address = *address & prefix_mask(result.m_length);
+        return result;
+    }
+
+    std::size_t route_key_hash::operator()(const route_key& key) const
+    {
+        uint64_t value = (uint64_t(key.m_destination) << 32) ^ (uint64_t(key.m_prefix_length) << 24) ^ static_cast<uint32_t>(key.m_interface_index);
+        // splitmix64 finalizer, the raw fields cluster badly
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+        return static_cast<std::size_t>(value ^ (value >> 31));
+    }
+
+    route_key make_route_key(const route_identifier& identifier)
+    {
+        uint32_t mask = parse_ipv4(identifier.m_mask).value_or(0);
+        return { parse_ipv4(identifier.m_destination).value_or(0), static_cast<uint8_t>(std::popcount(mask)), identifier.m_interface_index };
+    }
+
+    std::string to_cursor(const route_key& key)
+    {
+        return fmt::format("{:08x}{:02x}{:08x}", key.m_destination, key.m_prefix_length, static_cast<uint32_t>(key.m_interface_index));
+    }
+
+    std::optional<route_key> parse_cursor(std::string_view cursor)
+    {
+        if (cursor.size() != 18)
+        {
+            return std::nullopt;
+        }
+
+        auto parse_hex = [](std::string_view text, uint32_t& value)
+        {
+            auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value, 16);
+            return error == std::errc() && end == text.data() + text.size();
+        };
+
+        uint32_t destination = 0;
+        uint32_t prefix_length = 0;
+        uint32_t interface_index = 0;
+        if (!parse_hex(cursor.substr(0, 8), destination) || !parse_hex(cursor.substr(8, 2), prefix_length) || !parse_hex(cursor.substr(10), interface_index) || prefix_length > 32)
+        {
+            return std::nullopt;
+        }
+
+        return route_key{ destination, static_cast<uint8_t>(prefix_length), static_cast<int>(interface_index) };
+    }
+
+    route_index::route_index(std::span<const route_entry> routes)
+    {
+        m_keys.reserve(routes.size());
+        for (const route_entry& entry : routes)
+        {
+            m_keys.push_back(make_route_key(entry.m_identifier));
+            m_prefix_lengths |= uint64_t(1) << m_keys.back().m_prefix_length;
+        }
+
+        sort_by(m_by_key, m_keys, [](uint32_t) { return 0; });
+        sort_by(m_by_interface, m_keys, [&](uint32_t position) { return m_keys[position].m_interface_index; });
+        sort_by(m_by_gateway, m_keys, [&](uint32_t position) { return std::string_view(routes[position].m_gateway); });
+        sort_by(m_by_metric, m_keys, [&](uint32_t position) { return routes[position].m_metric; });
+    }
+
+    const route_key& route_index::key(uint32_t position) const
+    {
+        return m_keys[position];
+    }
+
+    bool route_index::matches(std::span<const route_entry> routes, uint32_t position, const route_query& query) const
+    {
+        const route_entry& entry = routes[position];
+        const route_key& entry_key = m_keys[position];
+
+        if (query.m_interface_index.has_value() && entry_key.m_interface_index != *query.m_interface_index)
+        {
+            return false;
+        }
+
+        if (query.m_gateway.has_value() && entry.m_gateway != *query.m_gateway)
+        {
+            return false;
+        }
+
+        if ((query.m_min_metric.has_value() && entry.m_metric < *query.m_min_metric) || (query.m_max_metric.has_value() && entry.m_metric > *query.m_max_metric))
+        {
+            return false;
+        }
+
+        if (query.m_within.has_value())
+        {
+            const ipv4_prefix& within = *query.m_within;
+            if (entry_key.m_prefix_length < within.m_length || (entry_key.m_destination & prefix_mask(within.m_length)) != within.m_address)
+            {
+                return false;
+            }
+        }
+
+        if (query.m_contains.has_value() && (*query.m_contains & prefix_mask(entry_key.m_prefix_length)) != entry_key.m_destination)
+        {
+            return false;
+        }
+
+        return !query.m_after.has_value() || *query.m_after < entry_key;
+    }
+
+    route_index::position_range route_index::key_range(const route_key& first, const route_key& last) const
+    {
+        auto begin = std::lower_bound(m_by_key.begin(), m_by_key.end(), first, [&](uint32_t position, const route_key& key) { return m_keys[position] < key; });
+        auto end = std::upper_bound(begin, m_by_key.end(), last, [&](const route_key& key, uint32_t position) { return key < m_keys[position]; });
+        return { begin, end };
+    }
+
+    std::pmr::vector<uint32_t> route_index::covering(uint32_t address) const
+    {
+        std::pmr::vector<uint32_t> result;
+        for (uint8_t length = 0; length <= 32; ++length)
+        {
+            if ((m_prefix_lengths & (uint64_t(1) << length)) == 0)
+            {
+                continue;
+            }
+
+            uint32_t destination = address & prefix_mask(length);
+            position_range range = key_range({ destination, length, std::numeric_limits<int>::min() }, { destination, length, std::numeric_limits<int>::max() });
+            result.insert(result.end(), range.first, range.second);
+        }
+
+        return result;
+    }
+
+    route_page route_index::select(std::span<const route_entry> routes, const route_query& query) const
+    {
+        route_page result;
+        if (query.m_limit == 0)
+        {
+            return result;
+        }
+
+        // sources sorted by (field, key) are in key order once the field is fixed, the cursor narrows them too
+        route_key after = query.m_after.value_or(route_key{ 0, 0, std::numeric_limits<int>::min() });
+        auto after_key = [&](auto begin, auto end)
+        {
+            return !query.m_after.has_value() ? begin : std::upper_bound(begin, end, after, [&](const route_key& key, uint32_t position) { return key < m_keys[position]; });
+        };
+
+        route_key first{ 0, 0, std::numeric_limits<int>::min() };
+        route_key last{ std::numeric_limits<uint32_t>::max(), 32, std::numeric_limits<int>::max() };
+        if (query.m_within.has_value())
+        {
+            first = { query.m_within->m_address, query.m_within->m_length, std::numeric_limits<int>::min() };
+            last.m_destination = query.m_within->m_address | ~prefix_mask(query.m_within->m_length);
+        }
+
+        position_range best = key_range(first, last);
+        best.first = std::max(best.first, after_key(best.first, best.second));
+        bool is_key_ordered = true;
+
+        auto consider = [&](position_range range, bool key_ordered)
+        {
+            if (range.second - range.first < best.second - best.first)
+            {
+                best = range;
+                is_key_ordered = key_ordered;
+            }
+        };
+
+        if (query.m_interface_index.has_value())
+        {
+            int interface_index = *query.m_interface_index;
+            auto begin = std::lower_bound(m_by_interface.begin(), m_by_interface.end(), interface_index, [&](uint32_t position, int value) { return m_keys[position].m_interface_index < value; });
+            auto end = std::upper_bound(begin, m_by_interface.end(), interface_index, [&](int value, uint32_t position) { return value < m_keys[position].m_interface_index; });
+            consider({ after_key(begin, end), end }, true);
+        }
+
+        if (query.m_gateway.has_value())
+        {
+            std::string_view gateway = *query.m_gateway;
+            auto begin = std::lower_bound(m_by_gateway.begin(), m_by_gateway.end(), gateway, [&](uint32_t position, std::string_view value) { return std::string_view(routes[position].m_gateway) < value; });
+            auto end = std::upper_bound(begin, m_by_gateway.end(), gateway, [&](std::string_view value, uint32_t position) { return value < std::string_view(routes[position].m_gateway); });
+            consider({ after_key(begin, end), end }, true);
+        }
+
+        if (query.m_min_metric.has_value() || query.m_max_metric.has_value())
+        {
+            int min_metric = query.m_min_metric.value_or(std::numeric_limits<int>::min());
+            int max_metric = query.m_max_metric.value_or(std::numeric_limits<int>::max());
+            auto begin = std::lower_bound(m_by_metric.begin(), m_by_metric.end(), min_metric, [&](uint32_t position, int value) { return routes[position].m_metric < value; });
+            auto end = std::upper_bound(begin, m_by_metric.end(), max_metric, [&](int value, uint32_t position) { return value < routes[position].m_metric; });
+            // a single metric value is in key order like the other indices, a range is not
+            bool is_single_metric = min_metric == max_metric;
+            consider({ is_single_metric ? after_key(begin, end) : begin, end }, is_single_metric);
+        }
+
+        std::pmr::vector<uint32_t> covering_positions;
+        if (query.m_contains.has_value())
+        {
+            // at most a few candidates per prefix length, ascending lengths keep them in key order
+            covering_positions = covering(*query.m_contains);
+            best = { covering_positions.cbegin(), covering_positions.cend() };
+            is_key_ordered = true;
+        }
+
+        if (is_key_ordered)
+        {
+            // stop one past the page, that is all the work a page costs
+            for (auto itr = best.first; itr != best.second; ++itr)
+            {
+                if (!matches(routes, *itr, query))
+                {
+                    continue;
+                }
+
+                if (result.m_positions.size() == query.m_limit)
+                {
+                    result.m_next = m_keys[result.m_positions.back()];
+                    break;
+                }
+
+                result.m_positions.push_back(*itr);
+            }
+
+            return result;
+        }
+
+        for (auto itr = best.first; itr != best.second; ++itr)
+        {
+            if (matches(routes, *itr, query))
+            {
+                result.m_positions.push_back(*itr);
+            }
+        }
+
+        std::sort(result.m_positions.begin(), result.m_positions.end(), [&](uint32_t lhs, uint32_t rhs) { return m_keys[lhs] < m_keys[rhs]; });
+        if (result.m_positions.size() > query.m_limit)
+        {
+            result.m_positions.resize(query.m_limit);
+            result.m_next = m_keys[result.m_positions.back()];
+        }
+
+        return result;
+    }
+} // !namespace net
+} // !namespace noconn
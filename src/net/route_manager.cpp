@@ -7,9 +7,15 @@
 #include <comdef.h>
 #include <Wbemidl.h>
 #include <iphlpapi.h>
+#include <chrono>
+#include <algorithm>
+#include <system_error>
+#include <unordered_map>
 #include <fmt/format.h>
 #include <whatlog/logger.hpp>
 #include "noconn/net/wbem_consumer.hpp"
+#include "noconn/util/trace.hpp"
+#include "noconn/util/metrics.hpp"
 #include "noconn/net/route_manager.hpp"
 
 
@@ -21,6 +27,7 @@ namespace net
     {
         std::vector<route_entry> list_routing_table()
         {
+            NOCONN_TRACE_SPAN("route_manager::list_routing_table");
             whatlog::logger log("print_routing_table");
             std::vector<route_entry> result;
 
@@ -165,6 +172,81 @@ namespace net
 
             return result;
         }
+
+        // row for a route we own, empty if an address does not parse
+        std::optional<MIB_IPFORWARDROW> make_forward_row(const route_entry& entry)
+        {
+            std::optional<uint32_t> destination = parse_ipv4(entry.m_identifier.m_destination);
+            std::optional<uint32_t> mask = parse_ipv4(entry.m_identifier.m_mask);
+            std::optional<uint32_t> gateway = parse_ipv4(entry.m_gateway);
+            if (!destination.has_value() || !mask.has_value() || !gateway.has_value())
+            {
+                return std::nullopt;
+            }
+
+            MIB_IPFORWARDROW row{};
+            row.dwForwardDest = htonl(*destination);
+            row.dwForwardMask = htonl(*mask);
+            row.dwForwardNextHop = htonl(*gateway);
+            row.dwForwardIfIndex = static_cast<DWORD>(entry.m_identifier.m_interface_index);
+            // on-link routes have no next hop
+            row.dwForwardType = *gateway == 0 ? MIB_IPROUTE_TYPE_DIRECT : MIB_IPROUTE_TYPE_INDIRECT;
+            row.dwForwardProto = MIB_IPPROTO_NETMGMT;
+            row.dwForwardMetric1 = static_cast<DWORD>(entry.m_metric);
+            row.dwForwardMetric2 = MIB_IPROUTE_METRIC_UNUSED;
+            row.dwForwardMetric3 = MIB_IPROUTE_METRIC_UNUSED;
+            row.dwForwardMetric4 = MIB_IPROUTE_METRIC_UNUSED;
+            row.dwForwardMetric5 = MIB_IPROUTE_METRIC_UNUSED;
+            return row;
+        }
+
+        DWORD create_route(const route_entry& entry)
+        {
+            std::optional<MIB_IPFORWARDROW> row = make_forward_row(entry);
+            return row.has_value() ? CreateIpForwardEntry(&*row) : ERROR_INVALID_PARAMETER;
+        }
+
+        // the next hop is part of the row's identity, entry must be the route as it is in the table
+        DWORD delete_route(const route_entry& entry)
+        {
+            std::optional<MIB_IPFORWARDROW> row = make_forward_row(entry);
+            return row.has_value() ? DeleteIpForwardEntry(&*row) : ERROR_INVALID_PARAMETER;
+        }
+
+        std::string describe_error(DWORD code)
+        {
+            return fmt::format("{} (error {})", std::system_category().message(static_cast<int>(code)), code);
+        }
+
+        struct route_metrics
+        {
+            util::histogram& m_tick_duration;
+            util::histogram& m_diff_size;
+            util::gauge& m_routes;
+            util::gauge& m_generation;
+            util::counter& m_commands;
+            util::counter& m_failed_batches;
+            util::histogram& m_group_size;
+        };
+
+        route_metrics& metrics()
+        {
+            static route_metrics instance = []
+            {
+                util::metrics_registry& registry = util::metrics_registry::instance();
+                return route_metrics{
+                    registry.get_histogram("noconn_route_tick_duration_seconds", "time to read and diff the routing table.", util::histogram_unit::nanoseconds),
+                    registry.get_histogram("noconn_route_diff_size", "routes added, changed or removed per changing tick.", util::histogram_unit::count),
+                    registry.get_gauge("noconn_routes", "entries in the routing table."),
+                    registry.get_gauge("noconn_route_generation", "generation of the published routing table snapshot."),
+                    registry.get_counter("noconn_route_commands_total", "route add, replace and remove commands applied."),
+                    registry.get_counter("noconn_route_command_batches_failed_total", "command batches rolled back."),
+                    registry.get_histogram("noconn_route_command_group_size", "command batches committed together by one tick.", util::histogram_unit::count)
+                };
+            }();
+
+            return instance;
+        }
     } // !anonymous namespace
 
     route_identifier::route_identifier(const std::string& destination, const std::string& mask, int interface_index)
@@ -185,87 +267,345 @@ namespace net
         // nothing for now
     }
 
-    void route_manager::tick()
+    route_page route_snapshot::select(const route_query& query) const
     {
-        whatlog::logger log("route_manager::tick");
-        std::vector<route_entry> curr_routes = list_routing_table();
-        std::vector<route_entry>& prev_routes = m_routes;
+        return m_index.select(m_routes, query);
+    }
+
+    route_manager::route_manager()
+        : m_snapshot(util::make_tracked_shared<route_snapshot>(util::memory_subsystem::routes))
+    {
+        // nothing for now
+    }
+
+    shared_route_snapshot route_manager::snapshot() const
+    {
+        std::lock_guard<std::mutex> lock(m_snapshot_mutex);
+        return m_snapshot;
+    }
+
+    std::vector<route_entry> route_manager::get_routes() const
+    {
+        shared_route_snapshot current = snapshot();
+        return std::vector<route_entry>(current->m_routes.begin(), current->m_routes.end());
+    }
+
+    std::optional<route_delta_history> route_manager::deltas_since(uint64_t generation) const
+    {
+        std::lock_guard<std::mutex> lock(m_snapshot_mutex);
+        uint64_t current = m_snapshot->m_generation;
+        // sets are contiguous, the oldest one kept is the first generation a reader can catch up from
+        uint64_t oldest = m_deltas.empty() ? current + 1 : m_deltas.front()->m_generation;
+        if (generation > current || generation + 1 < oldest)
+        {
+            return std::nullopt;
+        }
+
+        route_delta_history result;
+        result.m_generation = current;
+        result.m_sets.assign(m_deltas.begin() + static_cast<std::ptrdiff_t>(generation + 1 - oldest), m_deltas.end());
+        return result;
+    }
+
+    void route_manager::publish(std::vector<route_entry> routes, std::vector<route_delta> deltas)
+    {
+        auto next = util::make_tracked_shared<route_snapshot>(util::memory_subsystem::routes);
+        next->m_routes.assign(std::make_move_iterator(routes.begin()), std::make_move_iterator(routes.end()));
+        // built off the lock, readers only ever see a snapshot with its indices complete
+        next->m_index = route_index(next->m_routes);
+
+        auto delta_set = util::make_tracked_shared<route_delta_set>(util::memory_subsystem::journal);
+        delta_set->m_time = std::chrono::system_clock::now();
+        delta_set->m_deltas.assign(std::make_move_iterator(deltas.begin()), std::make_move_iterator(deltas.end()));
+
+        std::unique_lock<std::mutex> lock(m_snapshot_mutex);
+        next->m_generation = m_snapshot->m_generation + 1;
+        delta_set->m_generation = next->m_generation;
+        m_snapshot = std::move(next);
+
+        m_deltas.push_back(delta_set);
+        const util::memory_account& journal = util::get_memory_account(util::memory_subsystem::journal);
+        while (m_deltas.size() > max_delta_history || (m_deltas.size() > 1 && journal.over_budget()))
+        {
+            m_deltas.pop_front();
+        }
+
+        lock.unlock();
+        m_events.publish(std::move(delta_set));
+    }
+
+    route_event_bus& route_manager::events()
+    {
+        return m_events;
+    }
+
+    void route_manager::submit(std::vector<route_command> commands, route_batch_handler completion)
+    {
+        m_commands.push({ std::move(commands), std::move(completion) });
+
+        // the first submit after the engine looked wakes it, the rest of a burst rides along
+        if (!m_commands_signalled.exchange(true, std::memory_order_acq_rel))
+        {
+            m_commands_ready.release();
+        }
+    }
+
+    void route_manager::wait_for_commands(std::chrono::milliseconds timeout)
+    {
+        // a leftover release from a wait that timed out only costs an early tick
+        m_commands_ready.try_acquire_for(timeout);
+    }
+
+    std::vector<route_manager::pending_batch> route_manager::take_commands()
+    {
+        // reset before draining, a submit racing with us signals again and is picked up next tick
+        m_commands_signalled.store(false, std::memory_order_release);
+
+        std::vector<pending_batch> result;
+        while (std::optional<pending_batch> batch = m_commands.pop())
+        {
+            result.push_back(std::move(*batch));
+        }
+
+        return result;
+    }
+
+    void route_manager::cancel_commands()
+    {
+        // submits racing with shutdown are not answered, their connections go with the drain timeout
+        uint64_t generation = snapshot()->m_generation;
+        for (pending_batch& batch : take_commands())
+        {
+            route_batch_result result;
+            result.m_status = route_batch_status::cancelled;
+            result.m_error = "the route engine is shutting down.";
+            result.m_generation = generation;
+            batch.m_completion(std::move(result));
+        }
+    }
+
+    route_batch_result route_manager::apply(const std::vector<route_command>& commands, std::vector<route_entry>& routes)
+    {
+        whatlog::logger log("route_manager::apply");
+
+        // kernel changes made so far, undone in reverse if a later command fails
+        struct undo_step
+        {
+            bool m_create;
+            route_entry m_entry;
+        };
 
-        // detect changes made to the routing table
-        // 1. added new routes or changed existing routes
-        for (const auto& curr_route : curr_routes)
+        std::vector<undo_step> undo;
+        std::vector<route_entry> working = routes;
+        route_batch_result result;
+
+        // position of every route in working, built once per batch and kept in step with it. the order
+        // of working does not matter, removals move the last route into the gap
+        std::unordered_map<route_key, std::size_t, route_key_hash> positions;
+        positions.reserve(working.size() + commands.size());
+        for (std::size_t index = 0; index < working.size(); ++index)
         {
-            bool is_route_added = true;
-            bool is_route_changed = false;
-            const route_identifier& curr_ident = curr_route.m_identifier;
+            positions.emplace(make_route_key(working[index].m_identifier), index);
+        }
 
-            // see if we can find existing route
-            for (const auto& prev_route : prev_routes)
+        for (std::size_t index = 0; index < commands.size() && result.m_error.empty(); ++index)
+        {
+            const route_command& command = commands[index];
+            route_key key = make_route_key(command.m_entry.m_identifier);
+            auto match = positions.find(key);
+            auto itr_route = match != positions.end() ? working.begin() + static_cast<std::ptrdiff_t>(match->second) : working.end();
+
+            result.m_failed_command = index;
+            if (command.m_operation != route_operation::remove && !make_forward_row(command.m_entry).has_value())
             {
-                const route_identifier& prev_ident = prev_route.m_identifier;
-                if (curr_ident.m_destination == prev_ident.m_destination &&
-                    curr_ident.m_mask == prev_ident.m_mask &&
-                    curr_ident.m_interface_index == prev_ident.m_interface_index)
+                result.m_error = "invalid address.";
+                break;
+            }
+
+            if (command.m_operation == route_operation::add)
+            {
+                if (itr_route != working.end())
                 {
-                    bool is_gateway_changed = curr_route.m_gateway != prev_route.m_gateway;
-                    bool is_metric_changed = curr_route.m_metric != prev_route.m_metric;
+                    result.m_status = route_batch_status::conflict;
+                    result.m_error = "route already exists.";
+                }
+                else if (DWORD code = create_route(command.m_entry); code != NO_ERROR)
+                {
+                    result.m_error = describe_error(code);
+                }
+                else
+                {
+                    undo.push_back({ false, command.m_entry });
+                    positions.emplace(key, working.size());
+                    working.push_back(command.m_entry);
+                }
 
-                    if (is_gateway_changed)
-                    {
-                        log.info(fmt::format("route_changed: dst: {}, mask: {} (gateway changed) {} => {}.", curr_ident.m_destination, curr_ident.m_mask, prev_route.m_gateway, curr_route.m_gateway));
-                    }
+                continue;
+            }
 
-                    if (is_metric_changed)
-                    {
-                        // tips: run "netsh interface ipv4 set interface 1 metric=10" to change metric for a given adapter
-                        log.info(fmt::format("route_changed: dst: {}, mask: {} (metric changed) {} => {}.", curr_ident.m_destination, curr_ident.m_mask, prev_route.m_metric, curr_route.m_metric));
-                    }
+            if (itr_route == working.end())
+            {
+                result.m_status = route_batch_status::conflict;
+                result.m_error = "no such route.";
+                break;
+            }
 
-                    is_route_changed = is_gateway_changed || is_metric_changed;
-                    is_route_added = false;
+            if (DWORD code = delete_route(*itr_route); code != NO_ERROR)
+            {
+                result.m_error = describe_error(code);
+                break;
+            }
 
-                    break;
+            undo.push_back({ true, *itr_route });
+            if (command.m_operation == route_operation::remove)
+            {
+                std::size_t position = match->second;
+                positions.erase(match);
+                if (position + 1 != working.size())
+                {
+                    working[position] = std::move(working.back());
+                    positions[make_route_key(working[position].m_identifier)] = position;
                 }
+
+                working.pop_back();
+                continue;
             }
 
-            if (is_route_changed)
+            // replace keeps the table's identifier, only gateway and metric come from the command
+            route_entry replacement(itr_route->m_identifier, command.m_entry.m_gateway, command.m_entry.m_metric);
+            if (DWORD code = create_route(replacement); code != NO_ERROR)
             {
-                // todo: implement
+                result.m_error = describe_error(code);
+                break;
             }
 
-            if (is_route_added)
+            undo.push_back({ false, replacement });
+            *itr_route = replacement;
+        }
+
+        if (!result.m_error.empty())
+        {
+            for (auto itr_step = undo.rbegin(); itr_step != undo.rend(); ++itr_step)
             {
-                // todo: implement
-                log.info(fmt::format("route_added: dst: {}, mask: {}, gateway: {}, if: {}, metric: {}.", 
-                    curr_ident.m_destination, curr_ident.m_mask, curr_route.m_gateway, curr_ident.m_interface_index, curr_route.m_metric));
+                DWORD code = itr_step->m_create ? create_route(itr_step->m_entry) : delete_route(itr_step->m_entry);
+                if (code != NO_ERROR)
+                {
+                    // the next tick publishes whatever state the table was left in
+                    log.error(fmt::format("rollback failed for dst: {}, mask: {}. {}", itr_step->m_entry.m_identifier.m_destination, itr_step->m_entry.m_identifier.m_mask, describe_error(code)));
+                }
             }
+
+            return result;
         }
 
-        // 2. old routes removed
-        for (const auto& prev_route : prev_routes)
+        routes = std::move(working);
+        result.m_status = route_batch_status::applied;
+        result.m_failed_command = 0;
+        return result;
+    }
+
+    void route_manager::restore(const route_snapshot& snapshot, std::vector<shared_route_delta_set> deltas)
+    {
+        m_routes.assign(snapshot.m_routes.begin(), snapshot.m_routes.end());
+
+        auto next = util::make_tracked_shared<route_snapshot>(util::memory_subsystem::routes);
+        next->m_generation = snapshot.m_generation;
+        next->m_routes = snapshot.m_routes;
+        next->m_index = route_index(next->m_routes);
+        metrics().m_generation.set(static_cast<int64_t>(next->m_generation));
+
+        // the newest sets that run without a gap up to the snapshot's generation
+        std::deque<shared_route_delta_set> history;
+        uint64_t expected = snapshot.m_generation;
+        for (auto set = deltas.rbegin(); set != deltas.rend() && history.size() < max_delta_history; ++set)
         {
-            bool is_route_removed = true;
-            const route_identifier& prev_ident = prev_route.m_identifier;
+            if (*set == nullptr || (*set)->m_generation > snapshot.m_generation)
+            {
+                continue;
+            }
 
-            // see if route is now missing
-            for (const auto& curr_route : curr_routes)
+            if ((*set)->m_generation != expected || expected == 0)
             {
-                const route_identifier& curr_ident = curr_route.m_identifier;
-                if (prev_ident.m_destination == curr_ident.m_destination &&
-                    prev_ident.m_mask == curr_ident.m_mask)
-                {
-                    is_route_removed = false;
-                    break;
-                }
+                break;
             }
 
-            if (is_route_removed)
+            history.push_front(std::move(*set));
+            --expected;
+        }
+
+        std::lock_guard<std::mutex> lock(m_snapshot_mutex);
+        m_snapshot = std::move(next);
+        m_deltas = std::move(history);
+    }
+
+    std::pair<shared_route_snapshot, std::vector<shared_route_delta_set>> route_manager::journal() const
+    {
+        std::lock_guard<std::mutex> lock(m_snapshot_mutex);
+        return { m_snapshot, std::vector<shared_route_delta_set>(m_deltas.begin(), m_deltas.end()) };
+    }
+
+    void route_manager::tick()
+    {
+        // changes are logged by subscribers of events(), not here
+        NOCONN_TRACE_SPAN("route_manager::tick");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        route_metrics& tick_metrics = metrics();
+
+        // group commit: every batch queued since the last tick goes to the kernel in this pass, then the
+        // table is read, diffed and published once for all of them
+        std::vector<pending_batch> batches = take_commands();
+        std::vector<route_batch_result> results;
+        results.reserve(batches.size());
+        if (!batches.empty())
+        {
+            NOCONN_TRACE_SPAN("route_manager::apply", batches.size());
+            std::vector<route_entry> expected_routes = m_routes;
+            for (const pending_batch& batch : batches)
             {
-                // todo: implement
+                results.push_back(apply(batch.m_commands, expected_routes));
+                if (results.back().m_status == route_batch_status::applied)
+                {
+                    tick_metrics.m_commands.add(batch.m_commands.size());
+                }
+                else
+                {
+                    tick_metrics.m_failed_batches.add();
+                }
             }
+
+            tick_metrics.m_group_size.record(static_cast<uint64_t>(batches.size()));
+        }
+
+        std::vector<route_entry> curr_routes = list_routing_table();
+        std::vector<route_delta> deltas;
+        {
+            NOCONN_TRACE_SPAN("route_manager::diff", curr_routes.size());
+            m_differ.diff(m_routes, curr_routes, [&deltas](util::table_change change, const route_entry& entry, const route_entry* previous)
+                {
+                    deltas.push_back({ static_cast<route_change>(change), entry, previous != nullptr ? std::optional<route_entry>(*previous) : std::nullopt });
+                });
         }
 
+        tick_metrics.m_routes.set(static_cast<int64_t>(curr_routes.size()));
+
         m_routes = curr_routes;
+        if (!deltas.empty())
+        {
+            tick_metrics.m_diff_size.record(static_cast<uint64_t>(deltas.size()));
+            NOCONN_TRACE_SPAN("route_manager::publish", deltas.size());
+            publish(std::move(curr_routes), std::move(deltas));
+            tick_metrics.m_generation.set(static_cast<int64_t>(snapshot()->m_generation));
+        }
+
+        tick_metrics.m_tick_duration.record(std::chrono::steady_clock::now() - start);
+
+        // only now, so a client that reads after its change was acknowledged finds it in the snapshot
+        uint64_t generation = snapshot()->m_generation;
+        for (std::size_t index = 0; index < batches.size(); ++index)
+        {
+            results[index].m_generation = generation;
+            batches[index].m_completion(std::move(results[index]));
+        }
     }
 } // !namespace net
 } // !namespace noconn
\ No newline at end of file
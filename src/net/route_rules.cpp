@@ -0,0 +1,436 @@
+/*
+ *
+ */
+
+#include <bit>
+#include <algorithm>
+#include <fmt/format.h>
+#include <boost/json.hpp>
+#include "noconn/util/log.hpp"
+#include "noconn/net/route_rules.hpp"
+
+namespace noconn
+{
+namespace net
+{
+    namespace
+    {
+        // a dotted quad member of object, empty if missing or not an address
+        std::optional<std::string> json_address(const boost::json::object& object, std::string_view name)
+        {
+            const boost::json::value* value = object.if_contains(name);
+            const boost::json::string* text = value != nullptr ? value->if_string() : nullptr;
+            if (text == nullptr || !parse_ipv4(std::string_view(text->data(), text->size())).has_value())
+            {
+                return std::nullopt;
+            }
+
+            return std::string(text->data(), text->size());
+        }
+
+        std::optional<int> json_int(const boost::json::object& object, std::string_view name)
+        {
+            const boost::json::value* value = object.if_contains(name);
+            if (value == nullptr)
+            {
+                return std::nullopt;
+            }
+
+            boost::system::error_code error_code;
+            int result = value->to_number<int>(error_code);
+            return error_code ? std::nullopt : std::optional<int>(result);
+        }
+
+        std::optional<route_change> parse_change(std::string_view name)
+        {
+            if (name == "added") return route_change::added;
+            if (name == "changed") return route_change::changed;
+            if (name == "removed") return route_change::removed;
+            return std::nullopt;
+        }
+
+        std::optional<route_condition> parse_condition(const boost::json::value& value, std::string& error)
+        {
+            const boost::json::object* object = value.if_object();
+            const boost::json::value* changes_value = object != nullptr ? object->if_contains("change") : nullptr;
+            const boost::json::array* changes = changes_value != nullptr ? changes_value->if_array() : nullptr;
+            if (changes == nullptr || changes->empty())
+            {
+                error = "\"when\" must be an object with a non-empty \"change\" array.";
+                return std::nullopt;
+            }
+
+            route_condition result;
+            for (const boost::json::value& change_value : *changes)
+            {
+                const boost::json::string* name = change_value.if_string();
+                std::optional<route_change> change = name != nullptr ? parse_change(std::string_view(name->data(), name->size())) : std::nullopt;
+                if (!change.has_value())
+                {
+                    error = "\"change\" entries must be added, changed or removed.";
+                    return std::nullopt;
+                }
+
+                result.m_changes |= static_cast<uint8_t>(1u << static_cast<unsigned>(*change));
+            }
+
+            std::optional<std::string> destination = json_address(*object, "destination");
+            std::optional<std::string> mask = json_address(*object, "mask");
+            if (destination.has_value() != mask.has_value() || destination.has_value() != object->contains("destination") || mask.has_value() != object->contains("mask"))
+            {
+                error = "\"destination\" and \"mask\" must be addresses and go together.";
+                return std::nullopt;
+            }
+
+            if (destination.has_value())
+            {
+                uint32_t mask_bits = *parse_ipv4(*mask);
+                uint8_t prefix_length = static_cast<uint8_t>(std::popcount(mask_bits));
+                if (prefix_mask(prefix_length) != mask_bits)
+                {
+                    error = "\"mask\" must be contiguous.";
+                    return std::nullopt;
+                }
+
+                result.m_destination = ipv4_prefix{ *parse_ipv4(*destination) & mask_bits, prefix_length };
+            }
+
+            if (object->contains("interface"))
+            {
+                result.m_interface_index = json_int(*object, "interface");
+                if (!result.m_interface_index.has_value())
+                {
+                    error = "\"interface\" must be an integer.";
+                    return std::nullopt;
+                }
+            }
+
+            if (object->contains("gateway"))
+            {
+                result.m_gateway = json_address(*object, "gateway");
+                if (!result.m_gateway.has_value())
+                {
+                    error = "\"gateway\" must be an address.";
+                    return std::nullopt;
+                }
+            }
+
+            if (const boost::json::value* gateway_changed = object->if_contains("gateway_changed"))
+            {
+                if (!gateway_changed->is_bool())
+                {
+                    error = "\"gateway_changed\" must be a boolean.";
+                    return std::nullopt;
+                }
+
+                result.m_gateway_changed = gateway_changed->get_bool();
+                if (result.m_gateway_changed && result.m_changes != (1u << static_cast<unsigned>(route_change::changed)))
+                {
+                    error = "\"gateway_changed\" only applies to \"change\": [\"changed\"].";
+                    return std::nullopt;
+                }
+            }
+
+            return result;
+        }
+
+        std::optional<route_threshold> parse_threshold(const boost::json::value& value, std::string& error)
+        {
+            const boost::json::object* object = value.if_object();
+            std::optional<int> count = object != nullptr ? json_int(*object, "count") : std::nullopt;
+            std::optional<int> window = object != nullptr ? json_int(*object, "window_ms") : std::nullopt;
+            if (!count.has_value() || !window.has_value() || *count < 0 || *window <= 0)
+            {
+                error = "\"threshold\" needs a non-negative \"count\" and a positive \"window_ms\".";
+                return std::nullopt;
+            }
+
+            return route_threshold{ static_cast<std::size_t>(*count), std::chrono::milliseconds(*window) };
+        }
+
+        std::optional<route_rule> parse_rule(const boost::json::value& value, std::string& error)
+        {
+            const boost::json::object* object = value.if_object();
+            const boost::json::value* name_value = object != nullptr ? object->if_contains("name") : nullptr;
+            const boost::json::string* name = name_value != nullptr ? name_value->if_string() : nullptr;
+            if (name == nullptr || name->empty())
+            {
+                error = "a rule must be an object with a \"name\".";
+                return std::nullopt;
+            }
+
+            route_rule result;
+            result.m_name = std::string(name->data(), name->size());
+
+            const boost::json::value* when = object->if_contains("when");
+            std::optional<route_condition> condition = when != nullptr ? parse_condition(*when, error) : std::nullopt;
+            if (!condition.has_value())
+            {
+                error = fmt::format("rule \"{}\": {}", result.m_name, when != nullptr ? error : "\"when\" is required.");
+                return std::nullopt;
+            }
+
+            result.m_condition = std::move(*condition);
+            if (const boost::json::value* threshold_value = object->if_contains("threshold"))
+            {
+                result.m_threshold = parse_threshold(*threshold_value, error);
+                if (!result.m_threshold.has_value())
+                {
+                    error = fmt::format("rule \"{}\": {}", result.m_name, error);
+                    return std::nullopt;
+                }
+            }
+
+            const boost::json::value* then_value = object->if_contains("then");
+            const boost::json::array* actions = then_value != nullptr ? then_value->if_array() : nullptr;
+            if (actions == nullptr || actions->empty())
+            {
+                error = fmt::format("rule \"{}\": \"then\" must be a non-empty array.", result.m_name);
+                return std::nullopt;
+            }
+
+            for (const boost::json::value& action : *actions)
+            {
+                const boost::json::object* action_object = action.if_object();
+                const boost::json::value* op = action_object != nullptr ? action_object->if_contains("op") : nullptr;
+                const boost::json::string* op_name = op != nullptr ? op->if_string() : nullptr;
+
+                std::optional<route_operation> operation;
+                if (op_name != nullptr && *op_name == "alert")
+                {
+                    result.m_alert = true;
+                    continue;
+                }
+
+                if (op_name != nullptr && *op_name == "add") operation = route_operation::add;
+                if (op_name != nullptr && *op_name == "replace") operation = route_operation::replace;
+                if (op_name != nullptr && *op_name == "remove") operation = route_operation::remove;
+
+                std::string command_error = "\"op\" must be alert, add, replace or remove.";
+                std::optional<route_command> command = operation.has_value() ? parse_route_command(*operation, action, command_error) : std::nullopt;
+                if (!command.has_value())
+                {
+                    error = fmt::format("rule \"{}\": {}", result.m_name, command_error);
+                    return std::nullopt;
+                }
+
+                result.m_commands.push_back(std::move(*command));
+            }
+
+            return result;
+        }
+    } // !anonymous namespace
+
+    std::optional<route_command> parse_route_command(route_operation operation, const boost::json::value& value, std::string& error)
+    {
+        const boost::json::object* object = value.if_object();
+        if (object == nullptr)
+        {
+            error = "a route must be a json object.";
+            return std::nullopt;
+        }
+
+        std::optional<std::string> destination = json_address(*object, "destination");
+        std::optional<std::string> mask = json_address(*object, "mask");
+        std::optional<int> interface_index = json_int(*object, "interface");
+        if (!destination.has_value() || !mask.has_value() || !interface_index.has_value())
+        {
+            error = "\"destination\", \"mask\" and \"interface\" are required.";
+            return std::nullopt;
+        }
+
+        uint32_t mask_bits = *parse_ipv4(*mask);
+        if (prefix_mask(static_cast<uint8_t>(std::popcount(mask_bits))) != mask_bits)
+        {
+            error = "\"mask\" must be contiguous.";
+            return std::nullopt;
+        }
+
+        if (operation == route_operation::remove)
+        {
+            return route_command{ operation, route_entry(*destination, *mask, *interface_index, std::string(), 0) };
+        }
+
+        std::optional<std::string> gateway = json_address(*object, "gateway");
+        std::optional<int> metric = json_int(*object, "metric");
+        if (!gateway.has_value() || !metric.has_value() || *metric < 0)
+        {
+            error = "\"gateway\" and a non-negative \"metric\" are required.";
+            return std::nullopt;
+        }
+
+        return route_command{ operation, route_entry(*destination, *mask, *interface_index, *gateway, *metric) };
+    }
+
+    std::optional<std::vector<route_rule>> parse_route_rules(const boost::json::value& document, std::string& error)
+    {
+        const boost::json::object* object = document.if_object();
+        const boost::json::value* rules_value = object != nullptr ? object->if_contains("rules") : nullptr;
+        const boost::json::array* rules = rules_value != nullptr ? rules_value->if_array() : nullptr;
+        if (rules == nullptr)
+        {
+            error = "expected {\"rules\": [...]}.";
+            return std::nullopt;
+        }
+
+        std::vector<route_rule> result;
+        result.reserve(rules->size());
+        for (const boost::json::value& rule_value : *rules)
+        {
+            std::optional<route_rule> rule = parse_rule(rule_value, error);
+            if (!rule.has_value())
+            {
+                return std::nullopt;
+            }
+
+            bool is_duplicate = std::any_of(result.begin(), result.end(), [&rule](const route_rule& other) { return other.m_name == rule->m_name; });
+            if (is_duplicate)
+            {
+                error = fmt::format("rule \"{}\" is defined twice.", rule->m_name);
+                return std::nullopt;
+            }
+
+            result.push_back(std::move(*rule));
+        }
+
+        return result;
+    }
+
+    route_rule_engine::route_rule_engine(std::vector<route_rule> rules, route_manager& manager)
+        : m_manager(manager)
+    {
+        util::metrics_registry& registry = util::metrics_registry::instance();
+        m_rules.reserve(rules.size());
+        for (route_rule& rule : rules)
+        {
+            std::string labels = fmt::format("rule=\"{}\"", rule.m_name);
+            util::counter* fired = &registry.get_counter("noconn_route_rule_fired_total", "route policy rules fired.", labels);
+            m_rules.push_back({ std::move(rule), fired, {} });
+        }
+
+        // compiled once: each (change, destination) a rule can match points back at it
+        for (std::size_t index = 0; index < m_rules.size(); ++index)
+        {
+            const route_condition& condition = m_rules[index].m_rule.m_condition;
+            for (route_change change : { route_change::added, route_change::changed, route_change::removed })
+            {
+                if ((condition.m_changes & (1u << static_cast<unsigned>(change))) == 0)
+                {
+                    continue;
+                }
+
+                if (condition.m_destination.has_value())
+                {
+                    m_by_destination[dispatch_key(change, condition.m_destination->m_address, condition.m_destination->m_length)].push_back(index);
+                }
+                else
+                {
+                    m_by_change[static_cast<std::size_t>(change)].push_back(index);
+                }
+            }
+        }
+    }
+
+    void route_rule_engine::evaluate(const route_delta_set& delta_set)
+    {
+        // the first set of a cold start is the table as it was found, not a change
+        if (delta_set.m_generation == 1)
+        {
+            return;
+        }
+
+        for (const route_delta& delta : delta_set.m_deltas)
+        {
+            auto evaluate_rule = [&](std::size_t index)
+            {
+                compiled_rule& rule = m_rules[index];
+                if (matches(rule.m_rule.m_condition, delta) && (!rule.m_rule.m_threshold.has_value() || count_match(rule, delta_set.m_time)))
+                {
+                    fire(rule, delta, delta_set.m_generation);
+                }
+            };
+
+            if (!m_by_destination.empty())
+            {
+                route_key key = make_route_key(delta.m_entry.m_identifier);
+                auto bucket = m_by_destination.find(dispatch_key(delta.m_change, key.m_destination, key.m_prefix_length));
+                if (bucket != m_by_destination.end())
+                {
+                    std::for_each(bucket->second.begin(), bucket->second.end(), evaluate_rule);
+                }
+            }
+
+            const std::vector<std::size_t>& any_destination = m_by_change[static_cast<std::size_t>(delta.m_change)];
+            std::for_each(any_destination.begin(), any_destination.end(), evaluate_rule);
+        }
+    }
+
+    std::size_t route_rule_engine::size() const
+    {
+        return m_rules.size();
+    }
+
+    uint64_t route_rule_engine::dispatch_key(route_change change, uint32_t destination, uint8_t prefix_length)
+    {
+        return (uint64_t(destination) << 16) | (uint64_t(prefix_length) << 8) | static_cast<uint64_t>(change);
+    }
+
+    // the destination was matched by the dispatch table already
+    bool route_rule_engine::matches(const route_condition& condition, const route_delta& delta)
+    {
+        const route_entry& entry = delta.m_entry;
+        if (condition.m_interface_index.has_value() && entry.m_identifier.m_interface_index != *condition.m_interface_index)
+        {
+            return false;
+        }
+
+        if (condition.m_gateway.has_value() && entry.m_gateway != *condition.m_gateway)
+        {
+            return false;
+        }
+
+        return !condition.m_gateway_changed || (delta.m_previous.has_value() && delta.m_previous->m_gateway != entry.m_gateway);
+    }
+
+    bool route_rule_engine::count_match(compiled_rule& rule, std::chrono::system_clock::time_point time)
+    {
+        const route_threshold& threshold = *rule.m_rule.m_threshold;
+        rule.m_matches.push_back(time);
+        while (rule.m_matches.front() + threshold.m_window <= time)
+        {
+            rule.m_matches.pop_front();
+        }
+
+        if (rule.m_matches.size() <= threshold.m_count)
+        {
+            return false;
+        }
+
+        rule.m_matches.clear();
+        return true;
+    }
+
+    void route_rule_engine::fire(compiled_rule& rule, const route_delta& delta, uint64_t generation)
+    {
+        rule.m_fired->add();
+        const route_identifier& identifier = delta.m_entry.m_identifier;
+        if (rule.m_rule.m_alert)
+        {
+            NOCONN_LOG_WARNING("route_rule_engine::fire", "rule \"{}\" fired at generation {} (route {}/{} if {}).",
+                rule.m_rule.m_name, generation, identifier.m_destination, identifier.m_mask, identifier.m_interface_index);
+        }
+
+        if (!rule.m_rule.m_commands.empty())
+        {
+            // the completion runs on the route engine thread, it only logs through the facade
+            m_manager.submit(rule.m_rule.m_commands, [name = rule.m_rule.m_name](route_batch_result result)
+                {
+                    if (result.m_status != route_batch_status::applied)
+                    {
+                        NOCONN_LOG_WARNING("route_rule_engine::fire", "commands of rule \"{}\" were not applied (command {}): {}", name, result.m_failed_command, result.m_error);
+                    }
+                });
+        }
+    }
+} // !namespace net
+} // !namespace noconn
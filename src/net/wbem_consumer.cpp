@@ -2,13 +2,12 @@
  *
  */
 
-#include <locale>
-#include <codecvt>
 #include <iostream>
 #include <comdef.h>
 #include <Wbemidl.h>
 #include <iphlpapi.h>
 #include <fmt/core.h>
+#include "noconn/util/utf.hpp"
 #include "noconn/net/wbem_consumer.hpp"
 #include "whatlog/logger.hpp"
 
@@ -173,9 +172,7 @@ namespace net
 
         if (FAILED(hres))
         {
-            std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> converter;
-            std::string query_str = converter.to_bytes(query);
-            log.error(fmt::format("Query {} failed. Error code = {}.", query_str, hresult_to_hex_str(hres)));
+            log.error(fmt::format("Query {} failed. Error code = {}.", util::to_utf8(query), hresult_to_hex_str(hres)));
         }
 
         return pEnumerator;
@@ -0,0 +1,227 @@
+/*
+ *
+ */
+
+#include <charconv>
+#include <string_view>
+#include <fmt/format.h>
+#include <whatlog/logger.hpp>
+#include "noconn/util/thread.hpp"
+#include "noconn/options.hpp"
+
+namespace noconn
+{
+    namespace
+    {
+        template <typename T>
+        bool parse_number(std::string_view text, T& value)
+        {
+            auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+            return error == std::errc() && end == text.data() + text.size();
+        }
+
+        // <name>:threads=<count>,cpus=<cpu>[-<cpu>],priority=<low|normal|high> onto the named lane
+        bool parse_lane(std::string_view text, options& result, std::string& error)
+        {
+            std::size_t colon = text.find(':');
+            std::string_view name = text.substr(0, colon);
+            util::lane_options* lane = name == "io" ? &result.m_io_lane : name == "poll" ? &result.m_poll_lane : name == "blocking" ? &result.m_blocking_lane : nullptr;
+            if (lane == nullptr)
+            {
+                error = fmt::format("unknown lane \"{}\", expected io, poll or blocking.", name);
+                return false;
+            }
+
+            std::string_view settings = colon == std::string_view::npos ? std::string_view() : text.substr(colon + 1);
+            while (!settings.empty())
+            {
+                std::size_t comma = settings.find(',');
+                std::string_view setting = settings.substr(0, comma);
+                settings = comma == std::string_view::npos ? std::string_view() : settings.substr(comma + 1);
+
+                std::size_t equals = setting.find('=');
+                std::string_view key = setting.substr(0, equals);
+                std::string_view value = equals == std::string_view::npos ? std::string_view() : setting.substr(equals + 1);
+                if (key == "threads")
+                {
+                    if (!parse_number(value, lane->m_threads) || lane->m_threads == 0)
+                    {
+                        error = fmt::format("invalid thread count \"{}\" for lane {}.", value, name);
+                        return false;
+                    }
+                }
+                else if (key == "cpus")
+                {
+                    std::size_t dash = value.find('-');
+                    std::size_t first = 0;
+                    std::size_t last = 0;
+                    if (!parse_number(value.substr(0, dash), first) || !parse_number(dash == std::string_view::npos ? value : value.substr(dash + 1), last) || last < first)
+                    {
+                        error = fmt::format("invalid cpus \"{}\" for lane {}.", value, name);
+                        return false;
+                    }
+
+                    lane->m_cpus.clear();
+                    for (std::size_t cpu = first; cpu <= last; ++cpu)
+                    {
+                        lane->m_cpus.push_back(cpu);
+                    }
+                }
+                else if (key == "priority" && (value == "low" || value == "normal" || value == "high"))
+                {
+                    lane->m_priority = value == "low" ? util::thread_priority::low : value == "high" ? util::thread_priority::high : util::thread_priority::normal;
+                }
+                else
+                {
+                    error = fmt::format("invalid lane setting \"{}\" for lane {}.", setting, name);
+                    return false;
+                }
+            }
+
+            return true;
+        }
+    } // !anonymous namespace
+
+    std::optional<options> parse_options(int argument_count, char** arguments)
+    {
+        whatlog::logger log("parse_options");
+        options result;
+        bool pin_threads = false;
+
+        for (int index = 1; index < argument_count; ++index)
+        {
+            std::string_view argument = arguments[index];
+            bool has_value = index + 1 < argument_count;
+
+            if (argument == "--pin-threads")
+            {
+                pin_threads = true;
+                continue;
+            }
+
+            if (argument == "--hot-restart")
+            {
+                result.m_hot_restart = true;
+                continue;
+            }
+
+            if (argument == "--trace")
+            {
+                result.m_trace = true;
+                continue;
+            }
+
+            if (argument != "--address" && argument != "--port" && argument != "--shards" && argument != "--drain-timeout" &&
+                argument != "--history-dir" && argument != "--history-retention" && argument != "--rules" &&
+                argument != "--aggregate" && argument != "--lane" && argument != "--memory-budget")
+            {
+                log.error(fmt::format("unknown argument \"{}\".", argument));
+                return std::nullopt;
+            }
+
+            if (!has_value)
+            {
+                log.error(fmt::format("missing value for argument \"{}\".", argument));
+                return std::nullopt;
+            }
+
+            std::string_view value = arguments[++index];
+            if (argument == "--address")
+            {
+                result.m_address = std::string(value);
+            }
+            else if (argument == "--port")
+            {
+                if (!parse_number(value, result.m_port))
+                {
+                    log.error(fmt::format("invalid port \"{}\".", value));
+                    return std::nullopt;
+                }
+            }
+            else if (argument == "--shards")
+            {
+                if (value == "auto")
+                {
+                    result.m_shards = util::cpu_count();
+                }
+                else if (!parse_number(value, result.m_shards))
+                {
+                    log.error(fmt::format("invalid shard count \"{}\".", value));
+                    return std::nullopt;
+                }
+            }
+            else if (argument == "--drain-timeout")
+            {
+                std::size_t seconds = 0;
+                if (!parse_number(value, seconds))
+                {
+                    log.error(fmt::format("invalid drain timeout \"{}\".", value));
+                    return std::nullopt;
+                }
+
+                result.m_drain_timeout = std::chrono::seconds(seconds);
+            }
+            else if (argument == "--history-dir")
+            {
+                result.m_history_directory = std::string(value);
+            }
+            else if (argument == "--history-retention")
+            {
+                std::size_t hours = 0;
+                if (!parse_number(value, hours) || hours == 0)
+                {
+                    log.error(fmt::format("invalid history retention \"{}\".", value));
+                    return std::nullopt;
+                }
+
+                result.m_history_retention = std::chrono::hours(hours);
+            }
+            else if (argument == "--rules")
+            {
+                result.m_rules_file = std::string(value);
+            }
+            else if (argument == "--aggregate")
+            {
+                result.m_agents_file = std::string(value);
+            }
+            else if (argument == "--memory-budget")
+            {
+                std::size_t equals = value.find('=');
+                std::optional<util::memory_subsystem> subsystem = util::parse_memory_subsystem(value.substr(0, equals));
+                std::size_t mebibytes = 0;
+                if (equals == std::string_view::npos || !subsystem.has_value() || !parse_number(value.substr(equals + 1), mebibytes) || mebibytes == 0)
+                {
+                    log.error(fmt::format("invalid memory budget \"{}\", expected <routes|adapters|connections|json|journal>=<MiB>.", value));
+                    return std::nullopt;
+                }
+
+                result.m_memory_budgets[*subsystem] = mebibytes * 1024 * 1024;
+            }
+            else if (argument == "--lane")
+            {
+                std::string error;
+                if (!parse_lane(value, result, error))
+                {
+                    log.error(error);
+                    return std::nullopt;
+                }
+            }
+        }
+
+        if (result.m_poll_lane.m_threads < 3)
+        {
+            log.error("the poll lane needs at least 3 threads, the route and adapter providers keep one each.");
+            return std::nullopt;
+        }
+
+        if (pin_threads && result.m_io_lane.m_cpus.empty())
+        {
+            for (std::size_t cpu = 0; cpu < util::cpu_count(); ++cpu)
+            {
+                result.m_io_lane.m_cpus.push_back(cpu);
+            }
+        }
+
+        return result;
+    }
+} // !namespace noconn
@@ -0,0 +1,273 @@
+/*
+ *
+ */
+
+#include <algorithm>
+#include <fmt/format.h>
+#include <boost/beast/version.hpp>
+#include "noconn/rest/admission.hpp"
+
+namespace noconn
+{
+namespace rest
+{
+namespace
+{
+	constexpr std::string_view rate_limited_message = "too many requests, slow down.";
+	constexpr std::string_view overloaded_message = "server overloaded, retry later.";
+
+	int64_t to_ticks(std::chrono::steady_clock::time_point time)
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+	}
+
+	std::string make_raw_response(std::string_view status_line, std::string_view body)
+	{
+		return fmt::format("HTTP/1.1 {}\r\nServer: {}\r\nContent-Type: text/plain\r\nContent-Length: {}\r\nRetry-After: 1\r\nConnection: close\r\n\r\n{}",
+			status_line, BOOST_BEAST_VERSION_STRING, body.size(), body);
+	}
+} // !anonymous namespace
+
+	admission_ticket::admission_ticket(admission_controller* controller, std::chrono::steady_clock::time_point admitted_at)
+		: m_controller(controller), m_admitted_at(admitted_at)
+	{
+		// nothing for now
+	}
+
+	admission_ticket::admission_ticket(admission_ticket&& other) noexcept
+		: m_controller(std::exchange(other.m_controller, nullptr)), m_admitted_at(other.m_admitted_at)
+	{
+		// nothing for now
+	}
+
+	admission_ticket& admission_ticket::operator=(admission_ticket&& other) noexcept
+	{
+		if (this != &other)
+		{
+			release(false);
+			m_controller = std::exchange(other.m_controller, nullptr);
+			m_admitted_at = other.m_admitted_at;
+		}
+
+		return *this;
+	}
+
+	admission_ticket::~admission_ticket()
+	{
+		release(false);
+	}
+
+	void admission_ticket::complete()
+	{
+		release(true);
+	}
+
+	void admission_ticket::exclude()
+	{
+		release(false);
+	}
+
+	void admission_ticket::release(bool completed)
+	{
+		if (m_controller != nullptr)
+		{
+			std::exchange(m_controller, nullptr)->release(m_admitted_at, completed);
+		}
+	}
+
+	shared_admission_controller admission_controller::create(admission_limits limits)
+	{
+		return shared_admission_controller(new admission_controller(limits));
+	}
+
+	admission_controller::admission_controller(admission_limits limits)
+		:	m_limits(limits),
+			m_rate_limited_body(std::make_shared<const std::string>(rate_limited_message)),
+			m_overloaded_body(std::make_shared<const std::string>(overloaded_message)),
+			m_rate_limited_raw(make_raw_response("429 Too Many Requests", rate_limited_message)),
+			m_overloaded_raw(make_raw_response("503 Service Unavailable", overloaded_message))
+	{
+		// nothing for now
+	}
+
+	std::size_t admission_controller::address_key_hash::operator()(const address_key& key) const
+	{
+		// fnv-1a, addresses are short and already well spread in their low bytes
+		std::size_t hash = 14695981039346656037ull;
+		for (unsigned char byte : key)
+		{
+			hash = (hash ^ byte) * 1099511628211ull;
+		}
+
+		return hash;
+	}
+
+	admission_controller::address_key admission_controller::to_key(const boost::asio::ip::address& client)
+	{
+		if (client.is_v4())
+		{
+			return boost::asio::ip::make_address_v6(boost::asio::ip::v4_mapped, client.to_v4()).to_bytes();
+		}
+
+		return client.to_v6().to_bytes();
+	}
+
+	admission_decision admission_controller::check_connection(const boost::asio::ip::address& client)
+	{
+		if (is_overloaded())
+		{
+			return admission_decision::overloaded;
+		}
+
+		return take_token(client, false) ? admission_decision::admitted : admission_decision::rate_limited;
+	}
+
+	admission_decision admission_controller::admit(const boost::asio::ip::address& client, admission_ticket& ticket)
+	{
+		// the client's token goes first, a client over its rate should not add to the overload picture
+		if (!take_token(client, true))
+		{
+			return admission_decision::rate_limited;
+		}
+
+		if (is_overloaded())
+		{
+			return admission_decision::overloaded;
+		}
+
+		m_in_flight.fetch_add(1, std::memory_order_relaxed);
+		ticket = admission_ticket(this, std::chrono::steady_clock::now());
+		return admission_decision::admitted;
+	}
+
+	bool admission_controller::is_overloaded() const
+	{
+		if (m_in_flight.load(std::memory_order_relaxed) >= m_limits.m_max_in_flight)
+		{
+			return true;
+		}
+
+		if (smoothed_latency() <= m_limits.m_max_latency)
+		{
+			return false;
+		}
+
+		// while shedding nothing new is admitted and the average stops moving, let it expire instead
+		int64_t age = to_ticks(std::chrono::steady_clock::now()) - m_last_sample.load(std::memory_order_relaxed);
+		return age < std::chrono::duration_cast<std::chrono::microseconds>(latency_window).count();
+	}
+
+	std::size_t admission_controller::in_flight() const
+	{
+		return m_in_flight.load(std::memory_order_relaxed);
+	}
+
+	std::chrono::microseconds admission_controller::smoothed_latency() const
+	{
+		return std::chrono::microseconds(m_latency_us.load(std::memory_order_relaxed));
+	}
+
+	const admission_limits& admission_controller::limits() const
+	{
+		return m_limits;
+	}
+
+	http_response admission_controller::make_rejection(const http_request& request, admission_decision decision) const
+	{
+		bool rate_limited = decision == admission_decision::rate_limited;
+		const std::shared_ptr<const std::string>& body = rate_limited ? m_rate_limited_body : m_overloaded_body;
+		boost::beast::http::status status = rate_limited ? boost::beast::http::status::too_many_requests : boost::beast::http::status::service_unavailable;
+
+		http_response response{ std::piecewise_construct, std::make_tuple(body), std::make_tuple(status, request.version()) };
+		response.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
+		response.set(boost::beast::http::field::content_type, "text/plain");
+		response.set(boost::beast::http::field::retry_after, "1");
+		response.content_length(body->size());
+		response.keep_alive(request.keep_alive());
+		return response;
+	}
+
+	const std::string& admission_controller::connection_rejection(admission_decision decision) const
+	{
+		return decision == admission_decision::rate_limited ? m_rate_limited_raw : m_overloaded_raw;
+	}
+
+	bool admission_controller::take_token(const boost::asio::ip::address& client, bool consume)
+	{
+		address_key key = to_key(client);
+		bucket_shard& shard = m_shards[address_key_hash{}(key) % bucket_shards];
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+		std::lock_guard<std::mutex> lock(shard.m_mutex);
+		auto itr_bucket = shard.m_buckets.find(key);
+		if (itr_bucket == shard.m_buckets.end())
+		{
+			if (shard.m_buckets.size() >= std::max<std::size_t>(m_limits.m_max_clients / bucket_shards, 1))
+			{
+				evict_idle(shard, now);
+				if (shard.m_buckets.size() >= std::max<std::size_t>(m_limits.m_max_clients / bucket_shards, 1))
+				{
+					// table full of active clients, admit rather than punish a client we cannot track
+					return true;
+				}
+			}
+
+			itr_bucket = shard.m_buckets.emplace(key, bucket{ m_limits.m_client_burst, now }).first;
+		}
+
+		bucket& target = itr_bucket->second;
+		refill(target, now);
+		if (target.m_tokens < 1.0)
+		{
+			return false;
+		}
+
+		if (consume)
+		{
+			target.m_tokens -= 1.0;
+		}
+
+		return true;
+	}
+
+	void admission_controller::refill(bucket& target, std::chrono::steady_clock::time_point now) const
+	{
+		std::chrono::duration<double> elapsed = now - target.m_updated;
+		target.m_tokens = std::min(m_limits.m_client_burst, target.m_tokens + elapsed.count() * m_limits.m_client_rate);
+		target.m_updated = now;
+	}
+
+	void admission_controller::evict_idle(bucket_shard& shard, std::chrono::steady_clock::time_point now) const
+	{
+		for (auto itr_bucket = shard.m_buckets.begin(); itr_bucket != shard.m_buckets.end();)
+		{
+			refill(itr_bucket->second, now);
+			if (itr_bucket->second.m_tokens >= m_limits.m_client_burst)
+			{
+				itr_bucket = shard.m_buckets.erase(itr_bucket);
+			}
+			else
+			{
+				++itr_bucket;
+			}
+		}
+	}
+
+	void admission_controller::release(std::chrono::steady_clock::time_point admitted_at, bool completed)
+	{
+		m_in_flight.fetch_sub(1, std::memory_order_relaxed);
+		if (!completed)
+		{
+			return;
+		}
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		int64_t sample = std::chrono::duration_cast<std::chrono::microseconds>(now - admitted_at).count();
+
+		// exponential moving average with weight 1/8, racing updates just lose a sample
+		int64_t current = m_latency_us.load(std::memory_order_relaxed);
+		m_latency_us.compare_exchange_strong(current, current + (sample - current) / 8, std::memory_order_relaxed);
+		m_last_sample.store(to_ticks(now), std::memory_order_relaxed);
+	}
+} // !namespace rest
+} // !namespace noconn
@@ -0,0 +1,92 @@
+/*
+ *
+ */
+
+#include "noconn/rest/cbor.hpp"
+
+namespace noconn
+{
+namespace rest
+{
+	cbor_writer::cbor_writer(std::string& output)
+		: m_output(output)
+	{
+		// nothing for now
+	}
+
+	void cbor_writer::write_head(uint8_t major, uint64_t value)
+	{
+		char head[9];
+		std::size_t size = 1;
+		uint8_t type = static_cast<uint8_t>(major << 5);
+
+		// shortest form, as required for deterministic encoding
+		if (value < 24)
+		{
+			head[0] = static_cast<char>(type | value);
+		}
+		else if (value <= 0xff)
+		{
+			head[0] = static_cast<char>(type | 24);
+			size = 2;
+		}
+		else if (value <= 0xffff)
+		{
+			head[0] = static_cast<char>(type | 25);
+			size = 3;
+		}
+		else if (value <= 0xffffffff)
+		{
+			head[0] = static_cast<char>(type | 26);
+			size = 5;
+		}
+		else
+		{
+			head[0] = static_cast<char>(type | 27);
+			size = 9;
+		}
+
+		for (std::size_t i = size - 1; i > 0; --i, value >>= 8)
+		{
+			head[i] = static_cast<char>(value & 0xff);
+		}
+
+		m_output.append(head, size);
+	}
+
+	void cbor_writer::write_int(int64_t value)
+	{
+		if (value >= 0)
+		{
+			write_head(major_unsigned, static_cast<uint64_t>(value));
+		}
+		else
+		{
+			// -1 - n, computed without overflowing on INT64_MIN
+			write_head(major_negative, ~static_cast<uint64_t>(value));
+		}
+	}
+
+	void cbor_writer::write_text(std::string_view value)
+	{
+		write_head(major_text, value.size());
+		m_output.append(value.data(), value.size());
+	}
+
+	void cbor_writer::write_bytes(const void* data, std::size_t size)
+	{
+		write_head(major_bytes, size);
+		m_output.append(static_cast<const char*>(data), size);
+	}
+
+	void cbor_writer::write_ipv4(uint32_t address)
+	{
+		const char bytes[4] = {
+			static_cast<char>(address >> 24), static_cast<char>((address >> 16) & 0xff),
+			static_cast<char>((address >> 8) & 0xff), static_cast<char>(address & 0xff)
+		};
+
+		write_bytes(bytes, sizeof(bytes));
+	}
+} // !namespace rest
+} // !namespace noconn
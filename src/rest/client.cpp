@@ -0,0 +1,271 @@
+/*
+ *
+ */
+
+#include <limits>
+#include "noconn/rest/client.hpp"
+
+namespace noconn
+{
+namespace rest
+{
+	shared_client client::create(boost::asio::any_io_executor executor, boost::asio::ip::tcp::endpoint endpoint, client_options options)
+	{
+		return shared_client(new client(executor, endpoint, options));
+	}
+
+	client::client(boost::asio::any_io_executor executor, boost::asio::ip::tcp::endpoint endpoint, client_options options)
+		: m_strand(boost::asio::make_strand(executor)), m_endpoint(endpoint), m_options(options)
+	{
+		m_options.m_pipeline_depth = std::max<std::size_t>(m_options.m_pipeline_depth, 1);
+	}
+
+	void client::send(request_type&& request, completion_handler handler)
+	{
+		m_in_flight.fetch_add(1, std::memory_order_relaxed);
+		boost::asio::post(m_strand,
+			[self = shared_from_this(), request = std::move(request), handler = std::move(handler)]() mutable
+			{
+				self->m_queued.push_back({ std::move(request), std::move(handler) });
+				if (self->m_state == connection_state::connected)
+				{
+					self->write();
+				}
+				else
+				{
+					self->reconnect_if_needed();
+				}
+			}
+		);
+	}
+
+	void client::close()
+	{
+		boost::asio::post(m_strand, [self = shared_from_this()]() { self->fail(boost::asio::error::operation_aborted, true); });
+	}
+
+	std::size_t client::in_flight() const
+	{
+		return m_in_flight.load(std::memory_order_relaxed);
+	}
+
+	void client::connect()
+	{
+		m_state = connection_state::connecting;
+		m_connecting = true;
+		m_stream.emplace(m_strand);
+		m_buffer.clear();
+
+		m_stream->expires_after(m_options.m_timeout);
+		m_stream->async_connect(m_endpoint, boost::beast::bind_front_handler(&client::on_connect, shared_from_this()));
+	}
+
+	void client::on_connect(boost::beast::error_code error_code)
+	{
+		m_connecting = false;
+		if (m_state != connection_state::connecting)
+		{
+			// closed while connecting
+			reconnect_if_needed();
+			return;
+		}
+
+		if (error_code)
+		{
+			// nobody to send the queue to, fail it instead of retrying forever
+			fail(error_code, true);
+			return;
+		}
+
+		m_state = connection_state::connected;
+		m_stream->socket().set_option(boost::asio::ip::tcp::no_delay(true), error_code);
+		write();
+	}
+
+	void client::write()
+	{
+		if (m_state != connection_state::connected || m_writing || m_queued.empty() || m_awaiting.size() >= m_options.m_pipeline_depth)
+		{
+			return;
+		}
+
+		pending_request pending = std::move(m_queued.front());
+		m_queued.pop_front();
+
+		// expect the response before the write completes, it may well arrive first
+		m_awaiting.emplace_back(std::move(pending.m_handler));
+		m_write_request.emplace(std::move(pending.m_request));
+		m_writing = true;
+
+		m_stream->expires_after(m_options.m_timeout);
+		boost::beast::http::async_write(*m_stream, *m_write_request, boost::beast::bind_front_handler(&client::on_write, shared_from_this()));
+		read();
+	}
+
+	void client::on_write(boost::beast::error_code error_code, std::size_t bytes_transferred)
+	{
+		boost::ignore_unused(bytes_transferred);
+		m_writing = false;
+		m_write_request.reset();
+
+		if (m_state != connection_state::connected)
+		{
+			// the connection failed while this write was pending
+			reconnect_if_needed();
+			return;
+		}
+
+		if (error_code)
+		{
+			fail(error_code, false);
+			return;
+		}
+
+		write();
+	}
+
+	void client::read()
+	{
+		if (m_reading || m_awaiting.empty())
+		{
+			return;
+		}
+
+		m_reading = true;
+		m_parser.emplace();
+		m_parser->body_limit(std::numeric_limits<std::uint64_t>::max());
+
+		boost::beast::http::async_read(*m_stream, m_buffer, *m_parser, boost::beast::bind_front_handler(&client::on_read, shared_from_this()));
+	}
+
+	void client::on_read(boost::beast::error_code error_code, std::size_t bytes_transferred)
+	{
+		boost::ignore_unused(bytes_transferred);
+		m_reading = false;
+
+		if (m_state != connection_state::connected)
+		{
+			reconnect_if_needed();
+			return;
+		}
+
+		if (error_code)
+		{
+			fail(error_code, false);
+			return;
+		}
+
+		response_type response = m_parser->release();
+		completion_handler handler = std::move(m_awaiting.front());
+		m_awaiting.pop_front();
+		m_in_flight.fetch_sub(1, std::memory_order_relaxed);
+
+		bool keep_alive = response.keep_alive();
+		handler({}, std::move(response));
+
+		if (!keep_alive)
+		{
+			// the server will not answer anything written after this request
+			fail(boost::beast::http::error::end_of_stream, false);
+			return;
+		}
+
+		read();
+		write();
+	}
+
+	void client::fail(boost::beast::error_code error_code, bool include_queued)
+	{
+		if (m_stream.has_value())
+		{
+			boost::beast::error_code ignored;
+			m_stream->socket().shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+			m_stream->socket().close(ignored);
+		}
+
+		m_state = connection_state::disconnected;
+
+		std::deque<completion_handler> awaiting = std::move(m_awaiting);
+		m_awaiting.clear();
+		std::deque<pending_request> queued;
+		if (include_queued)
+		{
+			queued = std::move(m_queued);
+			m_queued.clear();
+		}
+
+		// handlers may send again, run them after our own state is consistent
+		for (completion_handler& handler : awaiting)
+		{
+			m_in_flight.fetch_sub(1, std::memory_order_relaxed);
+			handler(error_code, {});
+		}
+
+		for (pending_request& pending : queued)
+		{
+			m_in_flight.fetch_sub(1, std::memory_order_relaxed);
+			pending.m_handler(error_code, {});
+		}
+
+		reconnect_if_needed();
+	}
+
+	void client::reconnect_if_needed()
+	{
+		// the old stream can only go once none of its operations are pending
+		if (m_state == connection_state::disconnected && !m_connecting && !m_writing && !m_reading && !m_queued.empty())
+		{
+			connect();
+		}
+	}
+
+	client_pool::client_pool(boost::asio::any_io_executor executor, boost::asio::ip::tcp::endpoint endpoint, std::size_t size, client_options options)
+	{
+		for (std::size_t i = 0; i < std::max<std::size_t>(size, 1); ++i)
+		{
+			m_clients.emplace_back(client::create(executor, endpoint, options));
+		}
+	}
+
+	void client_pool::send(client::request_type&& request, client::completion_handler handler)
+	{
+		// start the scan at a rotating client so ties do not all land on the first one
+		std::size_t start = m_next.fetch_add(1, std::memory_order_relaxed);
+		const shared_client* target = &m_clients[start % m_clients.size()];
+		for (std::size_t i = 1; i < m_clients.size(); ++i)
+		{
+			const shared_client& candidate = m_clients[(start + i) % m_clients.size()];
+			if (candidate->in_flight() < (*target)->in_flight())
+			{
+				target = &candidate;
+			}
+		}
+
+		(*target)->send(std::move(request), std::move(handler));
+	}
+
+	void client_pool::close()
+	{
+		for (const shared_client& target : m_clients)
+		{
+			target->close();
+		}
+	}
+
+	std::size_t client_pool::size() const
+	{
+		return m_clients.size();
+	}
+
+	std::size_t client_pool::in_flight() const
+	{
+		std::size_t result = 0;
+		for (const shared_client& target : m_clients)
+		{
+			result += target->in_flight();
+		}
+
+		return result;
+	}
+} // !namespace rest
+} // !namespace noconn
@@ -0,0 +1,395 @@
+/*
+ *
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include <zlib.h>
+#if defined(NOCONN_HAS_ZSTD)
+#include <zstd.h>
+#endif
+#include "noconn/util/trace.hpp"
+#include "noconn/rest/compression.hpp"
+
+namespace noconn
+{
+namespace rest
+{
+namespace
+{
+	std::string_view trim(std::string_view value)
+	{
+		while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+		{
+			value.remove_prefix(1);
+		}
+
+		while (!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+		{
+			value.remove_suffix(1);
+		}
+
+		return value;
+	}
+
+	bool iequals(std::string_view lhs, std::string_view rhs)
+	{
+		if (lhs.size() != rhs.size())
+		{
+			return false;
+		}
+
+		for (std::size_t i = 0; i < lhs.size(); ++i)
+		{
+			char left = (lhs[i] >= 'A' && lhs[i] <= 'Z') ? static_cast<char>(lhs[i] - 'A' + 'a') : lhs[i];
+			if (left != rhs[i])
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// q-value in thousandths, "q=0.5" => 500. anything unparsable counts as 1.
+	int parse_quality(std::string_view parameters)
+	{
+		std::size_t position = parameters.find("q=");
+		if (position == std::string_view::npos)
+		{
+			return 1000;
+		}
+
+		std::string_view value = trim(parameters.substr(position + 2));
+		if (value.empty() || value.front() == '1')
+		{
+			return 1000;
+		}
+
+		int quality = 0;
+		int scale = 100;
+		for (std::size_t i = 2; i < value.size() && value[0] == '0' && value[1] == '.' && scale > 0; ++i, scale /= 10)
+		{
+			if (value[i] < '0' || value[i] > '9')
+			{
+				break;
+			}
+
+			quality += (value[i] - '0') * scale;
+		}
+
+		return quality;
+	}
+
+	bool is_supported(content_encoding encoding)
+	{
+#if !defined(NOCONN_HAS_ZSTD)
+		if (encoding == content_encoding::zstd)
+		{
+			return false;
+		}
+#endif
+		return encoding != content_encoding::count;
+	}
+
+	std::string zlib_compress(std::string_view input, int window_bits)
+	{
+		z_stream stream{};
+		// window_bits 15 = zlib (deflate), 15 + 16 = gzip wrapper
+		if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			throw std::runtime_error("failed to initialize zlib stream.");
+		}
+
+		std::string output(deflateBound(&stream, static_cast<uLong>(input.size())) + 32, '\0');
+		stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+		stream.avail_in = static_cast<uInt>(input.size());
+		stream.next_out = reinterpret_cast<Bytef*>(output.data());
+		stream.avail_out = static_cast<uInt>(output.size());
+
+		int result = deflate(&stream, Z_FINISH);
+		output.resize(stream.total_out);
+		deflateEnd(&stream);
+
+		if (result != Z_STREAM_END)
+		{
+			throw std::runtime_error("zlib failed to compress response body.");
+		}
+
+		return output;
+	}
+} // !anonymous namespace
+
+	std::string_view to_string(content_encoding encoding)
+	{
+		switch (encoding)
+		{
+		case content_encoding::deflate:
+			return "deflate";
+		case content_encoding::gzip:
+			return "gzip";
+		case content_encoding::zstd:
+			return "zstd";
+		default:
+			return {};
+		}
+	}
+
+	content_encoding negotiate_encoding(std::string_view accept_encoding)
+	{
+		// server preference when the client weighs several encodings equally
+		constexpr std::array<content_encoding, 3> preference = { content_encoding::zstd, content_encoding::gzip, content_encoding::deflate };
+		std::array<int, static_cast<std::size_t>(content_encoding::count)> quality{};
+		quality.fill(-1);
+		int wildcard = -1;
+
+		while (!accept_encoding.empty())
+		{
+			std::size_t end = accept_encoding.find(',');
+			std::string_view item = accept_encoding.substr(0, end);
+			accept_encoding.remove_prefix(end == std::string_view::npos ? accept_encoding.size() : end + 1);
+
+			std::size_t parameters_position = item.find(';');
+			std::string_view name = trim(item.substr(0, parameters_position));
+			int item_quality = parameters_position == std::string_view::npos ? 1000 : parse_quality(item.substr(parameters_position + 1));
+
+			if (name == "*")
+			{
+				wildcard = item_quality;
+				continue;
+			}
+
+			for (content_encoding encoding : preference)
+			{
+				if (iequals(name, to_string(encoding)))
+				{
+					quality[static_cast<std::size_t>(encoding)] = item_quality;
+				}
+			}
+		}
+
+		content_encoding result = content_encoding::identity;
+		int best_quality = 0;
+		for (content_encoding encoding : preference)
+		{
+			int encoding_quality = quality[static_cast<std::size_t>(encoding)];
+			if (encoding_quality < 0)
+			{
+				encoding_quality = wildcard;
+			}
+
+			if (is_supported(encoding) && encoding_quality > best_quality)
+			{
+				result = encoding;
+				best_quality = encoding_quality;
+			}
+		}
+
+		return result;
+	}
+
+	std::string_view to_string(media_type type)
+	{
+		switch (type)
+		{
+		case media_type::cbor:
+			return "application/cbor";
+		default:
+			return "application/json";
+		}
+	}
+
+	std::optional<media_type> negotiate_media_type(std::string_view accept)
+	{
+		// json stays the default for clients that send no Accept
+		if (trim(accept).empty())
+		{
+			return media_type::json;
+		}
+
+		int json_quality = -1;
+		int cbor_quality = -1;
+		int wildcard = -1;
+
+		while (!accept.empty())
+		{
+			std::size_t end = accept.find(',');
+			std::string_view item = accept.substr(0, end);
+			accept.remove_prefix(end == std::string_view::npos ? accept.size() : end + 1);
+
+			std::size_t parameters_position = item.find(';');
+			std::string_view name = trim(item.substr(0, parameters_position));
+			int item_quality = parameters_position == std::string_view::npos ? 1000 : parse_quality(item.substr(parameters_position + 1));
+
+			if (iequals(name, to_string(media_type::json)))
+			{
+				json_quality = item_quality;
+			}
+			else if (iequals(name, to_string(media_type::cbor)))
+			{
+				cbor_quality = item_quality;
+			}
+			else if (name == "*/*" || iequals(name, "application/*"))
+			{
+				wildcard = std::max(wildcard, item_quality);
+			}
+		}
+
+		// a type the client names explicitly is weighed on its own, the others through a wildcard
+		if (json_quality < 0)
+		{
+			json_quality = wildcard;
+		}
+
+		if (cbor_quality < 0)
+		{
+			cbor_quality = wildcard;
+		}
+
+		// q=0 means not acceptable. json wins ties, so "*/*" keeps answering json
+		if (json_quality <= 0 && cbor_quality <= 0)
+		{
+			return std::nullopt;
+		}
+
+		return cbor_quality > json_quality ? media_type::cbor : media_type::json;
+	}
+
+	std::string compress(std::string_view input, content_encoding encoding)
+	{
+		NOCONN_TRACE_SPAN("compress", input.size());
+		switch (encoding)
+		{
+		case content_encoding::deflate:
+			return zlib_compress(input, 15);
+		case content_encoding::gzip:
+			return zlib_compress(input, 15 + 16);
+#if defined(NOCONN_HAS_ZSTD)
+		case content_encoding::zstd:
+		{
+			std::string output(ZSTD_compressBound(input.size()), '\0');
+			std::size_t size = ZSTD_compress(output.data(), output.size(), input.data(), input.size(), 3);
+			if (ZSTD_isError(size))
+			{
+				throw std::runtime_error("zstd failed to compress response body.");
+			}
+
+			output.resize(size);
+			return output;
+		}
+#endif
+		default:
+			return std::string(input);
+		}
+	}
+
+	cached_representation::result cached_representation::get(uint64_t generation, content_encoding encoding, const render_function& render)
+	{
+		shared_bytes identity = produce(generation, content_encoding::identity, [&render, generation]()
+			{
+				NOCONN_TRACE_SPAN("cached_representation::render", generation);
+				return render();
+			});
+
+		if (encoding == content_encoding::identity || identity->size() < min_compress_size)
+		{
+			return { identity, content_encoding::identity };
+		}
+
+		return { produce(generation, encoding, [&identity, encoding]() { return compress(*identity, encoding); }), encoding };
+	}
+
+	cached_representation::shared_bytes cached_representation::produce(uint64_t generation, content_encoding encoding, const render_function& make)
+	{
+		std::size_t index = static_cast<std::size_t>(encoding);
+		std::promise<shared_bytes> promise;
+		std::shared_future<shared_bytes> pending;
+		bool is_superseded = false;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_valid && generation < m_generation)
+			{
+				is_superseded = true;
+			}
+			else
+			{
+				if (!m_valid || generation != m_generation)
+				{
+					m_representations.fill(nullptr);
+					m_pending.fill({});
+					m_generation = generation;
+					m_valid = true;
+				}
+
+				if (m_representations[index])
+				{
+					return m_representations[index];
+				}
+
+				if (m_pending[index].valid())
+				{
+					pending = m_pending[index];
+				}
+				else
+				{
+					m_pending[index] = promise.get_future().share();
+				}
+			}
+		}
+
+		if (is_superseded)
+		{
+			// a reader holding an older snapshot, serve it without evicting the newer cache
+			return std::make_shared<const std::string>(make());
+		}
+
+		if (pending.valid())
+		{
+			// someone else is already producing it, other representations stay available meanwhile
+			return pending.get();
+		}
+
+		shared_bytes bytes;
+		try
+		{
+			bytes = std::make_shared<const std::string>(make());
+		}
+		catch (...)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_valid && generation == m_generation)
+				{
+					m_pending[index] = {};
+				}
+			}
+
+			promise.set_exception(std::current_exception());
+			throw;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			// skipped if the generation moved on meanwhile, waiters still get the bytes from the promise
+			if (m_valid && generation == m_generation)
+			{
+				m_representations[index] = bytes;
+				m_pending[index] = {};
+			}
+		}
+
+		promise.set_value(bytes);
+		return bytes;
+	}
+
+	cached_representation::result encode_body(std::string&& body, content_encoding encoding)
+	{
+		if (encoding == content_encoding::identity || body.size() < cached_representation::min_compress_size)
+		{
+			return { std::make_shared<const std::string>(std::move(body)), content_encoding::identity };
+		}
+
+		return { std::make_shared<const std::string>(compress(body, encoding)), encoding };
+	}
+} // !namespace rest
+} // !namespace noconn
@@ -2,9 +2,13 @@
  *
  */
 
+#include <array>
+#include <atomic>
 #include <fmt/format.h>
-#include <whatlog/logger.hpp>
-#include <boost/json.hpp>
+#include "noconn/util/log.hpp"
+#include "noconn/util/memory.hpp"
+#include "noconn/util/trace.hpp"
+#include "noconn/util/metrics.hpp"
 #include "noconn/rest/helper.hpp"
 #include "noconn/rest/server.hpp"
 #include "noconn/rest/connection.hpp"
@@ -50,172 +54,404 @@ namespace
 		return "application/text";
 	}
 
-	boost::json::value route_entry(const std::string& destination, const std::string& mask, const std::string& gateway, const std::string& adapter, int metric)
+	struct connection_metrics
 	{
-		boost::json::value json_value { {"destination", destination}, {"mask", mask}, {"gateway", gateway}, {"interface", adapter}, {"metric", metric} };
-		return json_value;
+		util::counter& m_requests;
+		// indexed by status class, 1xx .. 5xx
+		std::array<util::counter*, 5> m_responses;
+		util::counter& m_rate_limited;
+		util::counter& m_overloaded;
+		util::counter& m_bytes_read;
+		util::counter& m_bytes_written;
+		util::histogram& m_handler_duration;
+		util::histogram& m_request_latency;
+
+		void count_response(unsigned status)
+		{
+			std::size_t status_class = status / 100;
+			if (status_class >= 1 && status_class <= 5)
+			{
+				m_responses[status_class - 1]->add();
+			}
+		}
+	};
+
+	connection_metrics& metrics()
+	{
+		static connection_metrics instance = []
+		{
+			util::metrics_registry& registry = util::metrics_registry::instance();
+			constexpr std::string_view responses_help = "http responses written, by status class.";
+			return connection_metrics{
+				registry.get_counter("noconn_http_requests_total", "http requests read."),
+				{
+					&registry.get_counter("noconn_http_responses_total", responses_help, R"(code="1xx")"),
+					&registry.get_counter("noconn_http_responses_total", responses_help, R"(code="2xx")"),
+					&registry.get_counter("noconn_http_responses_total", responses_help, R"(code="3xx")"),
+					&registry.get_counter("noconn_http_responses_total", responses_help, R"(code="4xx")"),
+					&registry.get_counter("noconn_http_responses_total", responses_help, R"(code="5xx")")
+				},
+				registry.get_counter("noconn_http_requests_shed_total", "requests refused by admission control.", R"(reason="rate_limited")"),
+				registry.get_counter("noconn_http_requests_shed_total", "requests refused by admission control.", R"(reason="overloaded")"),
+				registry.get_counter("noconn_http_bytes_read_total", "bytes of http requests read."),
+				registry.get_counter("noconn_http_bytes_written_total", "bytes of http responses written."),
+				registry.get_histogram("noconn_http_handler_duration_seconds", "time spent routing and handling a request.", util::histogram_unit::nanoseconds),
+				registry.get_histogram("noconn_http_request_latency_seconds", "time from a request being read to its response being written.", util::histogram_unit::nanoseconds)
+			};
+		}();
+
+		return instance;
 	}
 } // !anonymous namespace
 
 	connection::connection(boost::asio::ip::tcp::socket&& socket, uint32_t session_id, shared_server server)
-		:	m_stream(std::move(socket)), m_id(session_id), m_server(server)
+		:	m_stream(std::move(socket)), m_id(session_id), m_server(server), m_admission(server->admission()),
+			m_json_arena(server->limits().m_json), m_read_signal(m_stream.get_executor()), m_write_signal(m_stream.get_executor()),
+			m_last_activity(std::chrono::steady_clock::now())
 	{
-		whatlog::logger log("connection::ctor()");
-		log.info(fmt::format("{} [CREATED] on socket {}.", m_id, to_string(m_stream.socket())));
+		boost::beast::error_code error_code;
+		m_remote_address = m_stream.socket().remote_endpoint(error_code).address();
+
+		NOCONN_LOG_INFO("connection::ctor()", "{} [CREATED] on socket {}.", m_id, to_string(m_stream.socket()));
 		// nothing for now
 	}
 
 	connection::~connection()
 	{
-		whatlog::logger log("connection::ctor()");
-		log.info(fmt::format("{} [TERMINATED] connection.", m_id));
+		NOCONN_LOG_INFO("connection::dtor()", "{} [TERMINATED] connection.", m_id);
 	}
 
 	shared_connection connection::create(boost::asio::ip::tcp::socket&& socket, shared_server server)
 	{
-		static uint32_t session_id = 0;
+		static std::atomic<uint32_t> session_id = 0;
 		return shared_connection(new connection(std::move(socket), session_id++, server));
 	}
 
+	void* connection::operator new(std::size_t size)
+	{
+		return util::memory_resource(util::memory_subsystem::connections)->allocate(size, alignof(connection));
+	}
+
+	void connection::operator delete(void* pointer, std::size_t size)
+	{
+		util::memory_resource(util::memory_subsystem::connections)->deallocate(pointer, size, alignof(connection));
+	}
+
 	void connection::open()
 	{
-		read();
+		// both loops run on the socket's strand, they never overlap
+		boost::asio::co_spawn(m_stream.get_executor(), read_loop(shared_from_this()), boost::asio::detached);
+		boost::asio::co_spawn(m_stream.get_executor(), write_loop(shared_from_this()), boost::asio::detached);
 	}
 
-	void connection::read()
+	boost::asio::awaitable<void> connection::wait(boost::asio::steady_timer& signal)
 	{
-		// clear previous request
-		m_request = {};
+		// cancelled by the other loop or close(), the error is the wake-up
+		boost::beast::error_code ignored;
+		signal.expires_at(std::chrono::steady_clock::time_point::max());
+		co_await signal.async_wait(use_handler_memory(ignored));
+	}
 
-		m_stream.expires_after(std::chrono::seconds(30));
+	boost::asio::awaitable<void> connection::read_loop(shared_connection self)
+	{
+		while (!m_read_closed && !m_closed)
+		{
+			// back-pressure: stop reading ahead until the client drains some responses
+			if (m_responses.size() >= max_pipelined_responses)
+			{
+				co_await wait(m_read_signal);
+				continue;
+			}
+
+			// clear previous request, its response is already queued. the parser (and the json value in its
+			// body) has to go before the arena memory is recycled.
+			m_parser.reset();
+			m_json_arena.reset();
+
+			m_parser.emplace();
+			m_parser->body_limit(m_json_arena.limits().m_max_body_size);
+			m_parser->get().body().m_arena = &m_json_arena;
+			m_reading = true;
+
+			m_stream.expires_after(read_timeout);
+
+			boost::beast::error_code error_code;
+			std::size_t bytes_transferred = co_await boost::beast::http::async_read(m_stream, m_buffer, *m_parser, use_handler_memory(error_code));
+			m_reading = false;
+
+			if (!co_await on_read(error_code, bytes_transferred))
+			{
+				break;
+			}
+		}
 
-		boost::beast::http::async_read(m_stream, m_buffer, m_request,
-			boost::beast::bind_front_handler(&connection::on_read, shared_from_this())
-		);
+		// the writer closes once it has written what we owe
+		m_write_signal.cancel();
 	}
 
-	void connection::on_read(boost::beast::error_code error_code, std::size_t bytes_transferred)
+	boost::asio::awaitable<bool> connection::on_read(boost::beast::error_code error_code, std::size_t bytes_transferred)
 	{
-		boost::ignore_unused(bytes_transferred);
-		whatlog::logger log("connection::on_read");
+		NOCONN_TRACE_ASYNC_SPAN("connection::on_read", m_id);
+		m_last_activity = std::chrono::steady_clock::now();
+		// the writer moves m_last_activity on while an async handler is suspended
+		std::chrono::steady_clock::time_point received = m_last_activity;
+		metrics().m_bytes_read.add(bytes_transferred);
 
 		if (error_code == boost::beast::http::error::end_of_stream ||
 			error_code == boost::asio::error::connection_reset ||
 			error_code == boost::asio::error::eof ||
-			error_code == boost::asio::error::timed_out)
+			error_code == boost::asio::error::timed_out ||
+			error_code == boost::beast::error::timeout)
 		{
-			log.info(fmt::format("{} [CLOSED] by remote endpoint.", m_id));
+			NOCONN_LOG_INFO("connection::on_read", "{} [CLOSED] by remote endpoint.", m_id);
 
-			// connection closed by sender
-			close();
-			return;
+			// connection closed by sender, finish writing what we owe it first
+			m_read_closed = true;
+			co_return false;
+		}
+
+		if (error_code == boost::asio::error::operation_aborted)
+		{
+			// socket closed by us (reaper or shutdown)
+			co_return false;
+		}
+
+		if (error_code == boost::beast::http::error::body_limit)
+		{
+			NOCONN_LOG_WARNING("connection::on_read", "{} [REJECTED] request body larger than {} bytes.", m_id, m_json_arena.limits().m_max_body_size);
+
+			// the rest of the body is still on the wire, answer and hang up
+			http_response response = make_error_response(m_parser->get(), boost::beast::http::status::payload_too_large, "request body too large.");
+			response.keep_alive(false);
+			m_read_closed = true;
+			enqueue(std::move(response), admission_ticket(), received);
+			co_return false;
 		}
 
 		if (error_code)
 		{
-			log.error(fmt::format("{} [ERROR] during read. message: {}.", m_id, error_code.message()));
+			NOCONN_LOG_ERROR("connection::on_read", "{} [ERROR] during read. message: {}.", m_id, error_code.message());
 			close();
-			return;
+			co_return false;
 		}
 
 		{
-			std::string target = m_request.target().to_string();
-			std::string method = m_request.method_string().to_string();
-			std::string body = m_request.body();
-			log.info(fmt::format("{} [REQUEST] target: {}, method: {}, body: {}.", m_id, target, method, body));
+			const http_request& request = m_parser->get();
+			// views, only copied into the log record if info is enabled
+			std::string_view target(request.target().data(), request.target().size());
+			std::string_view method(request.method_string().data(), request.method_string().size());
+			NOCONN_LOG_INFO("connection::on_read", "{} [REQUEST] target: {}, method: {}, body: {} bytes.", m_id, target, method, request.body().m_size);
 		}
 
-		// Make sure we can handle the method
-		if (m_request.method() != boost::beast::http::verb::get && 
-			m_request.method() != boost::beast::http::verb::head)
-		{
-			m_response = { boost::beast::http::status::bad_request, m_request.version() };
-			m_response.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
-			m_response.set(boost::beast::http::field::content_type, "text/html");
-			m_response.keep_alive(false);
-			m_response.body() = std::string("Unknown HTTP-method");
-			m_response.prepare_payload();
+		metrics().m_requests.add();
 
-			boost::beast::http::async_write(
-				m_stream, m_response,
-				boost::beast::bind_front_handler(
-					&connection::on_write,
-					shared_from_this(),
-					m_response.need_eof()
-				)
-			);
+		admission_ticket ticket;
+		admission_decision decision = m_admission->admit(m_remote_address, ticket);
+		if (decision != admission_decision::admitted)
+		{
+			(decision == admission_decision::rate_limited ? metrics().m_rate_limited : metrics().m_overloaded).add();
+			NOCONN_LOG_DEBUG("connection::on_read", "{} [SHED] request refused with {}.", m_id, decision == admission_decision::rate_limited ? 429 : 503);
+		}
 
-			return;
+		std::optional<http_response> response;
+		if (decision == admission_decision::admitted)
+		{
+			response.emplace(co_await handle_request(ticket));
+		}
+		else
+		{
+			response.emplace(m_admission->make_rejection(m_parser->get(), decision));
 		}
 
-		boost::json::object json;
-		json["entry_0"] = route_entry("0.0.0.0", "0.0.0.0", "192.168.0.1", "192.168.0.13", 55);
-		json["entry_1"] = route_entry("127.0.0.0", "255.0.0.0", "0.0.0.0", "127.0.0.1", 331);
-		json["entry_2"] = route_entry("127.0.0.1", "255.255.255.255", "0.0.0.0", "127.0.0.1", 331);
-		std::string json_routes = boost::json::serialize(json);
-		size_t json_routes_size = json_routes.size();
+		if (m_closed)
+		{
+			// closed while the handler was suspended, the ticket is released with it
+			co_return false;
+		}
 
-		m_response = { std::piecewise_construct, std::make_tuple(std::move(json_routes)), std::make_tuple(boost::beast::http::status::ok, m_request.version()) };
-		m_response.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
-		m_response.set(boost::beast::http::field::content_type, "application/json");
-		m_response.content_length(json_routes_size);
-		m_response.keep_alive(m_request.keep_alive());
+		if (m_draining)
+		{
+			// tell the client to reconnect, the listener has moved on
+			response->keep_alive(false);
+		}
 
+		if (!response->keep_alive())
 		{
-			whatlog::logger log_output("on_read", "input_output");
-			std::string body = m_response.body();
-			log.info(fmt::format("{} [RESPONSE] body: {}.", m_id, body));
-			log_output.info(fmt::format("{} [RESPONSE] body: {}.", m_id, body));
+			// nothing after this request will be answered
+			m_read_closed = true;
 		}
 
-		boost::beast::http::async_write(
-			m_stream, m_response,
-			boost::beast::bind_front_handler(
-				&connection::on_write,
-				shared_from_this(),
-				m_response.need_eof()
-			)
-		);
+		enqueue(std::move(*response), std::move(ticket), received);
+		co_return !m_read_closed;
+	}
 
-		read();
+	boost::asio::awaitable<http_response> connection::handle_request(admission_ticket& ticket)
+	{
+		NOCONN_TRACE_ASYNC_SPAN("connection::handle_request", m_id);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		m_handling = true;
+		http_response response = co_await m_server->get_router().dispatch(m_parser->get(), &ticket);
+		m_handling = false;
+		metrics().m_handler_duration.record(std::chrono::steady_clock::now() - start);
+
+		NOCONN_LOG_INFO("connection::handle_request", "{} [RESPONSE] status: {}, {} bytes.", m_id, response.result_int(), response.body().size());
+		// full bodies only when tracing, they can be whole routing tables
+		NOCONN_LOG_TRACE("connection::handle_request", "{} [RESPONSE] body: {}.", m_id, response.body().view());
+
+		co_return response;
 	}
 
-	void connection::on_write(bool close_connection, boost::beast::error_code error_code, std::size_t bytes_transferred)
+	void connection::enqueue(http_response&& response, admission_ticket&& ticket, std::chrono::steady_clock::time_point received)
 	{
-		boost::ignore_unused(bytes_transferred);
-		whatlog::logger log("connection::on_write");
+		metrics().count_response(response.result_int());
+		m_responses.push_back({ std::move(response), std::move(ticket), received });
+		m_write_signal.cancel();
+	}
 
-		if (error_code)
+	boost::asio::awaitable<void> connection::write_loop(shared_connection self)
+	{
+		for (;;)
 		{
-			log.error(fmt::format("{} [FAILED] write. message: {}.", m_id, error_code.message()));
+			if (m_closed)
+			{
+				co_return;
+			}
+
+			if (m_responses.empty())
+			{
+				// nothing owed and nothing more coming
+				if (m_read_closed || (m_draining && is_idle()))
+				{
+					close();
+					co_return;
+				}
+
+				co_await wait(m_write_signal);
+				continue;
+			}
+
+			http_response& response = m_responses.front().m_response;
+			bool close_connection = response.need_eof();
+			m_writing = true;
+
+			boost::beast::error_code error_code;
+			std::size_t bytes_transferred = 0;
+			{
+				NOCONN_TRACE_ASYNC_SPAN("connection::async_write", m_id);
+				bytes_transferred = co_await boost::beast::http::async_write(m_stream, response, use_handler_memory(error_code));
+			}
+
+			m_writing = false;
+			metrics().m_bytes_written.add(bytes_transferred);
+			if (!error_code)
+			{
+				m_responses.front().m_ticket.complete();
+				metrics().m_request_latency.record(std::chrono::steady_clock::now() - m_responses.front().m_received);
+			}
+
+			m_responses.pop_front();
+			m_last_activity = std::chrono::steady_clock::now();
+			// resume reading if the queue was full
+			m_read_signal.cancel();
+
+			if (error_code)
+			{
+				NOCONN_LOG_ERROR("connection::write_loop", "{} [FAILED] write. message: {}.", m_id, error_code.message());
+				close();
+				co_return;
+			}
+
+			if (close_connection)
+			{
+				close();
+				co_return;
+			}
 		}
+	}
 
-		if (close_connection)
+	void connection::close()
+	{
+		if (m_closed)
 		{
-			close();
 			return;
 		}
-	}
 
-	void connection::close()
-	{
+		m_closed = true;
 		boost::beast::error_code error_code;
-		whatlog::logger log("connection::close");
 
-		log.info(fmt::format("{} [DISCONNECTED].", m_id));
+		NOCONN_LOG_INFO("connection::close", "{} [DISCONNECTED].", m_id);
 		m_stream.socket().shutdown(boost::asio::ip::tcp::socket::shutdown_send, error_code);
 
 		if (error_code)
 		{
-			log.error(fmt::format("{} [ERROR] during shutdown of session. message: {}.", m_id, error_code.message()));
+			NOCONN_LOG_ERROR("connection::close", "{} [ERROR] during shutdown of session. message: {}.", m_id, error_code.message());
 		}
 
+		// cancels the pending read and wakes both loops so they release our last references
+		m_stream.socket().close(error_code);
+		m_read_signal.cancel();
+		m_write_signal.cancel();
+
 		m_server->close(shared_from_this());
 	}
 
+	void connection::close_if_idle(std::chrono::steady_clock::duration idle_timeout)
+	{
+		boost::asio::post(m_stream.get_executor(),
+			[self = shared_from_this(), idle_timeout]()
+			{
+				bool is_busy = self->m_writing || self->m_handling || !self->m_responses.empty();
+				if (self->m_closed || is_busy || std::chrono::steady_clock::now() - self->m_last_activity < idle_timeout)
+				{
+					return;
+				}
+
+				NOCONN_LOG_INFO("connection::close_if_idle", "{} [IDLE] reaping keep-alive connection.", self->m_id);
+				self->close();
+			}
+		);
+	}
+
+	void connection::drain()
+	{
+		boost::asio::post(m_stream.get_executor(),
+			[self = shared_from_this()]()
+			{
+				if (self->m_closed)
+				{
+					return;
+				}
+
+				self->m_draining = true;
+				if (self->is_idle())
+				{
+					NOCONN_LOG_INFO("connection::drain", "{} [DRAINED] closing idle connection.", self->m_id);
+					self->close();
+				}
+			}
+		);
+	}
+
+	bool connection::is_idle() const
+	{
+		// a pending read that has not seen a byte yet is just waiting for the next request
+		bool is_reading_request = m_reading && m_parser.has_value() && m_parser->got_some();
+		return !m_writing && !m_handling && m_responses.empty() && !is_reading_request;
+	}
+
 	uint32_t connection::id() const
 	{
 		return m_id;
 	}
+
+	connection_handle connection::handle() const
+	{
+		return m_handle;
+	}
+
+	void connection::set_handle(connection_handle handle)
+	{
+		m_handle = handle;
+	}
 } // !namespace rest
 } // !namespace noconn
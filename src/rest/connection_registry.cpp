@@ -0,0 +1,113 @@
+/*
+ *
+ */
+
+#include "noconn/rest/connection_registry.hpp"
+
+namespace noconn
+{
+namespace rest
+{
+	connection_registry::connection_registry(std::size_t capacity)
+		:	m_slots(capacity),
+			m_free_head(capacity == 0 ? invalid_index : 0)
+	{
+		for (std::size_t index = 0; index + 1 < capacity; ++index)
+		{
+			m_slots[index].m_next_free = static_cast<uint32_t>(index + 1);
+		}
+	}
+
+	std::optional<connection_registry::handle> connection_registry::insert(shared_connection connection)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_free_head == invalid_index)
+		{
+			return std::nullopt;
+		}
+
+		uint32_t index = m_free_head;
+		slot& target = m_slots[index];
+		m_free_head = target.m_next_free;
+		target.m_next_free = invalid_index;
+		target.m_connection = std::move(connection);
+		++m_size;
+
+		return handle{ index, target.m_generation };
+	}
+
+	bool connection_registry::remove(handle target_handle)
+	{
+		shared_connection released;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (target_handle.m_index >= m_slots.size())
+			{
+				return false;
+			}
+
+			slot& target = m_slots[target_handle.m_index];
+			if (target.m_generation != target_handle.m_generation || !target.m_connection)
+			{
+				return false;
+			}
+
+			// drop the reference outside the lock, the connection destructor logs
+			released = std::move(target.m_connection);
+			++target.m_generation;
+			target.m_next_free = m_free_head;
+			m_free_head = target_handle.m_index;
+			--m_size;
+		}
+
+		return true;
+	}
+
+	std::size_t connection_registry::size() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_size;
+	}
+
+	std::size_t connection_registry::capacity() const
+	{
+		return m_slots.size();
+	}
+
+	void connection_registry::for_each(const std::function<void(const shared_connection&)>& callback) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (const slot& current : m_slots)
+		{
+			if (current.m_connection)
+			{
+				callback(current.m_connection);
+			}
+		}
+	}
+
+	void connection_registry::clear()
+	{
+		std::vector<shared_connection> released;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			released.reserve(m_size);
+			m_free_head = invalid_index;
+			for (std::size_t index = m_slots.size(); index-- > 0;)
+			{
+				slot& current = m_slots[index];
+				if (current.m_connection)
+				{
+					released.emplace_back(std::move(current.m_connection));
+					++current.m_generation;
+				}
+
+				current.m_next_free = m_free_head;
+				m_free_head = static_cast<uint32_t>(index);
+			}
+
+			m_size = 0;
+		}
+	}
+} // !namespace rest
+} // !namespace noconn
@@ -0,0 +1,56 @@
+/*
+ *
+ */
+
+#include <new>
+#include "noconn/util/metrics.hpp"
+#include "noconn/rest/handler_memory.hpp"
+
+namespace noconn
+{
+namespace rest
+{
+namespace
+{
+	util::counter& heap_allocations()
+	{
+		static util::counter& instance = util::metrics_registry::instance().get_counter(
+			"noconn_http_handler_heap_allocations_total", "completion handler allocations that did not fit the connection's slots.");
+		return instance;
+	}
+} // !anonymous namespace
+
+	void* handler_memory::allocate(std::size_t size)
+	{
+		if (size <= slot_size)
+		{
+			for (std::size_t index = 0; index < slot_count; ++index)
+			{
+				bool expected = false;
+				if (m_in_use[index].compare_exchange_strong(expected, true, std::memory_order_acquire, std::memory_order_relaxed))
+				{
+					return m_slots[index].m_storage;
+				}
+			}
+		}
+
+		heap_allocations().add();
+		return ::operator new(size);
+	}
+
+	void handler_memory::deallocate(void* pointer)
+	{
+		auto* storage = static_cast<unsigned char*>(pointer);
+		for (std::size_t index = 0; index < slot_count; ++index)
+		{
+			if (storage == m_slots[index].m_storage)
+			{
+				m_in_use[index].store(false, std::memory_order_release);
+				return;
+			}
+		}
+
+		::operator delete(pointer);
+	}
+} // !namespace rest
+} // !namespace noconn
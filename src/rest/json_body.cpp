@@ -0,0 +1,63 @@
+/*
+ *
+ */
+
+#include "noconn/util/memory.hpp"
+#include "noconn/rest/json_body.hpp"
+
+namespace noconn
+{
+namespace rest
+{
+namespace
+{
+	boost::json::parse_options make_parse_options(const json_limits& limits)
+	{
+		boost::json::parse_options options;
+		options.max_depth = limits.m_max_depth;
+		return options;
+	}
+
+	// where arenas grow past their initial block, accounted to util::memory_subsystem::json. never
+	// destroyed, like the accounts
+	boost::json::memory_resource* json_upstream()
+	{
+		using json_tracking_resource = util::basic_tracking_resource<boost::json::memory_resource>;
+		static json_tracking_resource* resource = new json_tracking_resource(util::get_memory_account(util::memory_subsystem::json), boost::json::storage_ptr().get());
+		return resource;
+	}
+} // !anonymous namespace
+
+	json_arena::json_arena(json_limits limits)
+		:	m_limits(limits),
+			m_initial_block(new unsigned char[initial_block_size]),
+			m_resource(m_initial_block.get(), initial_block_size, boost::json::storage_ptr(json_upstream())),
+			m_parser(boost::json::storage_ptr(), make_parse_options(limits), m_parser_buffer.data(), m_parser_buffer.size())
+	{
+		// nothing for now
+	}
+
+	boost::json::stream_parser& json_arena::parser()
+	{
+		return m_parser;
+	}
+
+	const json_limits& json_arena::limits() const
+	{
+		return m_limits;
+	}
+
+	void json_arena::begin()
+	{
+		// the value tree is allocated from the arena, the parser's own stack stays in m_parser_buffer
+		m_parser.reset(boost::json::storage_ptr(&m_resource));
+	}
+
+	void json_arena::reset()
+	{
+		// drop any half parsed value before its memory is handed back
+		m_parser.reset();
+		m_resource.release();
+	}
+} // !namespace rest
+} // !namespace noconn
@@ -0,0 +1,89 @@
+/*
+ *
+ */
+
+#include "noconn/rest/query.hpp"
+
+namespace noconn
+{
+namespace rest
+{
+namespace
+{
+	int hex_value(char c)
+	{
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+		return -1;
+	}
+
+	std::string decode(std::string_view text)
+	{
+		std::string result;
+		result.reserve(text.size());
+		for (std::size_t i = 0; i < text.size(); ++i)
+		{
+			if (text[i] == '+')
+			{
+				result.push_back(' ');
+			}
+			else if (text[i] == '%' && i + 2 < text.size() && hex_value(text[i + 1]) >= 0 && hex_value(text[i + 2]) >= 0)
+			{
+				result.push_back(static_cast<char>(hex_value(text[i + 1]) * 16 + hex_value(text[i + 2])));
+				i += 2;
+			}
+			else
+			{
+				result.push_back(text[i]);
+			}
+		}
+
+		return result;
+	}
+} // !anonymous namespace
+
+	query_parameters::query_parameters(std::string_view query)
+	{
+		while (!query.empty())
+		{
+			std::size_t end = query.find('&');
+			std::string_view item = query.substr(0, end);
+			query.remove_prefix(end == std::string_view::npos ? query.size() : end + 1);
+
+			if (item.empty())
+			{
+				continue;
+			}
+
+			std::size_t equals = item.find('=');
+			std::string_view name = item.substr(0, equals);
+			std::string_view value = equals == std::string_view::npos ? std::string_view() : item.substr(equals + 1);
+			m_parameters.emplace_back(decode(name), decode(value));
+		}
+	}
+
+	std::optional<std::string_view> query_parameters::get(std::string_view name) const
+	{
+		for (const auto& parameter : m_parameters)
+		{
+			if (parameter.first == name)
+			{
+				return std::string_view(parameter.second);
+			}
+		}
+
+		return std::nullopt;
+	}
+
+	bool query_parameters::empty() const
+	{
+		return m_parameters.empty();
+	}
+
+	const std::vector<std::pair<std::string, std::string>>& query_parameters::items() const
+	{
+		return m_parameters;
+	}
+} // !namespace rest
+} // !namespace noconn
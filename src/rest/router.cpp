@@ -0,0 +1,358 @@
+/*
+ *
+ */
+
+#include <optional>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/beast/version.hpp>
+#include "noconn/rest/router.hpp"
+
+namespace noconn
+{
+namespace rest
+{
+namespace
+{
+	char to_lower(char c)
+	{
+		return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+	}
+
+	// lower_case is already lower case
+	bool iequals_lower(std::string_view value, std::string_view lower_case)
+	{
+		if (value.size() != lower_case.size())
+		{
+			return false;
+		}
+
+		for (std::size_t i = 0; i < value.size(); ++i)
+		{
+			if (to_lower(value[i]) != lower_case[i])
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// returns the next non-empty segment and advances path past it
+	std::string_view next_segment(std::string_view& path)
+	{
+		while (!path.empty() && path.front() == '/')
+		{
+			path.remove_prefix(1);
+		}
+
+		std::size_t end = path.find('/');
+		std::string_view segment = path.substr(0, end);
+		path.remove_prefix(end == std::string_view::npos ? path.size() : end);
+		return segment;
+	}
+
+	bool is_parameter(std::string_view segment)
+	{
+		return segment.size() > 2 && segment.front() == '{' && segment.back() == '}';
+	}
+} // !anonymous namespace
+
+	std::string_view route_parameters::get(std::string_view name) const
+	{
+		for (std::size_t i = 0; i < m_size; ++i)
+		{
+			if (m_parameters[i].first == name)
+			{
+				return m_parameters[i].second;
+			}
+		}
+
+		return {};
+	}
+
+	std::size_t route_parameters::size() const
+	{
+		return m_size;
+	}
+
+	bool route_parameters::push(std::string_view name, std::string_view value)
+	{
+		if (m_size == max_parameters)
+		{
+			return false;
+		}
+
+		m_parameters[m_size++] = { name, value };
+		return true;
+	}
+
+	void route_parameters::clear()
+	{
+		m_size = 0;
+	}
+
+	http_response make_response(const http_request& request, boost::beast::http::status status, std::string&& body, std::string_view content_type)
+	{
+		std::size_t body_size = body.size();
+		http_response response{ std::piecewise_construct, std::make_tuple(std::move(body)), std::make_tuple(status, request.version()) };
+		response.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
+		response.set(boost::beast::http::field::content_type, boost::beast::string_view(content_type.data(), content_type.size()));
+		response.content_length(body_size);
+		response.keep_alive(request.keep_alive());
+		return response;
+	}
+
+	http_response make_response(const http_request& request, boost::beast::http::status status, const cached_representation::result& body, std::string_view content_type)
+	{
+		std::size_t body_size = body.m_body->size();
+		http_response response{ std::piecewise_construct, std::make_tuple(body.m_body), std::make_tuple(status, request.version()) };
+		response.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
+		response.set(boost::beast::http::field::content_type, boost::beast::string_view(content_type.data(), content_type.size()));
+		response.set(boost::beast::http::field::vary, "Accept-Encoding");
+		if (body.m_encoding != content_encoding::identity)
+		{
+			std::string_view encoding = to_string(body.m_encoding);
+			response.set(boost::beast::http::field::content_encoding, boost::beast::string_view(encoding.data(), encoding.size()));
+		}
+
+		response.content_length(body_size);
+		response.keep_alive(request.keep_alive());
+		return response;
+	}
+
+	http_response make_error_response(const http_request& request, boost::beast::http::status status, std::string_view message)
+	{
+		return make_response(request, status, std::string(message), "text/plain");
+	}
+
+	router::router()
+		: m_nodes(1)
+	{
+		// node 0 is the root
+	}
+
+	void router::add(std::string_view path, boost::beast::http::verb method, route_handler handler)
+	{
+		add_handler(path, method, std::move(handler));
+	}
+
+	void router::add(std::string_view path, std::initializer_list<boost::beast::http::verb> methods, route_handler handler)
+	{
+		for (boost::beast::http::verb method : methods)
+		{
+			add(path, method, handler);
+		}
+	}
+
+	void router::add_async(std::string_view path, boost::beast::http::verb method, async_route_handler handler)
+	{
+		add_handler(path, method, std::move(handler));
+	}
+
+	void router::add_async(std::string_view path, std::initializer_list<boost::beast::http::verb> methods, async_route_handler handler)
+	{
+		for (boost::beast::http::verb method : methods)
+		{
+			add_async(path, method, handler);
+		}
+	}
+
+	void router::add_handler(std::string_view path, boost::beast::http::verb method, any_route_handler handler)
+	{
+		node& target = m_nodes[insert(path)];
+		if (find_handler(target, method) != nullptr)
+		{
+			throw std::logic_error("route registered twice for the same method: " + std::string(path));
+		}
+
+		target.m_handlers.emplace_back(method, std::move(handler));
+	}
+
+	uint32_t router::insert(std::string_view path)
+	{
+		uint32_t current = 0;
+		for (std::string_view segment = next_segment(path); !segment.empty(); segment = next_segment(path))
+		{
+			if (is_parameter(segment))
+			{
+				std::string_view name = segment.substr(1, segment.size() - 2);
+				uint32_t child = m_nodes[current].m_parameter_child;
+				if (child == no_node)
+				{
+					child = static_cast<uint32_t>(m_nodes.size());
+					m_nodes.emplace_back();
+					m_nodes[child].m_segment = std::string(name);
+					m_nodes[current].m_parameter_child = child;
+				}
+				else if (m_nodes[child].m_segment != name)
+				{
+					throw std::logic_error("conflicting parameter names in route: " + std::string(segment));
+				}
+
+				current = child;
+				continue;
+			}
+
+			std::string lower_case(segment.size(), '\0');
+			std::transform(segment.begin(), segment.end(), lower_case.begin(), to_lower);
+
+			std::vector<uint32_t>& children = m_nodes[current].m_children;
+			auto itr_child = std::find_if(children.begin(), children.end(), [&](uint32_t child) { return m_nodes[child].m_segment == lower_case; });
+			if (itr_child != children.end())
+			{
+				current = *itr_child;
+				continue;
+			}
+
+			uint32_t child = static_cast<uint32_t>(m_nodes.size());
+			m_nodes.emplace_back();
+			m_nodes[child].m_segment = std::move(lower_case);
+
+			// m_nodes may have reallocated
+			std::vector<uint32_t>& siblings = m_nodes[current].m_children;
+			auto position = std::upper_bound(siblings.begin(), siblings.end(), m_nodes[child].m_segment.size(),
+				[&](std::size_t size, uint32_t sibling) { return size < m_nodes[sibling].m_segment.size(); });
+			siblings.insert(position, child);
+
+			current = child;
+		}
+
+		return current;
+	}
+
+	uint32_t router::find(std::string_view path, route_parameters& parameters) const
+	{
+		uint32_t current = 0;
+		for (std::string_view segment = next_segment(path); !segment.empty(); segment = next_segment(path))
+		{
+			const node& parent = m_nodes[current];
+			uint32_t match = no_node;
+
+			auto first = std::lower_bound(parent.m_children.begin(), parent.m_children.end(), segment.size(),
+				[&](uint32_t child, std::size_t size) { return m_nodes[child].m_segment.size() < size; });
+			for (auto itr_child = first; itr_child != parent.m_children.end() && m_nodes[*itr_child].m_segment.size() == segment.size(); ++itr_child)
+			{
+				if (iequals_lower(segment, m_nodes[*itr_child].m_segment))
+				{
+					match = *itr_child;
+					break;
+				}
+			}
+
+			// literals win over parameters
+			if (match == no_node && parent.m_parameter_child != no_node)
+			{
+				match = parent.m_parameter_child;
+				if (!parameters.push(m_nodes[match].m_segment, segment))
+				{
+					return no_node;
+				}
+			}
+
+			if (match == no_node)
+			{
+				return no_node;
+			}
+
+			current = match;
+		}
+
+		return current;
+	}
+
+	const router::any_route_handler* router::find_handler(const node& target, boost::beast::http::verb method) const
+	{
+		for (const auto& handler : target.m_handlers)
+		{
+			if (handler.first == method)
+			{
+				return &handler.second;
+			}
+		}
+
+		return nullptr;
+	}
+
+	std::string router::allowed_methods(const node& target) const
+	{
+		std::string result;
+		for (const auto& handler : target.m_handlers)
+		{
+			if (!result.empty())
+			{
+				result += ", ";
+			}
+
+			boost::beast::string_view method = boost::beast::http::to_string(handler.first);
+			result.append(method.data(), method.size());
+		}
+
+		return result;
+	}
+
+	boost::asio::awaitable<http_response> router::dispatch(const http_request& request, admission_ticket* ticket) const
+	{
+		boost::beast::string_view target = request.target();
+		std::string_view path(target.data(), target.size());
+		std::string_view query;
+
+		std::size_t query_position = path.find('?');
+		if (query_position != std::string_view::npos)
+		{
+			query = path.substr(query_position + 1);
+			path = path.substr(0, query_position);
+		}
+
+		while (!path.empty() && path.front() == '/')
+		{
+			path.remove_prefix(1);
+		}
+
+		// lives in this frame, async handlers may hold on to it while suspended
+		request_context context{ request, path, query, {}, ticket };
+		uint32_t index = find(path, context.m_parameters);
+		if (index == no_node || m_nodes[index].m_handlers.empty())
+		{
+			co_return make_error_response(request, boost::beast::http::status::not_found, "service requested not found.");
+		}
+
+		const node& target_node = m_nodes[index];
+		const any_route_handler* handler = find_handler(target_node, request.method());
+		bool is_head_fallback = false;
+		if (handler == nullptr && request.method() == boost::beast::http::verb::head)
+		{
+			handler = find_handler(target_node, boost::beast::http::verb::get);
+			is_head_fallback = handler != nullptr;
+		}
+
+		if (handler == nullptr)
+		{
+			http_response response = make_error_response(request, boost::beast::http::status::method_not_allowed, "invalid rest method.");
+			response.set(boost::beast::http::field::allow, allowed_methods(target_node));
+			co_return response;
+		}
+
+		// plain handlers are called in place, only async ones add a coroutine frame
+		std::optional<http_response> response;
+		if (const route_handler* plain_handler = std::get_if<route_handler>(handler))
+		{
+			response.emplace((*plain_handler)(context));
+		}
+		else
+		{
+			response.emplace(co_await std::get<async_route_handler>(*handler)(context));
+		}
+
+		if (is_head_fallback)
+		{
+			// keep the headers (including content-length) of the GET response, drop the body
+			std::size_t content_length = response->body().size();
+			response->body().clear();
+			response->content_length(content_length);
+		}
+
+		co_return std::move(*response);
+	}
+} // !namespace rest
+} // !namespace noconn
@@ -4,6 +4,9 @@
 
 #include <fmt/format.h>
 #include <whatlog/logger.hpp>
+#include "noconn/util/log.hpp"
+#include "noconn/util/memory.hpp"
+#include "noconn/util/metrics.hpp"
 #include "noconn/rest/helper.hpp"
 #include "noconn/rest/server.hpp"
 
@@ -11,23 +14,73 @@ namespace noconn
 {
 namespace rest
 {
-	shared_server server::create(std::shared_ptr<boost::asio::io_context> io_context)
+namespace
+{
+	struct server_metrics
+	{
+		util::gauge& m_open_connections;
+		util::counter& m_accepted;
+		util::counter& m_refused_limit;
+		util::counter& m_refused_rate_limited;
+		util::counter& m_refused_overloaded;
+		util::counter& m_refused_memory;
+	};
+
+	server_metrics& metrics()
+	{
+		static server_metrics instance = []
+		{
+			util::metrics_registry& registry = util::metrics_registry::instance();
+			constexpr std::string_view refused_help = "connections closed right after accept.";
+			return server_metrics{
+				registry.get_gauge("noconn_http_connections_open", "http connections currently open."),
+				registry.get_counter("noconn_http_connections_accepted_total", "http connections accepted."),
+				registry.get_counter("noconn_http_connections_refused_total", refused_help, R"(reason="limit")"),
+				registry.get_counter("noconn_http_connections_refused_total", refused_help, R"(reason="rate_limited")"),
+				registry.get_counter("noconn_http_connections_refused_total", refused_help, R"(reason="overloaded")"),
+				registry.get_counter("noconn_http_connections_refused_total", refused_help, R"(reason="memory")")
+			};
+		}();
+
+		return instance;
+	}
+} // !anonymous namespace
+
+	shared_server server::create(std::shared_ptr<boost::asio::io_context> io_context, server_limits limits)
 	{
-		return shared_server(new server(io_context));
+		return shared_server(new server(io_context, limits));
 	}
 
-	server::server(std::shared_ptr<boost::asio::io_context> io_context)
+	server::server(std::shared_ptr<boost::asio::io_context> io_context, server_limits limits)
 		:	m_io_context(io_context),
-			m_signals(*io_context)
+			m_strand(boost::asio::make_strand(*io_context)),
+			m_signals(*io_context),
+			m_limits(limits),
+			m_admission(admission_controller::create(limits.m_admission)),
+			m_connections(limits.m_max_connections),
+			m_reaper(m_strand)
 	{
 		whatlog::logger log("server::ctr()");
 		log.info("server created.");
+		if (m_limits.m_idle_timeout >= connection::read_timeout)
+		{
+			log.warning(fmt::format("idle timeout of {}s is not below the read timeout of {}s, idle connections are only closed by the read timeout.",
+				m_limits.m_idle_timeout.count(), connection::read_timeout.count()));
+		}
 
 		m_signals.add(SIGINT);
 		m_signals.add(SIGTERM);
+
+		m_router.add("metrics", boost::beast::http::verb::get, [](const request_context& context)
+			{
+				std::string body;
+				util::metrics_registry::instance().render(body);
+				return make_response(context.m_request, boost::beast::http::status::ok, std::move(body), "text/plain; version=0.0.4; charset=utf-8");
+			}
+		);
 	}
 
-	bool server::open(boost::asio::ip::address address, ip_port port)
+	bool server::open(boost::asio::ip::address address, ip_port port, bool reuse_port)
 	{
 		whatlog::logger log("server::open");
 		std::lock_guard<std::mutex> lock(m_mutex);
@@ -38,7 +91,7 @@ namespace rest
 		
 		boost::beast::error_code error_code;
 
-		m_acceptor.reset(new boost::asio::ip::tcp::acceptor(m_io_context->get_executor()));
+		m_acceptor.reset(new boost::asio::ip::tcp::acceptor(m_strand));
 
 		m_acceptor->open(local_endpoint.protocol(), error_code);
 		if (error_code)
@@ -54,6 +107,21 @@ namespace rest
 			return false;
 		}
 
+		if (reuse_port)
+		{
+#if defined(SO_REUSEPORT)
+			m_acceptor->set_option(reuse_port_option(true), error_code);
+			if (error_code)
+			{
+				log.error(fmt::format("failed to set option (reuse port) on acceptor. message: {}.", error_code.message()));
+				return false;
+			}
+#else
+			log.error("reuse port is not supported on this platform.");
+			return false;
+#endif
+		}
+
 		m_acceptor->bind(local_endpoint, error_code);
 		if (error_code)
 		{
@@ -68,55 +136,264 @@ namespace rest
 			return false;
 		}
 
-		do_accept();
+		start();
+		return true;
+	}
+
+	bool server::open(const inherited_acceptor& acceptor)
+	{
+		whatlog::logger log("server::open");
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		boost::beast::error_code error_code;
+		m_acceptor.reset(new boost::asio::ip::tcp::acceptor(m_strand));
+		m_acceptor->assign(acceptor.m_protocol, acceptor.m_handle, error_code);
+		if (error_code)
+		{
+			log.error(fmt::format("failed to take over listening socket. message: {}.", error_code.message()));
+			return false;
+		}
 
+		boost::asio::ip::tcp::endpoint local_endpoint = m_acceptor->local_endpoint(error_code);
+		log.info(fmt::format("took over acceptor on local endpoint {}.", noconn::rest::to_string(local_endpoint)));
+
+		start();
 		return true;
 	}
 
+	void server::start()
+	{
+		boost::asio::post(m_strand, [self = shared_from_this()]()
+			{
+				self->do_accept();
+				self->start_reaper();
+			}
+		);
+	}
+
 	void server::close()
 	{
-		// todo: shutdown open connections
+		boost::asio::post(m_strand, [self = shared_from_this()]()
+			{
+				if (self->m_closing)
+				{
+					return;
+				}
+
+				NOCONN_LOG_INFO("server::close", "stopping acceptor and draining {} connections.", self->m_connections.size());
+				self->m_closing = true;
+
+				{
+					std::lock_guard<std::mutex> lock(self->m_mutex);
+					boost::beast::error_code ignored;
+					if (self->m_acceptor)
+					{
+						self->m_acceptor->close(ignored);
+					}
+				}
+
+				self->m_reaper.cancel();
+				self->m_connections.for_each([](const shared_connection& connection) { connection->drain(); });
+			}
+		);
+	}
+
+	std::optional<inherited_acceptor> server::acceptor()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_acceptor || !m_acceptor->is_open())
+		{
+			return std::nullopt;
+		}
+
+		boost::beast::error_code error_code;
+		boost::asio::ip::tcp::endpoint local_endpoint = m_acceptor->local_endpoint(error_code);
+		if (error_code)
+		{
+			return std::nullopt;
+		}
+
+		return inherited_acceptor{ local_endpoint.protocol(), m_acceptor->native_handle() };
 	}
 
 	void server::close(shared_connection connection)
 	{
-		whatlog::logger log("server::close(connection)");
-		auto itr_connection = std::find_if(m_connections.begin(), m_connections.end(), [&](const shared_connection& temp) { return temp->id() == connection->id(); });
-		if (itr_connection != m_connections.end())
+		if (m_connections.remove(connection->handle()))
 		{
-			log.info(fmt::format("terminating connection {}.", connection->id()));
-			// m_connections.erase(itr_connection);
+			metrics().m_open_connections.add(-1);
+			NOCONN_LOG_INFO("server::close(connection)", "terminating connection {}.", connection->id());
 		}
 		else
 		{
-			log.warning(fmt::format("failed to find connection {}.", connection->id()));
+			NOCONN_LOG_WARNING("server::close(connection)", "failed to find connection {}.", connection->id());
 		}
 	}
 
+	std::size_t server::connection_count() const
+	{
+		return m_connections.size();
+	}
+
+	router& server::get_router()
+	{
+		return m_router;
+	}
+
+	const router& server::get_router() const
+	{
+		return m_router;
+	}
+
+	const server_limits& server::limits() const
+	{
+		return m_limits;
+	}
+
+	const shared_admission_controller& server::admission() const
+	{
+		return m_admission;
+	}
+
+	void server::set_admission_controller(shared_admission_controller admission)
+	{
+		m_admission = std::move(admission);
+	}
+
+	void server::set_accept_executors(std::vector<boost::asio::any_io_executor> executors)
+	{
+		m_accept_executors = std::move(executors);
+	}
+
 	void server::do_accept()
 	{
-		whatlog::logger log("server::do_accept");
-		log.info("now accepting requests.");
+		if (m_closing)
+		{
+			return;
+		}
+
+		NOCONN_LOG_INFO("server::do_accept", "now accepting requests.");
+
+		// accept handlers run one at a time, no lock needed for the round-robin index
+		boost::asio::any_io_executor executor = m_io_context->get_executor();
+		if (!m_accept_executors.empty())
+		{
+			executor = m_accept_executors[m_next_accept_executor++ % m_accept_executors.size()];
+		}
 
 		m_acceptor->async_accept(
-			boost::asio::make_strand(m_io_context->get_executor()), 
+			boost::asio::make_strand(executor),
 			boost::beast::bind_front_handler(&server::handle_accept, shared_from_this())
 		);
 	}
 
 	void server::handle_accept(boost::beast::error_code error_code, boost::asio::ip::tcp::socket socket)
 	{
-		whatlog::logger log("server::handle_accept");
-		log.info(fmt::format("accepting connection on socket {}.", to_string(socket)));
+		if (error_code == boost::asio::error::operation_aborted)
+		{
+			// acceptor closed
+			return;
+		}
+
+		if (error_code)
+		{
+			NOCONN_LOG_ERROR("server::handle_accept", "failed to accept connection. message: {}.", error_code.message());
+			do_accept();
+			return;
+		}
+
+		NOCONN_LOG_INFO("server::handle_accept", "accepting connection on socket {}.", to_string(socket));
+
+		if (m_connections.size() >= m_connections.capacity())
+		{
+			NOCONN_LOG_WARNING("server::handle_accept", "connection limit ({}) reached, refusing socket {}.", m_connections.capacity(), to_string(socket));
+			metrics().m_refused_limit.add();
+			boost::beast::error_code ignored;
+			socket.close(ignored);
+			do_accept();
+			return;
+		}
+
+		if (util::get_memory_account(util::memory_subsystem::connections).over_budget())
+		{
+			NOCONN_LOG_WARNING("server::handle_accept", "connection memory over budget, refusing socket {}.", to_string(socket));
+			metrics().m_refused_memory.add();
+			boost::beast::error_code ignored;
+			socket.close(ignored);
+			do_accept();
+			return;
+		}
+
+		boost::beast::error_code endpoint_error;
+		boost::asio::ip::address client = socket.remote_endpoint(endpoint_error).address();
+		admission_decision decision = m_admission->check_connection(client);
+		if (decision != admission_decision::admitted)
+		{
+			NOCONN_LOG_WARNING("server::handle_accept", "shedding connection from {} ({}).", to_string(client), decision == admission_decision::rate_limited ? "rate limited" : "overloaded");
+			(decision == admission_decision::rate_limited ? metrics().m_refused_rate_limited : metrics().m_refused_overloaded).add();
+			reject(std::move(socket), decision);
+			do_accept();
+			return;
+		}
 
 		shared_connection connection = connection::create(std::move(socket), shared_from_this());
-		m_connections.emplace_back(connection);
-		
-		connection->open();
+		std::optional<connection_handle> handle = m_connections.insert(connection);
+		if (handle.has_value())
+		{
+			metrics().m_accepted.add();
+			metrics().m_open_connections.add(1);
+			connection->set_handle(handle.value());
+			connection->open();
+			if (m_closing)
+			{
+				// accepted while the acceptor was being closed, serve what it sends and let it go
+				connection->drain();
+			}
+		}
+		else
+		{
+			// the registry is full (accepts are serialized on m_strand, each server has its own registry)
+			NOCONN_LOG_WARNING("server::handle_accept", "connection limit ({}) reached, refusing connection {}.", m_connections.capacity(), connection->id());
+			metrics().m_refused_limit.add();
+		}
 
 		do_accept();
 	}
 
+	void server::reject(boost::asio::ip::tcp::socket&& socket, admission_decision decision)
+	{
+		// the response bytes live in the controller, keep it alive until the write is done
+		auto target = std::make_shared<boost::asio::ip::tcp::socket>(std::move(socket));
+		const std::string& response = m_admission->connection_rejection(decision);
+		boost::asio::async_write(*target, boost::asio::buffer(response),
+			[target, admission = m_admission](boost::beast::error_code, std::size_t)
+			{
+				boost::beast::error_code ignored;
+				target->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+				target->close(ignored);
+			}
+		);
+	}
+
+	void server::start_reaper()
+	{
+		m_reaper.expires_after(m_limits.m_reap_interval);
+		m_reaper.async_wait(boost::beast::bind_front_handler(&server::handle_reap, shared_from_this()));
+	}
+
+	void server::handle_reap(boost::beast::error_code error_code)
+	{
+		if (error_code)
+		{
+			// timer cancelled, server is closing
+			return;
+		}
+
+		std::chrono::steady_clock::duration idle_timeout = m_limits.m_idle_timeout;
+		m_connections.for_each([idle_timeout](const shared_connection& connection) { connection->close_if_idle(idle_timeout); });
+
+		start_reaper();
+	}
+
 	void server::handle_exit_signal(const boost::system::error_code& error, int signal)
 	{
 		whatlog::logger log("server::handle_exit_signal");
@@ -0,0 +1,144 @@
+/*
+ *
+ */
+
+#include <fmt/format.h>
+#include <whatlog/logger.hpp>
+#include "noconn/rest/shard_group.hpp"
+
+namespace noconn
+{
+namespace rest
+{
+	shard_group::shard_group(std::size_t shard_count)
+	{
+		for (std::size_t shard = 0; shard < std::max<std::size_t>(shard_count, 1); ++shard)
+		{
+			// one thread per io_context. a hint of 1 only sets the completion port's concurrency, asio
+			// keeps its locking
+			auto io_context = std::make_shared<boost::asio::io_context>(1);
+			m_work_guards.emplace_back(io_context->get_executor());
+			m_io_contexts.emplace_back(std::move(io_context));
+		}
+	}
+
+	bool shard_group::open(boost::asio::ip::address address, ip_port port, server_limits limits, const std::function<void(router&)>& register_routes)
+	{
+		return open(limits, register_routes, [&](server& shard_server, std::size_t)
+			{
+				return shard_server.open(address, port, server::supports_reuse_port());
+			});
+	}
+
+	bool shard_group::open(const std::vector<inherited_acceptor>& acceptors, server_limits limits, const std::function<void(router&)>& register_routes)
+	{
+		std::size_t expected = server::supports_reuse_port() ? m_io_contexts.size() : 1;
+		if (acceptors.size() != expected)
+		{
+			whatlog::logger log("shard_group::open");
+			log.error(fmt::format("received {} listening sockets, {} shards need {}.", acceptors.size(), m_io_contexts.size(), expected));
+			return false;
+		}
+
+		return open(limits, register_routes, [&](server& shard_server, std::size_t index)
+			{
+				return shard_server.open(acceptors[index]);
+			});
+	}
+
+	bool shard_group::open(server_limits limits, const std::function<void(router&)>& register_routes, const open_function& open_server)
+	{
+		whatlog::logger log("shard_group::open");
+		log.info(fmt::format("opening {} shards (reuse port: {}).", m_io_contexts.size(), server::supports_reuse_port()));
+
+		// the connection cap is global, split it across the shards
+		server_limits shard_limits = limits;
+		shard_limits.m_max_connections = std::max<std::size_t>(limits.m_max_connections / m_io_contexts.size(), 1);
+
+		if (server::supports_reuse_port())
+		{
+			// a client landing on different shards still has one rate and counts against one in-flight cap
+			shared_admission_controller admission = admission_controller::create(limits.m_admission);
+			for (std::size_t index = 0; index < m_io_contexts.size(); ++index)
+			{
+				shared_server shard_server = server::create(m_io_contexts[index], shard_limits);
+				shard_server->set_admission_controller(admission);
+				register_routes(shard_server->get_router());
+				if (!open_server(*shard_server, index))
+				{
+					return false;
+				}
+
+				m_servers.emplace_back(std::move(shard_server));
+			}
+
+			return true;
+		}
+
+		std::vector<boost::asio::any_io_executor> executors;
+		for (const auto& io_context : m_io_contexts)
+		{
+			executors.emplace_back(io_context->get_executor());
+		}
+
+		shared_server shard_server = server::create(m_io_contexts.front(), limits);
+		register_routes(shard_server->get_router());
+		shard_server->set_accept_executors(std::move(executors));
+		if (!open_server(*shard_server, 0))
+		{
+			return false;
+		}
+
+		m_servers.emplace_back(std::move(shard_server));
+		return true;
+	}
+
+	void shard_group::stop()
+	{
+		for (const auto& shard_server : m_servers)
+		{
+			shard_server->close();
+		}
+
+		for (work_guard& guard : m_work_guards)
+		{
+			guard.reset();
+		}
+	}
+
+	std::size_t shard_group::size() const
+	{
+		return m_io_contexts.size();
+	}
+
+	std::size_t shard_group::connection_count() const
+	{
+		std::size_t result = 0;
+		for (const auto& shard_server : m_servers)
+		{
+			result += shard_server->connection_count();
+		}
+
+		return result;
+	}
+
+	std::vector<inherited_acceptor> shard_group::acceptors()
+	{
+		std::vector<inherited_acceptor> result;
+		for (const auto& shard_server : m_servers)
+		{
+			if (std::optional<inherited_acceptor> acceptor = shard_server->acceptor())
+			{
+				result.push_back(*acceptor);
+			}
+		}
+
+		return result;
+	}
+
+	std::shared_ptr<boost::asio::io_context> shard_group::get_io_context(std::size_t shard) const
+	{
+		return m_io_contexts.at(shard);
+	}
+} // !namespace rest
+} // !namespace noconn
@@ -0,0 +1,326 @@
+/*
+ *
+ */
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <charconv>
+#include <optional>
+#include <string_view>
+#include <fmt/format.h>
+#include <boost/asio.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/version.hpp>
+#include "noconn/rest/client.hpp"
+#include "noconn/util/metrics.hpp"
+
+/*
+ * Open-loop HTTP load generator for noconn.
+ *
+ *   noconn_load [--address <ip>] [--port <port>] [--target <path>] [--method <verb>] [--body <text>]
+ *               [--rate <requests per second>] [--duration <seconds>] [--connections <count>]
+ *               [--pipeline <depth>] [--threads <count>]
+ *
+ * Requests are issued on a fixed schedule whether or not earlier ones have been answered, and every
+ * latency is measured from the time the request was *scheduled* to go out. A stalled server therefore
+ * shows up as the queueing delay its clients would really see instead of as a gap in the samples
+ * (coordinated omission). The latency from the moment the request was handed to a connection is
+ * reported next to it.
+ */
+
+namespace noconn
+{
+    namespace
+    {
+        struct load_options
+        {
+            std::string m_address = "127.0.0.1";
+            unsigned short m_port = 3031;
+            std::string m_target = "/my_page/inet/route";
+            boost::beast::http::verb m_method = boost::beast::http::verb::get;
+            std::string m_body;
+            double m_rate = 1000.0;
+            std::chrono::seconds m_duration = std::chrono::seconds(10);
+            std::size_t m_connections = 8;
+            std::size_t m_pipeline = 1;
+            std::size_t m_threads = 1;
+        };
+
+        template <typename T>
+        bool parse_number(std::string_view text, T& value)
+        {
+            auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+            return error == std::errc() && end == text.data() + text.size();
+        }
+
+        std::optional<load_options> parse_load_options(int argument_count, char** arguments)
+        {
+            load_options result;
+
+            for (int index = 1; index < argument_count; ++index)
+            {
+                std::string_view argument = arguments[index];
+                if (index + 1 >= argument_count)
+                {
+                    fmt::print(stderr, "missing value for argument \"{}\".\n", argument);
+                    return std::nullopt;
+                }
+
+                std::string_view value = arguments[++index];
+                bool is_valid = true;
+                if (argument == "--address")
+                {
+                    result.m_address = std::string(value);
+                }
+                else if (argument == "--port")
+                {
+                    is_valid = parse_number(value, result.m_port);
+                }
+                else if (argument == "--target")
+                {
+                    result.m_target = std::string(value);
+                }
+                else if (argument == "--method")
+                {
+                    result.m_method = boost::beast::http::string_to_verb(boost::beast::string_view(value.data(), value.size()));
+                    is_valid = result.m_method != boost::beast::http::verb::unknown;
+                }
+                else if (argument == "--body")
+                {
+                    result.m_body = std::string(value);
+                }
+                else if (argument == "--rate")
+                {
+                    is_valid = parse_number(value, result.m_rate) && result.m_rate > 0.0;
+                }
+                else if (argument == "--duration")
+                {
+                    std::size_t seconds = 0;
+                    is_valid = parse_number(value, seconds) && seconds > 0;
+                    result.m_duration = std::chrono::seconds(seconds);
+                }
+                else if (argument == "--connections")
+                {
+                    is_valid = parse_number(value, result.m_connections) && result.m_connections > 0;
+                }
+                else if (argument == "--pipeline")
+                {
+                    is_valid = parse_number(value, result.m_pipeline) && result.m_pipeline > 0;
+                }
+                else if (argument == "--threads")
+                {
+                    is_valid = parse_number(value, result.m_threads) && result.m_threads > 0;
+                }
+                else
+                {
+                    fmt::print(stderr, "unknown argument \"{}\".\n", argument);
+                    return std::nullopt;
+                }
+
+                if (!is_valid)
+                {
+                    fmt::print(stderr, "invalid value \"{}\" for argument \"{}\".\n", value, argument);
+                    return std::nullopt;
+                }
+            }
+
+            return result;
+        }
+
+        class load_generator : public std::enable_shared_from_this<load_generator>
+        {
+        public:
+            using clock = std::chrono::steady_clock;
+
+            // outstanding requests get this long after the schedule ends before they count as lost
+            static constexpr std::chrono::seconds drain_timeout = std::chrono::seconds(5);
+
+            load_generator(boost::asio::io_context& io_context, load_options options)
+                :   m_options(std::move(options)),
+                    m_timer(boost::asio::make_strand(io_context)),
+                    m_pool(io_context.get_executor(),
+                        boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address(m_options.m_address), m_options.m_port),
+                        m_options.m_connections, rest::client_options{ m_options.m_pipeline }),
+                    m_interval(std::chrono::duration<double>(1.0 / m_options.m_rate)),
+                    m_corrected(util::histogram_unit::nanoseconds),
+                    m_uncorrected(util::histogram_unit::nanoseconds)
+            {
+                // nothing for now
+            }
+
+            void start()
+            {
+                m_start = clock::now();
+                m_end = m_start + m_options.m_duration;
+                boost::asio::post(m_timer.get_executor(), [self = shared_from_this()]() { self->schedule(); });
+            }
+
+            void report() const
+            {
+                clock::duration elapsed = m_finished - m_start;
+                double seconds = std::chrono::duration<double>(elapsed).count();
+                uint64_t completed = m_completed.load();
+
+                fmt::print("target: {} {}:{}{}\n", boost::beast::http::to_string(m_options.m_method).to_string(), m_options.m_address, m_options.m_port, m_options.m_target);
+                fmt::print("schedule: {} requests/s for {}s over {} connections (pipeline depth {}).\n",
+                    m_options.m_rate, m_options.m_duration.count(), m_options.m_connections, m_options.m_pipeline);
+                fmt::print("requests: {} sent, {} completed, {} non-2xx, {} errors, {} lost, {:.1f} completed/s.\n",
+                    m_sent.load(), completed, m_non_success.load(), m_errors.load(), m_sent.load() - completed - m_errors.load(), completed / seconds);
+
+                print_latency("latency (from schedule)", m_corrected.snapshot());
+                print_latency("latency (from send)", m_uncorrected.snapshot());
+            }
+        private:
+            static void print_latency(std::string_view title, const util::histogram_snapshot& snapshot)
+            {
+                auto milliseconds = [&](double q) { return static_cast<double>(snapshot.quantile(q)) / 1e6; };
+                double mean = snapshot.m_count == 0 ? 0.0 : static_cast<double>(snapshot.m_sum) / static_cast<double>(snapshot.m_count) / 1e6;
+
+                fmt::print("{}: mean {:.3f}ms, p50 {:.3f}ms, p90 {:.3f}ms, p99 {:.3f}ms, p99.9 {:.3f}ms, p99.99 {:.3f}ms, max {:.3f}ms.\n",
+                    title, mean, milliseconds(0.5), milliseconds(0.9), milliseconds(0.99), milliseconds(0.999), milliseconds(0.9999), milliseconds(1.0));
+            }
+
+            clock::time_point intended_time(uint64_t index) const
+            {
+                return m_start + std::chrono::duration_cast<clock::duration>(m_interval * static_cast<double>(index));
+            }
+
+            void schedule()
+            {
+                // issue everything that is due, a late timer catches up in one burst instead of silently lowering the rate
+                clock::time_point now = clock::now();
+                while (intended_time(m_next) <= now && intended_time(m_next) < m_end)
+                {
+                    issue(intended_time(m_next++));
+                }
+
+                if (intended_time(m_next) >= m_end)
+                {
+                    drain();
+                    return;
+                }
+
+                m_timer.expires_at(intended_time(m_next));
+                m_timer.async_wait([self = shared_from_this()](boost::beast::error_code error_code)
+                    {
+                        if (!error_code)
+                        {
+                            self->schedule();
+                        }
+                    }
+                );
+            }
+
+            void issue(clock::time_point intended)
+            {
+                rest::client::request_type request{ m_options.m_method, m_options.m_target, 11 };
+                request.set(boost::beast::http::field::host, m_options.m_address);
+                request.set(boost::beast::http::field::user_agent, BOOST_BEAST_VERSION_STRING);
+                request.keep_alive(true);
+                if (!m_options.m_body.empty())
+                {
+                    request.set(boost::beast::http::field::content_type, "application/json");
+                    request.body() = m_options.m_body;
+                }
+
+                request.prepare_payload();
+
+                m_sent.fetch_add(1, std::memory_order_relaxed);
+                clock::time_point sent = clock::now();
+                m_pool.send(std::move(request),
+                    [self = shared_from_this(), intended, sent](boost::beast::error_code error_code, rest::client::response_type&& response)
+                    {
+                        if (error_code == boost::asio::error::operation_aborted)
+                        {
+                            // still outstanding when the drain timed out, reported as lost
+                            return;
+                        }
+
+                        if (error_code)
+                        {
+                            self->m_errors.fetch_add(1, std::memory_order_relaxed);
+                            return;
+                        }
+
+                        clock::time_point now = clock::now();
+                        self->m_corrected.record(now - intended);
+                        self->m_uncorrected.record(now - sent);
+                        self->m_completed.fetch_add(1, std::memory_order_relaxed);
+                        if (response.result_int() < 200 || response.result_int() >= 300)
+                        {
+                            self->m_non_success.fetch_add(1, std::memory_order_relaxed);
+                        }
+                    }
+                );
+            }
+
+            void drain()
+            {
+                if (m_pool.in_flight() == 0 || clock::now() - m_end > drain_timeout)
+                {
+                    m_finished = clock::now();
+                    m_pool.close();
+                    return;
+                }
+
+                m_timer.expires_after(std::chrono::milliseconds(10));
+                m_timer.async_wait([self = shared_from_this()](boost::beast::error_code error_code)
+                    {
+                        if (!error_code)
+                        {
+                            self->drain();
+                        }
+                    }
+                );
+            }
+        private:
+            load_options m_options;
+            boost::asio::steady_timer m_timer;
+            rest::client_pool m_pool;
+            std::chrono::duration<double> m_interval;
+            clock::time_point m_start;
+            clock::time_point m_end;
+            clock::time_point m_finished;
+            uint64_t m_next = 0;
+
+            util::histogram m_corrected;
+            util::histogram m_uncorrected;
+            std::atomic<uint64_t> m_sent = 0;
+            std::atomic<uint64_t> m_completed = 0;
+            std::atomic<uint64_t> m_errors = 0;
+            std::atomic<uint64_t> m_non_success = 0;
+        };
+    } // !anonymous namespace
+} // !namespace noconn
+
+int main(int argument_count, char** arguments)
+{
+    std::optional<noconn::load_options> options = noconn::parse_load_options(argument_count, arguments);
+    if (!options.has_value())
+    {
+        return EXIT_FAILURE;
+    }
+
+    boost::asio::io_context io_context(static_cast<int>(options->m_threads));
+    auto generator = std::make_shared<noconn::load_generator>(io_context, *options);
+    generator->start();
+
+    // runs until the schedule is done and every connection is closed
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < options->m_threads; ++i)
+    {
+        threads.emplace_back([&io_context]() { io_context.run(); });
+    }
+
+    io_context.run();
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    generator->report();
+    return EXIT_SUCCESS;
+}
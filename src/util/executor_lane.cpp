@@ -0,0 +1,168 @@
+/*
+ *
+ */
+
+#include <algorithm>
+#include <string_view>
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+#include <whatlog/logger.hpp>
+#include "noconn/util/trace.hpp"
+#include "noconn/util/executor_lane.hpp"
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+namespace noconn
+{
+namespace util
+{
+    namespace
+    {
+        std::string_view to_string(thread_priority priority)
+        {
+            switch (priority)
+            {
+            case thread_priority::low:
+                return "low";
+            case thread_priority::high:
+                return "high";
+            default:
+                return "normal";
+            }
+        }
+    } // !anonymous namespace
+
+    executor_lane::executor_lane(std::string name, lane_options options)
+        : m_name(std::move(name)), m_options(std::move(options))
+    {
+        m_options.m_threads = std::max<std::size_t>(m_options.m_threads, 1);
+        auto io_context = std::make_shared<boost::asio::io_context>(static_cast<int>(m_options.m_threads));
+        m_work_guards.emplace_back(io_context->get_executor());
+        m_io_contexts.push_back(std::move(io_context));
+    }
+
+    executor_lane::executor_lane(std::string name, lane_options options, std::vector<std::shared_ptr<boost::asio::io_context>> io_contexts)
+        : m_name(std::move(name)), m_options(std::move(options)), m_io_contexts(std::move(io_contexts))
+    {
+        // the owner of the io_contexts keeps them alive until it is done with them
+        m_options.m_threads = m_io_contexts.size();
+    }
+
+    executor_lane::~executor_lane()
+    {
+        stop();
+    }
+
+    void executor_lane::start()
+    {
+        whatlog::logger log("executor_lane::start");
+        log.info(fmt::format("starting lane {} with {} threads (cpus: {}, priority: {}).", m_name, m_options.m_threads,
+            m_options.m_cpus.empty() ? std::string("any") : fmt::format("{}", fmt::join(m_options.m_cpus, ",")), to_string(m_options.m_priority)));
+
+        m_threads.reserve(m_options.m_threads);
+        for (std::size_t index = 0; index < m_options.m_threads; ++index)
+        {
+            m_threads.emplace_back([this, index]() { run(index); });
+        }
+    }
+
+    void executor_lane::stop()
+    {
+        m_work_guards.clear();
+        for (const std::shared_ptr<boost::asio::io_context>& io_context : m_io_contexts)
+        {
+            io_context->stop();
+        }
+
+        for (std::thread& thread : m_threads)
+        {
+            if (thread.joinable())
+            {
+                thread.join();
+            }
+        }
+
+        m_threads.clear();
+    }
+
+    const std::string& executor_lane::name() const
+    {
+        return m_name;
+    }
+
+    std::size_t executor_lane::thread_count() const
+    {
+        return m_options.m_threads;
+    }
+
+    std::shared_ptr<boost::asio::io_context> executor_lane::get_io_context() const
+    {
+        return m_io_contexts.front();
+    }
+
+    boost::asio::any_io_executor executor_lane::get_executor() const
+    {
+        return m_io_contexts.front()->get_executor();
+    }
+
+    std::vector<boost::asio::any_io_executor> executor_lane::executors() const
+    {
+        std::vector<boost::asio::any_io_executor> result;
+        result.reserve(m_io_contexts.size());
+        for (const std::shared_ptr<boost::asio::io_context>& io_context : m_io_contexts)
+        {
+            result.push_back(io_context->get_executor());
+        }
+
+        return result;
+    }
+
+    void executor_lane::run(std::size_t index)
+    {
+        std::string thread_name = fmt::format("{}_{}", m_name, index);
+#if defined(_WIN32)
+        whatlog::rename_thread(GetCurrentThread(), thread_name);
+#endif
+        trace::set_thread_name(thread_name);
+        whatlog::logger log("executor_lane::run");
+        log.info(fmt::format("starting thread {}.", thread_name));
+
+        if (!m_options.m_cpus.empty() && !pin_current_thread(m_options.m_cpus[index % m_options.m_cpus.size()]))
+        {
+            log.warning(fmt::format("failed to pin thread {} to cpu {}.", thread_name, m_options.m_cpus[index % m_options.m_cpus.size()]));
+        }
+
+        if (m_options.m_priority != thread_priority::normal && !set_current_thread_priority(m_options.m_priority))
+        {
+            log.warning(fmt::format("failed to change the priority of thread {}.", thread_name));
+        }
+
+        boost::asio::io_context& io_context = *m_io_contexts[index % m_io_contexts.size()];
+        for (;;)
+        {
+            try
+            {
+                boost::system::error_code error_code;
+                io_context.run(error_code);
+
+                if (error_code)
+                {
+                    log.error(fmt::format("thread {} encountered an error. message: {}", thread_name, error_code.message()));
+                }
+
+                break;
+            }
+            catch (std::exception& ex)
+            {
+                log.warning(fmt::format("thread {} encountered an error. exception: {}.", thread_name, std::string(ex.what())));
+            }
+            catch (...)
+            {
+                log.warning(fmt::format("thread {} encountered an unknown exception.", thread_name));
+            }
+        }
+    }
+} // !namespace util
+} // !namespace noconn
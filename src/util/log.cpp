@@ -0,0 +1,258 @@
+/*
+ *
+ */
+
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <whatlog/logger.hpp>
+#include "noconn/util/log.hpp"
+#include "noconn/util/metrics.hpp"
+
+namespace noconn
+{
+namespace util
+{
+    namespace
+    {
+        // single producer (the owning thread), single consumer (the formatting thread)
+        struct log_ring
+        {
+            static constexpr std::size_t capacity = 512;
+
+            std::array<log_record, capacity> m_records;
+            alignas(64) std::atomic<std::size_t> m_head = 0;
+            alignas(64) std::atomic<std::size_t> m_tail = 0;
+            std::atomic<bool> m_abandoned = false;
+        };
+
+        struct log_state
+        {
+            std::atomic<int> m_level = static_cast<int>(log_level::info);
+            std::atomic<bool> m_running = false;
+            // exported, so records lost under overload show up in /metrics
+            counter& m_dropped = metrics_registry::instance().get_counter("noconn_log_dropped_total", "log records lost because a thread's ring was full.");
+
+            std::mutex m_rings_mutex;
+            std::vector<std::shared_ptr<log_ring>> m_rings;
+            std::thread m_thread;
+        };
+
+        log_state& state()
+        {
+            static log_state instance;
+            return instance;
+        }
+
+        struct ring_owner
+        {
+            std::shared_ptr<log_ring> m_ring;
+
+            ~ring_owner()
+            {
+                if (m_ring)
+                {
+                    // the formatting thread drains and drops it
+                    m_ring->m_abandoned.store(true, std::memory_order_release);
+                }
+            }
+        };
+
+        log_ring& local_ring()
+        {
+            thread_local ring_owner owner;
+            if (!owner.m_ring)
+            {
+                owner.m_ring = std::make_shared<log_ring>();
+                std::lock_guard<std::mutex> lock(state().m_rings_mutex);
+                state().m_rings.emplace_back(owner.m_ring);
+            }
+
+            return *owner.m_ring;
+        }
+
+        // returns the number of records formatted
+        std::size_t drain(log_ring& ring, fmt::memory_buffer& buffer)
+        {
+            std::size_t tail = ring.m_tail.load(std::memory_order_relaxed);
+            std::size_t head = ring.m_head.load(std::memory_order_acquire);
+            std::size_t count = head - tail;
+
+            for (; tail != head; ++tail)
+            {
+                log_record& record = ring.m_records[tail % log_ring::capacity];
+                buffer.clear();
+                try
+                {
+                    record.m_format_function(record, buffer);
+                }
+                catch (const std::exception& ex)
+                {
+                    buffer.clear();
+                    fmt::format_to(fmt::appender(buffer), "failed to format log record \"{}\". exception: {}", record.m_format, ex.what());
+                }
+
+                log_level level = record.m_level;
+                const char* scope = record.m_scope;
+                record.m_destroy_function(record);
+
+                // hand the slot back to the producer only after we are done reading it
+                ring.m_tail.store(tail + 1, std::memory_order_release);
+
+                whatlog::logger log(scope);
+                std::string message(buffer.data(), buffer.size());
+                switch (level)
+                {
+                case log_level::error:
+                    log.error(message);
+                    break;
+                case log_level::warning:
+                    log.warning(message);
+                    break;
+                case log_level::info:
+                    log.info(message);
+                    break;
+                default:
+                    log.info("[debug] " + message);
+                    break;
+                }
+            }
+
+            return count;
+        }
+
+        std::size_t drain_all(fmt::memory_buffer& buffer)
+        {
+            std::vector<std::shared_ptr<log_ring>> rings;
+            {
+                std::lock_guard<std::mutex> lock(state().m_rings_mutex);
+                rings = state().m_rings;
+            }
+
+            std::size_t count = 0;
+            for (const auto& ring : rings)
+            {
+                bool abandoned = ring->m_abandoned.load(std::memory_order_acquire);
+                count += drain(*ring, buffer);
+                if (abandoned)
+                {
+                    std::lock_guard<std::mutex> lock(state().m_rings_mutex);
+                    auto& all_rings = state().m_rings;
+                    all_rings.erase(std::remove(all_rings.begin(), all_rings.end(), ring), all_rings.end());
+                }
+            }
+
+            return count;
+        }
+
+        void run()
+        {
+            fmt::memory_buffer buffer;
+            auto idle_sleep = std::chrono::microseconds(100);
+
+            while (state().m_running.load(std::memory_order_acquire))
+            {
+                if (drain_all(buffer) > 0)
+                {
+                    idle_sleep = std::chrono::microseconds(100);
+                    continue;
+                }
+
+                // back off while nothing is being logged
+                std::this_thread::sleep_for(idle_sleep);
+                idle_sleep = std::min<std::chrono::microseconds>(idle_sleep * 2, std::chrono::milliseconds(10));
+            }
+
+            drain_all(buffer);
+        }
+    } // !anonymous namespace
+
+    bool log::is_enabled(log_level level)
+    {
+        return static_cast<int>(level) >= state().m_level.load(std::memory_order_relaxed);
+    }
+
+    void log::set_level(log_level level)
+    {
+        state().m_level.store(static_cast<int>(level), std::memory_order_relaxed);
+    }
+
+    void log::start()
+    {
+        log_state& current = state();
+        if (current.m_running.exchange(true))
+        {
+            return;
+        }
+
+        current.m_thread = std::thread(run);
+    }
+
+    void log::stop()
+    {
+        log_state& current = state();
+        if (!current.m_running.exchange(false))
+        {
+            return;
+        }
+
+        current.m_thread.join();
+    }
+
+    bool log::is_running()
+    {
+        return state().m_running.load(std::memory_order_relaxed);
+    }
+
+    uint64_t log::dropped()
+    {
+        return state().m_dropped.value();
+    }
+
+    log_record* log::acquire()
+    {
+        log_ring& ring = local_ring();
+        std::size_t head = ring.m_head.load(std::memory_order_relaxed);
+        std::size_t tail = ring.m_tail.load(std::memory_order_acquire);
+        if (head - tail >= log_ring::capacity)
+        {
+            state().m_dropped.add();
+            return nullptr;
+        }
+
+        return &ring.m_records[head % log_ring::capacity];
+    }
+
+    void log::commit()
+    {
+        log_ring& ring = local_ring();
+        ring.m_head.store(ring.m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    void log::write_now(log_level level, const char* scope, std::string_view message)
+    {
+        whatlog::logger log(scope);
+        std::string text(message);
+        switch (level)
+        {
+        case log_level::error:
+            log.error(text);
+            break;
+        case log_level::warning:
+            log.warning(text);
+            break;
+        case log_level::info:
+            log.info(text);
+            break;
+        default:
+            log.info("[debug] " + text);
+            break;
+        }
+    }
+} // !namespace util
+} // !namespace noconn
@@ -0,0 +1,136 @@
+/*
+ *
+ */
+
+#include "noconn/util/mapped_file.hpp"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace noconn
+{
+namespace util
+{
+    mapped_file::~mapped_file()
+    {
+        close();
+    }
+
+    bool mapped_file::open(const std::filesystem::path& path, std::size_t size)
+    {
+        close();
+        m_path = path;
+
+#if defined(_WIN32)
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        LARGE_INTEGER file_size{};
+        GetFileSizeEx(file, &file_size);
+        // not std::max, windows.h defines a max macro
+        std::size_t mapped_size = static_cast<std::size_t>(file_size.QuadPart) > size ? static_cast<std::size_t>(file_size.QuadPart) : size;
+
+        // the mapping extends the file (with zeros) to its size
+        LARGE_INTEGER maximum_size{};
+        maximum_size.QuadPart = static_cast<LONGLONG>(mapped_size);
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READWRITE, maximum_size.HighPart, maximum_size.LowPart, nullptr);
+        void* data = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, mapped_size) : nullptr;
+        if (data == nullptr)
+        {
+            if (mapping != nullptr)
+            {
+                CloseHandle(mapping);
+            }
+
+            CloseHandle(file);
+            return false;
+        }
+
+        m_file = file;
+        m_mapping = mapping;
+#else
+        int file = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (file < 0)
+        {
+            return false;
+        }
+
+        struct stat file_status{};
+        fstat(file, &file_status);
+        std::size_t mapped_size = static_cast<std::size_t>(file_status.st_size) > size ? static_cast<std::size_t>(file_status.st_size) : size;
+        if (static_cast<std::size_t>(file_status.st_size) < mapped_size && ftruncate(file, static_cast<off_t>(mapped_size)) != 0)
+        {
+            ::close(file);
+            return false;
+        }
+
+        void* data = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+        if (data == MAP_FAILED)
+        {
+            ::close(file);
+            return false;
+        }
+
+        m_file = file;
+#endif
+
+        m_data = data;
+        m_size = mapped_size;
+        return true;
+    }
+
+    void mapped_file::close()
+    {
+        if (m_data == nullptr)
+        {
+            return;
+        }
+
+#if defined(_WIN32)
+        UnmapViewOfFile(m_data);
+        CloseHandle(m_mapping);
+        CloseHandle(m_file);
+        m_mapping = nullptr;
+        m_file = nullptr;
+#else
+        munmap(m_data, m_size);
+        ::close(m_file);
+        m_file = -1;
+#endif
+
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    bool mapped_file::resize(std::size_t size)
+    {
+        std::filesystem::path path = m_path;
+        close();
+        return open(path, size);
+    }
+
+    bool mapped_file::is_open() const
+    {
+        return m_data != nullptr;
+    }
+
+    void* mapped_file::data() const
+    {
+        return m_data;
+    }
+
+    std::size_t mapped_file::size() const
+    {
+        return m_size;
+    }
+} // !namespace util
+} // !namespace noconn
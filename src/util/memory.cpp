@@ -0,0 +1,158 @@
+/*
+ *
+ */
+
+#include <fmt/format.h>
+#include "noconn/util/log.hpp"
+#include "noconn/util/memory.hpp"
+
+namespace noconn
+{
+namespace util
+{
+    namespace
+    {
+        constexpr std::size_t subsystem_count = static_cast<std::size_t>(memory_subsystem::count);
+
+        std::string labels(memory_subsystem subsystem)
+        {
+            return fmt::format("subsystem=\"{}\"", to_string(subsystem));
+        }
+
+        struct memory_state
+        {
+            std::array<std::optional<memory_account>, subsystem_count> m_accounts;
+            std::array<std::optional<tracking_resource>, subsystem_count> m_resources;
+
+            memory_state()
+            {
+                for (std::size_t index = 0; index < subsystem_count; ++index)
+                {
+                    memory_account& account = m_accounts[index].emplace(static_cast<memory_subsystem>(index));
+                    m_resources[index].emplace(account, std::pmr::new_delete_resource());
+                }
+            }
+        };
+
+        memory_state& state()
+        {
+            // leaked on purpose, see get_memory_account()
+            static memory_state* instance = new memory_state();
+            return *instance;
+        }
+    } // !anonymous namespace
+
+    std::string_view to_string(memory_subsystem subsystem)
+    {
+        switch (subsystem)
+        {
+        case memory_subsystem::routes:
+            return "routes";
+        case memory_subsystem::adapters:
+            return "adapters";
+        case memory_subsystem::connections:
+            return "connections";
+        case memory_subsystem::json:
+            return "json";
+        default:
+            return "journal";
+        }
+    }
+
+    std::optional<memory_subsystem> parse_memory_subsystem(std::string_view name)
+    {
+        for (std::size_t index = 0; index < subsystem_count; ++index)
+        {
+            if (to_string(static_cast<memory_subsystem>(index)) == name)
+            {
+                return static_cast<memory_subsystem>(index);
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    memory_account::memory_account(memory_subsystem subsystem)
+        :   m_subsystem(subsystem),
+            m_allocated(metrics_registry::instance().get_counter("noconn_memory_allocated_bytes_total", "bytes allocated through the subsystem's tracking resource.", labels(subsystem))),
+            m_freed(metrics_registry::instance().get_counter("noconn_memory_freed_bytes_total", "bytes handed back to the subsystem's tracking resource.", labels(subsystem))),
+            m_allocations(metrics_registry::instance().get_counter("noconn_memory_allocations_total", "allocations through the subsystem's tracking resource.", labels(subsystem))),
+            m_peak(metrics_registry::instance().get_gauge("noconn_memory_peak_bytes", "highest sampled live bytes of the subsystem.", labels(subsystem))),
+            m_budget(metrics_registry::instance().get_gauge("noconn_memory_budget_bytes", "configured budget of the subsystem, 0 for none.", labels(subsystem)))
+    {
+        // nothing for now
+    }
+
+    int64_t memory_account::live_bytes() const
+    {
+        // freed first: a block freed between the two loads is then counted as live, never as negative
+        uint64_t freed = m_freed.value();
+        return static_cast<int64_t>(m_allocated.value() - freed);
+    }
+
+    memory_usage memory_account::usage() const
+    {
+        sample();
+
+        memory_usage result;
+        result.m_live_bytes = live_bytes();
+        result.m_peak_bytes = std::max(m_peak_bytes.load(std::memory_order_relaxed), result.m_live_bytes);
+        result.m_allocated_bytes = m_allocated.value();
+        result.m_allocations = m_allocations.value();
+        result.m_budget_bytes = m_budget_bytes.load(std::memory_order_relaxed);
+        return result;
+    }
+
+    void memory_account::set_budget(std::size_t bytes)
+    {
+        m_budget_bytes.store(bytes, std::memory_order_relaxed);
+        m_budget.set(static_cast<int64_t>(bytes));
+        sample();
+    }
+
+    bool memory_account::over_budget() const
+    {
+        std::size_t budget = m_budget_bytes.load(std::memory_order_relaxed);
+        return budget != 0 && live_bytes() > static_cast<int64_t>(budget);
+    }
+
+    void memory_account::sample() const
+    {
+        int64_t live = live_bytes();
+        int64_t peak = m_peak_bytes.load(std::memory_order_relaxed);
+        while (live > peak && !m_peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+        {
+            // peak reloaded
+        }
+
+        if (live > peak)
+        {
+            m_peak.set(live);
+        }
+
+        std::size_t budget = m_budget_bytes.load(std::memory_order_relaxed);
+        bool over = budget != 0 && live > static_cast<int64_t>(budget);
+        if (over != m_over_budget.load(std::memory_order_relaxed) && over != m_over_budget.exchange(over, std::memory_order_relaxed))
+        {
+            if (over)
+            {
+                NOCONN_LOG_WARNING("memory_account", "{} memory ({} bytes) is over its budget of {} bytes.", to_string(m_subsystem), live, budget);
+            }
+            else
+            {
+                NOCONN_LOG_INFO("memory_account", "{} memory ({} bytes) is back within its budget of {} bytes.", to_string(m_subsystem), live, budget);
+            }
+        }
+    }
+
+    memory_account& get_memory_account(memory_subsystem subsystem)
+    {
+        return *state().m_accounts[static_cast<std::size_t>(subsystem)];
+    }
+
+    std::pmr::memory_resource* memory_resource(memory_subsystem subsystem)
+    {
+        return &*state().m_resources[static_cast<std::size_t>(subsystem)];
+    }
+} // !namespace util
+} // !namespace noconn
@@ -0,0 +1,251 @@
+/*
+ *
+ */
+
+#include <stdexcept>
+#include <fmt/format.h>
+#include "noconn/util/metrics.hpp"
+
+namespace noconn
+{
+namespace util
+{
+    namespace
+    {
+        // exported "le" buckets are the powers of two in this range, fixed per unit so series stay comparable between scrapes
+        struct exported_range
+        {
+            std::size_t m_first_exponent;
+            std::size_t m_last_exponent;
+            double m_scale;
+        };
+
+        exported_range get_exported_range(histogram_unit unit)
+        {
+            switch (unit)
+            {
+            case histogram_unit::nanoseconds:
+                // ~1us to ~34s
+                return { 10, 35, 1e-9 };
+            default:
+                return { 0, 24, 1.0 };
+            }
+        }
+
+        void append_series(std::string& output, std::string_view name, std::string_view suffix, std::string_view labels, std::string_view extra_label)
+        {
+            output.append(name);
+            output.append(suffix);
+            if (!labels.empty() || !extra_label.empty())
+            {
+                output.push_back('{');
+                output.append(labels);
+                if (!labels.empty() && !extra_label.empty())
+                {
+                    output.push_back(',');
+                }
+
+                output.append(extra_label);
+                output.push_back('}');
+            }
+
+            output.push_back(' ');
+        }
+    } // !anonymous namespace
+
+    std::size_t next_metric_shard()
+    {
+        static std::atomic<std::size_t> next = 0;
+        return next.fetch_add(1, std::memory_order_relaxed) % metric_shards;
+    }
+
+    uint64_t counter::value() const
+    {
+        uint64_t total = 0;
+        for (const cell& shard : m_cells)
+        {
+            total += shard.m_value.load(std::memory_order_relaxed);
+        }
+
+        return total;
+    }
+
+    histogram::histogram(histogram_unit unit)
+        : m_unit(unit), m_shards(new shard[metric_shards])
+    {
+        // nothing for now
+    }
+
+    histogram_unit histogram::unit() const
+    {
+        return m_unit;
+    }
+
+    histogram_snapshot histogram::snapshot() const
+    {
+        histogram_snapshot result;
+        for (std::size_t i = 0; i < metric_shards; ++i)
+        {
+            const shard& source = m_shards[i];
+            for (std::size_t bucket = 0; bucket < bucket_count; ++bucket)
+            {
+                uint64_t count = source.m_buckets[bucket].load(std::memory_order_relaxed);
+                result.m_buckets[bucket] += count;
+                result.m_count += count;
+            }
+
+            result.m_sum += source.m_sum.load(std::memory_order_relaxed);
+        }
+
+        return result;
+    }
+
+    uint64_t histogram_snapshot::quantile(double q) const
+    {
+        if (m_count == 0)
+        {
+            return 0;
+        }
+
+        uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(m_count - 1));
+        uint64_t seen = 0;
+        for (std::size_t bucket = 0; bucket < m_buckets.size(); ++bucket)
+        {
+            seen += m_buckets[bucket];
+            if (seen > rank)
+            {
+                return histogram::bucket_lower_bound(bucket);
+            }
+        }
+
+        return histogram::bucket_lower_bound(m_buckets.size() - 1);
+    }
+
+    uint64_t histogram_snapshot::count_below(uint64_t bound) const
+    {
+        uint64_t result = 0;
+        for (std::size_t bucket = 0; bucket < m_buckets.size() && histogram::bucket_lower_bound(bucket) < bound; ++bucket)
+        {
+            result += m_buckets[bucket];
+        }
+
+        return result;
+    }
+
+    metrics_registry& metrics_registry::instance()
+    {
+        // never destroyed, memory accounting records frees during static destruction
+        static metrics_registry* registry = new metrics_registry();
+        return *registry;
+    }
+
+    metrics_registry::family& metrics_registry::get_family(std::string_view name, std::string_view help, metric_type type)
+    {
+        auto itr_family = m_families.find(name);
+        if (itr_family == m_families.end())
+        {
+            itr_family = m_families.emplace(std::string(name), family{ type, std::string(help) }).first;
+        }
+        else if (itr_family->second.m_type != type)
+        {
+            throw std::logic_error("metric registered twice with different types: " + std::string(name));
+        }
+
+        return itr_family->second;
+    }
+
+    counter& metrics_registry::get_counter(std::string_view name, std::string_view help, std::string_view labels)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& metrics = get_family(name, help, metric_type::counter).m_counters;
+        auto itr_metric = metrics.find(labels);
+        if (itr_metric == metrics.end())
+        {
+            itr_metric = metrics.emplace(std::string(labels), std::make_unique<counter>()).first;
+        }
+
+        return *itr_metric->second;
+    }
+
+    gauge& metrics_registry::get_gauge(std::string_view name, std::string_view help, std::string_view labels)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& metrics = get_family(name, help, metric_type::gauge).m_gauges;
+        auto itr_metric = metrics.find(labels);
+        if (itr_metric == metrics.end())
+        {
+            itr_metric = metrics.emplace(std::string(labels), std::make_unique<gauge>()).first;
+        }
+
+        return *itr_metric->second;
+    }
+
+    histogram& metrics_registry::get_histogram(std::string_view name, std::string_view help, histogram_unit unit, std::string_view labels)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& metrics = get_family(name, help, metric_type::histogram).m_histograms;
+        auto itr_metric = metrics.find(labels);
+        if (itr_metric == metrics.end())
+        {
+            itr_metric = metrics.emplace(std::string(labels), std::make_unique<histogram>(unit)).first;
+        }
+        else if (itr_metric->second->unit() != unit)
+        {
+            throw std::logic_error("histogram registered twice with different units: " + std::string(name));
+        }
+
+        return *itr_metric->second;
+    }
+
+    void metrics_registry::render(std::string& output) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& [name, metrics] : m_families)
+        {
+            switch (metrics.m_type)
+            {
+            case metric_type::counter:
+                output += fmt::format("# HELP {} {}\n# TYPE {} counter\n", name, metrics.m_help, name);
+                for (const auto& [labels, metric] : metrics.m_counters)
+                {
+                    append_series(output, name, {}, labels, {});
+                    output += fmt::format("{}\n", metric->value());
+                }
+                break;
+            case metric_type::gauge:
+                output += fmt::format("# HELP {} {}\n# TYPE {} gauge\n", name, metrics.m_help, name);
+                for (const auto& [labels, metric] : metrics.m_gauges)
+                {
+                    append_series(output, name, {}, labels, {});
+                    output += fmt::format("{}\n", metric->value());
+                }
+                break;
+            case metric_type::histogram:
+                output += fmt::format("# HELP {} {}\n# TYPE {} histogram\n", name, metrics.m_help, name);
+                for (const auto& [labels, metric] : metrics.m_histograms)
+                {
+                    histogram_snapshot snapshot = metric->snapshot();
+                    exported_range range = get_exported_range(metric->unit());
+
+                    for (std::size_t exponent = range.m_first_exponent; exponent <= range.m_last_exponent; ++exponent)
+                    {
+                        // integer values below 2^e are exactly those <= 2^e - 1
+                        uint64_t bound = uint64_t(1) << exponent;
+                        double upper = metric->unit() == histogram_unit::count ? static_cast<double>(bound - 1) : static_cast<double>(bound) * range.m_scale;
+                        append_series(output, name, "_bucket", labels, fmt::format("le=\"{}\"", upper));
+                        output += fmt::format("{}\n", snapshot.count_below(bound));
+                    }
+
+                    append_series(output, name, "_bucket", labels, "le=\"+Inf\"");
+                    output += fmt::format("{}\n", snapshot.m_count);
+                    append_series(output, name, "_sum", labels, {});
+                    output += fmt::format("{}\n", static_cast<double>(snapshot.m_sum) * range.m_scale);
+                    append_series(output, name, "_count", labels, {});
+                    output += fmt::format("{}\n", snapshot.m_count);
+                }
+                break;
+            }
+        }
+    }
+} // !namespace util
+} // !namespace noconn
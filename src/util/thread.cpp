@@ -0,0 +1,59 @@
+/*
+ *
+ */
+
+#include <thread>
+#include "noconn/util/thread.hpp"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+namespace noconn
+{
+namespace util
+{
+    std::size_t cpu_count()
+    {
+        unsigned int count = std::thread::hardware_concurrency();
+        return count == 0 ? 1 : count;
+    }
+
+    bool pin_current_thread(std::size_t cpu)
+    {
+        cpu %= cpu_count();
+#if defined(_WIN32)
+        if (cpu >= sizeof(DWORD_PTR) * 8)
+        {
+            // processor groups beyond the first 64 cpus are not handled
+            return false;
+        }
+
+        return SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << cpu) != 0;
+#else
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(cpu, &cpu_set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+#endif
+    }
+
+    bool set_current_thread_priority(thread_priority priority)
+    {
+#if defined(_WIN32)
+        int value = priority == thread_priority::low ? THREAD_PRIORITY_BELOW_NORMAL : priority == thread_priority::high ? THREAD_PRIORITY_ABOVE_NORMAL : THREAD_PRIORITY_NORMAL;
+        return SetThreadPriority(GetCurrentThread(), value) != 0;
+#else
+        // linux applies the nice value to the calling thread only
+        int value = priority == thread_priority::low ? 10 : priority == thread_priority::high ? -5 : 0;
+        return setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), value) == 0;
+#endif
+    }
+} // !namespace util
+} // !namespace noconn
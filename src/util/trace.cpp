@@ -0,0 +1,277 @@
+/*
+ *
+ */
+
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <fmt/format.h>
+#include "noconn/util/trace.hpp"
+
+namespace noconn
+{
+namespace util
+{
+    namespace
+    {
+        /*
+         * One span, written by the owning thread only. The sequence is odd while the slot is being
+         * written, a reader that sees it change (or odd) skips the slot instead of waiting.
+         */
+        struct trace_slot
+        {
+            std::atomic<uint64_t> m_sequence = 0;
+            std::atomic<const char*> m_name = nullptr;
+            std::atomic<trace_kind> m_kind = trace_kind::complete;
+            std::atomic<uint32_t> m_thread = 0;
+            std::atomic<uint64_t> m_start = 0;
+            std::atomic<uint64_t> m_end = 0;
+            std::atomic<uint64_t> m_argument = 0;
+        };
+
+        struct trace_ring
+        {
+            static constexpr std::size_t capacity = 8192;
+
+            explicit trace_ring(uint32_t thread)
+                : m_thread(thread), m_slots(new trace_slot[capacity])
+            {
+                // nothing for now
+            }
+
+            uint32_t m_thread;
+            // guarded by the state's mutex
+            std::string m_name;
+            std::unique_ptr<trace_slot[]> m_slots;
+            std::atomic<uint64_t> m_head = 0;
+            std::atomic<bool> m_abandoned = false;
+        };
+
+        struct trace_state
+        {
+            // the clock's origin, and the pair the tsc rate is measured against
+            uint64_t m_origin = trace::now();
+            std::chrono::steady_clock::time_point m_origin_time = std::chrono::steady_clock::now();
+            // spans that began before the last start() are not dumped
+            std::atomic<uint64_t> m_started = 0;
+
+            std::mutex m_rings_mutex;
+            std::vector<std::shared_ptr<trace_ring>> m_rings;
+            uint32_t m_next_thread = 1;
+        };
+
+        trace_state& state()
+        {
+            // never destroyed, spans may end during static destruction
+            static trace_state* instance = new trace_state();
+            return *instance;
+        }
+
+        struct ring_owner
+        {
+            std::shared_ptr<trace_ring> m_ring;
+            std::string m_name;
+
+            ~ring_owner()
+            {
+                if (m_ring)
+                {
+                    // dumped until the next start() drops it
+                    m_ring->m_abandoned.store(true, std::memory_order_release);
+                }
+            }
+        };
+
+        ring_owner& local_owner()
+        {
+            thread_local ring_owner owner;
+            return owner;
+        }
+
+        trace_ring& local_ring()
+        {
+            ring_owner& owner = local_owner();
+            if (!owner.m_ring)
+            {
+                std::lock_guard<std::mutex> lock(state().m_rings_mutex);
+                owner.m_ring = std::make_shared<trace_ring>(state().m_next_thread++);
+                owner.m_ring->m_name = owner.m_name;
+                state().m_rings.emplace_back(owner.m_ring);
+            }
+
+            return *owner.m_ring;
+        }
+
+        void append_escaped(std::string& output, std::string_view text)
+        {
+            for (char character : text)
+            {
+                if (character == '"' || character == '\\')
+                {
+                    output.push_back('\\');
+                    output.push_back(character);
+                }
+                else if (static_cast<unsigned char>(character) < 0x20)
+                {
+                    fmt::format_to(std::back_inserter(output), "\\u{:04x}", static_cast<unsigned int>(character));
+                }
+                else
+                {
+                    output.push_back(character);
+                }
+            }
+        }
+
+        // ticks per microsecond, measured over the process' lifetime so far
+        double tick_rate()
+        {
+            trace_state& target = state();
+            auto elapsed = std::chrono::steady_clock::now() - target.m_origin_time;
+            if (elapsed < std::chrono::milliseconds(10))
+            {
+                // too short to measure the tsc against, only happens right after startup
+                std::this_thread::sleep_for(std::chrono::milliseconds(10) - elapsed);
+                elapsed = std::chrono::steady_clock::now() - target.m_origin_time;
+            }
+
+            uint64_t ticks = trace::now() - target.m_origin;
+            return static_cast<double>(ticks) / std::chrono::duration<double, std::micro>(elapsed).count();
+        }
+    } // !anonymous namespace
+
+    void trace::start()
+    {
+        trace_state& target = state();
+        {
+            std::lock_guard<std::mutex> lock(target.m_rings_mutex);
+            std::erase_if(target.m_rings, [](const std::shared_ptr<trace_ring>& ring) { return ring->m_abandoned.load(std::memory_order_acquire); });
+        }
+
+        target.m_started.store(now(), std::memory_order_relaxed);
+        m_enabled.store(true, std::memory_order_relaxed);
+    }
+
+    void trace::stop()
+    {
+        m_enabled.store(false, std::memory_order_relaxed);
+    }
+
+    uint32_t trace::current_thread()
+    {
+        return local_ring().m_thread;
+    }
+
+    void trace::set_thread_name(std::string name)
+    {
+        ring_owner& owner = local_owner();
+        if (owner.m_ring)
+        {
+            std::lock_guard<std::mutex> lock(state().m_rings_mutex);
+            owner.m_ring->m_name = name;
+        }
+
+        owner.m_name = std::move(name);
+    }
+
+    void trace::record(const char* name, trace_kind kind, uint32_t thread, uint64_t start, uint64_t end, uint64_t argument)
+    {
+        trace_ring& ring = local_ring();
+        uint64_t head = ring.m_head.load(std::memory_order_relaxed);
+        trace_slot& slot = ring.m_slots[head % trace_ring::capacity];
+
+        uint64_t sequence = slot.m_sequence.load(std::memory_order_relaxed);
+        slot.m_sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot.m_name.store(name, std::memory_order_relaxed);
+        slot.m_kind.store(kind, std::memory_order_relaxed);
+        slot.m_thread.store(thread, std::memory_order_relaxed);
+        slot.m_start.store(start, std::memory_order_relaxed);
+        slot.m_end.store(end, std::memory_order_relaxed);
+        slot.m_argument.store(argument, std::memory_order_relaxed);
+
+        slot.m_sequence.store(sequence + 2, std::memory_order_release);
+        ring.m_head.store(head + 1, std::memory_order_release);
+    }
+
+    std::string trace::dump()
+    {
+        trace_state& target = state();
+        std::vector<std::pair<std::shared_ptr<trace_ring>, std::string>> rings;
+        {
+            std::lock_guard<std::mutex> lock(target.m_rings_mutex);
+            rings.reserve(target.m_rings.size());
+            for (const std::shared_ptr<trace_ring>& ring : target.m_rings)
+            {
+                rings.emplace_back(ring, ring->m_name);
+            }
+        }
+
+        double rate = tick_rate();
+        uint64_t started = target.m_started.load(std::memory_order_relaxed);
+        auto microseconds = [&target, rate](uint64_t ticks) { return static_cast<double>(static_cast<int64_t>(ticks - target.m_origin)) / rate; };
+
+        std::string output = R"({"displayTimeUnit":"ns","traceEvents":[{"name":"process_name","ph":"M","pid":1,"tid":0,"args":{"name":"noconn"}})";
+        for (const auto& [ring, name] : rings)
+        {
+            output.append(R"(,{"name":"thread_name","ph":"M","pid":1,"tid":)");
+            fmt::format_to(std::back_inserter(output), "{}", ring->m_thread);
+            output.append(R"(,"args":{"name":")");
+            append_escaped(output, name.empty() ? fmt::format("thread_{}", ring->m_thread) : name);
+            output.append("\"}}");
+        }
+
+        for (const auto& [ring, name] : rings)
+        {
+            uint64_t head = ring->m_head.load(std::memory_order_acquire);
+            uint64_t tail = head > trace_ring::capacity ? head - trace_ring::capacity : 0;
+            for (uint64_t index = tail; index < head; ++index)
+            {
+                const trace_slot& slot = ring->m_slots[index % trace_ring::capacity];
+                uint64_t sequence = slot.m_sequence.load(std::memory_order_acquire);
+                if (sequence == 0 || (sequence & 1) != 0)
+                {
+                    continue;
+                }
+
+                const char* span_name = slot.m_name.load(std::memory_order_relaxed);
+                trace_kind kind = slot.m_kind.load(std::memory_order_relaxed);
+                uint32_t thread = slot.m_thread.load(std::memory_order_relaxed);
+                uint64_t start = slot.m_start.load(std::memory_order_relaxed);
+                uint64_t end = slot.m_end.load(std::memory_order_relaxed);
+                uint64_t argument = slot.m_argument.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.m_sequence.load(std::memory_order_relaxed) != sequence || start < started || span_name == nullptr)
+                {
+                    // overwritten while we read it, or from before the last start()
+                    continue;
+                }
+
+                if (kind == trace_kind::complete)
+                {
+                    output.append(R"(,{"name":")");
+                    append_escaped(output, span_name);
+                    fmt::format_to(std::back_inserter(output), R"(","cat":"noconn","ph":"X","pid":1,"tid":{},"ts":{:.3f},"dur":{:.3f},"args":{{"argument":{}}}}})",
+                        thread, microseconds(start), static_cast<double>(end - start) / rate, argument);
+                }
+                else
+                {
+                    // a begin and end pair, matched by name and id
+                    for (auto [phase, ticks] : { std::pair<char, uint64_t>('b', start), std::pair<char, uint64_t>('e', end) })
+                    {
+                        output.append(R"(,{"name":")");
+                        append_escaped(output, span_name);
+                        fmt::format_to(std::back_inserter(output), R"(","cat":"noconn","ph":"{}","id":"{}","pid":1,"tid":{},"ts":{:.3f}}})",
+                            phase, argument, thread, microseconds(ticks));
+                    }
+                }
+            }
+        }
+
+        output.append("]}");
+        return output;
+    }
+} // !namespace util
+} // !namespace noconn
@@ -0,0 +1,303 @@
+/*
+ *
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include "noconn/util/utf.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NOCONN_UTF_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define NOCONN_UTF_NEON
+#include <arm_neon.h>
+#endif
+
+namespace noconn
+{
+namespace util
+{
+    namespace
+    {
+        constexpr char32_t replacement_character = 0xFFFD;
+
+        bool is_high_surrogate(char16_t unit)
+        {
+            return unit >= 0xD800 && unit <= 0xDBFF;
+        }
+
+        bool is_low_surrogate(char16_t unit)
+        {
+            return unit >= 0xDC00 && unit <= 0xDFFF;
+        }
+
+        std::size_t encoded_length(char32_t code_point)
+        {
+            if (code_point < 0x80)
+            {
+                return 1;
+            }
+            else if (code_point < 0x800)
+            {
+                return 2;
+            }
+            else if (code_point < 0x10000)
+            {
+                return 3;
+            }
+
+            return 4;
+        }
+
+        // caller guarantees room for 4 bytes
+        char* encode(char32_t code_point, char* output)
+        {
+            if (code_point < 0x80)
+            {
+                *output++ = static_cast<char>(code_point);
+            }
+            else if (code_point < 0x800)
+            {
+                *output++ = static_cast<char>(0xC0 | (code_point >> 6));
+                *output++ = static_cast<char>(0x80 | (code_point & 0x3F));
+            }
+            else if (code_point < 0x10000)
+            {
+                *output++ = static_cast<char>(0xE0 | (code_point >> 12));
+                *output++ = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+                *output++ = static_cast<char>(0x80 | (code_point & 0x3F));
+            }
+            else
+            {
+                *output++ = static_cast<char>(0xF0 | (code_point >> 18));
+                *output++ = static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+                *output++ = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+                *output++ = static_cast<char>(0x80 | (code_point & 0x3F));
+            }
+
+            return output;
+        }
+
+        // decodes one code point starting at input[index] and advances index
+        char32_t decode(const char16_t* input, std::size_t length, std::size_t& index)
+        {
+            char16_t unit = input[index++];
+            if (is_high_surrogate(unit))
+            {
+                if (index < length && is_low_surrogate(input[index]))
+                {
+                    char16_t low = input[index++];
+                    return 0x10000 + ((static_cast<char32_t>(unit) - 0xD800) << 10) + (static_cast<char32_t>(low) - 0xDC00);
+                }
+
+                return replacement_character;
+            }
+            else if (is_low_surrogate(unit))
+            {
+                return replacement_character;
+            }
+
+            return unit;
+        }
+
+        // true if all 8 code units starting at input are ascii
+        inline bool is_ascii_block(const char16_t* input)
+        {
+#if defined(NOCONN_UTF_SSE2)
+            __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input));
+            __m128i high_bits = _mm_and_si128(units, _mm_set1_epi16(static_cast<short>(0xFF80)));
+            return _mm_movemask_epi8(_mm_cmpeq_epi16(high_bits, _mm_setzero_si128())) == 0xFFFF;
+#elif defined(NOCONN_UTF_NEON)
+            uint16x8_t units = vld1q_u16(reinterpret_cast<const uint16_t*>(input));
+            return vmaxvq_u16(units) < 0x80;
+#else
+            std::uint64_t words[2];
+            std::memcpy(words, input, sizeof(words));
+            return ((words[0] | words[1]) & 0xFF80FF80FF80FF80ull) == 0;
+#endif
+        }
+
+        // narrows 8 ascii code units into 8 bytes
+        inline void store_ascii_block(const char16_t* input, char* output)
+        {
+#if defined(NOCONN_UTF_SSE2)
+            __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(output), _mm_packus_epi16(units, units));
+#elif defined(NOCONN_UTF_NEON)
+            uint16x8_t units = vld1q_u16(reinterpret_cast<const uint16_t*>(input));
+            vst1_u8(reinterpret_cast<uint8_t*>(output), vmovn_u16(units));
+#else
+            for (std::size_t i = 0; i < 8; ++i)
+            {
+                output[i] = static_cast<char>(input[i]);
+            }
+#endif
+        }
+
+        // fast path, requires capacity >= utf8_max_length(length)
+        std::size_t transcode_unchecked(const char16_t* input, std::size_t length, char* output)
+        {
+            char* cursor = output;
+            std::size_t index = 0;
+
+            while (index < length)
+            {
+                // adapter names, guids and descriptions are almost always ascii
+                while (index + 8 <= length && is_ascii_block(input + index))
+                {
+                    store_ascii_block(input + index, cursor);
+                    index += 8;
+                    cursor += 8;
+                }
+
+                // finish the mixed block (or the tail) one code point at a time
+                std::size_t block_end = std::min(index + 8, length);
+                while (index < block_end)
+                {
+                    cursor = encode(decode(input, length, index), cursor);
+                }
+            }
+
+            return static_cast<std::size_t>(cursor - output);
+        }
+
+        std::size_t transcode(const char16_t* input, std::size_t length, char* output, std::size_t capacity)
+        {
+            if (capacity >= utf8_max_length(length))
+            {
+                return transcode_unchecked(input, length, output);
+            }
+
+            // small buffer, make sure the result fits before writing anything
+            std::size_t required = utf8_length(input, length);
+            if (required > capacity)
+            {
+                return utf_error;
+            }
+
+            if (required == length)
+            {
+                // pure ascii, the narrowing loop cannot overrun
+                return transcode_unchecked(input, length, output);
+            }
+
+            return utf16_to_utf8_scalar(input, length, output, capacity);
+        }
+
+        void append_utf8_units(const char16_t* input, std::size_t length, std::string& output)
+        {
+            std::size_t offset = output.size();
+            output.resize(offset + utf8_max_length(length));
+            std::size_t written = utf16_to_utf8(input, length, output.data() + offset, output.size() - offset);
+            output.resize(offset + written);
+        }
+    } // !anonymous namespace
+
+    std::size_t utf8_length(const char16_t* input, std::size_t length)
+    {
+        std::size_t result = 0;
+        std::size_t index = 0;
+        while (index < length)
+        {
+            if (index + 8 <= length && is_ascii_block(input + index))
+            {
+                index += 8;
+                result += 8;
+                continue;
+            }
+
+            result += encoded_length(decode(input, length, index));
+        }
+
+        return result;
+    }
+
+    std::size_t utf16_to_utf8_scalar(const char16_t* input, std::size_t length, char* output, std::size_t capacity)
+    {
+        char* cursor = output;
+        char* end = output + capacity;
+        std::size_t index = 0;
+
+        while (index < length)
+        {
+            char32_t code_point = decode(input, length, index);
+            if (static_cast<std::size_t>(end - cursor) < encoded_length(code_point))
+            {
+                return utf_error;
+            }
+
+            cursor = encode(code_point, cursor);
+        }
+
+        return static_cast<std::size_t>(cursor - output);
+    }
+
+    std::size_t utf16_to_utf8(const char16_t* input, std::size_t length, char* output, std::size_t capacity)
+    {
+        std::size_t result = transcode(input, length, output, capacity);
+
+#ifndef NDEBUG
+        if (result != utf_error)
+        {
+            std::vector<char> reference(utf8_max_length(length));
+            std::size_t reference_size = utf16_to_utf8_scalar(input, length, reference.data(), reference.size());
+            assert(reference_size == result);
+            assert(std::memcmp(reference.data(), output, result) == 0);
+        }
+#endif
+
+        return result;
+    }
+
+    void append_utf8(std::u16string_view input, std::string& output)
+    {
+        append_utf8_units(input.data(), input.size(), output);
+    }
+
+    void append_utf8(std::wstring_view input, std::string& output)
+    {
+        if constexpr (sizeof(wchar_t) == sizeof(char16_t))
+        {
+            // windows: wchar_t strings (and BSTRs) are utf-16
+            append_utf8_units(reinterpret_cast<const char16_t*>(input.data()), input.size(), output);
+        }
+        else
+        {
+            // posix: wchar_t strings are utf-32
+            std::size_t offset = output.size();
+            output.resize(offset + input.size() * 4);
+            char* cursor = output.data() + offset;
+            for (wchar_t code_point : input)
+            {
+                char32_t value = static_cast<char32_t>(code_point);
+                if (value > 0x10FFFF || (value >= 0xD800 && value <= 0xDFFF))
+                {
+                    value = replacement_character;
+                }
+
+                cursor = encode(value, cursor);
+            }
+
+            output.resize(static_cast<std::size_t>(cursor - output.data()));
+        }
+    }
+
+    std::string to_utf8(std::wstring_view input)
+    {
+        std::string result;
+        append_utf8(input, result);
+        return result;
+    }
+
+    std::string to_utf8(std::u16string_view input)
+    {
+        std::string result;
+        append_utf8(input, result);
+        return result;
+    }
+} // !namespace util
+} // !namespace noconn